@@ -0,0 +1,624 @@
+/*
+ * Load generator and throughput benchmark for the SSAM cdev interface.
+ *
+ * Drives /dev/surface/aggregator with a configurable number of concurrent
+ * threads, each with its own file descriptor, repeatedly issuing the same
+ * request. Reports requests/s and the p50/p99/p999 request latency as seen
+ * by user-space.
+ *
+ * Optionally, an event can be enabled to measure event delivery. Events do
+ * not carry a timestamp, so the event to user-space latency is measured
+ * relative to a trigger request, i.e. a request which causes the EC to send
+ * the event. The measured latency thus includes EC processing time. Without
+ * trigger, only the event rate and inter-arrival times are reported.
+ *
+ * If given the path to the debugfs statistics of the controller (e.g.
+ * /sys/kernel/debug/surface_aggregator/<device>/stats), these are reset
+ * before the run, and the kernel-side latency histograms of the request's
+ * target category are reported alongside the user-space numbers.
+ *
+ * WARNING: Requests are sent to the EC as specified. Only use requests that
+ * do not have any side effects.
+ *
+ * Usage: see usage() below.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../module/include/uapi/linux/surface_aggregator/cdev.h"
+
+#define PATH_CDEV		"/dev/surface/aggregator"
+
+#define DEFAULT_THREADS		1
+#define DEFAULT_REQUESTS	1000
+#define DEFAULT_RSP_LEN		64
+#define DEFAULT_EVENTS		100
+#define DEFAULT_EVENT_TIMEOUT	1000	/* ms */
+
+/* Must be kept in sync with module/src/ssh_stats.h. */
+#define SSH_STATS_HIST_BUCKETS	24
+
+struct cmd {
+	__u8 tc;
+	__u8 tid;
+	__u8 cid;
+	__u8 iid;
+};
+
+struct config {
+	struct cmd rqst;
+	unsigned int rsp_len;
+	unsigned int threads;
+	unsigned int requests;
+
+	bool event;
+	struct ssam_cdev_event_desc event_desc;
+	bool trigger;
+	struct cmd trigger_rqst;
+	unsigned int events;
+	int event_timeout;
+
+	const char *stats;
+};
+
+struct worker {
+	pthread_t thread;
+	const struct config *cfg;
+	uint64_t *lat;
+	unsigned int n;
+	unsigned int errors;
+	int status;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const uint64_t *v, size_t n, double p)
+{
+	size_t i = p * n;
+
+	return n ? v[i < n ? i : n - 1] : 0;
+}
+
+static void print_latency(const char *name, uint64_t *v, size_t n)
+{
+	qsort(v, n, sizeof(*v), cmp_u64);
+
+	printf("%-8s %zu samples, p50: %.1f us, p99: %.1f us, p999: %.1f us, max: %.1f us\n",
+	       name, n, percentile(v, n, 0.5) * 1e-3, percentile(v, n, 0.99) * 1e-3,
+	       percentile(v, n, 0.999) * 1e-3, n ? v[n - 1] * 1e-3 : 0.0);
+}
+
+static int request(int fd, const struct cmd *cmd, void *rsp, __u16 rsp_len)
+{
+	struct ssam_cdev_request rqst = {};
+
+	rqst.target_category = cmd->tc;
+	rqst.target_id = cmd->tid;
+	rqst.command_id = cmd->cid;
+	rqst.instance_id = cmd->iid;
+	rqst.flags = SSAM_CDEV_REQUEST_HAS_RESPONSE;
+	rqst.response.data = (__u64)(uintptr_t)rsp;
+	rqst.response.length = rsp_len;
+
+	if (ioctl(fd, SSAM_CDEV_REQUEST, &rqst) < 0)
+		return -errno;
+
+	return rqst.status;
+}
+
+
+/* -- Requests. ------------------------------------------------------------- */
+
+static void *worker_fn(void *data)
+{
+	struct worker *w = data;
+	uint8_t *rsp;
+	uint64_t t;
+	int status;
+	int fd;
+
+	rsp = malloc(w->cfg->rsp_len);
+	if (!rsp) {
+		w->status = -ENOMEM;
+		return NULL;
+	}
+
+	fd = open(PATH_CDEV, O_RDWR);
+	if (fd < 0) {
+		w->status = -errno;
+		free(rsp);
+		return NULL;
+	}
+
+	for (w->n = 0; w->n < w->cfg->requests; w->n++) {
+		t = now_ns();
+		status = request(fd, &w->cfg->rqst, rsp, w->cfg->rsp_len);
+		w->lat[w->n] = now_ns() - t;
+
+		if (status)
+			w->errors++;
+
+		/* Errors of the cdev itself are fatal. */
+		if (status == -ENODEV || status == -EFAULT || status == -EINVAL) {
+			w->status = status;
+			break;
+		}
+	}
+
+	close(fd);
+	free(rsp);
+	return NULL;
+}
+
+static int bench_requests(const struct config *cfg)
+{
+	struct worker *workers;
+	unsigned int errors = 0;
+	uint64_t *lat;
+	size_t n = 0;
+	uint64_t t;
+	unsigned int i;
+	int status = 0;
+
+	workers = calloc(cfg->threads, sizeof(*workers));
+	lat = calloc((size_t)cfg->threads * cfg->requests, sizeof(*lat));
+	if (!workers || !lat) {
+		free(workers);
+		free(lat);
+		return -ENOMEM;
+	}
+
+	t = now_ns();
+
+	for (i = 0; i < cfg->threads; i++) {
+		workers[i].cfg = cfg;
+		workers[i].lat = lat + (size_t)i * cfg->requests;
+
+		status = pthread_create(&workers[i].thread, NULL, worker_fn, &workers[i]);
+		if (status) {
+			status = -status;
+			break;
+		}
+	}
+
+	while (i--) {
+		pthread_join(workers[i].thread, NULL);
+
+		if (workers[i].status && !status)
+			status = workers[i].status;
+	}
+
+	t = now_ns() - t;
+
+	if (status) {
+		printf("error: Failed to run requests: %s\n", strerror(-status));
+		goto out;
+	}
+
+	/* Compact latency samples of all threads. */
+	for (i = 0; i < cfg->threads; i++) {
+		memmove(lat + n, workers[i].lat, workers[i].n * sizeof(*lat));
+		n += workers[i].n;
+		errors += workers[i].errors;
+	}
+
+	printf("request: tc: %#04x, tid: %#04x, cid: %#04x, iid: %#04x, threads: %u\n",
+	       cfg->rqst.tc, cfg->rqst.tid, cfg->rqst.cid, cfg->rqst.iid, cfg->threads);
+	printf("rate:    %zu requests in %.3f s, %.1f requests/s, %u errors\n",
+	       n, t * 1e-9, n * 1e9 / t, errors);
+	print_latency("latency:", lat, n);
+
+out:
+	free(workers);
+	free(lat);
+	return status;
+}
+
+
+/* -- Events. --------------------------------------------------------------- */
+
+/*
+ * Wait for the next complete event record. Events are read as byte stream,
+ * so records may have to be re-assembled from multiple reads.
+ */
+static int event_wait(int fd, uint8_t *buf, size_t cap, size_t *offs, int timeout)
+{
+	struct ssam_cdev_event *event = (struct ssam_cdev_event *)buf;
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	size_t len;
+	ssize_t n;
+	int status;
+
+	while (true) {
+		if (*offs >= sizeof(*event)) {
+			len = sizeof(*event) + event->length;
+
+			if (*offs >= len) {
+				memmove(buf, buf + len, *offs - len);
+				*offs -= len;
+				return 0;
+			}
+		}
+
+		status = poll(&pfd, 1, timeout);
+		if (status < 0)
+			return -errno;
+		if (status == 0)
+			return -ETIMEDOUT;
+
+		n = read(fd, buf + *offs, cap - *offs);
+		if (n < 0)
+			return -errno;
+
+		*offs += n;
+	}
+}
+
+static int bench_events(const struct config *cfg)
+{
+	struct ssam_cdev_notifier_desc nf = {};
+	uint8_t buf[sizeof(struct ssam_cdev_event) + 0x10000];
+	uint8_t rsp[DEFAULT_RSP_LEN];
+	unsigned int timeouts = 0;
+	uint64_t *lat;
+	uint64_t t, prev = 0;
+	size_t offs = 0;
+	size_t n = 0;
+	unsigned int i;
+	int status;
+	int fd;
+
+	lat = calloc(cfg->events, sizeof(*lat));
+	if (!lat)
+		return -ENOMEM;
+
+	fd = open(PATH_CDEV, O_RDWR | O_NONBLOCK);
+	if (fd < 0) {
+		status = -errno;
+		free(lat);
+		return status;
+	}
+
+	nf.priority = 1;
+	nf.target_category = cfg->event_desc.id.target_category;
+
+	status = ioctl(fd, SSAM_CDEV_NOTIF_REGISTER, &nf);
+	if (status < 0) {
+		status = -errno;
+		printf("error: Failed to register notifier: %s\n", strerror(-status));
+		goto out_close;
+	}
+
+	status = ioctl(fd, SSAM_CDEV_EVENT_ENABLE, &cfg->event_desc);
+	if (status < 0) {
+		status = -errno;
+		printf("error: Failed to enable event: %s\n", strerror(-status));
+		goto out_unregister;
+	}
+
+	t = now_ns();
+
+	for (i = 0; i < cfg->events; i++) {
+		uint64_t start = now_ns();
+
+		if (cfg->trigger) {
+			status = request(fd, &cfg->trigger_rqst, rsp, sizeof(rsp));
+			if (status) {
+				printf("error: Trigger request failed: %d\n", status);
+				break;
+			}
+		}
+
+		status = event_wait(fd, buf, sizeof(buf), &offs, cfg->event_timeout);
+		if (status == -ETIMEDOUT) {
+			timeouts++;
+			status = 0;
+			continue;
+		}
+		if (status) {
+			printf("error: Failed to read event: %s\n", strerror(-status));
+			break;
+		}
+
+		if (cfg->trigger) {
+			lat[n++] = now_ns() - start;
+		} else {
+			if (prev)
+				lat[n++] = now_ns() - prev;
+			prev = now_ns();
+		}
+	}
+
+	t = now_ns() - t;
+
+	printf("event:   tc: %#04x, iid: %#04x, %s\n", cfg->event_desc.id.target_category,
+	       cfg->event_desc.id.instance, cfg->trigger ? "triggered" : "untriggered");
+	printf("rate:    %u events in %.3f s, %.1f events/s, %u timeouts\n",
+	       i - timeouts, t * 1e-9, (i - timeouts) * 1e9 / t, timeouts);
+	print_latency(cfg->trigger ? "latency:" : "arrival:", lat, n);
+
+	ioctl(fd, SSAM_CDEV_EVENT_DISABLE, &cfg->event_desc);
+out_unregister:
+	ioctl(fd, SSAM_CDEV_NOTIF_UNREGISTER, &nf);
+out_close:
+	close(fd);
+	free(lat);
+	return status;
+}
+
+
+/* -- Kernel statistics. ---------------------------------------------------- */
+
+static int stats_reset(const char *path)
+{
+	int fd;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -errno;
+
+	if (write(fd, "0", 1) < 0) {
+		close(fd);
+		return -errno;
+	}
+
+	close(fd);
+	return 0;
+}
+
+/* Upper bound of the given percentile in microseconds, see ssh_stats.h. */
+static unsigned long hist_percentile(const unsigned long *counts, unsigned long total,
+				     double p)
+{
+	unsigned long sum = 0;
+	unsigned int b;
+
+	for (b = 0; b < SSH_STATS_HIST_BUCKETS - 1; b++) {
+		sum += counts[b];
+		if (sum > p * total)
+			break;
+	}
+
+	return 1ul << b;
+}
+
+static int stats_show(const char *path, __u8 tc)
+{
+	unsigned long counts[SSH_STATS_HIST_BUCKETS];
+	unsigned long total;
+	unsigned long value;
+	char line[1024];
+	char name[16];
+	unsigned int b, t;
+	int offs, n;
+	char c;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp)
+		return -errno;
+
+	while (fgets(line, sizeof(line), fp)) {
+		/* Event counters: Name and value only. */
+		if (sscanf(line, "%15s %lu %c", name, &value, &c) == 2) {
+			printf("kernel:  %-18s %lu\n", name, value);
+			continue;
+		}
+
+		/* Histograms: Name, target category, and bucket counts. */
+		if (sscanf(line, "%15s %x%n", name, &t, &offs) != 2)
+			continue;
+
+		if (strcmp(name, "ack") && strcmp(name, "rsp") && strcmp(name, "total"))
+			continue;
+
+		if (t != tc)
+			continue;
+
+		total = 0;
+		for (b = 0; b < SSH_STATS_HIST_BUCKETS; b++) {
+			if (sscanf(line + offs, "%lu%n", &counts[b], &n) != 1)
+				break;
+
+			total += counts[b];
+			offs += n;
+		}
+
+		if (b != SSH_STATS_HIST_BUCKETS || !total)
+			continue;
+
+		printf("kernel:  %-5s %lu samples, p50: <%lu us, p99: <%lu us, p999: <%lu us\n",
+		       name, total, hist_percentile(counts, total, 0.5),
+		       hist_percentile(counts, total, 0.99),
+		       hist_percentile(counts, total, 0.999));
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+
+/* -- Main. ----------------------------------------------------------------- */
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"\n"
+		"Options:\n"
+		"  -r tc:tid:cid:iid    request to issue (default: 01:01:13:00, firmware version)\n"
+		"  -l length            response buffer length (default: %u)\n"
+		"  -t threads           number of concurrent threads (default: %u)\n"
+		"  -n requests          requests per thread, 0 to skip (default: %u)\n"
+		"  -e tc:tid:en:dis:iid enable the specified event and measure its delivery\n"
+		"  -f flags             event flags (default: 0)\n"
+		"  -T tc:tid:cid:iid    trigger request for the event\n"
+		"  -E events            number of events to wait for (default: %u)\n"
+		"  -w timeout           event timeout in ms (default: %u)\n"
+		"  -s path              debugfs statistics of the controller\n",
+		name, DEFAULT_RSP_LEN, DEFAULT_THREADS, DEFAULT_REQUESTS, DEFAULT_EVENTS,
+		DEFAULT_EVENT_TIMEOUT);
+}
+
+static int parse_cmd(const char *str, struct cmd *cmd)
+{
+	unsigned int tc, tid, cid, iid;
+
+	if (sscanf(str, "%x:%x:%x:%x", &tc, &tid, &cid, &iid) != 4)
+		return -EINVAL;
+
+	cmd->tc = tc;
+	cmd->tid = tid;
+	cmd->cid = cid;
+	cmd->iid = iid;
+	return 0;
+}
+
+static int parse_event(const char *str, struct ssam_cdev_event_desc *desc)
+{
+	unsigned int tc, tid, en, dis, iid;
+
+	if (sscanf(str, "%x:%x:%x:%x:%x", &tc, &tid, &en, &dis, &iid) != 5)
+		return -EINVAL;
+
+	desc->reg.target_category = tc;
+	desc->reg.target_id = tid;
+	desc->reg.cid_enable = en;
+	desc->reg.cid_disable = dis;
+	desc->id.target_category = tc;
+	desc->id.instance = iid;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct config cfg = {
+		.rqst = { .tc = 0x01, .tid = 0x01, .cid = 0x13, .iid = 0x00 },
+		.rsp_len = DEFAULT_RSP_LEN,
+		.threads = DEFAULT_THREADS,
+		.requests = DEFAULT_REQUESTS,
+		.events = DEFAULT_EVENTS,
+		.event_timeout = DEFAULT_EVENT_TIMEOUT,
+	};
+	int status;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:l:t:n:e:f:T:E:w:s:h")) != -1) {
+		status = 0;
+
+		switch (opt) {
+		case 'r':
+			status = parse_cmd(optarg, &cfg.rqst);
+			break;
+
+		case 'l':
+			cfg.rsp_len = strtoul(optarg, NULL, 0);
+			break;
+
+		case 't':
+			cfg.threads = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'n':
+			cfg.requests = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'e':
+			cfg.event = true;
+			status = parse_event(optarg, &cfg.event_desc);
+			break;
+
+		case 'f':
+			cfg.event_desc.flags = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'T':
+			cfg.trigger = true;
+			status = parse_cmd(optarg, &cfg.trigger_rqst);
+			break;
+
+		case 'E':
+			cfg.events = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'w':
+			cfg.event_timeout = strtol(optarg, NULL, 0);
+			break;
+
+		case 's':
+			cfg.stats = optarg;
+			break;
+
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : -1;
+		}
+
+		if (status) {
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if (!cfg.threads || cfg.rsp_len > 0xffff || (cfg.trigger && !cfg.event)) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	if (cfg.stats) {
+		status = stats_reset(cfg.stats);
+		if (status) {
+			printf("error: Failed to reset statistics: %s\n", strerror(-status));
+			return -1;
+		}
+	}
+
+	if (cfg.requests) {
+		status = bench_requests(&cfg);
+		if (status)
+			return -1;
+	}
+
+	if (cfg.event) {
+		status = bench_events(&cfg);
+		if (status)
+			return -1;
+	}
+
+	if (cfg.stats) {
+		status = stats_show(cfg.stats, cfg.rqst.tc);
+		if (status) {
+			printf("error: Failed to read statistics: %s\n", strerror(-status));
+			return -1;
+		}
+	}
+
+	return 0;
+}
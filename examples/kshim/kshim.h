@@ -0,0 +1,166 @@
+/*
+ * Minimal user-space shim of the kernel API.
+ *
+ * Provides just enough of the kernel headers to build the pure
+ * data-manipulation parts of the SSH transport layer (i.e.
+ * module/src/ssh_parser.c, module/src/ssh_receiver.c, and
+ * module/src/ssh_crc.c) as user-space library.
+ * The headers in the linux/ and asm/ sub-directories all resolve to this
+ * file. Assumes a little-endian host.
+ */
+
+#ifndef _KSHIM_H
+#define _KSHIM_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+
+/* -- Types. ---------------------------------------------------------------- */
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+
+typedef int8_t   s8;
+typedef int16_t  s16;
+typedef int32_t  s32;
+typedef long long s64;
+
+typedef uint8_t  __u8;
+typedef uint16_t __u16;
+typedef uint32_t __u32;
+typedef unsigned long long __u64;
+
+typedef uint16_t __le16;
+typedef uint32_t __le32;
+typedef unsigned long long __le64;
+
+typedef s64 ktime_t;
+
+#define U8_MAX		((u8)~0U)
+#define U16_MAX		((u16)~0U)
+#define U32_MAX		((u32)~0U)
+
+
+/* -- Compiler and generic helpers. ----------------------------------------- */
+
+#define __packed		__attribute__((__packed__))
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+#define fallthrough		__attribute__((__fallthrough__))
+
+#define static_assert(expr, ...)	_Static_assert(expr, #expr)
+
+#define BIT(nr)			(1UL << (nr))
+#define ARRAY_SIZE(arr)		(sizeof(arr) / sizeof((arr)[0]))
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define min(a, b)		((a) < (b) ? (a) : (b))
+#define max(a, b)		((a) > (b) ? (a) : (b))
+#define min_t(t, a, b)		min((t)(a), (t)(b))
+#define max_t(t, a, b)		max((t)(a), (t)(b))
+
+
+/* -- Barriers. ------------------------------------------------------------- */
+
+#define smp_load_acquire(p)		__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v)		__atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+
+/* -- Unaligned access. ----------------------------------------------------- */
+
+#define get_unaligned(ptr) \
+	(((const struct { __typeof__(*(ptr)) x; } __packed *)(ptr))->x)
+
+static inline u16 get_unaligned_le16(const void *p)
+{
+	const u8 *b = p;
+
+	return b[0] | (b[1] << 8);
+}
+
+static inline u16 get_unaligned_be16(const void *p)
+{
+	const u8 *b = p;
+
+	return (b[0] << 8) | b[1];
+}
+
+static inline void put_unaligned_le16(u16 val, void *p)
+{
+	u8 *b = p;
+
+	b[0] = val & 0xff;
+	b[1] = val >> 8;
+}
+
+static inline void put_unaligned_le32(u32 val, void *p)
+{
+	put_unaligned_le16(val & 0xffff, p);
+	put_unaligned_le16(val >> 16, (u8 *)p + 2);
+}
+
+
+/* -- Devices and logging. -------------------------------------------------- */
+
+struct device {
+	const char *name;
+};
+
+/*
+ * Logging is compiled out: The parser logs every invalid frame, which would
+ * otherwise dominate any measurement. Arguments are still type-checked.
+ */
+static inline __attribute__((format(printf, 2, 3)))
+void kshim_no_printk(const struct device *dev, const char *fmt, ...)
+{
+}
+
+#define dev_err(dev, fmt, ...)		kshim_no_printk(dev, fmt, ##__VA_ARGS__)
+#define dev_warn(dev, fmt, ...)		kshim_no_printk(dev, fmt, ##__VA_ARGS__)
+#define dev_info(dev, fmt, ...)		kshim_no_printk(dev, fmt, ##__VA_ARGS__)
+#define dev_dbg(dev, fmt, ...)		kshim_no_printk(dev, fmt, ##__VA_ARGS__)
+
+
+/* -- Memory. --------------------------------------------------------------- */
+
+struct page;
+
+
+/* -- Lists and reference counting. ----------------------------------------- */
+
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+struct kref {
+	int refcount;
+};
+
+
+/* -- CRC. ------------------------------------------------------------------ */
+
+/* Bit-wise reference implementation, equivalent to the kernel's version. */
+static inline u16 crc_ccitt_false(u16 crc, const u8 *buf, size_t len)
+{
+	unsigned int i;
+
+	while (len--) {
+		crc ^= *buf++ << 8;
+
+		for (i = 0; i < 8; i++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+	}
+
+	return crc;
+}
+
+#endif /* _KSHIM_H */
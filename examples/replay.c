@@ -0,0 +1,593 @@
+/*
+ * Offline replay benchmark for the SSH receiver path.
+ *
+ * Feeds a raw SSH byte stream through the receiver of the packet transport
+ * layer at maximum speed. The receiver state machine, parser, and CRC
+ * implementation are taken directly from module/src/ssh_receiver.c,
+ * module/src/ssh_parser.c, and module/src/ssh_crc.c, built as user-space
+ * library against the kernel API shim in kshim/. ACK/NAK transmission and
+ * data dispatch are replaced by counters via the receiver callbacks. The
+ * receiver thread of module/src/ssh_packet_layer.c is mirrored here.
+ *
+ * Reports the achieved frame rate, as well as the cost of CRC computation
+ * and of re-synchronization after invalid data. Both are measured by
+ * replaying the respective operations of the first pass in isolation.
+ *
+ * Raw byte streams can be obtained from IRPMon captures via
+ *
+ *   scripts/irpmon/irpmon_to_json.py <capture> --raw > stream.bin
+ *
+ * and from dmesg traces (with receiver debug output enabled) via
+ *
+ *   scripts/dmesg/dmesg_parse.py <log> --raw > stream.bin
+ *
+ * If no input is specified, a synthetic stream is generated instead.
+ *
+ * Usage: replay [-i iterations] [-c chunk-size] [-e error-rate] [file|-]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ssh_crc.h"
+#include "ssh_parser.h"
+#include "ssh_receiver.h"
+
+#define DEFAULT_ITERATIONS	100
+#define DEFAULT_CHUNK_SIZE	64
+
+#define SYNTH_FRAMES		100000
+#define SYNTH_MAX_PAYLOAD	64
+
+struct span_list {
+	struct {
+		size_t off;
+		size_t len;
+	} *v;
+	size_t n;
+	size_t cap;
+};
+
+struct replay_stats {
+	unsigned long ack;
+	unsigned long nak;
+	unsigned long data_seq;
+	unsigned long data_nsq;
+	unsigned long unknown;
+	unsigned long repeated;
+	unsigned long commands;
+	unsigned long events;
+
+	unsigned long ack_tx;
+	unsigned long nak_tx;
+	unsigned long crc_error;
+	unsigned long invalid;
+	unsigned long skipped;
+};
+
+struct replay {
+	struct device dev;
+	struct sshp_ring ring;
+	struct ssh_rx rx;
+
+	const u8 *stream;
+	size_t len;
+	size_t chunk;
+
+	/* Start of the span currently evaluated, for stream offsets. */
+	const u8 *base;
+
+	struct replay_stats stats;
+
+	/* Recorded operations, only set for the accounting pass. */
+	struct span_list *crc;
+	struct span_list *resync;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void span_list_push(struct span_list *l, size_t off, size_t len)
+{
+	if (!l)
+		return;
+
+	if (l->n == l->cap) {
+		l->cap = l->cap ? 2 * l->cap : 1024;
+		l->v = realloc(l->v, l->cap * sizeof(*l->v));
+		if (!l->v) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+
+	l->v[l->n].off = off;
+	l->v[l->n].len = len;
+	l->n++;
+}
+
+
+/* -- Receiver. ------------------------------------------------------------- */
+
+/*
+ * Mirrors sshp_ring_alloc() in module/src/ssh_ring.c: Map the same memory
+ * twice in a row, here via a memfd instead of vmap().
+ */
+static int ring_alloc(struct sshp_ring *ring, size_t cap)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	u8 *ptr;
+	int fd;
+
+	cap = max(cap, page);
+
+	fd = memfd_create("ssh-ring", 0);
+	if (fd < 0)
+		return -errno;
+
+	if (ftruncate(fd, cap))
+		goto err;
+
+	ptr = mmap(NULL, 2 * cap, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED)
+		goto err;
+
+	if (mmap(ptr, cap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+		goto err_unmap;
+
+	if (mmap(ptr + cap, cap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+		goto err_unmap;
+
+	close(fd);
+
+	ring->ptr = ptr;
+	ring->pages = NULL;
+	ring->cap = cap;
+	ring->head = 0;
+	ring->tail = 0;
+	return 0;
+
+err_unmap:
+	munmap(ptr, 2 * cap);
+err:
+	close(fd);
+	return -errno;
+}
+
+static void ring_free(struct sshp_ring *ring)
+{
+	munmap(ring->ptr, 2 * ring->cap);
+}
+
+static size_t replay_offset(const struct replay *r, const u8 *ptr)
+{
+	return r->ring.head + (ptr - r->base);
+}
+
+static struct replay *replay_from_rx(struct ssh_rx *rx)
+{
+	return container_of(rx, struct replay, rx);
+}
+
+static void replay_rx_resync(struct ssh_rx *rx, const struct ssam_span *data, size_t skip)
+{
+	struct replay *r = replay_from_rx(rx);
+
+	span_list_push(r->resync, replay_offset(r, data->ptr), data->len);
+
+	r->stats.skipped += skip;
+	r->stats.nak_tx++;
+}
+
+static void replay_rx_frame_invalid(struct ssh_rx *rx, int status)
+{
+	struct replay *r = replay_from_rx(rx);
+
+	if (status == -EBADMSG)
+		r->stats.crc_error++;
+	else
+		r->stats.invalid++;
+}
+
+static void replay_rx_frame_received(struct ssh_rx *rx, const struct ssh_frame *frame,
+				     const struct ssam_span *payload)
+{
+	struct replay *r = replay_from_rx(rx);
+
+	span_list_push(r->crc, replay_offset(r, (u8 *)frame), sizeof(*frame));
+	span_list_push(r->crc, replay_offset(r, payload->ptr), payload->len);
+
+	switch (frame->type) {
+	case SSH_FRAME_TYPE_ACK:
+		r->stats.ack++;
+		break;
+
+	case SSH_FRAME_TYPE_NAK:
+		r->stats.nak++;
+		break;
+
+	case SSH_FRAME_TYPE_DATA_SEQ:
+		r->stats.data_seq++;
+		break;
+
+	case SSH_FRAME_TYPE_DATA_NSQ:
+		r->stats.data_nsq++;
+		break;
+
+	default:
+		r->stats.unknown++;
+		break;
+	}
+}
+
+/* Received ACKs and NAKs are counted in replay_rx_frame_received(). */
+static void replay_rx_ack_received(struct ssh_rx *rx, u8 seq)
+{
+}
+
+static void replay_rx_nak_received(struct ssh_rx *rx)
+{
+}
+
+static void replay_rx_send_ack(struct ssh_rx *rx, u8 seq)
+{
+	replay_from_rx(rx)->stats.ack_tx++;
+}
+
+static void replay_rx_data_repeated(struct ssh_rx *rx, const struct ssh_frame *frame)
+{
+	replay_from_rx(rx)->stats.repeated++;
+}
+
+/* Mirrors the command parsing of the request transport layer. */
+static void replay_rx_data_received(struct ssh_rx *rx, const struct ssam_span *payload)
+{
+	struct replay *r = replay_from_rx(rx);
+	struct ssh_command *command;
+	struct ssam_span command_data;
+
+	if (payload->len < 1 || payload->ptr[0] != SSH_PLD_TYPE_CMD)
+		return;
+
+	if (sshp_parse_command(&r->dev, payload, &command, &command_data))
+		return;
+
+	r->stats.commands++;
+
+	if (ssh_rqid_is_event(get_unaligned_le16(&command->rqid)))
+		r->stats.events++;
+}
+
+static const struct ssh_rx_ops replay_rx_ops = {
+	.resync = replay_rx_resync,
+	.frame_invalid = replay_rx_frame_invalid,
+	.frame_received = replay_rx_frame_received,
+	.ack_received = replay_rx_ack_received,
+	.nak_received = replay_rx_nak_received,
+	.send_ack = replay_rx_send_ack,
+	.data_repeated = replay_rx_data_repeated,
+	.data_received = replay_rx_data_received,
+};
+
+/*
+ * Mirrors ssh_ptl_rx_threadfn(), with the data arriving in chunks of the
+ * configured size, as it would via ssh_ptl_rx_rcvbuf().
+ */
+static void replay_run(struct replay *r)
+{
+	size_t written = 0;
+
+	memset(&r->stats, 0, sizeof(r->stats));
+	ssh_rx_init(&r->rx, &r->dev, &replay_rx_ops);
+
+	r->ring.head = 0;
+	r->ring.tail = 0;
+
+	while (written < r->len) {
+		struct ssam_span data;
+		size_t n;
+
+		n = min(r->chunk, r->len - written);
+		written += sshp_ring_write(&r->ring, r->stream + written, n);
+
+		sshp_ring_span(&r->ring, &data);
+		r->base = data.ptr;
+
+		n = ssh_rx_process(&r->rx, &data);
+		sshp_ring_drop(&r->ring, n);
+	}
+}
+
+
+/* -- Isolated operations. -------------------------------------------------- */
+
+static double bench_crc(const struct replay *r, const struct span_list *l,
+			unsigned int iterations)
+{
+	volatile u16 sink = 0;
+	unsigned int i;
+	double start;
+	size_t k;
+
+	start = now();
+	for (i = 0; i < iterations; i++) {
+		for (k = 0; k < l->n; k++)
+			sink ^= ssh_crc_fast(r->stream + l->v[k].off, l->v[k].len);
+	}
+	(void)sink;
+
+	return (now() - start) * 1e9 / iterations;
+}
+
+static double bench_resync(const struct replay *r, const struct span_list *l,
+			   unsigned int iterations)
+{
+	volatile size_t sink = 0;
+	struct ssam_span src, rem;
+	unsigned int i;
+	double start;
+	size_t k;
+
+	start = now();
+	for (i = 0; i < iterations; i++) {
+		for (k = 0; k < l->n; k++) {
+			src.ptr = (u8 *)r->stream + l->v[k].off;
+			src.len = l->v[k].len;
+
+			sshp_find_syn(&src, &rem);
+			sink += rem.len;
+		}
+	}
+	(void)sink;
+
+	return (now() - start) * 1e9 / iterations;
+}
+
+
+/* -- Input. ---------------------------------------------------------------- */
+
+static u8 *read_stream(const char *path, size_t *len)
+{
+	FILE *fp = strcmp(path, "-") ? fopen(path, "rb") : stdin;
+	size_t cap = 0;
+	u8 *buf = NULL;
+	size_t n;
+
+	if (!fp) {
+		perror(path);
+		return NULL;
+	}
+
+	*len = 0;
+	do {
+		if (*len == cap) {
+			cap = cap ? 2 * cap : 1 << 16;
+			buf = realloc(buf, cap);
+			if (!buf) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+
+		n = fread(buf + *len, 1, cap - *len, fp);
+		*len += n;
+	} while (n);
+
+	if (ferror(fp)) {
+		perror(path);
+		free(buf);
+		buf = NULL;
+	}
+
+	if (fp != stdin)
+		fclose(fp);
+
+	return buf;
+}
+
+static size_t synth_frame(u8 *buf, u8 type, u8 seq, const u8 *pld, u16 len)
+{
+	struct ssh_frame *frame = (struct ssh_frame *)(buf + sizeof(u16));
+
+	put_unaligned_le16(SSH_MSG_SYN, buf);
+
+	frame->type = type;
+	put_unaligned_le16(len, &frame->len);
+	frame->seq = seq;
+	put_unaligned_le16(ssh_crc((u8 *)frame, sizeof(*frame)), frame + 1);
+
+	buf += sizeof(u16) + sizeof(*frame) + sizeof(u16);
+	memcpy(buf, pld, len);
+	put_unaligned_le16(ssh_crc(buf, len), buf + len);
+
+	return SSH_MESSAGE_LENGTH(len);
+}
+
+/*
+ * Generate a stream resembling EC to host traffic: Sequenced events and
+ * responses, unsequenced events, and ACKs for host requests. With the given
+ * probability, a frame is preceded by line noise or has one of its bytes
+ * corrupted.
+ */
+static u8 *synth_stream(size_t *len, double error_rate)
+{
+	u8 pld[sizeof(struct ssh_command) + SYNTH_MAX_PAYLOAD];
+	struct ssh_command *cmd = (struct ssh_command *)pld;
+	size_t cap = SYNTH_FRAMES * (SSH_MESSAGE_LENGTH(sizeof(pld)) + 8);
+	u8 *buf = malloc(cap);
+	size_t off = 0;
+	unsigned int i, k;
+	u8 seq = 0;
+
+	if (!buf) {
+		perror("malloc");
+		exit(1);
+	}
+
+	for (i = 0; i < SYNTH_FRAMES; i++) {
+		size_t start, n;
+		u16 plen;
+		u8 type;
+
+		if (rand() < error_rate * RAND_MAX && rand() % 2) {
+			for (k = rand() % 8; k > 0; k--)
+				buf[off++] = rand() & 0xff;
+		}
+
+		start = off;
+
+		switch (rand() % 4) {
+		case 0:
+			off += synth_frame(buf + off, SSH_FRAME_TYPE_ACK, rand() & 0xff, NULL, 0);
+			break;
+
+		default:
+			type = rand() % 3 ? SSH_FRAME_TYPE_DATA_SEQ : SSH_FRAME_TYPE_DATA_NSQ;
+			plen = rand() % (SYNTH_MAX_PAYLOAD + 1);
+
+			cmd->type = SSH_PLD_TYPE_CMD;
+			cmd->tc = 1 + rand() % 0x30;
+			cmd->tid = 0x00;
+			cmd->sid = 0x01 + rand() % 2;
+			cmd->iid = 0x00;
+			put_unaligned_le16(1 + rand() % 0x40, &cmd->rqid);
+			cmd->cid = rand() & 0xff;
+
+			for (k = 0; k < plen; k++)
+				pld[sizeof(*cmd) + k] = rand() & 0xff;
+
+			off += synth_frame(buf + off, type, seq++, pld, sizeof(*cmd) + plen);
+			break;
+		}
+
+		if (rand() < error_rate * RAND_MAX && rand() % 2) {
+			n = off - start;
+			buf[start + rand() % n] ^= 1 << (rand() % 8);
+		}
+	}
+
+	*len = off;
+	return buf;
+}
+
+
+/* -- Main. ----------------------------------------------------------------- */
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-i iterations] [-c chunk-size] [-e error-rate] [file|-]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	struct span_list crc = {}, resync = {};
+	unsigned int iterations = DEFAULT_ITERATIONS;
+	struct replay r = {};
+	unsigned long frames;
+	double error_rate = 0.001;
+	double t_run, t_crc, t_resync;
+	size_t crc_bytes = 0;
+	unsigned int i;
+	u8 *stream;
+	int opt;
+
+	r.dev.name = "replay";
+	r.chunk = DEFAULT_CHUNK_SIZE;
+
+	while ((opt = getopt(argc, argv, "i:c:e:h")) != -1) {
+		switch (opt) {
+		case 'i':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'c':
+			r.chunk = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'e':
+			error_rate = strtod(optarg, NULL);
+			break;
+
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (!iterations || !r.chunk || optind + 1 < argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	srand(0);
+
+	if (optind < argc)
+		stream = read_stream(argv[optind], &r.len);
+	else
+		stream = synth_stream(&r.len, error_rate);
+
+	if (!stream)
+		return 1;
+
+	if (ring_alloc(&r.ring, SSH_RX_RING_LEN)) {
+		perror("ring_alloc");
+		return 1;
+	}
+
+	r.stream = stream;
+
+	/* Accounting pass: Record CRC and re-synchronization operations. */
+	r.crc = &crc;
+	r.resync = &resync;
+	replay_run(&r);
+	r.crc = NULL;
+	r.resync = NULL;
+
+	for (i = 0; i < crc.n; i++)
+		crc_bytes += crc.v[i].len;
+
+	frames = r.stats.ack + r.stats.nak + r.stats.data_seq + r.stats.data_nsq
+		 + r.stats.unknown;
+
+	printf("stream:  %zu bytes (%s), chunk size: %zu, iterations: %u\n", r.len,
+	       optind < argc ? argv[optind] : "synthetic", r.chunk, iterations);
+	printf("frames:  %lu (ack: %lu, nak: %lu, data-seq: %lu, data-nsq: %lu, unknown: %lu)\n",
+	       frames, r.stats.ack, r.stats.nak, r.stats.data_seq, r.stats.data_nsq,
+	       r.stats.unknown);
+	printf("data:    %lu commands (%lu events), %lu repeated, %lu ACKs to send\n",
+	       r.stats.commands, r.stats.events, r.stats.repeated, r.stats.ack_tx);
+	printf("errors:  %lu CRC, %lu invalid, %lu resyncs (%lu bytes skipped, %lu NAKs to send)\n",
+	       r.stats.crc_error, r.stats.invalid, resync.n, r.stats.skipped, r.stats.nak_tx);
+
+	t_run = now();
+	for (i = 0; i < iterations; i++)
+		replay_run(&r);
+	t_run = (now() - t_run) * 1e9 / iterations;
+
+	t_crc = bench_crc(&r, &crc, iterations);
+	t_resync = bench_resync(&r, &resync, iterations);
+
+	printf("replay:  %.1f us/iteration, %.0f frames/s, %.1f MB/s\n", t_run * 1e-3,
+	       frames * 1e9 / t_run, r.len * 1e3 / t_run);
+	printf("crc:     %.1f us/iteration (%.1f%%), %zu bytes in %zu spans, %.2f ns/byte\n",
+	       t_crc * 1e-3, 100.0 * t_crc / t_run, crc_bytes, crc.n,
+	       crc_bytes ? t_crc / crc_bytes : 0.0);
+	printf("resync:  %.1f us/iteration (%.1f%%), %.1f ns/resync\n", t_resync * 1e-3,
+	       100.0 * t_resync / t_run, resync.n ? t_resync / resync.n : 0.0);
+
+	ring_free(&r.ring);
+	free(resync.v);
+	free(crc.v);
+	free(stream);
+
+	return 0;
+}
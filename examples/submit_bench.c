@@ -0,0 +1,299 @@
+/*
+ * Concurrency microbenchmark for the request submission fast path.
+ *
+ * Models the shared state touched by concurrent request submission in the
+ * request transport layer (module/src/ssh_request_layer.c) and compares the
+ * fully locked variant against the lockless fast paths:
+ *
+ * - Scheduling the transmitter work: The locked variant checks the queue for
+ *   requests under the queue lock before trying to schedule the work item.
+ *   The fast path skips this if the work item is already pending.
+ *
+ * - Arming the timeout reaper: The locked variant always takes the timeout
+ *   lock to compare the current reaper expiration date against the new one.
+ *   The fast path reads the expiration date without lock and only takes it
+ *   if the reaper has to be re-armed.
+ *
+ * Each submitter thread repeatedly queues a request under the queue lock,
+ * schedules the transmitter, and arms the reaper. A separate thread stands in
+ * for the transmitter work and timeout reaper, draining the queue and
+ * periodically resetting the reaper expiration date. The benchmark reports
+ * submissions per second for an increasing number of submitter threads.
+ *
+ * This only models the lock and cache-line access patterns. To measure the
+ * actual driver, use cdev_bench with multiple threads.
+ *
+ * Usage: see usage() below.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_THREADS		4
+#define DEFAULT_DURATION	1000		/* ms */
+
+#define TIMEOUT			1000000000LL	/* ns */
+#define TIMEOUT_RESOLUTION	50000000LL	/* ns */
+#define REAPER_PERIOD		1000000LL	/* ns */
+
+#define KTIME_MAX		INT64_MAX
+
+struct model {
+	bool fast;
+
+	/* Request queue, guarded by queue_lock. */
+	pthread_spinlock_t queue_lock;
+	unsigned long queued;
+
+	/* Transmitter work pending bit. */
+	atomic_bool tx_pending;
+
+	/* Timeout reaper expiration date, written under timeout_lock. */
+	pthread_spinlock_t timeout_lock;
+	_Atomic int64_t expires;
+
+	atomic_bool stop;
+};
+
+struct submitter {
+	pthread_t thread;
+	struct model *model;
+	unsigned long count;
+};
+
+
+/* -- Helpers. -------------------------------------------------------------- */
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_ns(int64_t ns)
+{
+	struct timespec ts = {
+		.tv_sec = ns / 1000000000LL,
+		.tv_nsec = ns % 1000000000LL,
+	};
+
+	nanosleep(&ts, NULL);
+}
+
+
+/* -- Submission model. ----------------------------------------------------- */
+
+static bool queue_empty(struct model *m)
+{
+	bool empty;
+
+	pthread_spin_lock(&m->queue_lock);
+	empty = !m->queued;
+	pthread_spin_unlock(&m->queue_lock);
+
+	return empty;
+}
+
+/* See __ssh_rtl_tx_schedule(). */
+static bool tx_schedule(struct model *m)
+{
+	if (m->fast) {
+		if (atomic_load_explicit(&m->tx_pending, memory_order_relaxed))
+			return false;
+	} else if (queue_empty(m)) {
+		return false;
+	}
+
+	return !atomic_exchange(&m->tx_pending, true);
+}
+
+/* See ssh_rtl_timeout_reaper_mod(). */
+static void timeout_reaper_mod(struct model *m, int64_t expires)
+{
+	int64_t aexp = expires + TIMEOUT_RESOLUTION;
+
+	if (m->fast && aexp >= atomic_load_explicit(&m->expires, memory_order_relaxed))
+		return;
+
+	pthread_spin_lock(&m->timeout_lock);
+
+	if (aexp < atomic_load_explicit(&m->expires, memory_order_relaxed))
+		atomic_store_explicit(&m->expires, expires, memory_order_relaxed);
+
+	pthread_spin_unlock(&m->timeout_lock);
+}
+
+static void *submitter_fn(void *arg)
+{
+	struct submitter *s = arg;
+	struct model *m = s->model;
+
+	while (!atomic_load_explicit(&m->stop, memory_order_relaxed)) {
+		pthread_spin_lock(&m->queue_lock);
+		m->queued++;
+		pthread_spin_unlock(&m->queue_lock);
+
+		tx_schedule(m);
+		timeout_reaper_mod(m, now_ns() + TIMEOUT);
+
+		s->count++;
+	}
+
+	return NULL;
+}
+
+/* Stands in for both the transmitter work and the timeout reaper. */
+static void *worker_fn(void *arg)
+{
+	struct model *m = arg;
+	int64_t reaper = now_ns() + REAPER_PERIOD;
+
+	while (!atomic_load_explicit(&m->stop, memory_order_relaxed)) {
+		if (atomic_exchange(&m->tx_pending, false)) {
+			pthread_spin_lock(&m->queue_lock);
+			m->queued = 0;
+			pthread_spin_unlock(&m->queue_lock);
+		}
+
+		if (now_ns() >= reaper) {
+			pthread_spin_lock(&m->timeout_lock);
+			atomic_store_explicit(&m->expires, KTIME_MAX, memory_order_relaxed);
+			pthread_spin_unlock(&m->timeout_lock);
+
+			timeout_reaper_mod(m, now_ns() + TIMEOUT);
+			reaper = now_ns() + REAPER_PERIOD;
+		}
+
+		sleep_ns(10000);
+	}
+
+	return NULL;
+}
+
+static int run(bool fast, unsigned int threads, unsigned int duration,
+	       double *rate)
+{
+	struct model m = { .fast = fast };
+	struct submitter *subs;
+	pthread_t worker;
+	unsigned long total = 0;
+	unsigned int i;
+	int status;
+
+	atomic_init(&m.tx_pending, false);
+	atomic_init(&m.expires, KTIME_MAX);
+	atomic_init(&m.stop, false);
+	pthread_spin_init(&m.queue_lock, PTHREAD_PROCESS_PRIVATE);
+	pthread_spin_init(&m.timeout_lock, PTHREAD_PROCESS_PRIVATE);
+
+	subs = calloc(threads, sizeof(*subs));
+	if (!subs)
+		return -ENOMEM;
+
+	status = pthread_create(&worker, NULL, worker_fn, &m);
+	if (status)
+		goto out_free;
+
+	for (i = 0; i < threads; i++) {
+		subs[i].model = &m;
+
+		status = pthread_create(&subs[i].thread, NULL, submitter_fn, &subs[i]);
+		if (status)
+			break;
+	}
+
+	if (!status)
+		sleep_ns((int64_t)duration * 1000000LL);
+
+	atomic_store(&m.stop, true);
+
+	while (i--) {
+		pthread_join(subs[i].thread, NULL);
+		total += subs[i].count;
+	}
+
+	pthread_join(worker, NULL);
+	*rate = (double)total * 1000.0 / duration;
+
+out_free:
+	pthread_spin_destroy(&m.timeout_lock);
+	pthread_spin_destroy(&m.queue_lock);
+	free(subs);
+	return -status;
+}
+
+
+/* -- Main. ----------------------------------------------------------------- */
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"\n"
+		"Options:\n"
+		"  -t threads           maximum number of submitter threads (default: %u)\n"
+		"  -d duration          duration of each run in ms (default: %u)\n",
+		name, DEFAULT_THREADS, DEFAULT_DURATION);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int max_threads = DEFAULT_THREADS;
+	unsigned int duration = DEFAULT_DURATION;
+	double locked, fast;
+	unsigned int t;
+	int status;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:d:h")) != -1) {
+		switch (opt) {
+		case 't':
+			max_threads = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'd':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : -1;
+		}
+	}
+
+	if (!max_threads || !duration) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	printf("%8s %14s %14s %8s\n", "threads", "locked/s", "fast/s", "speedup");
+
+	for (t = 1; ; t = t * 2 < max_threads ? t * 2 : max_threads) {
+		status = run(false, t, duration, &locked);
+		if (!status)
+			status = run(true, t, duration, &fast);
+
+		if (status) {
+			printf("error: Failed to run benchmark: %s\n", strerror(-status));
+			return -1;
+		}
+
+		printf("%8u %14.0f %14.0f %7.2fx\n", t, locked, fast, fast / locked);
+
+		if (t == max_threads)
+			break;
+	}
+
+	return 0;
+}
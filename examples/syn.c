@@ -0,0 +1,202 @@
+/*
+ * Test and micro-benchmark harness for SSH SYN scanning.
+ *
+ * Tests the word-at-a-time implementation of sshp_find_syn() from
+ * module/src/ssh_parser.c, built as user-space library against the kernel
+ * API shim in kshim/, against the straight-forward byte-wise reference
+ * implementation, including the partial-SYN-at-end semantics, unaligned
+ * starts, and tails shorter than a word. Then measures both on (noisy)
+ * buffers of the size of the receiver evaluation buffer.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "ssh_parser.h"
+#include "ssh_receiver.h"
+
+#define TEST_ROUNDS		200000
+#define TEST_MAX_LEN		64
+#define TEST_MAX_OFFSET		16
+#define BENCH_ITERATIONS	20000
+
+#define WORD			sizeof(unsigned long)
+
+/* Byte-wise reference implementation. */
+static bool find_syn_ref(const struct ssam_span *src, struct ssam_span *rem)
+{
+	size_t i;
+
+	if (!src->len) {
+		rem->ptr = src->ptr;
+		rem->len = 0;
+		return false;
+	}
+
+	for (i = 0; i < src->len - 1; i++) {
+		if (get_unaligned_le16(src->ptr + i) == SSH_MSG_SYN) {
+			rem->ptr = src->ptr + i;
+			rem->len = src->len - i;
+			return true;
+		}
+	}
+
+	if (src->ptr[src->len - 1] == (SSH_MSG_SYN & 0xff)) {
+		rem->ptr = src->ptr + src->len - 1;
+		rem->len = 1;
+		return false;
+	}
+
+	rem->ptr = src->ptr + src->len;
+	rem->len = 0;
+	return false;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Fill buffer with random data from a small alphabet so that partial and
+ * complete SYN sequences occur frequently at arbitrary offsets.
+ */
+static void fill_test(u8 *buf, size_t len)
+{
+	static const u8 alphabet[] = { 0xaa, 0x55, 0x00, 0xff, 0x5a, 0xa5 };
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = alphabet[rand() % sizeof(alphabet)];
+}
+
+/* Fill buffer like line noise, but without any SYN sequence in it. */
+static void fill_noise(u8 *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		buf[i] = rand() & 0xff;
+
+		if (i > 0 && get_unaligned_le16(buf + i - 1) == SSH_MSG_SYN)
+			buf[i] = 0x00;
+	}
+}
+
+static int check(u8 *buf, size_t off, size_t len)
+{
+	struct ssam_span src = { buf + off, len };
+	struct ssam_span ra, rb;
+	bool fa, fb;
+
+	fa = find_syn_ref(&src, &ra);
+	fb = sshp_find_syn(&src, &rb);
+
+	if (fa != fb || ra.ptr != rb.ptr || ra.len != rb.len) {
+		printf("error: mismatch (len: %zu, offset: %zu): ref: %d/%zd/%zu, sshp_find_syn: %d/%zd/%zu\n",
+		       len, off, fa, ra.ptr - src.ptr, ra.len, fb,
+		       rb.ptr - src.ptr, rb.len);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int test(void)
+{
+	u8 buf[TEST_MAX_LEN + TEST_MAX_OFFSET];
+	size_t off, len, pos;
+	unsigned int r;
+
+	/*
+	 * Exhaustive: A single (partial) SYN at every position of spans up to
+	 * a few words long, at every alignment. This covers SYNs straddling
+	 * word boundaries, the end of the word loop, and the byte-wise tail.
+	 */
+	for (off = 0; off < WORD; off++) {
+		for (len = 0; len <= 3 * WORD + 1; len++) {
+			memset(buf, 0x00, sizeof(buf));
+			if (check(buf, off, len))
+				return -1;
+
+			for (pos = 0; pos < len; pos++) {
+				memset(buf, 0x00, sizeof(buf));
+
+				/* Partial SYN, followed by a complete one if possible. */
+				buf[off + pos] = SSH_MSG_SYN & 0xff;
+				if (check(buf, off, len))
+					return -1;
+
+				buf[off + pos + 1] = SSH_MSG_SYN >> 8;
+				if (check(buf, off, len))
+					return -1;
+			}
+		}
+	}
+
+	/* Random spans with frequent partial and complete SYN sequences. */
+	for (r = 0; r < TEST_ROUNDS; r++) {
+		off = rand() % TEST_MAX_OFFSET;
+		len = rand() % TEST_MAX_LEN;
+
+		fill_test(buf, sizeof(buf));
+		if (check(buf, off, len))
+			return -1;
+	}
+
+	printf("test: exhaustive spans and %u random spans OK\n", TEST_ROUNDS);
+	return 0;
+}
+
+static double bench(bool (*fn)(const struct ssam_span *, struct ssam_span *),
+		    const struct ssam_span *src)
+{
+	volatile size_t sink = 0;
+	struct ssam_span rem;
+	unsigned int i;
+	double start;
+
+	start = now();
+	for (i = 0; i < BENCH_ITERATIONS; i++) {
+		fn(src, &rem);
+		sink += rem.len;
+	}
+	(void)sink;
+
+	return (now() - start) * 1e9 / BENCH_ITERATIONS;
+}
+
+int main(void)
+{
+	static u8 buf[SSH_RX_BUF_LEN];
+	struct ssam_span src = { buf, sizeof(buf) };
+	double ta, tb;
+
+	srand(0);
+
+	if (test())
+		return -1;
+
+	/* Worst case: No SYN in the full evaluation buffer. */
+	fill_noise(buf, sizeof(buf));
+
+	ta = bench(find_syn_ref, &src);
+	tb = bench(sshp_find_syn, &src);
+
+	printf("bench: %zu bytes of noise: byte-wise: %.1f ns, word-wise: %.1f ns (%.2fx)\n",
+	       sizeof(buf), ta, tb, ta / tb);
+
+	/* SYN at the very end, with partial SYN handling. */
+	buf[sizeof(buf) - 1] = SSH_MSG_SYN & 0xff;
+
+	ta = bench(find_syn_ref, &src);
+	tb = bench(sshp_find_syn, &src);
+
+	printf("bench: %zu bytes, partial SYN at end: byte-wise: %.1f ns, word-wise: %.1f ns (%.2fx)\n",
+	       sizeof(buf), ta, tb, ta / tb);
+
+	return 0;
+}
@@ -14,7 +14,9 @@
 
 #include <linux/completion.h>
 #include <linux/device.h>
+#include <linux/ktime.h>
 #include <linux/types.h>
+#include <linux/workqueue.h>
 
 #include "serial_hub.h"
 
@@ -60,10 +62,33 @@ struct ssam_event {
  *	Specifies that the request should be transmitted via an unsequenced
  *	packet. If set, the request must not have a response, meaning that this
  *	flag and the %SSAM_REQUEST_HAS_RESPONSE flag are mutually exclusive.
+ *
+ * @SSAM_REQUEST_IDEMPOTENT:
+ *	Specifies that the request is free of side effects, i.e. that
+ *	concurrent identical synchronous requests may share a single EC round
+ *	trip and response. Requests without this flag are never
+ *	de-duplicated, regardless of whether they carry a payload. Only
+ *	applicable to requests with response.
+ *
+ * @SSAM_REQUEST_PRIO_INTERACTIVE:
+ *	Specifies that the request is latency-sensitive, e.g. because it is
+ *	directly triggered by user input. Interactive requests are transmitted
+ *	in preference to normal and bulk requests.
+ *
+ * @SSAM_REQUEST_PRIO_BULK:
+ *	Specifies that the request is not latency-sensitive, e.g. because it is
+ *	issued by some periodic data collection. Bulk requests are transmitted
+ *	only after interactive and normal requests, but are guaranteed to not
+ *	be starved by them. This flag and the %SSAM_REQUEST_PRIO_INTERACTIVE
+ *	flag are mutually exclusive. If neither is set, the request is of
+ *	normal priority.
  */
 enum ssam_request_flags {
-	SSAM_REQUEST_HAS_RESPONSE = BIT(0),
-	SSAM_REQUEST_UNSEQUENCED  = BIT(1),
+	SSAM_REQUEST_HAS_RESPONSE     = BIT(0),
+	SSAM_REQUEST_UNSEQUENCED      = BIT(1),
+	SSAM_REQUEST_IDEMPOTENT       = BIT(2),
+	SSAM_REQUEST_PRIO_INTERACTIVE = BIT(3),
+	SSAM_REQUEST_PRIO_BULK        = BIT(4),
 };
 
 /**
@@ -117,6 +142,8 @@ void ssam_controller_put(struct ssam_controller *c);
 void ssam_controller_statelock(struct ssam_controller *c);
 void ssam_controller_stateunlock(struct ssam_controller *c);
 
+bool ssam_controller_events_held(struct ssam_controller *ctrl);
+
 ssize_t ssam_request_write_data(struct ssam_span *buf,
 				struct ssam_controller *ctrl,
 				const struct ssam_request *spec);
@@ -243,6 +270,69 @@ int ssam_request_do_sync_with_buffer(struct ssam_controller *ctrl,
 		ssam_request_do_sync_with_buffer(ctrl, rqst, rsp, &__buf);	\
 	})
 
+int ssam_request_cache_lookup(struct ssam_controller *ctrl,
+			      const struct ssam_request *spec,
+			      struct ssam_response *rsp, u32 *gen);
+
+void ssam_request_cache_store(struct ssam_controller *ctrl,
+			      const struct ssam_request *spec,
+			      const struct ssam_response *rsp,
+			      unsigned int ttl_ms, u32 gen);
+
+void ssam_request_cache_invalidate(struct ssam_controller *ctrl, u8 tc);
+
+int ssam_client_cache_store(struct ssam_controller *ctrl, u64 key,
+			    const void *data, size_t len);
+
+ssize_t ssam_client_cache_load(struct ssam_controller *ctrl, u64 key,
+			       void *buf, size_t len);
+
+void ssam_client_cache_drop(struct ssam_controller *ctrl, u64 key);
+
+void ssam_controller_pm_record_client(struct ssam_controller *ctrl,
+				      struct device *dev, ktime_t start,
+				      int status);
+
+/**
+ * ssam_request_do_sync_cached_onstack - Execute a synchronous request on the
+ * stack, using the controller's response cache.
+ * @ctrl:   The controller via which the request is submitted.
+ * @rqst:   The request specification.
+ * @rsp:    The response buffer.
+ * @payload_len: The (maximum) request payload length.
+ * @ttl_ms: Time-to-live of the cached response in milliseconds. Zero
+ *          disables caching.
+ *
+ * Behaves like ssam_request_do_sync_onstack(), but first tries to answer the
+ * request from the response cache of the controller. If no valid cached
+ * response is available, the request is submitted and its response stored in
+ * the cache on success. Cached responses are invalidated when their
+ * time-to-live expires or when an event with the same target category is
+ * received. Caching should thus only be used for idempotent requests without
+ * side effects.
+ *
+ * Return: Returns the status of the request or any failure during setup, i.e.
+ * zero on success and a negative value on failure.
+ */
+#define ssam_request_do_sync_cached_onstack(ctrl, rqst, rsp, payload_len, ttl_ms) \
+	({									\
+		unsigned int __ttl = (ttl_ms);					\
+		u32 __gen = 0;							\
+		int __s = -ENOENT;						\
+										\
+		if (__ttl)							\
+			__s = ssam_request_cache_lookup(ctrl, rqst, rsp, &__gen); \
+										\
+		if (__s) {							\
+			__s = ssam_request_do_sync_onstack(ctrl, rqst, rsp,	\
+							   payload_len);	\
+			if (!__s && __ttl)					\
+				ssam_request_cache_store(ctrl, rqst, rsp, __ttl, \
+							 __gen);		\
+		}								\
+		__s;								\
+	})
+
 /**
  * __ssam_retry - Retry request in case of I/O errors or timeouts.
  * @request: The request function to execute. Must return an integer.
@@ -293,6 +383,10 @@ int ssam_request_do_sync_with_buffer(struct ssam_controller *ctrl,
  * @command_id:      Command ID of the request.
  * @instance_id:     Instance ID of the request's target.
  * @flags:           Flags for the request. See &enum ssam_request_flags.
+ * @cache_ms:        Time-to-live in milliseconds for responses of this request
+ *                   in the controller's response cache. Zero (the default)
+ *                   disables caching. Only applicable to requests with
+ *                   response. See ssam_request_do_sync_cached_onstack().
  *
  * Blue-print specification for a SAM request. This struct describes the
  * unique static parameters of a request (i.e. type) without specifying any of
@@ -306,6 +400,7 @@ struct ssam_request_spec {
 	u8 command_id;
 	u8 instance_id;
 	u8 flags;
+	u16 cache_ms;
 };
 
 /**
@@ -314,6 +409,10 @@ struct ssam_request_spec {
  * @target_category: Category of the request's target. See &enum ssam_ssh_tc.
  * @command_id:      Command ID of the request.
  * @flags:           Flags for the request. See &enum ssam_request_flags.
+ * @cache_ms:        Time-to-live in milliseconds for responses of this request
+ *                   in the controller's response cache. Zero (the default)
+ *                   disables caching. Only applicable to requests with
+ *                   response. See ssam_request_do_sync_cached_onstack().
  *
  * Blue-print specification for a multi-device SAM request, i.e. a request
  * that is applicable to multiple device instances, described by their
@@ -329,6 +428,7 @@ struct ssam_request_spec_md {
 	u8 target_category;
 	u8 command_id;
 	u8 flags;
+	u16 cache_ms;
 };
 
 /**
@@ -453,7 +553,8 @@ struct ssam_request_spec_md {
 		rsp.length = 0;							\
 		rsp.pointer = (u8 *)ret;					\
 										\
-		status = ssam_request_do_sync_onstack(ctrl, &rqst, &rsp, 0);	\
+		status = ssam_request_do_sync_cached_onstack(ctrl, &rqst, &rsp, 0, \
+							     s.cache_ms);	\
 		if (status)							\
 			return status;						\
 										\
@@ -514,7 +615,9 @@ struct ssam_request_spec_md {
 		rsp.length = 0;							\
 		rsp.pointer = (u8 *)ret;					\
 										\
-		status = ssam_request_do_sync_onstack(ctrl, &rqst, &rsp, sizeof(atype)); \
+		status = ssam_request_do_sync_cached_onstack(ctrl, &rqst, &rsp,	\
+							     sizeof(atype),	\
+							     s.cache_ms);	\
 		if (status)							\
 			return status;						\
 										\
@@ -658,7 +761,8 @@ struct ssam_request_spec_md {
 		rsp.length = 0;							\
 		rsp.pointer = (u8 *)ret;					\
 										\
-		status = ssam_request_do_sync_onstack(ctrl, &rqst, &rsp, 0);	\
+		status = ssam_request_do_sync_cached_onstack(ctrl, &rqst, &rsp, 0, \
+							     s.cache_ms);	\
 		if (status)							\
 			return status;						\
 										\
@@ -722,7 +826,9 @@ struct ssam_request_spec_md {
 		rsp.length = 0;							\
 		rsp.pointer = (u8 *)ret;					\
 										\
-		status = ssam_request_do_sync_onstack(ctrl, &rqst, &rsp, sizeof(atype)); \
+		status = ssam_request_do_sync_cached_onstack(ctrl, &rqst, &rsp,	\
+							     sizeof(atype),	\
+							     s.cache_ms);	\
 		if (status)							\
 			return status;						\
 										\
@@ -739,9 +845,105 @@ struct ssam_request_spec_md {
 	}
 
 
+/* -- Asynchronous request interface. --------------------------------------- */
+
+struct ssam_request_async;
+
+/**
+ * typedef ssam_request_async_fn - Completion callback of an asynchronous
+ * request.
+ * @rqst:   The request that has been completed.
+ * @status: The status of the request. Zero on success, negative on failure.
+ *
+ * Called on the completion workqueue of the controller once the request has
+ * been completed and has fully left the transport system. At this point, the
+ * response (if any) has been copied to the response buffer set via
+ * ssam_request_async_set_resp() and the request, its message buffer, and its
+ * response buffer are no longer accessed by the transport system. It is thus
+ * valid to free the request from inside this callback.
+ */
+typedef void (*ssam_request_async_fn)(struct ssam_request_async *rqst,
+				      int status);
+
+/**
+ * struct ssam_request_async - Asynchronous SAM request struct.
+ * @base:   Underlying SSH request.
+ * @work:   Work item used to execute the completion callback on the
+ *          completion workqueue of the controller.
+ * @ctrl:   The controller via which the request has been submitted.
+ * @resp:   Buffer to store the response.
+ * @status: Status of the request, set after the base request has been
+ *          completed or has failed.
+ * @fn:     Completion callback, executed once the request has been completed
+ *          and released. After the request has been submitted, this struct
+ *          may only be modified or deallocated once this callback has been
+ *          executed.
+ *
+ * This struct may be embedded in a larger, caller-defined struct. The
+ * completion callback can then use container_of() to access any additional
+ * context.
+ */
+struct ssam_request_async {
+	struct ssh_request base;
+	struct work_struct work;
+	struct ssam_controller *ctrl;
+	struct ssam_response *resp;
+	int status;
+	ssam_request_async_fn fn;
+};
+
+int ssam_request_async_alloc(size_t payload_len, gfp_t flags,
+			     struct ssam_request_async **rqst,
+			     struct ssam_span *buffer);
+
+void ssam_request_async_free(struct ssam_request_async *rqst);
+
+int ssam_request_async_init(struct ssam_request_async *rqst,
+			    enum ssam_request_flags flags,
+			    ssam_request_async_fn fn);
+
+/**
+ * ssam_request_async_set_data - Set message data of an asynchronous request.
+ * @rqst: The request.
+ * @ptr:  Pointer to the request message data.
+ * @len:  Length of the request message data.
+ *
+ * Set the request message data of an asynchronous request. The provided
+ * buffer needs to live until the completion callback of the request has been
+ * executed.
+ */
+static inline void ssam_request_async_set_data(struct ssam_request_async *rqst,
+					       u8 *ptr, size_t len)
+{
+	ssh_request_set_data(&rqst->base, ptr, len);
+}
+
+/**
+ * ssam_request_async_set_resp - Set response buffer of an asynchronous
+ * request.
+ * @rqst: The request.
+ * @resp: The response buffer.
+ *
+ * Sets the response buffer of an asynchronous request. This buffer will store
+ * the response of the request once it has been completed and must live until
+ * the completion callback of the request has been executed. May be %NULL if
+ * no response is expected.
+ */
+static inline void ssam_request_async_set_resp(struct ssam_request_async *rqst,
+					       struct ssam_response *resp)
+{
+	rqst->resp = resp;
+}
+
+int ssam_request_async_submit(struct ssam_controller *ctrl,
+			      struct ssam_request_async *rqst);
+
+bool ssam_request_async_cancel(struct ssam_request_async *rqst);
+
+
 /* -- Event notifier/callbacks. --------------------------------------------- */
 
-#define SSAM_NOTIF_STATE_SHIFT		2
+#define SSAM_NOTIF_STATE_SHIFT		3
 #define SSAM_NOTIF_STATE_MASK		((1 << SSAM_NOTIF_STATE_SHIFT) - 1)
 
 /**
@@ -764,10 +966,29 @@ struct ssam_request_spec_md {
  *	immediately stop and any remaining notifiers will not be called. This
  *	flag is automatically set when ssam_notifier_from_errno() is called
  *	with a negative error value.
+ *
+ * @SSAM_NOTIF_WAKEUP:
+ *	Indicates that the event warrants a system wakeup. Events received
+ *	while the EC is in the display-off state are released one-by-one by
+ *	the controller and routed through the notifier chain like any other
+ *	event. Only events for which at least one handler has set this flag
+ *	will be reported as wakeup event, i.e. abort a pending suspend
+ *	transition. Handlers should only set this flag for events that
+ *	require user attention, e.g. a power button press, and not for
+ *	routine updates such as battery status changes. As every reported
+ *	wakeup event is forwarded to the PM core, handlers should only set
+ *	this flag while events are held back by the EC, see
+ *	ssam_controller_events_held().
+ *
+ *	Note that events are only released and filtered this way while the
+ *	controller is running. Once the controller has been suspended, e.g.
+ *	while the system is in s2idle, any event held back by the EC causes
+ *	a full system resume, independent of this flag.
  */
 enum ssam_notif_flags {
 	SSAM_NOTIF_HANDLED = BIT(0),
 	SSAM_NOTIF_STOP    = BIT(1),
+	SSAM_NOTIF_WAKEUP  = BIT(2),
 };
 
 struct ssam_event_notifier;
@@ -934,6 +1155,8 @@ enum ssam_event_notifier_flags {
 	SSAM_EVENT_NOTIFIER_OBSERVER = BIT(0),
 };
 
+struct ssam_event_coalesce;
+
 /**
  * struct ssam_event_notifier - Notifier block for SSAM events.
  * @base:        The base notifier block with callback function and priority.
@@ -943,6 +1166,21 @@ enum ssam_event_notifier_flags {
  * @event.mask:  Flags determining how events are matched to the notifier.
  * @event.flags: Flags used for enabling the event.
  * @flags:       Notifier flags (see &enum ssam_event_notifier_flags).
+ * @coalesce:    Event coalescing.
+ * @coalesce.window_ms: Coalescing window in milliseconds. If non-zero,
+ *               consecutive events with the same target category, target ID,
+ *               instance ID, and command ID received within this window after
+ *               a delivered event are collapsed, and only the latest of them
+ *               is delivered at the end of the window. The first event after
+ *               a quiet period, as well as any event not matching the
+ *               previous one, is delivered immediately. Collapsed events are
+ *               reported with the notifier status of the previously delivered
+ *               one. Events are delivered in order and never concurrently.
+ *               Zero disables coalescing.
+ * @coalesce.state: Coalescing state. Managed by the controller, must not be
+ *               accessed by the owner of the notifier.
+ * @seq:         Registration sequence number, used to order notifiers of
+ *               equal priority. Managed by the controller.
  */
 struct ssam_event_notifier {
 	struct ssam_notifier_block base;
@@ -955,6 +1193,13 @@ struct ssam_event_notifier {
 	} event;
 
 	unsigned long flags;
+
+	struct {
+		unsigned int window_ms;
+		struct ssam_event_coalesce *state;
+	} coalesce;
+
+	u32 seq;
 };
 
 int ssam_notifier_register(struct ssam_controller *ctrl,
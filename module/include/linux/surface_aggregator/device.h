@@ -165,6 +165,9 @@ enum ssam_device_flags {
  * @ctrl:  SSAM controller managing this device.
  * @uid:   UID identifying the device.
  * @flags: Device state flags, see &enum ssam_device_flags.
+ * @probe: Instrumentation of the most recent driver probe.
+ * @probe.duration: Time the driver probe callback took to complete.
+ * @probe.status:   Return value of the driver probe callback.
  */
 struct ssam_device {
 	struct device dev;
@@ -173,6 +176,11 @@ struct ssam_device {
 	struct ssam_device_uid uid;
 
 	unsigned long flags;
+
+	struct {
+		ktime_t duration;
+		int status;
+	} probe;
 };
 
 /**
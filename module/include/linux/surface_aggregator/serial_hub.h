@@ -486,6 +486,8 @@ struct ssh_packet_ops {
  *            pending lock after first submission.
  * @queue_node:	The list node for the packet queue.
  * @pending_node: The list node for the set of pending packets.
+ * @timeout_node: The list node for the set of pending packets with running
+ *            timeout, ordered by @timestamp.
  * @ops:      Packet operations.
  */
 struct ssh_packet {
@@ -504,6 +506,7 @@ struct ssh_packet {
 
 	struct list_head queue_node;
 	struct list_head pending_node;
+	struct list_head timeout_node;
 
 	const struct ssh_packet_ops *ops;
 };
@@ -566,6 +569,23 @@ enum ssh_request_flags {
 		| BIT(SSH_REQUEST_TY_HAS_RESPONSE_BIT),
 };
 
+/**
+ * enum ssh_request_prio - Priority classes of SSH requests.
+ * @SSH_REQUEST_PRIO_INTERACTIVE: Latency-sensitive requests.
+ * @SSH_REQUEST_PRIO_NORMAL:      Regular requests.
+ * @SSH_REQUEST_PRIO_BULK:        Requests that are not latency-sensitive.
+ * @SSH_REQUEST_NUM_PRIO:         Number of priority classes.
+ *
+ * Classes are ordered by decreasing priority. The request transport layer
+ * maintains one submission queue per class.
+ */
+enum ssh_request_prio {
+	SSH_REQUEST_PRIO_INTERACTIVE,
+	SSH_REQUEST_PRIO_NORMAL,
+	SSH_REQUEST_PRIO_BULK,
+	SSH_REQUEST_NUM_PRIO,
+};
+
 struct ssh_rtl;
 struct ssh_request;
 
@@ -604,6 +624,8 @@ struct ssh_request_ops {
  * struct ssh_request - SSH transport request.
  * @packet: The underlying SSH transport packet.
  * @node:   List node for the request queue and pending set.
+ * @timeout_node: List node for the set of pending requests with running
+ *          timeout, ordered by @timestamp.
  * @state:  State and type flags describing current request state (dynamic)
  *          and type (static). See &enum ssh_request_flags for possible
  *          options.
@@ -612,14 +634,29 @@ struct ssh_request_ops {
  *          completed and may be %KTIME_MAX before that, or when the request
  *          does not expect a response. Used for the request timeout
  *          implementation.
+ * @stats:  Timestamps used for latency statistics.
+ * @stats.submitted: Time at which the request has been submitted.
+ * @stats.acked:     Time at which the underlying packet has been completed.
+ * @prio:   Priority class of the request, selecting the submission queue.
+ *          See &enum ssh_request_prio.
+ * @seq:    Submission sequence number, used to order requests across
+ *          submission queues. Assigned on submission.
  * @ops:    Request Operations.
  */
 struct ssh_request {
 	struct ssh_packet packet;
 	struct list_head node;
+	struct list_head timeout_node;
 
 	unsigned long state;
 	ktime_t timestamp;
+	enum ssh_request_prio prio;
+	u32 seq;
+
+	struct {
+		ktime_t submitted;
+		ktime_t acked;
+	} stats;
 
 	const struct ssh_request_ops *ops;
 };
@@ -29,10 +29,23 @@
  *	packet. If set, the request must not have a response, meaning that this
  *	flag and the %SSAM_CDEV_REQUEST_HAS_RESPONSE flag are mutually
  *	exclusive.
+ *
+ * @SSAM_CDEV_REQUEST_PRIO_INTERACTIVE:
+ *	Specifies that the request is latency-sensitive and should be
+ *	transmitted in preference to requests of normal and bulk priority.
+ *
+ * @SSAM_CDEV_REQUEST_PRIO_BULK:
+ *	Specifies that the request is not latency-sensitive and should be
+ *	transmitted only after requests of interactive and normal priority.
+ *	This flag and the %SSAM_CDEV_REQUEST_PRIO_INTERACTIVE flag are
+ *	mutually exclusive. If neither is set, the request is of normal
+ *	priority.
  */
 enum ssam_cdev_request_flags {
-	SSAM_CDEV_REQUEST_HAS_RESPONSE = 0x01,
-	SSAM_CDEV_REQUEST_UNSEQUENCED  = 0x02,
+	SSAM_CDEV_REQUEST_HAS_RESPONSE     = 0x01,
+	SSAM_CDEV_REQUEST_UNSEQUENCED      = 0x02,
+	SSAM_CDEV_REQUEST_PRIO_INTERACTIVE = 0x04,
+	SSAM_CDEV_REQUEST_PRIO_BULK        = 0x08,
 };
 
 /**
@@ -73,6 +86,27 @@ struct ssam_cdev_request {
 	} response;
 } __attribute__((__packed__));
 
+/**
+ * struct ssam_cdev_request_batch - Batched controller request IOCTL argument.
+ * @requests: Pointer to an array of &struct ssam_cdev_request.
+ * @count:    Number of requests in the array. Must not be larger than
+ *            %SSAM_CDEV_REQUEST_BATCH_MAX.
+ * @__pad:    Padding, must be zero.
+ *
+ * Describes a set of requests to be submitted to the EC at once. All requests
+ * are queued in the request transport layer together and executed in order.
+ * Status and response length are reported individually for each request via
+ * the respective &struct ssam_cdev_request.status and
+ * &struct ssam_cdev_request.response.length fields.
+ */
+struct ssam_cdev_request_batch {
+	__u64 requests;
+	__u16 count;
+	__u8 __pad[6];
+} __attribute__((__packed__));
+
+#define SSAM_CDEV_REQUEST_BATCH_MAX	64
+
 /**
  * struct ssam_cdev_notifier_desc - Notifier descriptor.
  * @priority:        Priority value determining the order in which notifier
@@ -90,6 +124,58 @@ struct ssam_cdev_notifier_desc {
 	__u8 target_category;
 } __attribute__((__packed__));
 
+/**
+ * enum ssam_cdev_notifier_filter_flags - Flags for notifier event filters.
+ *
+ * @SSAM_CDEV_NOTIF_FILTER_TARGET:
+ *	Only pass events with a target ID contained in
+ *	&struct ssam_cdev_notifier_filter.target_id.
+ *
+ * @SSAM_CDEV_NOTIF_FILTER_INSTANCE:
+ *	Only pass events with an instance ID contained in
+ *	&struct ssam_cdev_notifier_filter.instance_id.
+ *
+ * @SSAM_CDEV_NOTIF_FILTER_COMMAND:
+ *	Only pass events with a command ID contained in
+ *	&struct ssam_cdev_notifier_filter.command_id.
+ */
+enum ssam_cdev_notifier_filter_flags {
+	SSAM_CDEV_NOTIF_FILTER_TARGET   = 0x01,
+	SSAM_CDEV_NOTIF_FILTER_INSTANCE = 0x02,
+	SSAM_CDEV_NOTIF_FILTER_COMMAND  = 0x04,
+};
+
+/**
+ * struct ssam_cdev_notifier_filter - Notifier event filter descriptor.
+ * @target_category: Target category of the registered notifier to which the
+ *                   filter should be applied.
+ * @flags:           Filter flags, specifying which of the ID sets are
+ *                   active (see &enum ssam_cdev_notifier_filter_flags).
+ * @__pad:           Padding, must be zero.
+ * @rate_limit:      Maximum number of events passed per second. Zero means
+ *                   unlimited.
+ * @target_id:       Bitmap of accepted target IDs. Bit ``n % 64`` of element
+ *                   ``n / 64`` corresponds to ID ``n``.
+ * @instance_id:     Bitmap of accepted instance IDs, in the same format.
+ * @command_id:      Bitmap of accepted command IDs, in the same format.
+ *
+ * Restricts the events forwarded to the client by the notifier of the given
+ * target category. Events not matching all active ID sets, as well as events
+ * exceeding the rate limit, are dropped before being copied to the client's
+ * event buffer. Setting a filter replaces any previously set filter of the
+ * notifier, a filter with @flags and @rate_limit set to zero passes all
+ * events. Filters are discarded when their notifier is unregistered.
+ */
+struct ssam_cdev_notifier_filter {
+	__u8 target_category;
+	__u8 flags;
+	__u8 __pad[2];
+	__u32 rate_limit;
+	__u64 target_id[4];
+	__u64 instance_id[4];
+	__u64 command_id[4];
+} __attribute__((__packed__));
+
 /**
  * struct ssam_cdev_event_desc - Event descriptor.
  * @reg:                 Registry via which the event will be enabled/disabled.
@@ -138,10 +224,67 @@ struct ssam_cdev_event {
 	__u8 data[];
 } __attribute__((__packed__));
 
+/**
+ * struct ssam_cdev_event_ring_desc - Event ring setup IOCTL argument.
+ * @size:      Size of the ring data area in bytes. Must be a power of two,
+ *             a multiple of the page size, and not larger than
+ *             %SSAM_CDEV_EVENT_RING_MAX_SIZE.
+ * @threshold: Fill level of the ring in bytes at which waiters are woken.
+ *             A value of zero is treated as one, i.e. waiters are woken as
+ *             soon as the ring becomes non-empty. Must not be larger than
+ *             @size.
+ *
+ * Switches event delivery of the client from read() to a ring buffer shared
+ * with user-space. After setup, the ring can be mapped via mmap() with an
+ * offset of zero and a length of the page size plus @size. The first page of
+ * the mapping contains the ring header (&struct ssam_cdev_event_ring), the
+ * data area starts at &struct ssam_cdev_event_ring.data_offset.
+ */
+struct ssam_cdev_event_ring_desc {
+	__u32 size;
+	__u32 threshold;
+} __attribute__((__packed__));
+
+#define SSAM_CDEV_EVENT_RING_MAX_SIZE	(1 << 20)
+
+/**
+ * struct ssam_cdev_event_ring - Header of the shared event ring.
+ * @head:        Producer index in bytes. Written by the kernel only.
+ * @tail:        Consumer index in bytes. Written by user-space only.
+ * @size:        Size of the data area in bytes.
+ * @threshold:   Fill level in bytes at which waiters are woken.
+ * @data_offset: Offset of the data area from the start of the mapping.
+ * @dropped:     Number of events dropped due to the ring being full.
+ *
+ * Both indices are free-running and have to be taken modulo @size to obtain
+ * the position in the data area. The ring is empty if they are equal. The
+ * data area contains a sequence of &struct ssam_cdev_event records, each
+ * directly followed by its payload, in the same format as returned by
+ * read(). Records are not aligned and may wrap around the end of the data
+ * area.
+ *
+ * User-space must read @head with acquire semantics before accessing the
+ * records up to it, and update @tail with release semantics after it has
+ * consumed them. poll() reports the ring as readable while its fill level is
+ * at or above @threshold. Waiters are only woken when the fill level crosses
+ * @threshold.
+ */
+struct ssam_cdev_event_ring {
+	__u32 head;
+	__u32 tail;
+	__u32 size;
+	__u32 threshold;
+	__u32 data_offset;
+	__u32 dropped;
+};
+
 #define SSAM_CDEV_REQUEST		_IOWR(0xA5, 1, struct ssam_cdev_request)
 #define SSAM_CDEV_NOTIF_REGISTER	_IOW(0xA5, 2, struct ssam_cdev_notifier_desc)
 #define SSAM_CDEV_NOTIF_UNREGISTER	_IOW(0xA5, 3, struct ssam_cdev_notifier_desc)
 #define SSAM_CDEV_EVENT_ENABLE		_IOW(0xA5, 4, struct ssam_cdev_event_desc)
 #define SSAM_CDEV_EVENT_DISABLE		_IOW(0xA5, 5, struct ssam_cdev_event_desc)
+#define SSAM_CDEV_REQUEST_BATCH		_IOW(0xA5, 6, struct ssam_cdev_request_batch)
+#define SSAM_CDEV_EVENT_RING_SETUP	_IOW(0xA5, 7, struct ssam_cdev_event_ring_desc)
+#define SSAM_CDEV_NOTIF_SET_FILTER	_IOW(0xA5, 8, struct ssam_cdev_notifier_filter)
 
 #endif /* _UAPI_LINUX_SURFACE_AGGREGATOR_CDEV_H */
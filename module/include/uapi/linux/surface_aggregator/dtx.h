@@ -98,6 +98,9 @@ struct sdtx_event {
  * @SDTX_EVENT_BASE_CONNECTION: Base/clipboard connection change event type.
  * @SDTX_EVENT_LATCH_STATUS:    Latch status change event type.
  * @SDTX_EVENT_DEVICE_MODE:     Device mode change event type.
+ * @SDTX_EVENT_OVERRUN:         Events have been lost because the reader did
+ *                              not keep up. The payload is a __u16 specifying
+ *                              the number of lost events, saturated at 0xffff.
  *
  * Used in &struct sdtx_event to describe the type of the event. Further event
  * codes are reserved for future use. Any event parser should be able to
@@ -112,6 +115,7 @@ enum sdtx_event_code {
 	SDTX_EVENT_BASE_CONNECTION	= 3,
 	SDTX_EVENT_LATCH_STATUS		= 4,
 	SDTX_EVENT_DEVICE_MODE		= 5,
+	SDTX_EVENT_OVERRUN		= 6,
 };
 
 /**
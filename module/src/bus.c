@@ -6,6 +6,7 @@
  */
 
 #include <linux/device.h>
+#include <linux/ktime.h>
 #include <linux/property.h>
 #include <linux/slab.h>
 
@@ -14,6 +15,7 @@
 
 #include "bus.h"
 #include "controller.h"
+#include "trace.h"
 
 
 /* -- Device and bus functions. --------------------------------------------- */
@@ -317,8 +319,29 @@ static int ssam_bus_match(struct device *dev, struct device_driver *drv)
 
 static int ssam_bus_probe(struct device *dev)
 {
-	return to_ssam_device_driver(dev->driver)
-		->probe(to_ssam_device(dev));
+	struct ssam_device *sdev = to_ssam_device(dev);
+	ktime_t start, duration;
+	int status;
+
+	/*
+	 * Client drivers generally prefer asynchronous probing (see
+	 * __ssam_device_driver_register()), so probes of sibling devices run
+	 * concurrently and the EC requests they issue are pipelined by the
+	 * request layer. Record the time each probe takes to be able to
+	 * figure out which devices contribute the most to boot time.
+	 */
+	start = ktime_get();
+	status = to_ssam_device_driver(dev->driver)->probe(sdev);
+	duration = ktime_sub(ktime_get(), start);
+
+	WRITE_ONCE(sdev->probe.duration, duration);
+	WRITE_ONCE(sdev->probe.status, status);
+
+	trace_ssam_device_probe(sdev, duration, status);
+	dev_dbg(dev, "probe returned %d after %lld us\n", status,
+		ktime_to_us(duration));
+
+	return status;
 }
 
 static void ssam_bus_remove(struct device *dev)
@@ -24,6 +24,17 @@
 #include "../../include/linux/surface_aggregator/controller.h"
 #include "../../include/linux/surface_acpi_notify.h"
 
+/*
+ * Deferred battery event update. Exactly one update is kept per event class
+ * (and battery), so no allocation is required when handling events.
+ */
+struct san_event_work {
+	struct delayed_work work;
+	struct device *dev;
+	u8 cid;
+	u8 iid;
+};
+
 struct san_data {
 	struct device *dev;
 	struct ssam_controller *ctrl;
@@ -32,6 +43,9 @@ struct san_data {
 
 	struct ssam_event_notifier nf_bat;
 	struct ssam_event_notifier nf_tmp;
+
+	struct san_event_work evt_adp;
+	struct san_event_work evt_bst[2];
 };
 
 #define to_san_data(ptr, member) \
@@ -176,11 +190,12 @@ enum sam_event_cid_tmp {
 	SAM_EVENT_CID_TMP_TRIP = 0x0b,
 };
 
-struct san_event_work {
-	struct delayed_work work;
-	struct device *dev;
-	struct ssam_event event;	/* must be last */
-};
+/*
+ * Coalescing window for battery and thermal events. These may arrive in
+ * bursts, e.g. during charge transitions, where relaying only the latest of
+ * a series of identical events to ACPI is sufficient.
+ */
+#define SAN_EVT_COALESCE_MS	100
 
 static int san_acpi_notify_event(struct device *dev, u64 func,
 				 union acpi_object *param)
@@ -332,32 +347,65 @@ static bool san_evt_bat(const struct ssam_event *event, struct device *dev)
 static void san_evt_bat_workfn(struct work_struct *work)
 {
 	struct san_event_work *ev;
+	struct ssam_event event = {};
 
 	ev = container_of(work, struct san_event_work, work.work);
-	san_evt_bat(&ev->event, ev->dev);
-	kfree(ev);
+
+	/* Delayed events do not depend on the event payload. */
+	event.target_category = SSAM_SSH_TC_BAT;
+	event.command_id = ev->cid;
+	event.instance_id = ev->iid;
+
+	san_evt_bat(&event, ev->dev);
+}
+
+static void san_evt_bat_work_init(struct san_event_work *ev, struct device *dev,
+				  u8 cid, u8 iid)
+{
+	INIT_DELAYED_WORK(&ev->work, san_evt_bat_workfn);
+	ev->dev = dev;
+	ev->cid = cid;
+	ev->iid = iid;
+}
+
+static void san_evt_bat_work_cancel(struct san_data *d)
+{
+	cancel_delayed_work_sync(&d->evt_adp.work);
+	cancel_delayed_work_sync(&d->evt_bst[0].work);
+	cancel_delayed_work_sync(&d->evt_bst[1].work);
+}
+
+static struct san_event_work *san_evt_bat_work(struct san_data *d,
+					       const struct ssam_event *event)
+{
+	switch (event->command_id) {
+	case SAM_EVENT_CID_BAT_ADP:
+		return &d->evt_adp;
+
+	case SAM_EVENT_CID_BAT_BST:
+		return &d->evt_bst[event->instance_id == 0x02 ? 1 : 0];
+
+	default:
+		return NULL;
+	}
 }
 
 static u32 san_evt_bat_nf(struct ssam_event_notifier *nf,
 			  const struct ssam_event *event)
 {
 	struct san_data *d = to_san_data(nf, nf_bat);
-	struct san_event_work *work;
 	unsigned long delay = san_evt_bat_delay(event->command_id);
+	struct san_event_work *work = san_evt_bat_work(d, event);
 
-	if (delay == 0)
+	if (delay == 0 || !work)
 		return san_evt_bat(event, d->dev) ? SSAM_NOTIF_HANDLED : 0;
 
-	work = kzalloc(sizeof(*work) + event->length, GFP_KERNEL);
-	if (!work)
-		return ssam_notifier_from_errno(-ENOMEM);
-
-	INIT_DELAYED_WORK(&work->work, san_evt_bat_workfn);
-	work->dev = d->dev;
-
-	work->event = *event;
-	memcpy(work->event.data, event->data, event->length);
-
+	/*
+	 * Debounce updates: If an update of this class is already scheduled,
+	 * it will cover this event as well, since the respective ACPI methods
+	 * re-query the current state. Do not postpone the pending update, to
+	 * ensure that a continuous stream of events still gets relayed.
+	 */
 	queue_delayed_work(san_wq, &work->work, delay);
 	return SSAM_NOTIF_HANDLED;
 }
@@ -463,6 +511,15 @@ enum san_gsb_request_cv {
 
 #define SAN_REQUEST_NUM_TRIES	5
 
+/*
+ * Time-to-live of cached RQST responses. Battery and thermal AML methods
+ * (e.g. DPTF participants and _BST) tend to query the same values repeatedly.
+ * Cached responses are invalidated by the controller on receiving an event
+ * of the same target category, so state changes are still picked up
+ * immediately.
+ */
+#define SAN_RQST_CACHE_MS	1000
+
 static acpi_status san_etwl(struct san_data *d, struct gsb_buffer *b)
 {
 	struct gsb_data_etwl *etwl = &b->data.etwl;
@@ -560,12 +617,33 @@ static acpi_status san_rqst_fixup_suspended(struct san_data *d,
 	return AE_OK;
 }
 
+static bool san_rqst_is_cacheable_tc(u8 tc)
+{
+	return tc == SSAM_SSH_TC_BAT || tc == SSAM_SSH_TC_TMP;
+}
+
+/*
+ * Only cache payload-less queries. Requests with payload may modify EC state
+ * and thus invalidate any cached responses of their target category.
+ */
+static unsigned int san_rqst_cache_ttl(const struct ssam_request *rqst)
+{
+	if (!san_rqst_is_cacheable_tc(rqst->target_category))
+		return 0;
+
+	if (!(rqst->flags & SSAM_REQUEST_HAS_RESPONSE) || rqst->length)
+		return 0;
+
+	return SAN_RQST_CACHE_MS;
+}
+
 static acpi_status san_rqst(struct san_data *d, struct gsb_buffer *buffer)
 {
 	u8 rspbuf[SAN_GSB_MAX_RESPONSE];
 	struct gsb_data_rqsx *gsb_rqst;
 	struct ssam_request rqst;
 	struct ssam_response rsp;
+	unsigned int ttl;
 	int status = 0;
 
 	gsb_rqst = san_validate_rqsx(d->dev, "RQST", buffer);
@@ -590,8 +668,23 @@ static acpi_status san_rqst(struct san_data *d, struct gsb_buffer *buffer)
 		return san_rqst_fixup_suspended(d, &rqst, buffer);
 	}
 
-	status = __ssam_retry(ssam_request_do_sync_onstack, SAN_REQUEST_NUM_TRIES,
-			      d->ctrl, &rqst, &rsp, SAN_GSB_MAX_RQSX_PAYLOAD);
+	/*
+	 * Coalesce concurrent identical queries into a single in-flight
+	 * request and serve repeated queries from the response cache where
+	 * possible. Both only apply to the side-effect free requests also
+	 * considered for caching.
+	 */
+	ttl = san_rqst_cache_ttl(&rqst);
+	if (ttl)
+		rqst.flags |= SSAM_REQUEST_IDEMPOTENT;
+
+	status = __ssam_retry(ssam_request_do_sync_cached_onstack,
+			      SAN_REQUEST_NUM_TRIES, d->ctrl, &rqst, &rsp,
+			      SAN_GSB_MAX_RQSX_PAYLOAD, ttl);
+
+	/* Any other request may have changed the cached state. */
+	if (!ttl && san_rqst_is_cacheable_tc(rqst.target_category))
+		ssam_request_cache_invalidate(d->ctrl, rqst.target_category);
 
 	if (!status) {
 		gsb_rqsx_response_success(buffer, rsp.pointer, rsp.length);
@@ -687,6 +780,7 @@ static int san_events_register(struct platform_device *pdev)
 	d->nf_bat.event.id.instance = 0;
 	d->nf_bat.event.mask = SSAM_EVENT_MASK_TARGET;
 	d->nf_bat.event.flags = SSAM_EVENT_SEQUENCED;
+	d->nf_bat.coalesce.window_ms = SAN_EVT_COALESCE_MS;
 
 	d->nf_tmp.base.priority = 1;
 	d->nf_tmp.base.fn = san_evt_tmp_nf;
@@ -695,6 +789,7 @@ static int san_events_register(struct platform_device *pdev)
 	d->nf_tmp.event.id.instance = 0;
 	d->nf_tmp.event.mask = SSAM_EVENT_MASK_TARGET;
 	d->nf_tmp.event.flags = SSAM_EVENT_SEQUENCED;
+	d->nf_tmp.coalesce.window_ms = SAN_EVT_COALESCE_MS;
 
 	status = ssam_notifier_register(d->ctrl, &d->nf_bat);
 	if (status)
@@ -822,6 +917,10 @@ static int san_probe(struct platform_device *pdev)
 	data->dev = &pdev->dev;
 	data->ctrl = ctrl;
 
+	san_evt_bat_work_init(&data->evt_adp, data->dev, SAM_EVENT_CID_BAT_ADP, 0x01);
+	san_evt_bat_work_init(&data->evt_bst[0], data->dev, SAM_EVENT_CID_BAT_BST, 0x01);
+	san_evt_bat_work_init(&data->evt_bst[1], data->dev, SAM_EVENT_CID_BAT_BST, 0x02);
+
 	platform_set_drvdata(pdev, data);
 
 	astatus = acpi_install_address_space_handler(san->handle,
@@ -844,6 +943,8 @@ static int san_probe(struct platform_device *pdev)
 
 err_install_dev:
 	san_events_unregister(pdev);
+	san_evt_bat_work_cancel(data);
+	flush_workqueue(san_wq);
 err_enable_events:
 	acpi_remove_address_space_handler(san, ACPI_ADR_SPACE_GSBUS,
 					  &san_opreg_handler);
@@ -852,6 +953,7 @@ err_enable_events:
 
 static int san_remove(struct platform_device *pdev)
 {
+	struct san_data *data = platform_get_drvdata(pdev);
 	acpi_handle san = ACPI_HANDLE(&pdev->dev);
 
 	san_set_rqsg_interface_device(NULL);
@@ -861,8 +963,12 @@ static int san_remove(struct platform_device *pdev)
 
 	/*
 	 * We have unregistered our event sources. Now we need to ensure that
-	 * all delayed works they may have spawned are run to completion.
+	 * all delayed works they may have spawned are cancelled or run to
+	 * completion. Note that flushing the workqueue does not wait for
+	 * delayed works whose timer has not yet expired, and these live in
+	 * our (device managed) driver data.
 	 */
+	san_evt_bat_work_cancel(data);
 	flush_workqueue(san_wq);
 
 	return 0;
@@ -6,17 +6,23 @@
  * Copyright (C) 2020-2022 Maximilian Luz <luzmaximilian@gmail.com>
  */
 
+#include <linux/atomic.h>
+#include <linux/completion.h>
 #include <linux/fs.h>
 #include <linux/ioctl.h>
+#include <linux/jiffies.h>
 #include <linux/kernel.h>
 #include <linux/kfifo.h>
 #include <linux/kref.h>
+#include <linux/log2.h>
 #include <linux/miscdevice.h>
+#include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/platform_device.h>
 #include <linux/poll.h>
 #include <linux/rwsem.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/uaccess.h>
 #include <linux/vmalloc.h>
 
@@ -48,9 +54,31 @@ struct ssam_cdev {
 
 struct ssam_cdev_client;
 
+struct ssam_cdev_filter {
+	u8 flags;
+	u32 rate_limit;
+	u64 tid[4];
+	u64 iid[4];
+	u64 cid[4];
+
+	unsigned long window;	/* Start of the current rate limit window */
+	u32 count;		/* Events passed in the current window */
+};
+
 struct ssam_cdev_notifier {
 	struct ssam_cdev_client *client;
 	struct ssam_event_notifier nf;
+
+	spinlock_t filter_lock;		/* Guards filter */
+	struct ssam_cdev_filter filter;
+};
+
+struct ssam_cdev_ring {
+	struct ssam_cdev_event_ring *hdr;	/* Shared with user-space */
+	u8 *data;
+	u32 head;
+	u32 size;
+	u32 threshold;
 };
 
 struct ssam_cdev_client {
@@ -63,6 +91,7 @@ struct ssam_cdev_client {
 	struct mutex read_lock;		/* Guards FIFO buffer read access */
 	struct mutex write_lock;	/* Guards FIFO buffer write access */
 	DECLARE_KFIFO(buffer, u8, 4096);
+	struct ssam_cdev_ring *ring;	/* Replaces FIFO buffer if set */
 
 	wait_queue_head_t waitq;
 	struct fasync_struct *fasync;
@@ -88,14 +117,151 @@ static void ssam_cdev_put(struct ssam_cdev *cdev)
 }
 
 
+/* -- Shared event ring. --------------------------------------------------- */
+
+static u32 ssam_cdev_ring_fill(struct ssam_cdev_ring *ring)
+{
+	u32 fill = READ_ONCE(ring->head) - smp_load_acquire(&ring->hdr->tail);
+
+	/* User-space may have corrupted the tail index. Treat ring as full. */
+	return min(fill, ring->size);
+}
+
+static void ssam_cdev_ring_write(struct ssam_cdev_ring *ring, u32 pos, const void *src,
+				 size_t len)
+{
+	u32 off = pos & (ring->size - 1);
+	size_t n = min_t(size_t, len, ring->size - off);
+
+	memcpy(ring->data + off, src, n);
+	memcpy(ring->data, src + n, len - n);
+}
+
+/*
+ * Push the given event to the shared ring. Returns true if the ring fill
+ * level has crossed the wakeup threshold, i.e. waiters need to be notified.
+ * Must be called with the client's write_lock held.
+ */
+static bool ssam_cdev_ring_push(struct ssam_cdev_client *client,
+				const struct ssam_cdev_event *event, const struct ssam_event *in)
+{
+	struct ssam_cdev_ring *ring = client->ring;
+	size_t hlen = struct_size(event, data, 0);
+	u32 fill = ssam_cdev_ring_fill(ring);
+
+	lockdep_assert_held(&client->write_lock);
+
+	if (ring->size - fill < hlen + in->length) {
+		WRITE_ONCE(ring->hdr->dropped, ring->hdr->dropped + 1);
+		dev_warn_ratelimited(client->cdev->dev,
+				     "ring full, dropping event (tc: %#04x, tid: %#04x, cid: %#04x, iid: %#04x)\n",
+				     in->target_category, in->target_id, in->command_id,
+				     in->instance_id);
+		return false;
+	}
+
+	ssam_cdev_ring_write(ring, ring->head, event, hlen);
+	ssam_cdev_ring_write(ring, ring->head + hlen, &in->data[0], in->length);
+
+	/* Publish the record to user-space. */
+	WRITE_ONCE(ring->head, ring->head + hlen + in->length);
+	smp_store_release(&ring->hdr->head, ring->head);
+
+	return fill < ring->threshold && fill + hlen + in->length >= ring->threshold;
+}
+
+static struct ssam_cdev_ring *ssam_cdev_ring_alloc(u32 size, u32 threshold)
+{
+	struct ssam_cdev_ring *ring;
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (!ring)
+		return NULL;
+
+	ring->hdr = vmalloc_user(PAGE_SIZE + size);
+	if (!ring->hdr) {
+		kfree(ring);
+		return NULL;
+	}
+
+	ring->data = (u8 *)ring->hdr + PAGE_SIZE;
+	ring->size = size;
+	ring->threshold = max_t(u32, threshold, 1);
+
+	ring->hdr->size = ring->size;
+	ring->hdr->threshold = ring->threshold;
+	ring->hdr->data_offset = PAGE_SIZE;
+
+	return ring;
+}
+
+static void ssam_cdev_ring_free(struct ssam_cdev_ring *ring)
+{
+	if (!ring)
+		return;
+
+	vfree(ring->hdr);
+	kfree(ring);
+}
+
+
 /* -- Notifier handling. ---------------------------------------------------- */
 
+static bool ssam_cdev_filter_test(const u64 *set, u8 value)
+{
+	return set[value / 64] & BIT_ULL(value % 64);
+}
+
+static bool ssam_cdev_filter_match(struct ssam_cdev_notifier *cdev_nf,
+				   const struct ssam_event *in)
+{
+	struct ssam_cdev_filter *f = &cdev_nf->filter;
+	bool match = false;
+
+	spin_lock(&cdev_nf->filter_lock);
+
+	if ((f->flags & SSAM_CDEV_NOTIF_FILTER_TARGET) &&
+	    !ssam_cdev_filter_test(f->tid, in->target_id))
+		goto out;
+
+	if ((f->flags & SSAM_CDEV_NOTIF_FILTER_INSTANCE) &&
+	    !ssam_cdev_filter_test(f->iid, in->instance_id))
+		goto out;
+
+	if ((f->flags & SSAM_CDEV_NOTIF_FILTER_COMMAND) &&
+	    !ssam_cdev_filter_test(f->cid, in->command_id))
+		goto out;
+
+	/* Apply rate limit over fixed windows of one second. */
+	if (f->rate_limit) {
+		if (time_after(jiffies, f->window + HZ)) {
+			f->window = jiffies;
+			f->count = 0;
+		}
+
+		if (f->count >= f->rate_limit)
+			goto out;
+
+		f->count++;
+	}
+
+	match = true;
+out:
+	spin_unlock(&cdev_nf->filter_lock);
+	return match;
+}
+
 static u32 ssam_cdev_notifier(struct ssam_event_notifier *nf, const struct ssam_event *in)
 {
 	struct ssam_cdev_notifier *cdev_nf = container_of(nf, struct ssam_cdev_notifier, nf);
 	struct ssam_cdev_client *client = cdev_nf->client;
 	struct ssam_cdev_event event;
 	size_t n = struct_size(&event, data, in->length);
+	bool wake;
+
+	/* Drop filtered events before doing any copying. */
+	if (!ssam_cdev_filter_match(cdev_nf, in))
+		return 0;
 
 	/* Translate event. */
 	event.target_category = in->target_category;
@@ -106,6 +272,19 @@ static u32 ssam_cdev_notifier(struct ssam_event_notifier *nf, const struct ssam_
 
 	mutex_lock(&client->write_lock);
 
+	/* Use the shared ring buffer, if it has been set up. */
+	if (client->ring) {
+		wake = ssam_cdev_ring_push(client, &event, in);
+		mutex_unlock(&client->write_lock);
+
+		if (wake) {
+			kill_fasync(&client->fasync, SIGIO, POLL_IN);
+			wake_up_interruptible(&client->waitq);
+		}
+
+		return 0;
+	}
+
 	/* Make sure we have enough space. */
 	if (kfifo_avail(&client->buffer) < n) {
 		dev_warn(client->cdev->dev,
@@ -167,6 +346,7 @@ static int ssam_cdev_notifier_register(struct ssam_cdev_client *client, u8 tc, i
 	 * registration, which does not enable the corresponding event.
 	 */
 	nf->client = client;
+	spin_lock_init(&nf->filter_lock);
 	nf->nf.base.fn = ssam_cdev_notifier;
 	nf->nf.base.priority = priority;
 	nf->nf.event.id.target_category = tc;
@@ -213,6 +393,44 @@ static int ssam_cdev_notifier_unregister(struct ssam_cdev_client *client, u8 tc)
 	return status;
 }
 
+static int ssam_cdev_notifier_set_filter(struct ssam_cdev_client *client,
+					 const struct ssam_cdev_notifier_filter *desc)
+{
+	const u16 rqid = ssh_tc_to_rqid(desc->target_category);
+	const u16 event = ssh_rqid_to_event(rqid);
+	struct ssam_cdev_notifier *nf;
+
+	lockdep_assert_held_read(&client->cdev->lock);
+
+	/* Validate notifier target category. */
+	if (!ssh_rqid_is_event(rqid))
+		return -EINVAL;
+
+	mutex_lock(&client->notifier_lock);
+
+	/* Check if the notifier is currently registered. */
+	nf = client->notifier[event];
+	if (!nf) {
+		mutex_unlock(&client->notifier_lock);
+		return -ENOENT;
+	}
+
+	spin_lock(&nf->filter_lock);
+
+	nf->filter.flags = desc->flags;
+	nf->filter.rate_limit = desc->rate_limit;
+	memcpy(nf->filter.tid, desc->target_id, sizeof(nf->filter.tid));
+	memcpy(nf->filter.iid, desc->instance_id, sizeof(nf->filter.iid));
+	memcpy(nf->filter.cid, desc->command_id, sizeof(nf->filter.cid));
+	nf->filter.window = jiffies;
+	nf->filter.count = 0;
+
+	spin_unlock(&nf->filter_lock);
+
+	mutex_unlock(&client->notifier_lock);
+	return 0;
+}
+
 static void ssam_cdev_notifier_unregister_all(struct ssam_cdev_client *client)
 {
 	int i;
@@ -285,6 +503,12 @@ static long ssam_cdev_request(struct ssam_cdev_client *client, struct ssam_cdev_
 	if (rqst.flags & SSAM_CDEV_REQUEST_UNSEQUENCED)
 		spec.flags |= SSAM_REQUEST_UNSEQUENCED;
 
+	if (rqst.flags & SSAM_CDEV_REQUEST_PRIO_INTERACTIVE)
+		spec.flags |= SSAM_REQUEST_PRIO_INTERACTIVE;
+
+	if (rqst.flags & SSAM_CDEV_REQUEST_PRIO_BULK)
+		spec.flags |= SSAM_REQUEST_PRIO_BULK;
+
 	rsp.capacity = rqst.response.length;
 	rsp.length = 0;
 	rsp.pointer = NULL;
@@ -367,6 +591,227 @@ out:
 	return ret;
 }
 
+struct ssam_cdev_batch {
+	atomic_t pending;
+	struct completion comp;
+};
+
+struct ssam_cdev_batch_entry {
+	struct ssam_request_async rqst;
+	struct ssam_cdev_batch *batch;
+	struct ssam_response rsp;
+	void __user *rspdata;
+	u8 *msgbuf;
+	int status;
+};
+
+static void ssam_cdev_batch_complete(struct ssam_request_async *rqst, int status)
+{
+	struct ssam_cdev_batch_entry *e;
+	struct ssam_cdev_batch *batch;
+
+	e = container_of(rqst, struct ssam_cdev_batch_entry, rqst);
+	batch = e->batch;
+
+	e->status = status;
+
+	if (atomic_dec_and_test(&batch->pending))
+		complete(&batch->comp);
+}
+
+static int ssam_cdev_batch_entry_setup(struct ssam_cdev_client *client,
+				       struct ssam_cdev_batch_entry *e,
+				       const struct ssam_cdev_request *r)
+{
+	const void __user *plddata = u64_to_user_ptr(r->payload.data);
+	struct ssam_request spec = {};
+	struct ssam_span buf;
+	void *payload = NULL;
+	ssize_t len;
+	int status;
+
+	/* Setup basic request fields. */
+	spec.target_category = r->target_category;
+	spec.target_id = r->target_id;
+	spec.command_id = r->command_id;
+	spec.instance_id = r->instance_id;
+	spec.flags = 0;
+	spec.length = r->payload.length;
+	spec.payload = NULL;
+
+	if (r->flags & SSAM_CDEV_REQUEST_HAS_RESPONSE)
+		spec.flags |= SSAM_REQUEST_HAS_RESPONSE;
+
+	if (r->flags & SSAM_CDEV_REQUEST_UNSEQUENCED)
+		spec.flags |= SSAM_REQUEST_UNSEQUENCED;
+
+	if (r->flags & SSAM_CDEV_REQUEST_PRIO_INTERACTIVE)
+		spec.flags |= SSAM_REQUEST_PRIO_INTERACTIVE;
+
+	if (r->flags & SSAM_CDEV_REQUEST_PRIO_BULK)
+		spec.flags |= SSAM_REQUEST_PRIO_BULK;
+
+	e->rspdata = u64_to_user_ptr(r->response.data);
+	e->rsp.capacity = r->response.length;
+	e->rsp.length = 0;
+	e->rsp.pointer = NULL;
+
+	if (spec.length > SSH_COMMAND_MAX_PAYLOAD_SIZE)
+		return -EINVAL;
+
+	if (spec.length && !plddata)
+		return -EINVAL;
+
+	if (e->rsp.capacity && !e->rspdata)
+		return -EINVAL;
+
+	status = ssam_request_async_init(&e->rqst, spec.flags, ssam_cdev_batch_complete);
+	if (status)
+		return status;
+
+	/* Get request payload from user-space. */
+	if (spec.length) {
+		payload = memdup_user(plddata, spec.length);
+		if (IS_ERR(payload))
+			return PTR_ERR(payload);
+
+		spec.payload = payload;
+	}
+
+	/*
+	 * Allocate response buffer. See ssam_cdev_request() for notes on its
+	 * size.
+	 */
+	if (e->rsp.capacity) {
+		e->rsp.pointer = kzalloc(e->rsp.capacity, GFP_KERNEL);
+		if (!e->rsp.pointer) {
+			status = -ENOMEM;
+			goto out;
+		}
+	}
+
+	/* Allocate and write message buffer. */
+	buf.len = SSH_COMMAND_MESSAGE_LENGTH(spec.length);
+	buf.ptr = kzalloc(buf.len, GFP_KERNEL);
+	if (!buf.ptr) {
+		status = -ENOMEM;
+		goto out;
+	}
+
+	e->msgbuf = buf.ptr;
+
+	len = ssam_request_write_data(&buf, client->cdev->ctrl, &spec);
+	if (len < 0) {
+		status = len;
+		goto out;
+	}
+
+	ssam_request_async_set_data(&e->rqst, buf.ptr, len);
+	ssam_request_async_set_resp(&e->rqst, &e->rsp);
+	status = 0;
+
+out:
+	kfree(payload);
+	return status;
+}
+
+static long ssam_cdev_request_batch(struct ssam_cdev_client *client,
+				    const struct ssam_cdev_request_batch __user *b)
+{
+	struct ssam_cdev_request __user *reqs;
+	struct ssam_cdev_batch_entry *entries;
+	struct ssam_cdev_request_batch desc;
+	struct ssam_cdev_batch batch;
+	struct ssam_cdev_request r;
+	int status, i;
+	long ret = 0;
+
+	lockdep_assert_held_read(&client->cdev->lock);
+
+	ret = copy_struct_from_user(&desc, sizeof(desc), b, sizeof(*b));
+	if (ret)
+		return ret;
+
+	if (memchr_inv(desc.__pad, 0, sizeof(desc.__pad)))
+		return -EINVAL;
+
+	if (desc.count > SSAM_CDEV_REQUEST_BATCH_MAX)
+		return -EINVAL;
+
+	if (!desc.count)
+		return 0;
+
+	reqs = u64_to_user_ptr(desc.requests);
+
+	entries = kcalloc(desc.count, sizeof(*entries), GFP_KERNEL);
+	if (!entries)
+		return -ENOMEM;
+
+	/*
+	 * Set up all requests before submitting any of them. Errors specific
+	 * to a single request are reported via its status field, failing to
+	 * access the request array itself aborts the whole batch.
+	 */
+	for (i = 0; i < desc.count; i++) {
+		if (copy_from_user(&r, &reqs[i], sizeof(r))) {
+			ret = -EFAULT;
+			goto out;
+		}
+
+		entries[i].batch = &batch;
+		entries[i].status = ssam_cdev_batch_entry_setup(client, &entries[i], &r);
+	}
+
+	/*
+	 * Submit all requests at once. The request transport layer limits the
+	 * number of requests in flight, so we can simply queue everything
+	 * here. Use a bias of one on the pending counter to avoid completing
+	 * the batch before all requests have been submitted.
+	 */
+	atomic_set(&batch.pending, 1);
+	init_completion(&batch.comp);
+
+	for (i = 0; i < desc.count; i++) {
+		if (entries[i].status)
+			continue;
+
+		atomic_inc(&batch.pending);
+
+		status = ssam_request_async_submit(client->cdev->ctrl, &entries[i].rqst);
+		if (status) {
+			entries[i].status = status;
+			atomic_dec(&batch.pending);
+		}
+	}
+
+	if (!atomic_dec_and_test(&batch.pending))
+		wait_for_completion(&batch.comp);
+
+	/* Copy responses and status to user-space. */
+	for (i = 0; i < desc.count; i++) {
+		struct ssam_cdev_batch_entry *e = &entries[i];
+
+		if (!e->status && e->rsp.length &&
+		    copy_to_user(e->rspdata, e->rsp.pointer, e->rsp.length))
+			ret = -EFAULT;
+
+		if (put_user(e->rsp.length, &reqs[i].response.length))
+			ret = -EFAULT;
+
+		if (put_user(e->status, &reqs[i].status))
+			ret = -EFAULT;
+	}
+
+out:
+	for (i = 0; i < desc.count; i++) {
+		kfree(entries[i].msgbuf);
+		kfree(entries[i].rsp.pointer);
+	}
+
+	kfree(entries);
+	return ret;
+}
+
 static long ssam_cdev_notif_register(struct ssam_cdev_client *client,
 				     const struct ssam_cdev_notifier_desc __user *d)
 {
@@ -397,6 +842,28 @@ static long ssam_cdev_notif_unregister(struct ssam_cdev_client *client,
 	return ssam_cdev_notifier_unregister(client, desc.target_category);
 }
 
+static long ssam_cdev_notif_set_filter(struct ssam_cdev_client *client,
+				       const struct ssam_cdev_notifier_filter __user *d)
+{
+	struct ssam_cdev_notifier_filter desc;
+	long ret;
+
+	lockdep_assert_held_read(&client->cdev->lock);
+
+	ret = copy_struct_from_user(&desc, sizeof(desc), d, sizeof(*d));
+	if (ret)
+		return ret;
+
+	if (desc.flags & ~(SSAM_CDEV_NOTIF_FILTER_TARGET | SSAM_CDEV_NOTIF_FILTER_INSTANCE |
+			   SSAM_CDEV_NOTIF_FILTER_COMMAND))
+		return -EINVAL;
+
+	if (memchr_inv(desc.__pad, 0, sizeof(desc.__pad)))
+		return -EINVAL;
+
+	return ssam_cdev_notifier_set_filter(client, &desc);
+}
+
 static long ssam_cdev_event_enable(struct ssam_cdev_client *client,
 				   const struct ssam_cdev_event_desc __user *d)
 {
@@ -453,6 +920,45 @@ static long ssam_cdev_event_disable(struct ssam_cdev_client *client,
 	return ssam_controller_event_disable(client->cdev->ctrl, reg, id, desc.flags);
 }
 
+static long ssam_cdev_event_ring_setup(struct ssam_cdev_client *client,
+				       const struct ssam_cdev_event_ring_desc __user *d)
+{
+	struct ssam_cdev_event_ring_desc desc;
+	struct ssam_cdev_ring *ring;
+	long ret;
+
+	lockdep_assert_held_read(&client->cdev->lock);
+
+	/* Read descriptor from user-space. */
+	ret = copy_struct_from_user(&desc, sizeof(desc), d, sizeof(*d));
+	if (ret)
+		return ret;
+
+	if (!is_power_of_2(desc.size) || desc.size < PAGE_SIZE)
+		return -EINVAL;
+
+	if (desc.size > SSAM_CDEV_EVENT_RING_MAX_SIZE || desc.threshold > desc.size)
+		return -EINVAL;
+
+	ring = ssam_cdev_ring_alloc(desc.size, desc.threshold);
+	if (!ring)
+		return -ENOMEM;
+
+	/* Each client can set up its ring only once. */
+	mutex_lock(&client->write_lock);
+	if (client->ring) {
+		mutex_unlock(&client->write_lock);
+		ssam_cdev_ring_free(ring);
+		return -EBUSY;
+	}
+	smp_store_release(&client->ring, ring);
+	mutex_unlock(&client->write_lock);
+
+	/* Wake up readers blocked on the FIFO so they can bail out. */
+	wake_up_interruptible(&client->waitq);
+	return 0;
+}
+
 
 /* -- File operations. ------------------------------------------------------ */
 
@@ -518,6 +1024,7 @@ static int ssam_cdev_device_release(struct inode *inode, struct file *filp)
 
 	mutex_destroy(&client->notifier_lock);
 
+	ssam_cdev_ring_free(client->ring);
 	ssam_cdev_put(client->cdev);
 	vfree(client);
 
@@ -547,6 +1054,18 @@ static long __ssam_cdev_device_ioctl(struct ssam_cdev_client *client, unsigned i
 	case SSAM_CDEV_EVENT_DISABLE:
 		return ssam_cdev_event_disable(client, (struct ssam_cdev_event_desc __user *)arg);
 
+	case SSAM_CDEV_REQUEST_BATCH:
+		return ssam_cdev_request_batch(client,
+					       (struct ssam_cdev_request_batch __user *)arg);
+
+	case SSAM_CDEV_NOTIF_SET_FILTER:
+		return ssam_cdev_notif_set_filter(client,
+						  (struct ssam_cdev_notifier_filter __user *)arg);
+
+	case SSAM_CDEV_EVENT_RING_SETUP:
+		return ssam_cdev_event_ring_setup(client,
+						  (struct ssam_cdev_event_ring_desc __user *)arg);
+
 	default:
 		return -ENOTTY;
 	}
@@ -589,6 +1108,12 @@ static ssize_t ssam_cdev_read(struct file *file, char __user *buf, size_t count,
 	}
 
 	do {
+		/* Events are delivered via the shared ring, if set up. */
+		if (smp_load_acquire(&client->ring)) {
+			up_read(&cdev->lock);
+			return -EBUSY;
+		}
+
 		/* Check availability, wait if necessary. */
 		if (kfifo_is_empty(&client->buffer)) {
 			up_read(&cdev->lock);
@@ -598,6 +1123,7 @@ static ssize_t ssam_cdev_read(struct file *file, char __user *buf, size_t count,
 
 			status = wait_event_interruptible(client->waitq,
 							  !kfifo_is_empty(&client->buffer) ||
+							  smp_load_acquire(&client->ring) ||
 							  test_bit(SSAM_CDEV_DEVICE_SHUTDOWN_BIT,
 								   &cdev->flags));
 			if (status < 0)
@@ -611,6 +1137,11 @@ static ssize_t ssam_cdev_read(struct file *file, char __user *buf, size_t count,
 				up_read(&cdev->lock);
 				return -ENODEV;
 			}
+
+			if (smp_load_acquire(&client->ring)) {
+				up_read(&cdev->lock);
+				return -EBUSY;
+			}
 		}
 
 		/* Try to read from FIFO. */
@@ -641,6 +1172,7 @@ static ssize_t ssam_cdev_read(struct file *file, char __user *buf, size_t count,
 static __poll_t ssam_cdev_poll(struct file *file, struct poll_table_struct *pt)
 {
 	struct ssam_cdev_client *client = file->private_data;
+	struct ssam_cdev_ring *ring;
 	__poll_t events = 0;
 
 	if (test_bit(SSAM_CDEV_DEVICE_SHUTDOWN_BIT, &client->cdev->flags))
@@ -648,12 +1180,33 @@ static __poll_t ssam_cdev_poll(struct file *file, struct poll_table_struct *pt)
 
 	poll_wait(file, &client->waitq, pt);
 
-	if (!kfifo_is_empty(&client->buffer))
+	ring = smp_load_acquire(&client->ring);
+	if (ring) {
+		if (ssam_cdev_ring_fill(ring) >= ring->threshold)
+			events |= EPOLLIN | EPOLLRDNORM;
+	} else if (!kfifo_is_empty(&client->buffer)) {
 		events |= EPOLLIN | EPOLLRDNORM;
+	}
 
 	return events;
 }
 
+static int ssam_cdev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct ssam_cdev_client *client = file->private_data;
+	struct ssam_cdev_ring *ring;
+
+	/* The ring, once set up, stays valid until the file is released. */
+	ring = smp_load_acquire(&client->ring);
+	if (!ring)
+		return -EINVAL;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE + ring->size)
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, ring->hdr, 0);
+}
+
 static int ssam_cdev_fasync(int fd, struct file *file, int on)
 {
 	struct ssam_cdev_client *client = file->private_data;
@@ -667,6 +1220,7 @@ static const struct file_operations ssam_controller_fops = {
 	.release        = ssam_cdev_device_release,
 	.read           = ssam_cdev_read,
 	.poll           = ssam_cdev_poll,
+	.mmap           = ssam_cdev_mmap,
 	.fasync         = ssam_cdev_fasync,
 	.unlocked_ioctl = ssam_cdev_device_ioctl,
 	.compat_ioctl   = ssam_cdev_device_ioctl,
@@ -10,6 +10,7 @@
  */
 
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/limits.h>
 #include <linux/module.h>
 #include <linux/types.h>
@@ -44,6 +45,7 @@ struct ssam_hub {
 
 	struct delayed_work update_work;
 	unsigned long connect_delay;
+	ktime_t resumed;
 
 	struct ssam_event_notifier notif;
 	struct ssam_hub_ops ops;
@@ -64,15 +66,22 @@ struct ssam_hub_desc {
 	unsigned long connect_delay_ms;
 };
 
-static void ssam_hub_update_workfn(struct work_struct *work)
+/*
+ * Note: The hub state is only ever queried on probe, in response to events,
+ * on resume, or after the connect delay following a missed disconnect. The
+ * controller response cache would either never be hit (events of the hub's
+ * target category as well as resuming the controller drop cached responses)
+ * or, in the last case, defeat the purpose of re-checking the state. Thus the
+ * state queries do not opt into it.
+ */
+static int ssam_hub_update_state(struct ssam_hub *hub)
 {
-	struct ssam_hub *hub = container_of(work, struct ssam_hub, update_work.work);
 	enum ssam_hub_state state;
 	int status = 0;
 
 	status = hub->ops.get_state(hub, &state);
 	if (status)
-		return;
+		return status;
 
 	/*
 	 * There is a small possibility that hub devices were hot-removed and
@@ -102,7 +111,7 @@ static void ssam_hub_update_workfn(struct work_struct *work)
 	}
 
 	if (hub->state == state)
-		return;
+		return 0;
 	hub->state = state;
 
 	if (hub->state == SSAM_HUB_CONNECTED)
@@ -112,6 +121,25 @@ static void ssam_hub_update_workfn(struct work_struct *work)
 
 	if (status)
 		dev_err(&hub->sdev->dev, "failed to update hub child devices: %d\n", status);
+
+	return status;
+}
+
+static void ssam_hub_update_workfn(struct work_struct *work)
+{
+	struct ssam_hub *hub = container_of(work, struct ssam_hub, update_work.work);
+	ktime_t resumed = READ_ONCE(hub->resumed);
+	int status;
+
+	if (resumed)
+		WRITE_ONCE(hub->resumed, 0);
+
+	status = ssam_hub_update_state(hub);
+
+	/* Report the time from resume until the hub state has been updated. */
+	if (resumed)
+		ssam_controller_pm_record_client(hub->sdev->ctrl, &hub->sdev->dev,
+						 resumed, status);
 }
 
 static int ssam_hub_mark_hot_removed(struct device *dev, void *_data)
@@ -147,6 +175,7 @@ static int __maybe_unused ssam_hub_resume(struct device *dev)
 {
 	struct ssam_hub *hub = dev_get_drvdata(dev);
 
+	WRITE_ONCE(hub->resumed, ktime_get_boottime());
 	schedule_delayed_work(&hub->update_work, 0);
 	return 0;
 }
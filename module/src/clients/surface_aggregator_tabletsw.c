@@ -40,6 +40,15 @@ struct ssam_tablet_sw {
 	struct work_struct update_work;
 	struct input_dev *mode_switch;
 
+	/*
+	 * Cached posture source, only used by the POS switch. Accessed only
+	 * via ops.get_state(), which is serialized by the update work.
+	 */
+	struct {
+		bool valid;
+		u32 id;
+	} source;
+
 	struct ssam_tablet_sw_ops ops;
 	struct ssam_event_notifier notif;
 };
@@ -85,6 +94,13 @@ static const struct attribute_group ssam_tablet_sw_group = {
 	.attrs = ssam_tablet_sw_attrs,
 };
 
+/*
+ * Note: The state of the switch is only ever queried on probe, in response to
+ * events, or on resume, and then kept in struct ssam_tablet_sw. The controller
+ * response cache could never serve these queries: Any event of the switch's
+ * target category drops cached responses of that category, and so does
+ * resuming the controller. Thus the requests below do not opt into it.
+ */
 static void ssam_tablet_sw_update_workfn(struct work_struct *work)
 {
 	struct ssam_tablet_sw *sw = container_of(work, struct ssam_tablet_sw, update_work);
@@ -510,11 +526,21 @@ static int ssam_pos_get_sources_list(struct ssam_tablet_sw *sw, struct ssam_sour
 	return 0;
 }
 
+/*
+ * The list of posture sources is static for a given firmware and hub
+ * configuration. Both of these cannot change without the device being
+ * re-created, so we only fetch the list once and cache the source ID.
+ */
 static int ssam_pos_get_source(struct ssam_tablet_sw *sw, u32 *source_id)
 {
 	struct ssam_sources_list sources = {};
 	int status;
 
+	if (sw->source.valid) {
+		*source_id = sw->source.id;
+		return 0;
+	}
+
 	status = ssam_pos_get_sources_list(sw, &sources);
 	if (status)
 		return status;
@@ -534,6 +560,9 @@ static int ssam_pos_get_source(struct ssam_tablet_sw *sw, u32 *source_id)
 	WARN_ON(get_unaligned_le32(&sources.count) > 1);
 
 	*source_id = get_unaligned_le32(&sources.id[0]);
+
+	sw->source.id = *source_id;
+	sw->source.valid = true;
 	return 0;
 }
 
@@ -542,6 +571,7 @@ SSAM_DEFINE_SYNC_REQUEST_WR(__ssam_pos_get_posture_for_source, __le32, __le32, {
 	.target_id       = SSAM_SSH_TID_SAM,
 	.command_id      = 0x02,
 	.instance_id     = 0x00,
+	.flags           = SSAM_REQUEST_IDEMPOTENT,
 });
 
 static int ssam_pos_get_posture_for_source(struct ssam_tablet_sw *sw, u32 source_id, u32 *posture)
@@ -559,7 +589,7 @@ static int ssam_pos_get_posture_for_source(struct ssam_tablet_sw *sw, u32 source
 	return 0;
 }
 
-static int ssam_pos_get_posture(struct ssam_tablet_sw *sw, struct ssam_tablet_sw_state *state)
+static int __ssam_pos_get_posture(struct ssam_tablet_sw *sw, struct ssam_tablet_sw_state *state)
 {
 	u32 source_id;
 	u32 source_state;
@@ -583,6 +613,25 @@ static int ssam_pos_get_posture(struct ssam_tablet_sw *sw, struct ssam_tablet_sw
 	return 0;
 }
 
+static int ssam_pos_get_posture(struct ssam_tablet_sw *sw, struct ssam_tablet_sw_state *state)
+{
+	bool cached = sw->source.valid;
+	int status;
+
+	status = __ssam_pos_get_posture(sw, state);
+	if (!status || !cached)
+		return status;
+
+	/*
+	 * We should not get here, but in case the posture sources have changed
+	 * after all, re-fetch them and try again.
+	 */
+	dev_warn(&sw->sdev->dev, "retrying posture query with updated source list\n");
+
+	sw->source.valid = false;
+	return __ssam_pos_get_posture(sw, state);
+}
+
 static u32 ssam_pos_sw_notif(struct ssam_event_notifier *nf, const struct ssam_event *event)
 {
 	struct ssam_tablet_sw *sw = container_of(nf, struct ssam_tablet_sw, notif);
@@ -7,11 +7,16 @@
  */
 
 #include <asm/unaligned.h>
+#include <linux/devm-helpers.h>
 #include <linux/jiffies.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/power_supply.h>
+#include <linux/seqlock.h>
+#include <linux/stddef.h>
+#include <linux/string.h>
 #include <linux/sysfs.h>
 #include <linux/types.h>
 #include <linux/workqueue.h>
@@ -88,18 +93,21 @@ static_assert(sizeof(struct spwr_bst) == 16);
 SSAM_DEFINE_SYNC_REQUEST_CL_R(ssam_bat_get_sta, __le32, {
 	.target_category = SSAM_SSH_TC_BAT,
 	.command_id      = 0x01,
+	.flags           = SSAM_REQUEST_IDEMPOTENT,
 });
 
 /* Get battery static information (_BIX). */
 SSAM_DEFINE_SYNC_REQUEST_CL_R(ssam_bat_get_bix, struct spwr_bix, {
 	.target_category = SSAM_SSH_TC_BAT,
 	.command_id      = 0x02,
+	.flags           = SSAM_REQUEST_IDEMPOTENT,
 });
 
 /* Get battery dynamic information (_BST). */
 SSAM_DEFINE_SYNC_REQUEST_CL_R(ssam_bat_get_bst, struct spwr_bst, {
 	.target_category = SSAM_SSH_TC_BAT,
 	.command_id      = 0x03,
+	.flags           = SSAM_REQUEST_IDEMPOTENT,
 });
 
 /* Set battery trip point (_BTP). */
@@ -116,6 +124,15 @@ struct spwr_psy_properties {
 	struct ssam_event_registry registry;
 };
 
+struct spwr_battery_state {
+	unsigned long timestamp;
+
+	__le32 sta;
+	struct spwr_bix bix;
+	struct spwr_bst bst;
+	u32 alarm;
+};
+
 struct spwr_battery_device {
 	struct ssam_device *sdev;
 
@@ -124,16 +141,31 @@ struct spwr_battery_device {
 	struct power_supply_desc psy_desc;
 
 	struct delayed_work update_work;
+	struct work_struct refresh_work;
 
 	struct ssam_event_notifier notif;
 
-	struct mutex lock;  /* Guards access to state data below. */
-	unsigned long timestamp;
+	/*
+	 * Updates of the state are serialized by the lock and published via
+	 * the sequence counter. Readers do not take the lock but retry on
+	 * concurrent updates.
+	 */
+	struct mutex lock;
+	seqcount_mutex_t seq;
+	struct spwr_battery_state state;
 
-	__le32 sta;
-	struct spwr_bix bix;
-	struct spwr_bst bst;
-	u32 alarm;
+	/*
+	 * Identification strings handed out via the power supply properties.
+	 * These are used by the power supply core after the property getter
+	 * returns and can therefore not be taken from a state snapshot. Only
+	 * written (under the lock) if they change, i.e. if a different battery
+	 * is inserted.
+	 */
+	struct {
+		char model[sizeof_field(struct spwr_bix, model)];
+		char serial[sizeof_field(struct spwr_bix, serial)];
+		char oem_info[sizeof_field(struct spwr_bix, oem_info)];
+	} info;
 };
 
 
@@ -152,79 +184,131 @@ MODULE_PARM_DESC(cache_time, "battery state caching time in milliseconds [defaul
  */
 #define SPWR_AC_BAT_UPDATE_DELAY	msecs_to_jiffies(5000)
 
-static bool spwr_battery_present(struct spwr_battery_device *bat)
-{
-	lockdep_assert_held(&bat->lock);
+/*
+ * Coalescing window for battery events. Bursts of identical events, e.g.
+ * during charge transitions, only require a single state re-check.
+ */
+#define SPWR_EVENT_COALESCE_MS		100
 
-	return le32_to_cpu(bat->sta) & SAM_BATTERY_STA_PRESENT;
+static bool spwr_battery_present(const struct spwr_battery_state *s)
+{
+	return le32_to_cpu(s->sta) & SAM_BATTERY_STA_PRESENT;
 }
 
-static int spwr_battery_load_sta(struct spwr_battery_device *bat)
+static int spwr_battery_load_sta(struct spwr_battery_device *bat, struct spwr_battery_state *s)
 {
 	lockdep_assert_held(&bat->lock);
 
-	return ssam_retry(ssam_bat_get_sta, bat->sdev, &bat->sta);
+	return ssam_retry(ssam_bat_get_sta, bat->sdev, &s->sta);
 }
 
-static int spwr_battery_load_bix(struct spwr_battery_device *bat)
+static int spwr_battery_load_bix(struct spwr_battery_device *bat, struct spwr_battery_state *s)
 {
 	int status;
 
 	lockdep_assert_held(&bat->lock);
 
-	if (!spwr_battery_present(bat))
+	if (!spwr_battery_present(s))
 		return 0;
 
-	status = ssam_retry(ssam_bat_get_bix, bat->sdev, &bat->bix);
+	status = ssam_retry(ssam_bat_get_bix, bat->sdev, &s->bix);
 
 	/* Enforce NULL terminated strings in case anything goes wrong... */
-	bat->bix.model[ARRAY_SIZE(bat->bix.model) - 1] = 0;
-	bat->bix.serial[ARRAY_SIZE(bat->bix.serial) - 1] = 0;
-	bat->bix.type[ARRAY_SIZE(bat->bix.type) - 1] = 0;
-	bat->bix.oem_info[ARRAY_SIZE(bat->bix.oem_info) - 1] = 0;
+	s->bix.model[ARRAY_SIZE(s->bix.model) - 1] = 0;
+	s->bix.serial[ARRAY_SIZE(s->bix.serial) - 1] = 0;
+	s->bix.type[ARRAY_SIZE(s->bix.type) - 1] = 0;
+	s->bix.oem_info[ARRAY_SIZE(s->bix.oem_info) - 1] = 0;
 
 	return status;
 }
 
-static int spwr_battery_load_bst(struct spwr_battery_device *bat)
+static int spwr_battery_load_bst(struct spwr_battery_device *bat, struct spwr_battery_state *s)
 {
 	lockdep_assert_held(&bat->lock);
 
-	if (!spwr_battery_present(bat))
+	if (!spwr_battery_present(s))
 		return 0;
 
-	return ssam_retry(ssam_bat_get_bst, bat->sdev, &bat->bst);
+	return ssam_retry(ssam_bat_get_bst, bat->sdev, &s->bst);
 }
 
-static int spwr_battery_set_alarm_unlocked(struct spwr_battery_device *bat, u32 value)
+static int spwr_battery_set_alarm_unlocked(struct spwr_battery_device *bat,
+					   struct spwr_battery_state *s, u32 value)
 {
 	__le32 value_le = cpu_to_le32(value);
 
 	lockdep_assert_held(&bat->lock);
 
-	bat->alarm = value;
+	s->alarm = value;
 	return ssam_retry(ssam_bat_set_btp, bat->sdev, &value_le);
 }
 
+/*
+ * Publish updated state data to readers. State data is loaded into a copy
+ * of the current state and published only once complete, so that readers
+ * never have to wait for communication with the EC.
+ */
+static void spwr_battery_publish(struct spwr_battery_device *bat,
+				 const struct spwr_battery_state *s)
+{
+	lockdep_assert_held(&bat->lock);
+
+	write_seqcount_begin(&bat->seq);
+	bat->state = *s;
+	write_seqcount_end(&bat->seq);
+
+	if (!spwr_battery_present(s))
+		return;
+
+	if (strcmp(bat->info.model, s->bix.model))
+		strscpy(bat->info.model, s->bix.model, sizeof(bat->info.model));
+
+	if (strcmp(bat->info.serial, s->bix.serial))
+		strscpy(bat->info.serial, s->bix.serial, sizeof(bat->info.serial));
+
+	if (strcmp(bat->info.oem_info, s->bix.oem_info))
+		strscpy(bat->info.oem_info, s->bix.oem_info, sizeof(bat->info.oem_info));
+}
+
+static void spwr_battery_snapshot(struct spwr_battery_device *bat, struct spwr_battery_state *s)
+{
+	unsigned int seq;
+
+	do {
+		seq = read_seqcount_begin(&bat->seq);
+		*s = bat->state;
+	} while (read_seqcount_retry(&bat->seq, seq));
+}
+
+static bool spwr_battery_is_stale(const struct spwr_battery_state *s)
+{
+	return !s->timestamp ||
+	       time_is_before_eq_jiffies(s->timestamp + msecs_to_jiffies(cache_time));
+}
+
 static int spwr_battery_update_bst_unlocked(struct spwr_battery_device *bat, bool cached)
 {
-	unsigned long cache_deadline = bat->timestamp + msecs_to_jiffies(cache_time);
+	struct spwr_battery_state s;
 	int status;
 
 	lockdep_assert_held(&bat->lock);
 
-	if (cached && bat->timestamp && time_is_after_jiffies(cache_deadline))
+	/* We hold the lock, so there cannot be any concurrent updates. */
+	s = bat->state;
+
+	if (cached && !spwr_battery_is_stale(&s))
 		return 0;
 
-	status = spwr_battery_load_sta(bat);
+	status = spwr_battery_load_sta(bat, &s);
 	if (status)
 		return status;
 
-	status = spwr_battery_load_bst(bat);
+	status = spwr_battery_load_bst(bat, &s);
 	if (status)
 		return status;
 
-	bat->timestamp = jiffies;
+	s.timestamp = jiffies;
+	spwr_battery_publish(bat, &s);
 	return 0;
 }
 
@@ -239,50 +323,47 @@ static int spwr_battery_update_bst(struct spwr_battery_device *bat, bool cached)
 	return status;
 }
 
-static int spwr_battery_update_bix_unlocked(struct spwr_battery_device *bat)
+static int spwr_battery_update_bix_unlocked(struct spwr_battery_device *bat,
+					    struct spwr_battery_state *s)
 {
 	int status;
 
 	lockdep_assert_held(&bat->lock);
 
-	status = spwr_battery_load_sta(bat);
+	status = spwr_battery_load_sta(bat, s);
 	if (status)
 		return status;
 
-	status = spwr_battery_load_bix(bat);
+	status = spwr_battery_load_bix(bat, s);
 	if (status)
 		return status;
 
-	status = spwr_battery_load_bst(bat);
+	status = spwr_battery_load_bst(bat, s);
 	if (status)
 		return status;
 
-	if (bat->bix.revision != SPWR_BIX_REVISION)
-		dev_warn(&bat->sdev->dev, "unsupported battery revision: %u\n", bat->bix.revision);
+	if (s->bix.revision != SPWR_BIX_REVISION)
+		dev_warn(&bat->sdev->dev, "unsupported battery revision: %u\n", s->bix.revision);
 
-	bat->timestamp = jiffies;
+	s->timestamp = jiffies;
 	return 0;
 }
 
-static u32 sprw_battery_get_full_cap_safe(struct spwr_battery_device *bat)
+static u32 sprw_battery_get_full_cap_safe(const struct spwr_battery_state *s)
 {
-	u32 full_cap = get_unaligned_le32(&bat->bix.last_full_charge_cap);
-
-	lockdep_assert_held(&bat->lock);
+	u32 full_cap = get_unaligned_le32(&s->bix.last_full_charge_cap);
 
 	if (full_cap == 0 || full_cap == SPWR_BATTERY_VALUE_UNKNOWN)
-		full_cap = get_unaligned_le32(&bat->bix.design_cap);
+		full_cap = get_unaligned_le32(&s->bix.design_cap);
 
 	return full_cap;
 }
 
-static bool spwr_battery_is_full(struct spwr_battery_device *bat)
+static bool spwr_battery_is_full(const struct spwr_battery_state *s)
 {
-	u32 state = get_unaligned_le32(&bat->bst.state);
-	u32 full_cap = sprw_battery_get_full_cap_safe(bat);
-	u32 remaining_cap = get_unaligned_le32(&bat->bst.remaining_cap);
-
-	lockdep_assert_held(&bat->lock);
+	u32 state = get_unaligned_le32(&s->bst.state);
+	u32 full_cap = sprw_battery_get_full_cap_safe(s);
+	u32 remaining_cap = get_unaligned_le32(&s->bst.remaining_cap);
 
 	return full_cap != SPWR_BATTERY_VALUE_UNKNOWN && full_cap != 0 &&
 		remaining_cap != SPWR_BATTERY_VALUE_UNKNOWN &&
@@ -292,33 +373,38 @@ static bool spwr_battery_is_full(struct spwr_battery_device *bat)
 
 static int spwr_battery_recheck_full(struct spwr_battery_device *bat)
 {
+	struct spwr_battery_state s;
 	bool present;
 	u32 unit;
 	int status;
 
 	mutex_lock(&bat->lock);
-	unit = get_unaligned_le32(&bat->bix.power_unit);
-	present = spwr_battery_present(bat);
+	s = bat->state;
 
-	status = spwr_battery_update_bix_unlocked(bat);
+	unit = get_unaligned_le32(&s.bix.power_unit);
+	present = spwr_battery_present(&s);
+
+	status = spwr_battery_update_bix_unlocked(bat, &s);
 	if (status)
 		goto out;
 
 	/* If battery has been attached, (re-)initialize alarm. */
-	if (!present && spwr_battery_present(bat)) {
-		u32 cap_warn = get_unaligned_le32(&bat->bix.design_cap_warn);
+	if (!present && spwr_battery_present(&s)) {
+		u32 cap_warn = get_unaligned_le32(&s.bix.design_cap_warn);
 
-		status = spwr_battery_set_alarm_unlocked(bat, cap_warn);
-		if (status)
-			goto out;
+		status = spwr_battery_set_alarm_unlocked(bat, &s, cap_warn);
 	}
 
+	spwr_battery_publish(bat, &s);
+	if (status)
+		goto out;
+
 	/*
 	 * Warn if the unit has changed. This is something we genuinely don't
 	 * expect to happen, so make this a big warning. If it does, we'll
 	 * need to add support for it.
 	 */
-	WARN_ON(unit != get_unaligned_le32(&bat->bix.power_unit));
+	WARN_ON(unit != get_unaligned_le32(&s.bix.power_unit));
 
 out:
 	mutex_unlock(&bat->lock);
@@ -406,6 +492,19 @@ static void spwr_battery_update_bst_workfn(struct work_struct *work)
 	power_supply_changed(bat->psy);
 }
 
+static void spwr_battery_refresh_workfn(struct work_struct *work)
+{
+	struct spwr_battery_device *bat;
+	int status;
+
+	bat = container_of(work, struct spwr_battery_device, refresh_work);
+
+	/* Use cached mode so that concurrent refresh triggers are dropped. */
+	status = spwr_battery_update_bst(bat, true);
+	if (status)
+		dev_dbg(&bat->sdev->dev, "failed to refresh battery state: %d\n", status);
+}
+
 static void spwr_external_power_changed(struct power_supply *psy)
 {
 	struct spwr_battery_device *bat = power_supply_get_drvdata(psy);
@@ -461,12 +560,10 @@ static const enum power_supply_property spwr_battery_props_eng[] = {
 	POWER_SUPPLY_PROP_SERIAL_NUMBER,
 };
 
-static int spwr_battery_prop_status(struct spwr_battery_device *bat)
+static int spwr_battery_prop_status(const struct spwr_battery_state *s)
 {
-	u32 state = get_unaligned_le32(&bat->bst.state);
-	u32 present_rate = get_unaligned_le32(&bat->bst.present_rate);
-
-	lockdep_assert_held(&bat->lock);
+	u32 state = get_unaligned_le32(&s->bst.state);
+	u32 present_rate = get_unaligned_le32(&s->bst.present_rate);
 
 	if (state & SAM_BATTERY_STATE_DISCHARGING)
 		return POWER_SUPPLY_STATUS_DISCHARGING;
@@ -474,7 +571,7 @@ static int spwr_battery_prop_status(struct spwr_battery_device *bat)
 	if (state & SAM_BATTERY_STATE_CHARGING)
 		return POWER_SUPPLY_STATUS_CHARGING;
 
-	if (spwr_battery_is_full(bat))
+	if (spwr_battery_is_full(s))
 		return POWER_SUPPLY_STATUS_FULL;
 
 	if (present_rate == 0)
@@ -483,34 +580,30 @@ static int spwr_battery_prop_status(struct spwr_battery_device *bat)
 	return POWER_SUPPLY_STATUS_UNKNOWN;
 }
 
-static int spwr_battery_prop_technology(struct spwr_battery_device *bat)
+static int spwr_battery_prop_technology(const struct spwr_battery_state *s)
 {
-	lockdep_assert_held(&bat->lock);
-
-	if (!strcasecmp("NiCd", bat->bix.type))
+	if (!strcasecmp("NiCd", s->bix.type))
 		return POWER_SUPPLY_TECHNOLOGY_NiCd;
 
-	if (!strcasecmp("NiMH", bat->bix.type))
+	if (!strcasecmp("NiMH", s->bix.type))
 		return POWER_SUPPLY_TECHNOLOGY_NiMH;
 
-	if (!strcasecmp("LION", bat->bix.type))
+	if (!strcasecmp("LION", s->bix.type))
 		return POWER_SUPPLY_TECHNOLOGY_LION;
 
-	if (!strncasecmp("LI-ION", bat->bix.type, 6))
+	if (!strncasecmp("LI-ION", s->bix.type, 6))
 		return POWER_SUPPLY_TECHNOLOGY_LION;
 
-	if (!strcasecmp("LiP", bat->bix.type))
+	if (!strcasecmp("LiP", s->bix.type))
 		return POWER_SUPPLY_TECHNOLOGY_LIPO;
 
 	return POWER_SUPPLY_TECHNOLOGY_UNKNOWN;
 }
 
-static int spwr_battery_prop_capacity(struct spwr_battery_device *bat)
+static int spwr_battery_prop_capacity(const struct spwr_battery_state *s)
 {
-	u32 full_cap = sprw_battery_get_full_cap_safe(bat);
-	u32 remaining_cap = get_unaligned_le32(&bat->bst.remaining_cap);
-
-	lockdep_assert_held(&bat->lock);
+	u32 full_cap = sprw_battery_get_full_cap_safe(s);
+	u32 remaining_cap = get_unaligned_le32(&s->bst.remaining_cap);
 
 	if (full_cap == 0 || full_cap == SPWR_BATTERY_VALUE_UNKNOWN)
 		return -ENODATA;
@@ -521,59 +614,80 @@ static int spwr_battery_prop_capacity(struct spwr_battery_device *bat)
 	return remaining_cap * 100 / full_cap;
 }
 
-static int spwr_battery_prop_capacity_level(struct spwr_battery_device *bat)
+static int spwr_battery_prop_capacity_level(const struct spwr_battery_state *s)
 {
-	u32 state = get_unaligned_le32(&bat->bst.state);
-	u32 remaining_cap = get_unaligned_le32(&bat->bst.remaining_cap);
-
-	lockdep_assert_held(&bat->lock);
+	u32 state = get_unaligned_le32(&s->bst.state);
+	u32 remaining_cap = get_unaligned_le32(&s->bst.remaining_cap);
 
 	if (state & SAM_BATTERY_STATE_CRITICAL)
 		return POWER_SUPPLY_CAPACITY_LEVEL_CRITICAL;
 
-	if (spwr_battery_is_full(bat))
+	if (spwr_battery_is_full(s))
 		return POWER_SUPPLY_CAPACITY_LEVEL_FULL;
 
-	if (remaining_cap <= bat->alarm)
+	if (remaining_cap <= s->alarm)
 		return POWER_SUPPLY_CAPACITY_LEVEL_LOW;
 
 	return POWER_SUPPLY_CAPACITY_LEVEL_NORMAL;
 }
 
+/*
+ * Get a snapshot of the current battery state. Stale data is refreshed
+ * asynchronously and returned as-is in the meantime. Only if no data has
+ * been loaded yet, we have to wait for the EC.
+ */
+static int spwr_battery_get_state(struct spwr_battery_device *bat, struct spwr_battery_state *s)
+{
+	int status;
+
+	spwr_battery_snapshot(bat, s);
+
+	if (s->timestamp) {
+		if (spwr_battery_is_stale(s))
+			schedule_work(&bat->refresh_work);
+
+		return 0;
+	}
+
+	status = spwr_battery_update_bst(bat, true);
+	if (status)
+		return status;
+
+	spwr_battery_snapshot(bat, s);
+	return 0;
+}
+
 static int spwr_battery_get_property(struct power_supply *psy, enum power_supply_property psp,
 				     union power_supply_propval *val)
 {
 	struct spwr_battery_device *bat = power_supply_get_drvdata(psy);
+	struct spwr_battery_state s;
 	u32 value;
 	int status;
 
-	mutex_lock(&bat->lock);
-
-	status = spwr_battery_update_bst_unlocked(bat, true);
+	status = spwr_battery_get_state(bat, &s);
 	if (status)
-		goto out;
+		return status;
 
 	/* Abort if battery is not present. */
-	if (!spwr_battery_present(bat) && psp != POWER_SUPPLY_PROP_PRESENT) {
-		status = -ENODEV;
-		goto out;
-	}
+	if (!spwr_battery_present(&s) && psp != POWER_SUPPLY_PROP_PRESENT)
+		return -ENODEV;
 
 	switch (psp) {
 	case POWER_SUPPLY_PROP_STATUS:
-		val->intval = spwr_battery_prop_status(bat);
+		val->intval = spwr_battery_prop_status(&s);
 		break;
 
 	case POWER_SUPPLY_PROP_PRESENT:
-		val->intval = spwr_battery_present(bat);
+		val->intval = spwr_battery_present(&s);
 		break;
 
 	case POWER_SUPPLY_PROP_TECHNOLOGY:
-		val->intval = spwr_battery_prop_technology(bat);
+		val->intval = spwr_battery_prop_technology(&s);
 		break;
 
 	case POWER_SUPPLY_PROP_CYCLE_COUNT:
-		value = get_unaligned_le32(&bat->bix.cycle_count);
+		value = get_unaligned_le32(&s.bix.cycle_count);
 		if (value != SPWR_BATTERY_VALUE_UNKNOWN)
 			val->intval = value;
 		else
@@ -581,7 +695,7 @@ static int spwr_battery_get_property(struct power_supply *psy, enum power_supply
 		break;
 
 	case POWER_SUPPLY_PROP_VOLTAGE_MIN_DESIGN:
-		value = get_unaligned_le32(&bat->bix.design_voltage);
+		value = get_unaligned_le32(&s.bix.design_voltage);
 		if (value != SPWR_BATTERY_VALUE_UNKNOWN)
 			val->intval = value * 1000;
 		else
@@ -589,7 +703,7 @@ static int spwr_battery_get_property(struct power_supply *psy, enum power_supply
 		break;
 
 	case POWER_SUPPLY_PROP_VOLTAGE_NOW:
-		value = get_unaligned_le32(&bat->bst.present_voltage);
+		value = get_unaligned_le32(&s.bst.present_voltage);
 		if (value != SPWR_BATTERY_VALUE_UNKNOWN)
 			val->intval = value * 1000;
 		else
@@ -598,7 +712,7 @@ static int spwr_battery_get_property(struct power_supply *psy, enum power_supply
 
 	case POWER_SUPPLY_PROP_CURRENT_NOW:
 	case POWER_SUPPLY_PROP_POWER_NOW:
-		value = get_unaligned_le32(&bat->bst.present_rate);
+		value = get_unaligned_le32(&s.bst.present_rate);
 		if (value != SPWR_BATTERY_VALUE_UNKNOWN)
 			val->intval = value * 1000;
 		else
@@ -607,7 +721,7 @@ static int spwr_battery_get_property(struct power_supply *psy, enum power_supply
 
 	case POWER_SUPPLY_PROP_CHARGE_FULL_DESIGN:
 	case POWER_SUPPLY_PROP_ENERGY_FULL_DESIGN:
-		value = get_unaligned_le32(&bat->bix.design_cap);
+		value = get_unaligned_le32(&s.bix.design_cap);
 		if (value != SPWR_BATTERY_VALUE_UNKNOWN)
 			val->intval = value * 1000;
 		else
@@ -616,7 +730,7 @@ static int spwr_battery_get_property(struct power_supply *psy, enum power_supply
 
 	case POWER_SUPPLY_PROP_CHARGE_FULL:
 	case POWER_SUPPLY_PROP_ENERGY_FULL:
-		value = get_unaligned_le32(&bat->bix.last_full_charge_cap);
+		value = get_unaligned_le32(&s.bix.last_full_charge_cap);
 		if (value != SPWR_BATTERY_VALUE_UNKNOWN)
 			val->intval = value * 1000;
 		else
@@ -625,7 +739,7 @@ static int spwr_battery_get_property(struct power_supply *psy, enum power_supply
 
 	case POWER_SUPPLY_PROP_CHARGE_NOW:
 	case POWER_SUPPLY_PROP_ENERGY_NOW:
-		value = get_unaligned_le32(&bat->bst.remaining_cap);
+		value = get_unaligned_le32(&s.bst.remaining_cap);
 		if (value != SPWR_BATTERY_VALUE_UNKNOWN)
 			val->intval = value * 1000;
 		else
@@ -633,23 +747,23 @@ static int spwr_battery_get_property(struct power_supply *psy, enum power_supply
 		break;
 
 	case POWER_SUPPLY_PROP_CAPACITY:
-		val->intval = spwr_battery_prop_capacity(bat);
+		val->intval = spwr_battery_prop_capacity(&s);
 		break;
 
 	case POWER_SUPPLY_PROP_CAPACITY_LEVEL:
-		val->intval = spwr_battery_prop_capacity_level(bat);
+		val->intval = spwr_battery_prop_capacity_level(&s);
 		break;
 
 	case POWER_SUPPLY_PROP_MODEL_NAME:
-		val->strval = bat->bix.model;
+		val->strval = bat->info.model;
 		break;
 
 	case POWER_SUPPLY_PROP_MANUFACTURER:
-		val->strval = bat->bix.oem_info;
+		val->strval = bat->info.oem_info;
 		break;
 
 	case POWER_SUPPLY_PROP_SERIAL_NUMBER:
-		val->strval = bat->bix.serial;
+		val->strval = bat->info.serial;
 		break;
 
 	default:
@@ -657,8 +771,6 @@ static int spwr_battery_get_property(struct power_supply *psy, enum power_supply
 		break;
 	}
 
-out:
-	mutex_unlock(&bat->lock);
 	return status;
 }
 
@@ -669,13 +781,10 @@ static ssize_t alarm_show(struct device *dev, struct device_attribute *attr, cha
 {
 	struct power_supply *psy = dev_get_drvdata(dev);
 	struct spwr_battery_device *bat = power_supply_get_drvdata(psy);
-	int status;
+	struct spwr_battery_state s;
 
-	mutex_lock(&bat->lock);
-	status = sysfs_emit(buf, "%d\n", bat->alarm * 1000);
-	mutex_unlock(&bat->lock);
-
-	return status;
+	spwr_battery_snapshot(bat, &s);
+	return sysfs_emit(buf, "%d\n", s.alarm * 1000);
 }
 
 static ssize_t alarm_store(struct device *dev, struct device_attribute *attr, const char *buf,
@@ -683,6 +792,7 @@ static ssize_t alarm_store(struct device *dev, struct device_attribute *attr, co
 {
 	struct power_supply *psy = dev_get_drvdata(dev);
 	struct spwr_battery_device *bat = power_supply_get_drvdata(psy);
+	struct spwr_battery_state s;
 	unsigned long value;
 	int status;
 
@@ -691,20 +801,18 @@ static ssize_t alarm_store(struct device *dev, struct device_attribute *attr, co
 		return status;
 
 	mutex_lock(&bat->lock);
+	s = bat->state;
 
-	if (!spwr_battery_present(bat)) {
+	if (!spwr_battery_present(&s)) {
 		mutex_unlock(&bat->lock);
 		return -ENODEV;
 	}
 
-	status = spwr_battery_set_alarm_unlocked(bat, value / 1000);
-	if (status) {
-		mutex_unlock(&bat->lock);
-		return status;
-	}
+	status = spwr_battery_set_alarm_unlocked(bat, &s, value / 1000);
+	spwr_battery_publish(bat, &s);
 
 	mutex_unlock(&bat->lock);
-	return count;
+	return status ? status : count;
 }
 
 static DEVICE_ATTR_RW(alarm);
@@ -722,6 +830,7 @@ static void spwr_battery_init(struct spwr_battery_device *bat, struct ssam_devic
 			      struct ssam_event_registry registry, const char *name)
 {
 	mutex_init(&bat->lock);
+	seqcount_mutex_init(&bat->seq, &bat->lock);
 	strncpy(bat->name, name, ARRAY_SIZE(bat->name) - 1);
 
 	bat->sdev = sdev;
@@ -733,6 +842,7 @@ static void spwr_battery_init(struct spwr_battery_device *bat, struct ssam_devic
 	bat->notif.event.id.instance = 0;	/* need to register with instance 0 */
 	bat->notif.event.mask = SSAM_EVENT_MASK_TARGET;
 	bat->notif.event.flags = SSAM_EVENT_SEQUENCED;
+	bat->notif.coalesce.window_ms = SPWR_EVENT_COALESCE_MS;
 
 	bat->psy_desc.name = bat->name;
 	bat->psy_desc.type = POWER_SUPPLY_TYPE_BATTERY;
@@ -744,6 +854,7 @@ static void spwr_battery_init(struct spwr_battery_device *bat, struct ssam_devic
 static int spwr_battery_register(struct spwr_battery_device *bat)
 {
 	struct power_supply_config psy_cfg = {};
+	struct spwr_battery_state s = {};
 	__le32 sta;
 	int status;
 
@@ -758,27 +869,28 @@ static int spwr_battery_register(struct spwr_battery_device *bat)
 	/* Satisfy lockdep although we are in an exclusive context here. */
 	mutex_lock(&bat->lock);
 
-	status = spwr_battery_update_bix_unlocked(bat);
+	status = spwr_battery_update_bix_unlocked(bat, &s);
 	if (status) {
 		mutex_unlock(&bat->lock);
 		return status;
 	}
 
-	if (spwr_battery_present(bat)) {
-		u32 cap_warn = get_unaligned_le32(&bat->bix.design_cap_warn);
+	if (spwr_battery_present(&s)) {
+		u32 cap_warn = get_unaligned_le32(&s.bix.design_cap_warn);
 
-		status = spwr_battery_set_alarm_unlocked(bat, cap_warn);
+		status = spwr_battery_set_alarm_unlocked(bat, &s, cap_warn);
 		if (status) {
 			mutex_unlock(&bat->lock);
 			return status;
 		}
 	}
 
+	spwr_battery_publish(bat, &s);
 	mutex_unlock(&bat->lock);
 
 	bat->psy_desc.external_power_changed = spwr_external_power_changed;
 
-	switch (get_unaligned_le32(&bat->bix.power_unit)) {
+	switch (get_unaligned_le32(&s.bix.power_unit)) {
 	case SAM_BATTERY_POWER_UNIT_mW:
 		bat->psy_desc.properties = spwr_battery_props_eng;
 		bat->psy_desc.num_properties = ARRAY_SIZE(spwr_battery_props_eng);
@@ -791,10 +903,20 @@ static int spwr_battery_register(struct spwr_battery_device *bat)
 
 	default:
 		dev_err(&bat->sdev->dev, "unsupported battery power unit: %u\n",
-			get_unaligned_le32(&bat->bix.power_unit));
+			get_unaligned_le32(&s.bix.power_unit));
 		return -EINVAL;
 	}
 
+	/*
+	 * Readers may schedule a refresh as long as the power supply is
+	 * registered, so make sure this is cancelled only after the power
+	 * supply has been unregistered.
+	 */
+	status = devm_work_autocancel(&bat->sdev->dev, &bat->refresh_work,
+				      spwr_battery_refresh_workfn);
+	if (status)
+		return status;
+
 	psy_cfg.drv_data = bat;
 	psy_cfg.attr_grp = spwr_battery_groups;
 
@@ -810,7 +932,14 @@ static int spwr_battery_register(struct spwr_battery_device *bat)
 
 static int __maybe_unused surface_battery_resume(struct device *dev)
 {
-	return spwr_battery_recheck_full(dev_get_drvdata(dev));
+	struct spwr_battery_device *bat = dev_get_drvdata(dev);
+	ktime_t start = ktime_get_boottime();
+	int status;
+
+	status = spwr_battery_recheck_full(bat);
+	ssam_controller_pm_record_client(bat->sdev->ctrl, dev, start, status);
+
+	return status;
 }
 static SIMPLE_DEV_PM_OPS(surface_battery_pm_ops, NULL, surface_battery_resume);
 
@@ -7,11 +7,15 @@
  */
 
 #include <asm/unaligned.h>
+#include <linux/devm-helpers.h>
+#include <linux/jiffies.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/power_supply.h>
+#include <linux/seqlock.h>
 #include <linux/types.h>
+#include <linux/workqueue.h>
 
 #include "../../include/linux/surface_aggregator/device.h"
 
@@ -27,16 +31,25 @@ enum sam_battery_sta {
 	SAM_BATTERY_STA_PRESENT	= 0x10,
 };
 
+/*
+ * Time-to-live of the adapter state snapshot. The requests below are not
+ * cached by the controller, as this would stack on top of the snapshot and
+ * extend the time until a refresh actually reaches the EC.
+ */
+#define SPWR_AC_CACHE_MS	1000
+
 /* Get battery status (_STA). */
 SSAM_DEFINE_SYNC_REQUEST_CL_R(ssam_bat_get_sta, __le32, {
 	.target_category = SSAM_SSH_TC_BAT,
 	.command_id      = 0x01,
+	.flags           = SSAM_REQUEST_IDEMPOTENT,
 });
 
 /* Get platform power source for battery (_PSR / DPTF PSRC). */
 SSAM_DEFINE_SYNC_REQUEST_CL_R(ssam_bat_get_psrc, __le32, {
 	.target_category = SSAM_SSH_TC_BAT,
 	.command_id      = 0x0d,
+	.flags           = SSAM_REQUEST_IDEMPOTENT,
 });
 
 
@@ -55,9 +68,17 @@ struct spwr_ac_device {
 	struct power_supply_desc psy_desc;
 
 	struct ssam_event_notifier notif;
+	struct work_struct refresh_work;
 
-	struct mutex lock;  /* Guards access to state below. */
+	/*
+	 * Updates of the state are serialized by the lock and published via
+	 * the sequence counter. Readers do not take the lock but retry on
+	 * concurrent updates.
+	 */
+	struct mutex lock;
+	seqcount_mutex_t seq;
 
+	unsigned long timestamp;
 	__le32 state;
 };
 
@@ -67,15 +88,22 @@ struct spwr_ac_device {
 static int spwr_ac_update_unlocked(struct spwr_ac_device *ac)
 {
 	__le32 old = ac->state;
+	__le32 state;
 	int status;
 
 	lockdep_assert_held(&ac->lock);
 
-	status = ssam_retry(ssam_bat_get_psrc, ac->sdev, &ac->state);
+	/* Communicate with the EC outside of the write-side critical section. */
+	status = ssam_retry(ssam_bat_get_psrc, ac->sdev, &state);
 	if (status < 0)
 		return status;
 
-	return old != ac->state;
+	write_seqcount_begin(&ac->seq);
+	ac->state = state;
+	ac->timestamp = jiffies;
+	write_seqcount_end(&ac->seq);
+
+	return old != state;
 }
 
 static int spwr_ac_update(struct spwr_ac_device *ac)
@@ -100,6 +128,48 @@ static int spwr_ac_recheck(struct spwr_ac_device *ac)
 	return status >= 0 ? 0 : status;
 }
 
+static void spwr_ac_refresh_workfn(struct work_struct *work)
+{
+	struct spwr_ac_device *ac = container_of(work, struct spwr_ac_device, refresh_work);
+	int status;
+
+	status = spwr_ac_recheck(ac);
+	if (status)
+		dev_dbg(&ac->sdev->dev, "failed to refresh adapter state: %d\n", status);
+}
+
+/*
+ * Get a snapshot of the current adapter state. Stale data is refreshed
+ * asynchronously and returned as-is in the meantime. Only if no data has
+ * been loaded yet, we have to wait for the EC.
+ */
+static int spwr_ac_get_state(struct spwr_ac_device *ac, __le32 *state)
+{
+	unsigned long timestamp;
+	unsigned int seq;
+	int status;
+
+	do {
+		seq = read_seqcount_begin(&ac->seq);
+		*state = ac->state;
+		timestamp = ac->timestamp;
+	} while (read_seqcount_retry(&ac->seq, seq));
+
+	if (timestamp) {
+		if (time_is_before_eq_jiffies(timestamp + msecs_to_jiffies(SPWR_AC_CACHE_MS)))
+			schedule_work(&ac->refresh_work);
+
+		return 0;
+	}
+
+	status = spwr_ac_update(ac);
+	if (status < 0)
+		return status;
+
+	*state = READ_ONCE(ac->state);
+	return 0;
+}
+
 static u32 spwr_notify_ac(struct ssam_event_notifier *nf, const struct ssam_event *event)
 {
 	struct spwr_ac_device *ac;
@@ -140,32 +210,32 @@ static int spwr_ac_get_property(struct power_supply *psy, enum power_supply_prop
 				union power_supply_propval *val)
 {
 	struct spwr_ac_device *ac = power_supply_get_drvdata(psy);
+	__le32 state;
 	int status;
 
-	mutex_lock(&ac->lock);
-
-	status = spwr_ac_update_unlocked(ac);
+	status = spwr_ac_get_state(ac, &state);
 	if (status)
-		goto out;
+		return status;
 
 	switch (psp) {
 	case POWER_SUPPLY_PROP_ONLINE:
-		val->intval = !!le32_to_cpu(ac->state);
-		break;
+		val->intval = !!le32_to_cpu(state);
+		return 0;
 
 	default:
-		status = -EINVAL;
-		goto out;
+		return -EINVAL;
 	}
-
-out:
-	mutex_unlock(&ac->lock);
-	return status;
 }
 
 
 /* -- Device setup. --------------------------------------------------------- */
 
+/*
+ * Coalescing window for adapter events. Bursts of identical events, e.g.
+ * during charge transitions, only require a single state re-check.
+ */
+#define SPWR_AC_EVENT_COALESCE_MS	100
+
 static char *battery_supplied_to[] = {
 	"BAT1",
 	"BAT2",
@@ -175,6 +245,7 @@ static void spwr_ac_init(struct spwr_ac_device *ac, struct ssam_device *sdev,
 			 struct ssam_event_registry registry, const char *name)
 {
 	mutex_init(&ac->lock);
+	seqcount_mutex_init(&ac->seq, &ac->lock);
 	strncpy(ac->name, name, ARRAY_SIZE(ac->name) - 1);
 
 	ac->sdev = sdev;
@@ -186,6 +257,7 @@ static void spwr_ac_init(struct spwr_ac_device *ac, struct ssam_device *sdev,
 	ac->notif.event.id.instance = 0;
 	ac->notif.event.mask = SSAM_EVENT_MASK_NONE;
 	ac->notif.event.flags = SSAM_EVENT_SEQUENCED;
+	ac->notif.coalesce.window_ms = SPWR_AC_EVENT_COALESCE_MS;
 
 	ac->psy_desc.name = ac->name;
 	ac->psy_desc.type = POWER_SUPPLY_TYPE_MAINS;
@@ -208,6 +280,20 @@ static int spwr_ac_register(struct spwr_ac_device *ac)
 	if ((le32_to_cpu(sta) & SAM_BATTERY_STA_OK) != SAM_BATTERY_STA_OK)
 		return -ENODEV;
 
+	status = spwr_ac_update(ac);
+	if (status < 0)
+		return status;
+
+	/*
+	 * Readers may schedule a refresh as long as the power supply is
+	 * registered, so make sure this is cancelled only after the power
+	 * supply has been unregistered.
+	 */
+	status = devm_work_autocancel(&ac->sdev->dev, &ac->refresh_work,
+				      spwr_ac_refresh_workfn);
+	if (status)
+		return status;
+
 	psy_cfg.drv_data = ac;
 	psy_cfg.supplied_to = battery_supplied_to;
 	psy_cfg.num_supplicants = ARRAY_SIZE(battery_supplied_to);
@@ -15,7 +15,6 @@
 #include <linux/input.h>
 #include <linux/ioctl.h>
 #include <linux/kernel.h>
-#include <linux/kfifo.h>
 #include <linux/kref.h>
 #include <linux/miscdevice.h>
 #include <linux/module.h>
@@ -24,6 +23,7 @@
 #include <linux/poll.h>
 #include <linux/rwsem.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/workqueue.h>
 
 #include "../../include/linux/surface_aggregator/controller.h"
@@ -135,6 +135,28 @@ SSAM_DEFINE_SYNC_REQUEST_R(ssam_bas_get_latch_status, u8, {
 
 /* -- Main structures. ------------------------------------------------------ */
 
+struct sdtx_status_event {
+	struct sdtx_event e;
+	__u16 v;
+} __packed;
+
+struct sdtx_base_info_event {
+	struct sdtx_event e;
+	struct sdtx_base_info v;
+} __packed;
+
+union sdtx_generic_event {
+	struct sdtx_event common;
+	struct sdtx_status_event status;
+	struct sdtx_base_info_event base;
+};
+
+/*
+ * Number of events retained in the event ring of the device. Must be a power
+ * of two. Readers falling behind by more than this lose events.
+ */
+#define SDTX_EVENT_RING_SIZE		64
+
 enum sdtx_device_state {
 	SDTX_DEVICE_SHUTDOWN_BIT    = BIT(0),
 	SDTX_DEVICE_DIRTY_BASE_BIT  = BIT(1),
@@ -156,6 +178,12 @@ struct sdtx_device {
 	struct rw_semaphore client_lock;  /* Guards client list.                   */
 	struct list_head client_list;
 
+	struct {
+		spinlock_t lock;          /* Guards event ring access.             */
+		unsigned int head;
+		union sdtx_generic_event events[SDTX_EVENT_RING_SIZE];
+	} ring;
+
 	struct delayed_work state_work;
 	struct {
 		struct ssam_bas_base_info base;
@@ -180,8 +208,13 @@ struct sdtx_client {
 
 	struct fasync_struct *fasync;
 
-	struct mutex read_lock;           /* Guards FIFO buffer read access. */
-	DECLARE_KFIFO(buffer, u8, 512);
+	struct mutex read_lock;           /* Guards read state below. */
+	unsigned int cursor;
+	unsigned int end;
+
+	union sdtx_generic_event pending;
+	unsigned int pending_len;
+	unsigned int pending_off;
 };
 
 static void __sdtx_device_release(struct kref *kref)
@@ -328,6 +361,28 @@ static int sdtx_ioctl_get_latch_status(struct sdtx_device *ddev, u16 __user *buf
 	return put_user(sdtx_translate_latch_status(ddev, latch), buf);
 }
 
+static void sdtx_client_events_enable(struct sdtx_client *client)
+{
+	struct sdtx_device *ddev = client->ddev;
+
+	/* Only deliver events received after enabling them. */
+	spin_lock(&ddev->ring.lock);
+	if (!test_and_set_bit(SDTX_CLIENT_EVENTS_ENABLED_BIT, &client->flags))
+		WRITE_ONCE(client->cursor, ddev->ring.head);
+	spin_unlock(&ddev->ring.lock);
+}
+
+static void sdtx_client_events_disable(struct sdtx_client *client)
+{
+	struct sdtx_device *ddev = client->ddev;
+
+	/* Still deliver events received before disabling them. */
+	spin_lock(&ddev->ring.lock);
+	if (test_and_clear_bit(SDTX_CLIENT_EVENTS_ENABLED_BIT, &client->flags))
+		WRITE_ONCE(client->end, ddev->ring.head);
+	spin_unlock(&ddev->ring.lock);
+}
+
 static long __surface_dtx_ioctl(struct sdtx_client *client, unsigned int cmd, unsigned long arg)
 {
 	struct sdtx_device *ddev = client->ddev;
@@ -336,11 +391,11 @@ static long __surface_dtx_ioctl(struct sdtx_client *client, unsigned int cmd, un
 
 	switch (cmd) {
 	case SDTX_IOCTL_EVENTS_ENABLE:
-		set_bit(SDTX_CLIENT_EVENTS_ENABLED_BIT, &client->flags);
+		sdtx_client_events_enable(client);
 		return 0;
 
 	case SDTX_IOCTL_EVENTS_DISABLE:
-		clear_bit(SDTX_CLIENT_EVENTS_ENABLED_BIT, &client->flags);
+		sdtx_client_events_disable(client);
 		return 0;
 
 	case SDTX_IOCTL_LATCH_LOCK:
@@ -412,7 +467,6 @@ static int surface_dtx_open(struct inode *inode, struct file *file)
 	INIT_LIST_HEAD(&client->node);
 
 	mutex_init(&client->read_lock);
-	INIT_KFIFO(client->buffer);
 
 	file->private_data = client;
 
@@ -457,11 +511,107 @@ static int surface_dtx_release(struct inode *inode, struct file *file)
 	return 0;
 }
 
+/*
+ * Check if the client has any data available for reading, without taking any
+ * locks. Used for waiting only, the actual read re-checks this with the
+ * respective locks held.
+ */
+static bool sdtx_client_has_data(struct sdtx_client *client)
+{
+	unsigned int end;
+
+	if (READ_ONCE(client->pending_off) != READ_ONCE(client->pending_len))
+		return true;
+
+	if (test_bit(SDTX_CLIENT_EVENTS_ENABLED_BIT, &client->flags))
+		end = READ_ONCE(client->ddev->ring.head);
+	else
+		end = READ_ONCE(client->end);
+
+	return READ_ONCE(client->cursor) != end;
+}
+
+/*
+ * Fetch the next event for the client from the event ring into its pending
+ * buffer. If the client has fallen behind so far that unread events have
+ * already been overwritten, skip those and fetch an overrun event instead.
+ * Returns false if there are no events to fetch.
+ */
+static bool sdtx_client_fetch(struct sdtx_client *client)
+{
+	struct sdtx_device *ddev = client->ddev;
+	unsigned int head, end, lost = 0;
+	union sdtx_generic_event *evt;
+
+	lockdep_assert_held(&client->read_lock);
+
+	spin_lock(&ddev->ring.lock);
+
+	head = ddev->ring.head;
+	if (test_bit(SDTX_CLIENT_EVENTS_ENABLED_BIT, &client->flags))
+		end = head;
+	else
+		end = client->end;
+
+	if (client->cursor == end) {
+		spin_unlock(&ddev->ring.lock);
+		return false;
+	}
+
+	if (head - client->cursor > SDTX_EVENT_RING_SIZE) {
+		lost = min(head - SDTX_EVENT_RING_SIZE - client->cursor, end - client->cursor);
+		WRITE_ONCE(client->cursor, client->cursor + lost);
+
+		client->pending.status.e.length = sizeof(u16);
+		client->pending.status.e.code = SDTX_EVENT_OVERRUN;
+		client->pending.status.v = min_t(unsigned int, lost, U16_MAX);
+		client->pending_len = sizeof(client->pending.status);
+	} else {
+		evt = &ddev->ring.events[client->cursor % SDTX_EVENT_RING_SIZE];
+
+		client->pending_len = sizeof(struct sdtx_event) + evt->common.length;
+		memcpy(&client->pending, evt, client->pending_len);
+		WRITE_ONCE(client->cursor, client->cursor + 1);
+	}
+
+	client->pending_off = 0;
+
+	spin_unlock(&ddev->ring.lock);
+
+	if (lost)
+		dev_warn(ddev->dev, "event buffer overrun, %u events lost\n", lost);
+
+	return true;
+}
+
+static ssize_t sdtx_client_copy_to_user(struct sdtx_client *client, char __user *buf,
+					size_t count)
+{
+	size_t copied = 0;
+	size_t n;
+
+	lockdep_assert_held(&client->read_lock);
+
+	while (copied < count) {
+		if (client->pending_off == client->pending_len && !sdtx_client_fetch(client))
+			break;
+
+		n = min_t(size_t, count - copied, client->pending_len - client->pending_off);
+		if (copy_to_user(buf + copied, (u8 *)&client->pending + client->pending_off, n))
+			return -EFAULT;
+
+		client->pending_off += n;
+		copied += n;
+	}
+
+	return copied;
+}
+
 static ssize_t surface_dtx_read(struct file *file, char __user *buf, size_t count, loff_t *offs)
 {
 	struct sdtx_client *client = file->private_data;
 	struct sdtx_device *ddev = client->ddev;
-	unsigned int copied;
+	ssize_t copied;
 	int status = 0;
 
 	if (down_read_killable(&ddev->lock))
@@ -475,14 +625,14 @@ static ssize_t surface_dtx_read(struct file *file, char __user *buf, size_t coun
 
 	do {
 		/* Check availability, wait if necessary. */
-		if (kfifo_is_empty(&client->buffer)) {
+		if (!sdtx_client_has_data(client)) {
 			up_read(&ddev->lock);
 
 			if (file->f_flags & O_NONBLOCK)
 				return -EAGAIN;
 
 			status = wait_event_interruptible(ddev->waitq,
-							  !kfifo_is_empty(&client->buffer) ||
+							  sdtx_client_has_data(client) ||
 							  test_bit(SDTX_DEVICE_SHUTDOWN_BIT,
 								   &ddev->flags));
 			if (status < 0)
@@ -498,18 +648,18 @@ static ssize_t surface_dtx_read(struct file *file, char __user *buf, size_t coun
 			}
 		}
 
-		/* Try to read from FIFO. */
+		/* Try to read from event ring. */
 		if (mutex_lock_interruptible(&client->read_lock)) {
 			up_read(&ddev->lock);
 			return -ERESTARTSYS;
 		}
 
-		status = kfifo_to_user(&client->buffer, buf, count, &copied);
+		copied = sdtx_client_copy_to_user(client, buf, count);
 		mutex_unlock(&client->read_lock);
 
-		if (status < 0) {
+		if (copied < 0) {
 			up_read(&ddev->lock);
-			return status;
+			return copied;
 		}
 
 		/* We might not have gotten anything, check this here. */
@@ -533,7 +683,7 @@ static __poll_t surface_dtx_poll(struct file *file, struct poll_table_struct *pt
 
 	poll_wait(file, &client->ddev->waitq, pt);
 
-	if (!kfifo_is_empty(&client->buffer))
+	if (sdtx_client_has_data(client))
 		events |= EPOLLIN | EPOLLRDNORM;
 
 	return events;
@@ -575,22 +725,6 @@ static const struct file_operations surface_dtx_fops = {
 #define SDTX_DEVICE_MODE_DELAY_CONNECT	msecs_to_jiffies(100)
 #define SDTX_DEVICE_MODE_DELAY_RECHECK	msecs_to_jiffies(100)
 
-struct sdtx_status_event {
-	struct sdtx_event e;
-	__u16 v;
-} __packed;
-
-struct sdtx_base_info_event {
-	struct sdtx_event e;
-	struct sdtx_base_info v;
-} __packed;
-
-union sdtx_generic_event {
-	struct sdtx_event common;
-	struct sdtx_status_event status;
-	struct sdtx_base_info_event base;
-};
-
 static void sdtx_update_device_mode(struct sdtx_device *ddev, unsigned long delay);
 
 /* Must be executed with ddev->write_lock held. */
@@ -601,17 +735,22 @@ static void sdtx_push_event(struct sdtx_device *ddev, struct sdtx_event *evt)
 
 	lockdep_assert_held(&ddev->write_lock);
 
-	down_read(&ddev->client_lock);
-	list_for_each_entry(client, &ddev->client_list, node) {
-		if (!test_bit(SDTX_CLIENT_EVENTS_ENABLED_BIT, &client->flags))
-			continue;
+	if (WARN_ON(len > sizeof(union sdtx_generic_event)))
+		return;
 
-		if (likely(kfifo_avail(&client->buffer) >= len))
-			kfifo_in(&client->buffer, (const u8 *)evt, len);
-		else
-			dev_warn(ddev->dev, "event buffer overrun\n");
+	/*
+	 * Events are written to the ring once and shared by all clients, each
+	 * client keeps track of its own read position.
+	 */
+	spin_lock(&ddev->ring.lock);
+	memcpy(&ddev->ring.events[ddev->ring.head % SDTX_EVENT_RING_SIZE], evt, len);
+	WRITE_ONCE(ddev->ring.head, ddev->ring.head + 1);
+	spin_unlock(&ddev->ring.lock);
 
-		kill_fasync(&client->fasync, SIGIO, POLL_IN);
+	down_read(&ddev->client_lock);
+	list_for_each_entry(client, &ddev->client_list, node) {
+		if (test_bit(SDTX_CLIENT_EVENTS_ENABLED_BIT, &client->flags))
+			kill_fasync(&client->fasync, SIGIO, POLL_IN);
 	}
 	up_read(&ddev->client_lock);
 
@@ -968,6 +1107,7 @@ static int sdtx_device_init(struct sdtx_device *ddev, struct device *dev,
 	mutex_init(&ddev->write_lock);
 	init_rwsem(&ddev->client_lock);
 	INIT_LIST_HEAD(&ddev->client_list);
+	spin_lock_init(&ddev->ring.lock);
 
 	INIT_DELAYED_WORK(&ddev->mode_work, sdtx_device_mode_workfn);
 	INIT_DELAYED_WORK(&ddev->state_work, sdtx_device_state_workfn);
@@ -125,7 +125,7 @@ static int ssam_hid_set_raw_report(struct surface_hid_device *shid, u8 rprt_id,
 	rqst.target_id = shid->uid.target;
 	rqst.instance_id = shid->uid.instance;
 	rqst.command_id = cid;
-	rqst.flags = 0;
+	rqst.flags = SSAM_REQUEST_PRIO_INTERACTIVE;
 	rqst.length = len;
 	rqst.payload = buf;
 
@@ -143,7 +143,7 @@ static int ssam_hid_get_raw_report(struct surface_hid_device *shid, u8 rprt_id,
 	rqst.target_id = shid->uid.target;
 	rqst.instance_id = shid->uid.instance;
 	rqst.command_id = SURFACE_HID_CID_GET_FEATURE_REPORT;
-	rqst.flags = SSAM_REQUEST_HAS_RESPONSE;
+	rqst.flags = SSAM_REQUEST_HAS_RESPONSE | SSAM_REQUEST_PRIO_INTERACTIVE;
 	rqst.length = sizeof(rprt_id);
 	rqst.payload = &rprt_id;
 
@@ -162,6 +162,11 @@ static u32 ssam_hid_event_fn(struct ssam_event_notifier *nf, const struct ssam_e
 		return 0;
 
 	hid_input_report(shid->hid, HID_INPUT_REPORT, (u8 *)&event->data[0], event->length, 0);
+
+	/* Input in display-off state indicates user activity, so request a wakeup. */
+	if (ssam_controller_events_held(shid->ctrl))
+		return SSAM_NOTIF_HANDLED | SSAM_NOTIF_WAKEUP;
+
 	return SSAM_NOTIF_HANDLED;
 }
 
@@ -10,7 +10,10 @@
 #include <asm/unaligned.h>
 #include <linux/hid.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/string.h>
 #include <linux/types.h>
 #include <linux/usb/ch9.h>
 
@@ -97,6 +100,99 @@ static int surface_hid_load_device_attributes(struct surface_hid_device *shid)
 }
 
 
+/* -- Descriptor cache. ----------------------------------------------------- */
+
+/*
+ * The report descriptor is cached in the controller's client data cache,
+ * prefixed by the HID descriptor and device attributes it has been obtained
+ * with. Both of those are re-fetched on each probe and compared to the
+ * cached copies, so that a changed device (e.g. after a firmware update of
+ * the detachable base or type cover) causes the report descriptor to be
+ * re-fetched.
+ */
+struct surface_hid_cache_header {
+	struct surface_hid_descriptor hid_desc;
+	struct surface_hid_attributes attrs;
+} __packed;
+
+static u64 surface_hid_cache_key(struct surface_hid_device *shid)
+{
+	return (u64)'H' << 56 | (u64)shid->uid.domain << 32 |
+	       (u64)shid->uid.category << 24 | shid->uid.target << 16 |
+	       shid->uid.instance << 8 | shid->uid.function;
+}
+
+static bool surface_hid_cache_load(struct surface_hid_device *shid, u8 *buf,
+				   size_t len)
+{
+	struct surface_hid_cache_header *hdr;
+	size_t size = sizeof(*hdr) + len;
+	ssize_t status;
+	bool valid;
+
+	hdr = kmalloc(size, GFP_KERNEL);
+	if (!hdr)
+		return false;
+
+	status = ssam_client_cache_load(shid->ctrl, surface_hid_cache_key(shid),
+					hdr, size);
+
+	valid = status == (ssize_t)size &&
+		!memcmp(&hdr->hid_desc, &shid->hid_desc, sizeof(hdr->hid_desc)) &&
+		!memcmp(&hdr->attrs, &shid->attrs, sizeof(hdr->attrs));
+
+	if (valid)
+		memcpy(buf, hdr + 1, len);
+	else if (status >= 0)
+		ssam_client_cache_drop(shid->ctrl, surface_hid_cache_key(shid));
+
+	kfree(hdr);
+	return valid;
+}
+
+static void surface_hid_cache_store(struct surface_hid_device *shid,
+				    const u8 *buf, size_t len)
+{
+	struct surface_hid_cache_header *hdr;
+
+	hdr = kmalloc(sizeof(*hdr) + len, GFP_KERNEL);
+	if (!hdr)
+		return;
+
+	hdr->hid_desc = shid->hid_desc;
+	hdr->attrs = shid->attrs;
+	memcpy(hdr + 1, buf, len);
+
+	/* Failure is not critical, we will simply re-fetch next time. */
+	ssam_client_cache_store(shid->ctrl, surface_hid_cache_key(shid), hdr,
+				sizeof(*hdr) + len);
+
+	kfree(hdr);
+}
+
+static int surface_hid_load_report_descriptor(struct surface_hid_device *shid,
+					      u8 *buf, size_t len)
+{
+	ktime_t start = ktime_get();
+	bool cached;
+	int status;
+
+	cached = surface_hid_cache_load(shid, buf, len);
+	if (!cached) {
+		status = shid->ops.get_descriptor(shid, SURFACE_HID_DESC_REPORT, buf, len);
+		if (status)
+			return status;
+
+		surface_hid_cache_store(shid, buf, len);
+	}
+
+	dev_dbg(shid->dev, "loaded report descriptor (%zu bytes) from %s in %lld us\n",
+		len, cached ? "cache" : "EC", ktime_us_delta(ktime_get(), start));
+
+	return 0;
+}
+
+
 /* -- Transport driver (common). -------------------------------------------- */
 
 static int surface_hid_start(struct hid_device *hid)
@@ -146,7 +242,7 @@ static int surface_hid_parse(struct hid_device *hid)
 	if (!buf)
 		return -ENOMEM;
 
-	status = shid->ops.get_descriptor(shid, SURFACE_HID_DESC_REPORT, buf, len);
+	status = surface_hid_load_report_descriptor(shid, buf, len);
 	if (!status)
 		status = hid_parse_report(hid, buf, len);
 
@@ -246,8 +342,13 @@ static int surface_hid_suspend(struct device *dev)
 static int surface_hid_resume(struct device *dev)
 {
 	struct surface_hid_device *d = dev_get_drvdata(dev);
+	ktime_t start = ktime_get_boottime();
+	int status;
 
-	return hid_driver_resume(d->hid);
+	status = hid_driver_resume(d->hid);
+	ssam_controller_pm_record_client(d->ctrl, dev, start, status);
+
+	return status;
 }
 
 static int surface_hid_freeze(struct device *dev)
@@ -267,8 +368,13 @@ static int surface_hid_poweroff(struct device *dev)
 static int surface_hid_restore(struct device *dev)
 {
 	struct surface_hid_device *d = dev_get_drvdata(dev);
+	ktime_t start = ktime_get_boottime();
+	int status;
 
-	return hid_driver_reset_resume(d->hid);
+	status = hid_driver_reset_resume(d->hid);
+	ssam_controller_pm_record_client(d->ctrl, dev, start, status);
+
+	return status;
 }
 
 const struct dev_pm_ops surface_hid_pm_ops = {
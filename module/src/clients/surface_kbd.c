@@ -71,7 +71,7 @@ static int ssam_kbd_set_caps_led(struct surface_hid_device *shid, bool value)
 	rqst.target_id = shid->uid.target;
 	rqst.command_id = SURFACE_KBD_CID_SET_CAPSLOCK_LED;
 	rqst.instance_id = shid->uid.instance;
-	rqst.flags = 0;
+	rqst.flags = SSAM_REQUEST_PRIO_INTERACTIVE;
 	rqst.length = sizeof(value_u8);
 	rqst.payload = &value_u8;
 
@@ -89,7 +89,7 @@ static int ssam_kbd_get_feature_report(struct surface_hid_device *shid, u8 *buf,
 	rqst.target_id = shid->uid.target;
 	rqst.command_id = SURFACE_KBD_CID_GET_FEATURE_REPORT;
 	rqst.instance_id = shid->uid.instance;
-	rqst.flags = SSAM_REQUEST_HAS_RESPONSE;
+	rqst.flags = SSAM_REQUEST_HAS_RESPONSE | SSAM_REQUEST_PRIO_INTERACTIVE;
 	rqst.length = sizeof(payload);
 	rqst.payload = &payload;
 
@@ -143,6 +143,11 @@ static u32 ssam_kbd_event_fn(struct ssam_event_notifier *nf, const struct ssam_e
 		return 0;
 
 	hid_input_report(shid->hid, HID_INPUT_REPORT, (u8 *)&event->data[0], event->length, 0);
+
+	/* Input in display-off state indicates user activity, so request a wakeup. */
+	if (ssam_controller_events_held(shid->ctrl))
+		return SSAM_NOTIF_HANDLED | SSAM_NOTIF_WAKEUP;
+
 	return SSAM_NOTIF_HANDLED;
 }
 
@@ -7,18 +7,27 @@
 
 #include <linux/acpi.h>
 #include <linux/atomic.h>
+#include <linux/bitops.h>
 #include <linux/completion.h>
+#include <linux/cpumask.h>
 #include <linux/gpio/consumer.h>
+#include <linux/hash.h>
 #include <linux/interrupt.h>
 #include <linux/kref.h>
+#include <linux/ktime.h>
 #include <linux/limits.h>
 #include <linux/list.h>
+#include <linux/llist.h>
 #include <linux/lockdep.h>
+#include <linux/log2.h>
+#include <linux/moduleparam.h>
 #include <linux/mutex.h>
+#include <linux/pm_wakeup.h>
 #include <linux/rculist.h>
 #include <linux/rbtree.h>
 #include <linux/rwsem.h>
 #include <linux/serdev.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/srcu.h>
@@ -129,36 +138,374 @@ static bool ssam_event_matches_notifier(const struct ssam_event_notifier *n,
 	return match;
 }
 
+static int ssam_cplt_wq_cpu(const struct ssam_cplt_wq *wq);
+
+static bool ssam_event_coalesce_matches(const struct ssam_event_coalesce *c,
+					const struct ssam_event *event)
+{
+	return c->tc == event->target_category &&
+	       c->tid == event->target_id &&
+	       c->cid == event->command_id &&
+	       c->iid == event->instance_id;
+}
+
+/*
+ * Deliver an event to the notifier and open a new coalescing window for
+ * events matching it. Must be called with the coalescing lock held.
+ */
+static u32 ssam_event_coalesce_deliver(struct ssam_event_coalesce *c,
+				       const struct ssam_event *event)
+{
+	struct ssam_event_notifier *n = c->notif;
+	unsigned long delay = msecs_to_jiffies(n->coalesce.window_ms);
+
+	lockdep_assert_held(&c->lock);
+
+	c->tc = event->target_category;
+	c->tid = event->target_id;
+	c->cid = event->command_id;
+	c->iid = event->instance_id;
+	c->last_ret = n->base.fn(n, event);
+
+	c->active = true;
+	mod_delayed_work_on(ssam_cplt_wq_cpu(c->wq), c->wq->wq, &c->work, delay);
+
+	return c->last_ret;
+}
+
+/*
+ * Deliver the stored collapsed event, if any. Must be called with the
+ * coalescing lock held. Returns false if there was no event to deliver.
+ */
+static bool ssam_event_coalesce_deliver_pending(struct ssam_event_coalesce *c)
+{
+	struct ssam_event *event = c->pending;
+	int status;
+
+	if (!event)
+		return false;
+
+	c->pending = NULL;
+
+	status = ssam_notifier_to_errno(ssam_event_coalesce_deliver(c, event));
+	if (status < 0) {
+		dev_err(c->dev,
+			"event: error handling coalesced event: %d (tc: %#04x, tid: %#04x, cid: %#04x, iid: %#04x)\n",
+			status, event->target_category, event->target_id,
+			event->command_id, event->instance_id);
+	}
+
+	kfree(event);
+	return true;
+}
+
+static void ssam_event_coalesce_workfn(struct work_struct *work)
+{
+	struct ssam_event_coalesce *c;
+	int idx;
+
+	c = container_of(work, struct ssam_event_coalesce, work.work);
+
+	/* Deliver in the same SRCU read-side section as regular chain calls. */
+	idx = srcu_read_lock(&c->nh->srcu);
+	mutex_lock(&c->lock);
+
+	/*
+	 * If there is no event to deliver, close the window. Otherwise,
+	 * delivering the event keeps it open for another period to continue
+	 * collapsing a potentially ongoing burst.
+	 */
+	if (!ssam_event_coalesce_deliver_pending(c))
+		c->active = false;
+
+	mutex_unlock(&c->lock);
+	srcu_read_unlock(&c->nh->srcu, idx);
+}
+
+/**
+ * ssam_event_coalesce_call() - Call a coalescing event notifier.
+ * @c:     The coalescing state of the notifier.
+ * @event: The event to notify of.
+ *
+ * If a coalescing window is currently open and the event matches the last
+ * delivered one, stores a copy of the event to be delivered at the end of the
+ * window, replacing any previously stored one. Otherwise, delivers any stored
+ * event, followed by the new one, and opens a new window for events matching
+ * the new one. All deliveries to the notifier are serialized, so that the
+ * notifier sees events in order of their reception.
+ *
+ * Return: Returns the notifier status value of the notifier callback if the
+ * event has been delivered directly. For collapsed events, returns the
+ * notifier status bits of the last delivered event, which is of the same type.
+ */
+static u32 ssam_event_coalesce_call(struct ssam_event_coalesce *c,
+				    const struct ssam_event *event)
+{
+	struct ssam_event *copy;
+	u32 ret;
+
+	mutex_lock(&c->lock);
+
+	if (c->active && ssam_event_coalesce_matches(c, event)) {
+		copy = kmemdup(event, struct_size(event, data, event->length),
+			       GFP_KERNEL);
+		if (copy) {
+			kfree(c->pending);
+			c->pending = copy;
+
+			/*
+			 * Only forward the status bits, error values and
+			 * wakeup requests are reported on delivery.
+			 */
+			ret = c->last_ret & SSAM_NOTIF_STATE_MASK & ~SSAM_NOTIF_WAKEUP;
+			goto out;
+		}
+
+		/* The new event supersedes any stored one. */
+		kfree(c->pending);
+		c->pending = NULL;
+	}
+
+	/* Preserve ordering: Deliver the stored (older) event first. */
+	ssam_event_coalesce_deliver_pending(c);
+
+	ret = ssam_event_coalesce_deliver(c, event);
+out:
+	mutex_unlock(&c->lock);
+	return ret;
+}
+
+/**
+ * ssam_nf_call_one() - Call a single event notifier.
+ * @n:     The event notifier.
+ * @event: The event to notify of.
+ *
+ * Return: Returns the notifier status value.
+ */
+static u32 ssam_nf_call_one(struct ssam_event_notifier *n,
+			    const struct ssam_event *event)
+{
+	if (n->coalesce.state)
+		return ssam_event_coalesce_call(n->coalesce.state, event);
+
+	return n->base.fn(n, event);
+}
+
+/**
+ * ssam_event_coalesce_alloc() - Allocate the coalescing state of a notifier.
+ * @n:   The event notifier.
+ * @nh:  The notifier head the notifier is registered on.
+ * @dev: The controller device, used for logging.
+ * @wq:  The completion workqueue on which deferred events are delivered.
+ *
+ * Return: Returns zero on success or if coalescing is disabled for the given
+ * notifier, %-ENOMEM if the state could not be allocated.
+ */
+static int ssam_event_coalesce_alloc(struct ssam_event_notifier *n,
+				     struct ssam_nf_head *nh,
+				     struct device *dev,
+				     struct ssam_cplt_wq *wq)
+{
+	struct ssam_event_coalesce *c;
+
+	n->coalesce.state = NULL;
+	if (!n->coalesce.window_ms)
+		return 0;
+
+	c = kzalloc(sizeof(*c), GFP_KERNEL);
+	if (!c)
+		return -ENOMEM;
+
+	c->notif = n;
+	c->nh = nh;
+	c->dev = dev;
+	c->wq = wq;
+	mutex_init(&c->lock);
+	INIT_DELAYED_WORK(&c->work, ssam_event_coalesce_workfn);
+
+	n->coalesce.state = c;
+	return 0;
+}
+
+/**
+ * ssam_event_coalesce_free() - Free the coalescing state of a notifier.
+ * @n: The event notifier.
+ *
+ * Must only be called once the notifier has been removed from its chain and
+ * no notifier calls are running any more. Discards any pending event.
+ */
+static void ssam_event_coalesce_free(struct ssam_event_notifier *n)
+{
+	struct ssam_event_coalesce *c = n->coalesce.state;
+
+	if (!c)
+		return;
+
+	/*
+	 * The notifier has been removed from its chain, so no new events can
+	 * be stored. Discard the pending one to prevent any further delivery.
+	 */
+	mutex_lock(&c->lock);
+	kfree(c->pending);
+	c->pending = NULL;
+	mutex_unlock(&c->lock);
+
+	cancel_delayed_work_sync(&c->work);
+	mutex_destroy(&c->lock);
+	kfree(c);
+
+	n->coalesce.state = NULL;
+}
+
+/*
+ * SSAM_NF_HEAD_MAX_BUCKETS - Maximum number of notifier buckets an event may
+ * match, one for each combination of &enum ssam_event_mask bits.
+ */
+#define SSAM_NF_HEAD_MAX_BUCKETS	4
+
+/**
+ * ssam_nf_head_bucket() - Get the notifier bucket for the given matching
+ * parameters.
+ * @nh:   The notifier head.
+ * @mask: The event mask, determining which of the remaining parameters are
+ *        used for matching.
+ * @tid:  The target ID. Ignored if @mask does not contain
+ *        %SSAM_EVENT_MASK_TARGET.
+ * @iid:  The instance ID. Ignored if @mask does not contain
+ *        %SSAM_EVENT_MASK_INSTANCE.
+ *
+ * Return: Returns the list-head of the bucket.
+ */
+static struct list_head *ssam_nf_head_bucket(struct ssam_nf_head *nh, u8 mask,
+					     u8 tid, u8 iid)
+{
+	u32 key;
+
+	mask &= SSAM_EVENT_MASK_STRICT;
+	tid = (mask & SSAM_EVENT_MASK_TARGET) ? tid : 0;
+	iid = (mask & SSAM_EVENT_MASK_INSTANCE) ? iid : 0;
+
+	key = (mask << 16) | (tid << 8) | iid;
+	return &nh->bucket[hash_32(key, ilog2(SSAM_NF_HEAD_NUM_BUCKETS))];
+}
+
+static struct list_head *ssam_nf_head_bucket_of(struct ssam_nf_head *nh,
+						 const struct ssam_event_notifier *n)
+{
+	return ssam_nf_head_bucket(nh, n->event.mask, n->event.reg.target_id,
+				   n->event.id.instance);
+}
+
+/**
+ * ssam_nf_head_event_buckets() - Get all notifier buckets that may contain
+ * notifiers matching the given event.
+ * @nh:      The notifier head.
+ * @event:   The event.
+ * @buckets: Output array for the list-heads of the buckets.
+ *
+ * Return: Returns the number of (distinct) buckets stored in @buckets.
+ */
+static unsigned int ssam_nf_head_event_buckets(struct ssam_nf_head *nh,
+					       const struct ssam_event *event,
+					       struct list_head **buckets)
+{
+	unsigned int n = 0, i;
+	struct list_head *b;
+	u8 mask;
+
+	for (mask = 0; mask < SSAM_NF_HEAD_MAX_BUCKETS; mask++) {
+		b = ssam_nf_head_bucket(nh, mask, event->target_id,
+					event->instance_id);
+
+		/* Different masks may hash to the same bucket. */
+		for (i = 0; i < n; i++) {
+			if (buckets[i] == b)
+				break;
+		}
+
+		if (i == n)
+			buckets[n++] = b;
+	}
+
+	return n;
+}
+
+/*
+ * Test if notifier a needs to be called before notifier b, i.e. if it has
+ * higher priority or equal priority but has been registered first.
+ */
+static bool ssam_nfblk_before(const struct ssam_event_notifier *a,
+			      const struct ssam_event_notifier *b)
+{
+	if (a->base.priority != b->base.priority)
+		return a->base.priority > b->base.priority;
+
+	return (s32)(a->seq - b->seq) < 0;
+}
+
 /**
  * ssam_nfblk_call_chain() - Call event notifier callbacks of the given chain.
  * @nh:    The notifier head for which the notifier callbacks should be called.
  * @event: The event data provided to the callbacks.
  *
- * Call all registered notifier callbacks in order of their priority until
- * either no notifier is left or a notifier returns a value with the
- * %SSAM_NOTIF_STOP bit set. Note that this bit is automatically set via
- * ssam_notifier_from_errno() on any non-zero error value.
+ * Call all registered notifier callbacks matching the given event in order
+ * of their priority until either no notifier is left or a notifier returns a
+ * value with the %SSAM_NOTIF_STOP bit set. Note that this bit is
+ * automatically set via ssam_notifier_from_errno() on any non-zero error
+ * value.
+ *
+ * Notifiers are indexed by their event mask, target ID, and instance ID.
+ * Only buckets that may contain matching notifiers are visited, and merged
+ * in order of notifier priority and registration.
  *
  * Return: Returns the notifier status value, which contains the notifier
- * status bits (%SSAM_NOTIF_HANDLED and %SSAM_NOTIF_STOP) as well as a
- * potential error value returned from the last executed notifier callback.
+ * status bits (%SSAM_NOTIF_HANDLED, %SSAM_NOTIF_STOP, and %SSAM_NOTIF_WAKEUP)
+ * as well as a potential error value returned from the last executed notifier
+ * callback.
  * Use ssam_notifier_to_errno() to convert this value to the original error
  * value.
  */
 static int ssam_nfblk_call_chain(struct ssam_nf_head *nh, struct ssam_event *event)
 {
+	struct ssam_event_notifier *cur[SSAM_NF_HEAD_MAX_BUCKETS];
+	struct list_head *buckets[SSAM_NF_HEAD_MAX_BUCKETS];
 	struct ssam_event_notifier *nf;
+	unsigned int n, i, sel;
 	int ret = 0, idx;
 
+	n = ssam_nf_head_event_buckets(nh, event, buckets);
+
 	idx = srcu_read_lock(&nh->srcu);
 
-	list_for_each_entry_rcu(nf, &nh->head, base.node,
-				srcu_read_lock_held(&nh->srcu)) {
-		if (ssam_event_matches_notifier(nf, event)) {
-			ret = (ret & SSAM_NOTIF_STATE_MASK) | nf->base.fn(nf, event);
-			if (ret & SSAM_NOTIF_STOP)
-				break;
+	for (i = 0; i < n; i++)
+		cur[i] = list_first_or_null_rcu(buckets[i], struct ssam_event_notifier,
+						base.node);
+
+	while (true) {
+		nf = NULL;
+		sel = 0;
+
+		for (i = 0; i < n; i++) {
+			if (cur[i] && (!nf || ssam_nfblk_before(cur[i], nf))) {
+				nf = cur[i];
+				sel = i;
+			}
 		}
+
+		if (!nf)
+			break;
+
+		cur[sel] = list_next_or_null_rcu(buckets[sel], &nf->base.node,
+						 struct ssam_event_notifier,
+						 base.node);
+
+		/* Buckets may be shared by notifiers with different keys. */
+		if (!ssam_event_matches_notifier(nf, event))
+			continue;
+
+		ret = (ret & SSAM_NOTIF_STATE_MASK) | ssam_nf_call_one(nf, event);
+		if (ret & SSAM_NOTIF_STOP)
+			break;
 	}
 
 	srcu_read_unlock(&nh->srcu, idx);
@@ -169,7 +516,7 @@ static int ssam_nfblk_call_chain(struct ssam_nf_head *nh, struct ssam_event *eve
  * ssam_nfblk_insert() - Insert a new notifier block into the given notifier
  * list.
  * @nh: The notifier head into which the block should be inserted.
- * @nb: The notifier block to add.
+ * @n:  The notifier block to add.
  *
  * Note: This function must be synchronized by the caller with respect to other
  * insert, find, and/or remove calls by holding ``struct ssam_nf.lock``.
@@ -177,25 +524,27 @@ static int ssam_nfblk_call_chain(struct ssam_nf_head *nh, struct ssam_event *eve
  * Return: Returns zero on success, %-EEXIST if the notifier block has already
  * been registered.
  */
-static int ssam_nfblk_insert(struct ssam_nf_head *nh, struct ssam_notifier_block *nb)
+static int ssam_nfblk_insert(struct ssam_nf_head *nh, struct ssam_event_notifier *n)
 {
-	struct ssam_notifier_block *p;
+	struct list_head *bucket = ssam_nf_head_bucket_of(nh, n);
+	struct ssam_event_notifier *p;
 	struct list_head *h;
 
 	/* Runs under lock, no need for RCU variant. */
-	list_for_each(h, &nh->head) {
-		p = list_entry(h, struct ssam_notifier_block, node);
+	list_for_each(h, bucket) {
+		p = list_entry(h, struct ssam_event_notifier, base.node);
 
-		if (unlikely(p == nb)) {
+		if (unlikely(p == n)) {
 			WARN(1, "double register detected");
 			return -EEXIST;
 		}
 
-		if (nb->priority > p->priority)
+		if (n->base.priority > p->base.priority)
 			break;
 	}
 
-	list_add_tail_rcu(&nb->node, h);
+	n->seq = nh->seq++;
+	list_add_tail_rcu(&n->base.node, h);
 	return 0;
 }
 
@@ -204,7 +553,7 @@ static int ssam_nfblk_insert(struct ssam_nf_head *nh, struct ssam_notifier_block
  * notifier head.
  * list.
  * @nh: The notifier head on which to search.
- * @nb: The notifier block to search for.
+ * @n:  The notifier block to search for.
  *
  * Note: This function must be synchronized by the caller with respect to other
  * insert, find, and/or remove calls by holding ``struct ssam_nf.lock``.
@@ -212,13 +561,13 @@ static int ssam_nfblk_insert(struct ssam_nf_head *nh, struct ssam_notifier_block
  * Return: Returns true if the given notifier block is registered on the given
  * notifier head, false otherwise.
  */
-static bool ssam_nfblk_find(struct ssam_nf_head *nh, struct ssam_notifier_block *nb)
+static bool ssam_nfblk_find(struct ssam_nf_head *nh, struct ssam_event_notifier *n)
 {
-	struct ssam_notifier_block *p;
+	struct ssam_event_notifier *p;
 
 	/* Runs under lock, no need for RCU variant. */
-	list_for_each_entry(p, &nh->head, node) {
-		if (p == nb)
+	list_for_each_entry(p, ssam_nf_head_bucket_of(nh, n), base.node) {
+		if (p == n)
 			return true;
 	}
 
@@ -227,7 +576,7 @@ static bool ssam_nfblk_find(struct ssam_nf_head *nh, struct ssam_notifier_block
 
 /**
  * ssam_nfblk_remove() - Remove a notifier block from its notifier list.
- * @nb: The notifier block to be removed.
+ * @n: The notifier block to be removed.
  *
  * Note: This function must be synchronized by the caller with respect to
  * other insert, find, and/or remove calls by holding ``struct ssam_nf.lock``.
@@ -235,9 +584,9 @@ static bool ssam_nfblk_find(struct ssam_nf_head *nh, struct ssam_notifier_block
  * synchronize_srcu() with ``nh->srcu`` after leaving the critical section, to
  * ensure that the removed notifier block is not in use any more.
  */
-static void ssam_nfblk_remove(struct ssam_notifier_block *nb)
+static void ssam_nfblk_remove(struct ssam_event_notifier *n)
 {
-	list_del_rcu(&nb->node);
+	list_del_rcu(&n->base.node);
 }
 
 /**
@@ -246,13 +595,16 @@ static void ssam_nfblk_remove(struct ssam_notifier_block *nb)
  */
 static int ssam_nf_head_init(struct ssam_nf_head *nh)
 {
-	int status;
+	int status, i;
 
 	status = init_srcu_struct(&nh->srcu);
 	if (status)
 		return status;
 
-	INIT_LIST_HEAD(&nh->head);
+	for (i = 0; i < SSAM_NF_HEAD_NUM_BUCKETS; i++)
+		INIT_LIST_HEAD(&nh->bucket[i]);
+
+	nh->seq = 0;
 	return 0;
 }
 
@@ -460,16 +812,19 @@ static bool ssam_nf_refcount_empty(struct ssam_nf *nf)
  * this function will emit a warning.
  *
  * In case a callback failed, this function will emit an error message.
+ *
+ * Return: Returns the accumulated notifier status value of the executed
+ * callbacks.
  */
-static void ssam_nf_call(struct ssam_nf *nf, struct device *dev, u16 rqid,
-			 struct ssam_event *event)
+static int ssam_nf_call(struct ssam_nf *nf, struct device *dev, u16 rqid,
+			struct ssam_event *event)
 {
 	struct ssam_nf_head *nf_head;
 	int status, nf_ret;
 
 	if (!ssh_rqid_is_event(rqid)) {
 		dev_warn(dev, "event: unsupported rqid: %#06x\n", rqid);
-		return;
+		return 0;
 	}
 
 	nf_head = &nf->head[ssh_rqid_to_event(rqid)];
@@ -487,6 +842,8 @@ static void ssam_nf_call(struct ssam_nf *nf, struct device *dev, u16 rqid,
 			 rqid, event->target_category, event->target_id,
 			 event->command_id, event->instance_id);
 	}
+
+	return nf_ret;
 }
 
 /**
@@ -531,7 +888,8 @@ static void ssam_nf_destroy(struct ssam_nf *nf)
 
 /* -- Event/async request completion system. -------------------------------- */
 
-#define SSAM_CPLT_WQ_NAME	"ssam_cpltq"
+#define SSAM_CPLT_WQ_NAME		"ssam_cpltq"
+#define SSAM_CPLT_WQ_HIPRI_NAME		"ssam_cpltq_hipri"
 
 /*
  * SSAM_CPLT_WQ_BATCH - Maximum number of event item completions executed per
@@ -540,6 +898,26 @@ static void ssam_nf_destroy(struct ssam_nf *nf)
  */
 #define SSAM_CPLT_WQ_BATCH	10
 
+/*
+ * Target categories whose events are completed on the high-priority
+ * completion workqueue. Defaults to keyboard and HID input events, so that
+ * these are not delayed by potentially slow notifier chains of other
+ * subsystems (e.g. battery or ACPI notifications).
+ */
+static unsigned short cplt_hipri_tc[SSH_NUM_EVENTS] = {
+	SSAM_SSH_TC_KBD,
+	SSAM_SSH_TC_HID,
+};
+static unsigned int cplt_hipri_tc_count = 2;
+module_param_array(cplt_hipri_tc, ushort, &cplt_hipri_tc_count, 0444);
+MODULE_PARM_DESC(cplt_hipri_tc,
+		 "Target categories of events completed on the high-priority workqueue (default: 0x08,0x15)");
+
+static int cplt_hipri_cpu = -1;
+module_param(cplt_hipri_cpu, int, 0444);
+MODULE_PARM_DESC(cplt_hipri_cpu,
+		 "CPU to pin the high-priority completion workqueue to, or -1 for unbound (default: -1)");
+
 /*
  * SSAM_EVENT_ITEM_CACHE_PAYLOAD_LEN - Maximum payload length for a cached
  * &struct ssam_event_item.
@@ -589,30 +967,180 @@ static void __ssam_event_item_free_generic(struct ssam_event_item *item)
 	kfree(item);
 }
 
+static void __ssam_event_item_free_pooled(struct ssam_event_item *item)
+{
+	llist_add(&item->pool_node, &item->pool->free);
+}
+
+/*
+ * ssam_event_pool_classes - Size classes of the event item pool.
+ *
+ * The two smallest classes cover the vast majority of events, including
+ * keyboard, touchpad, and most HID input reports. The largest class covers
+ * the maximum message size accepted by the packet layer receiver (4 KiB), so
+ * that no received event needs to exceed the pool. Classes start with a few
+ * preallocated items and are grown lazily up to their capacity when
+ * exhausted.
+ */
+static const struct {
+	size_t len;
+	unsigned int prealloc;
+	unsigned int capacity;
+} ssam_event_pool_classes[SSAM_EVENT_POOL_NUM_CLASSES] = {
+	{ .len = 32,   .prealloc = 16, .capacity = 64 },
+	{ .len = 64,   .prealloc = 16, .capacity = 64 },
+	{ .len = 256,  .prealloc = 4,  .capacity = 32 },
+	{ .len = 4096, .prealloc = 0,  .capacity = 4  },
+};
+
+/*
+ * SSAM_EVENT_POOL_REFILL_BATCH - Maximum number of event items added to an
+ * exhausted pool size class per refill work execution.
+ */
+#define SSAM_EVENT_POOL_REFILL_BATCH	8
+
 /**
- * ssam_event_item_free() - Free the provided event item.
- * @item: The event item to free.
+ * ssam_event_pool_class_grow() - Add new event items to a pool size class.
+ * @cls: The pool size class.
+ * @n:   The maximum number of items to add.
+ *
+ * Allocates up to @n new event items and adds them to the free list of the
+ * given size class, stopping once the class has reached its capacity.
  */
-static void ssam_event_item_free(struct ssam_event_item *item)
+static void ssam_event_pool_class_grow(struct ssam_event_pool_class *cls,
+				       unsigned int n)
 {
-	trace_ssam_event_item_free(item);
-	item->ops.free(item);
+	const size_t size = sizeof(struct ssam_event_item) + cls->len;
+	struct ssam_event_item *item;
+
+	while (n-- && atomic_read(&cls->size) < cls->capacity) {
+		item = kzalloc(size, GFP_KERNEL);
+		if (!item)
+			return;
+
+		item->pool = cls;
+		item->ops.free = __ssam_event_item_free_pooled;
+
+		atomic_inc(&cls->size);
+		llist_add(&item->pool_node, &cls->free);
+	}
+}
+
+static void ssam_event_pool_refill_fn(struct work_struct *work)
+{
+	struct ssam_event_pool *pool;
+	int i;
+
+	pool = container_of(work, struct ssam_event_pool, refill);
+
+	for (i = 0; i < ARRAY_SIZE(pool->cls); i++) {
+		if (llist_empty(&pool->cls[i].free))
+			ssam_event_pool_class_grow(&pool->cls[i],
+						   SSAM_EVENT_POOL_REFILL_BATCH);
+	}
 }
 
 /**
- * ssam_event_item_alloc() - Allocate an event item with the given payload size.
- * @len:   The event payload length.
- * @flags: The flags used for allocation.
+ * ssam_event_pool_init() - Initialize the event item pool.
+ * @pool: The pool to initialize.
  *
- * Allocate an event item with the given payload size, preferring allocation
- * from the event item cache if the payload is small enough (i.e. smaller than
- * %SSAM_EVENT_ITEM_CACHE_PAYLOAD_LEN). Sets the item operations and payload
- * length values. The item free callback (``ops.free``) should not be
- * overwritten after this call.
+ * Initializes the pool and preallocates the initial event items of each
+ * size class. Failure to preallocate is not fatal, as allocations fall back
+ * to the generic allocator when the pool is exhausted.
+ */
+static void ssam_event_pool_init(struct ssam_event_pool *pool)
+{
+	struct ssam_event_pool_class *cls;
+	unsigned int prealloc;
+	int i;
+
+	INIT_WORK(&pool->refill, ssam_event_pool_refill_fn);
+
+	for (i = 0; i < ARRAY_SIZE(pool->cls); i++) {
+		cls = &pool->cls[i];
+
+		init_llist_head(&cls->free);
+		cls->len = ssam_event_pool_classes[i].len;
+		cls->capacity = ssam_event_pool_classes[i].capacity;
+		atomic_set(&cls->size, 0);
+		atomic_long_set(&cls->hits, 0);
+		atomic_long_set(&cls->misses, 0);
+
+		prealloc = ssam_event_pool_classes[i].prealloc;
+		ssam_event_pool_class_grow(cls, prealloc);
+	}
+}
+
+/**
+ * ssam_event_pool_destroy() - Deinitialize the event item pool.
+ * @pool: The pool to deinitialize.
  *
- * Return: Returns the newly allocated event item.
+ * Frees all event items of the pool. All items must have been returned to
+ * the pool prior to this call.
+ */
+static void ssam_event_pool_destroy(struct ssam_event_pool *pool)
+{
+	struct ssam_event_item *item, *next;
+	struct llist_node *head;
+	int n, i;
+
+	cancel_work_sync(&pool->refill);
+
+	for (i = 0; i < ARRAY_SIZE(pool->cls); i++) {
+		head = llist_del_all(&pool->cls[i].free);
+		n = 0;
+
+		llist_for_each_entry_safe(item, next, head, pool_node) {
+			kfree(item);
+			n++;
+		}
+
+		WARN_ON(n != atomic_read(&pool->cls[i].size));
+	}
+}
+
+/**
+ * ssam_event_pool_get() - Get a free event item from the pool.
+ * @pool: The pool.
+ * @len:  The event payload length.
+ *
+ * Takes a free event item from the smallest size class that can hold the
+ * given payload. If that class is exhausted, schedules it to be refilled.
+ * Must only be called from the receiver thread, as the free lists of the
+ * pool support only a single consumer.
+ *
+ * Return: Returns the event item, or %NULL if no suitable item is available.
  */
-static struct ssam_event_item *ssam_event_item_alloc(size_t len, gfp_t flags)
+static struct ssam_event_item *ssam_event_pool_get(struct ssam_event_pool *pool,
+						   size_t len)
+{
+	struct ssam_event_pool_class *cls;
+	struct llist_node *node;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(pool->cls); i++) {
+		if (len <= pool->cls[i].len)
+			break;
+	}
+
+	if (WARN_ON(i == ARRAY_SIZE(pool->cls)))
+		return NULL;
+
+	cls = &pool->cls[i];
+
+	node = llist_del_first(&cls->free);
+	if (unlikely(!node)) {
+		atomic_long_inc(&cls->misses);
+		schedule_work(&pool->refill);
+		return NULL;
+	}
+
+	atomic_long_inc(&cls->hits);
+	return llist_entry(node, struct ssam_event_item, pool_node);
+}
+
+static struct ssam_event_item *__ssam_event_item_alloc_fallback(size_t len,
+								 gfp_t flags)
 {
 	struct ssam_event_item *item;
 
@@ -630,6 +1158,47 @@ static struct ssam_event_item *ssam_event_item_alloc(size_t len, gfp_t flags)
 		item->ops.free = __ssam_event_item_free_generic;
 	}
 
+	item->pool = NULL;
+	return item;
+}
+
+/**
+ * ssam_event_item_free() - Free the provided event item.
+ * @item: The event item to free.
+ */
+static void ssam_event_item_free(struct ssam_event_item *item)
+{
+	trace_ssam_event_item_free(item);
+	item->ops.free(item);
+}
+
+/**
+ * ssam_event_item_alloc() - Allocate an event item with the given payload size.
+ * @pool:  The event item pool to allocate from.
+ * @len:   The event payload length.
+ * @flags: The flags used for allocation if the pool has been exhausted.
+ *
+ * Allocate an event item with the given payload size, preferring allocation
+ * from the event item pool. If the respective pool size class has been
+ * exhausted, fall back to the event item cache if the payload is small
+ * enough (i.e. smaller than %SSAM_EVENT_ITEM_CACHE_PAYLOAD_LEN), or the
+ * generic allocator otherwise. Sets the item operations and payload length
+ * values. The item free callback (``ops.free``) should not be overwritten
+ * after this call.
+ *
+ * Return: Returns the newly allocated event item.
+ */
+static struct ssam_event_item *
+ssam_event_item_alloc(struct ssam_event_pool *pool, size_t len, gfp_t flags)
+{
+	struct ssam_event_item *item;
+
+	item = ssam_event_pool_get(pool, len);
+	if (!item)
+		item = __ssam_event_item_alloc_fallback(len, flags);
+	if (!item)
+		return NULL;
+
 	item->event.length = len;
 
 	trace_ssam_event_item_alloc(item, len);
@@ -716,13 +1285,33 @@ struct ssam_event_queue *ssam_cplt_get_event_queue(struct ssam_cplt *cplt,
 }
 
 /**
- * ssam_cplt_submit() - Submit a work item to the completion system workqueue.
- * @cplt: The completion system.
+ * ssam_cplt_wq_cpu() - Get the CPU to queue completion work items on.
+ * @wq: The completion workqueue.
+ *
+ * queue_work_on() does not guarantee execution of work items queued on an
+ * offline CPU. Fall back to unbound queuing if the CPU the workqueue has been
+ * bound to has been taken offline. Racing with CPU hotplug here is fine, as
+ * pending work items of a CPU going down are still executed elsewhere.
+ *
+ * Return: Returns the CPU the workqueue has been bound to if it is online,
+ * %WORK_CPU_UNBOUND otherwise.
+ */
+static int ssam_cplt_wq_cpu(const struct ssam_cplt_wq *wq)
+{
+	if (wq->cpu != WORK_CPU_UNBOUND && !cpu_online(wq->cpu))
+		return WORK_CPU_UNBOUND;
+
+	return wq->cpu;
+}
+
+/**
+ * ssam_cplt_submit() - Submit a work item to a completion system workqueue.
+ * @wq:   The completion workqueue.
  * @work: The work item to submit.
  */
-static bool ssam_cplt_submit(struct ssam_cplt *cplt, struct work_struct *work)
+static bool ssam_cplt_submit(struct ssam_cplt_wq *wq, struct work_struct *work)
 {
-	return queue_work(cplt->wq, work);
+	return queue_work_on(ssam_cplt_wq_cpu(wq), wq->wq, work);
 }
 
 /**
@@ -747,7 +1336,7 @@ static int ssam_cplt_submit_event(struct ssam_cplt *cplt,
 		return -EINVAL;
 
 	ssam_event_queue_push(evq, item);
-	ssam_cplt_submit(cplt, &evq->work);
+	ssam_cplt_submit(evq->wq, &evq->work);
 	return 0;
 }
 
@@ -770,7 +1359,10 @@ static int ssam_cplt_submit_event(struct ssam_cplt *cplt,
  */
 static void ssam_cplt_flush(struct ssam_cplt *cplt)
 {
-	flush_workqueue(cplt->wq);
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(cplt->wq); i++)
+		flush_workqueue(cplt->wq[i].wq);
 }
 
 static void ssam_event_queue_work_fn(struct work_struct *work)
@@ -780,6 +1372,7 @@ static void ssam_event_queue_work_fn(struct work_struct *work)
 	struct ssam_nf *nf;
 	struct device *dev;
 	unsigned int iterations = SSAM_CPLT_WQ_BATCH;
+	int nf_ret;
 
 	queue = container_of(work, struct ssam_event_queue, work);
 	nf = &queue->cplt->event.notif;
@@ -791,56 +1384,163 @@ static void ssam_event_queue_work_fn(struct work_struct *work)
 		if (!item)
 			return;
 
-		ssam_nf_call(nf, dev, item->rqid, &item->event);
+		nf_ret = ssam_nf_call(nf, dev, item->rqid, &item->event);
 		ssam_event_item_free(item);
+
+		/*
+		 * Report wakeup events to the PM core. This aborts any suspend
+		 * transition in progress and, while the system is running, is
+		 * accounted for in the wakeup source of the device.
+		 */
+		if (nf_ret & SSAM_NOTIF_WAKEUP) {
+			atomic_long_inc(&queue->cplt->event.wakeups);
+			pm_wakeup_hard_event(dev);
+		}
 	} while (--iterations);
 
 	if (!ssam_event_queue_is_empty(queue))
-		ssam_cplt_submit(queue->cplt, &queue->work);
+		ssam_cplt_submit(queue->wq, &queue->work);
 }
 
 /**
- * ssam_event_queue_init() - Initialize an event queue.
- * @cplt: The completion system on which the queue resides.
- * @evq:  The event queue to initialize.
+ * ssam_cplt_tc_to_wq() - Get the completion workqueue class for events of
+ * the given target category.
+ * @tc: The target category.
+ *
+ * Return: Returns %SSAM_CPLT_WQ_HIPRI if events of the given target category
+ * have been configured to be completed on the high-priority workqueue,
+ * %SSAM_CPLT_WQ_DEFAULT otherwise.
+ */
+static enum ssam_cplt_wq_id ssam_cplt_tc_to_wq(u8 tc)
+{
+	unsigned int i;
+
+	for (i = 0; i < cplt_hipri_tc_count; i++) {
+		if (cplt_hipri_tc[i] == tc)
+			return SSAM_CPLT_WQ_HIPRI;
+	}
+
+	return SSAM_CPLT_WQ_DEFAULT;
+}
+
+/**
+ * ssam_event_queue_init() - Initialize an event queue.
+ * @cplt: The completion system on which the queue resides.
+ * @evq:  The event queue to initialize.
+ * @wq:   The completion workqueue on which the queue should be processed.
  */
 static void ssam_event_queue_init(struct ssam_cplt *cplt,
-				  struct ssam_event_queue *evq)
+				  struct ssam_event_queue *evq,
+				  struct ssam_cplt_wq *wq)
 {
 	evq->cplt = cplt;
+	evq->wq = wq;
 	spin_lock_init(&evq->lock);
 	INIT_LIST_HEAD(&evq->head);
 	INIT_WORK(&evq->work, ssam_event_queue_work_fn);
 }
 
+/**
+ * ssam_cplt_wq_init() - Initialize the completion workqueues.
+ * @cplt: The completion system.
+ *
+ * Allocates the default and high-priority completion workqueues. The
+ * high-priority workqueue is bound to the CPU specified via the
+ * ``cplt_hipri_cpu`` module parameter, if set and online, and unbound
+ * otherwise. If that CPU is taken offline later on, work items are queued
+ * unbound until it comes back, see ssam_cplt_wq_cpu().
+ *
+ * Return: Returns zero on success, %-ENOMEM if any workqueue could not be
+ * allocated.
+ */
+static int ssam_cplt_wq_init(struct ssam_cplt *cplt)
+{
+	struct ssam_cplt_wq *dflt = &cplt->wq[SSAM_CPLT_WQ_DEFAULT];
+	struct ssam_cplt_wq *hipri = &cplt->wq[SSAM_CPLT_WQ_HIPRI];
+	unsigned int flags = WQ_HIGHPRI | WQ_MEM_RECLAIM;
+	int cpu = READ_ONCE(cplt_hipri_cpu);
+
+	if (cpu >= 0 && (cpu >= nr_cpu_ids || !cpu_online(cpu))) {
+		dev_warn(cplt->dev, "invalid or offline CPU for high-priority completion workqueue: %d\n",
+			 cpu);
+		cpu = -1;
+	}
+
+	if (cpu < 0) {
+		flags |= WQ_UNBOUND;
+		cpu = WORK_CPU_UNBOUND;
+	}
+
+	dflt->wq = alloc_workqueue(SSAM_CPLT_WQ_NAME, WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
+	if (!dflt->wq)
+		return -ENOMEM;
+
+	dflt->cpu = WORK_CPU_UNBOUND;
+
+	hipri->wq = alloc_workqueue(SSAM_CPLT_WQ_HIPRI_NAME, flags, 0);
+	if (!hipri->wq) {
+		destroy_workqueue(dflt->wq);
+		return -ENOMEM;
+	}
+
+	hipri->cpu = cpu;
+	return 0;
+}
+
+/**
+ * ssam_cplt_wq_destroy() - Destroy the completion workqueues.
+ * @cplt: The completion system.
+ *
+ * Drains and destroys all completion workqueues. The high-priority workqueue
+ * is destroyed first, as only event queues are processed on it.
+ */
+static void ssam_cplt_wq_destroy(struct ssam_cplt *cplt)
+{
+	int i;
+
+	for (i = ARRAY_SIZE(cplt->wq) - 1; i >= 0; i--)
+		destroy_workqueue(cplt->wq[i].wq);
+}
+
 /**
  * ssam_cplt_init() - Initialize completion system.
  * @cplt: The completion system to initialize.
- * @dev:  The device used for logging.
+ * @dev:  The device used for logging and wakeup reporting.
  */
 static int ssam_cplt_init(struct ssam_cplt *cplt, struct device *dev)
 {
 	struct ssam_event_target *target;
+	struct ssam_cplt_wq *wq;
 	int status, c, i;
 
 	cplt->dev = dev;
+	atomic_long_set(&cplt->event.wakeups, 0);
 
-	cplt->wq = alloc_workqueue(SSAM_CPLT_WQ_NAME, WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
-	if (!cplt->wq)
-		return -ENOMEM;
+	status = ssam_cplt_wq_init(cplt);
+	if (status)
+		return status;
 
 	for (c = 0; c < ARRAY_SIZE(cplt->event.target); c++) {
 		target = &cplt->event.target[c];
 
-		for (i = 0; i < ARRAY_SIZE(target->queue); i++)
-			ssam_event_queue_init(cplt, &target->queue[i]);
+		/*
+		 * Event queues are indexed by event ID, which directly
+		 * corresponds to the target category of the event.
+		 */
+		for (i = 0; i < ARRAY_SIZE(target->queue); i++) {
+			wq = &cplt->wq[ssam_cplt_tc_to_wq(i + 1)];
+			ssam_event_queue_init(cplt, &target->queue[i], wq);
+		}
 	}
 
 	status = ssam_nf_init(&cplt->event.notif);
-	if (status)
-		destroy_workqueue(cplt->wq);
+	if (status) {
+		ssam_cplt_wq_destroy(cplt);
+		return status;
+	}
 
-	return status;
+	ssam_event_pool_init(&cplt->event.pool);
+	return 0;
 }
 
 /**
@@ -856,180 +1556,742 @@ static void ssam_cplt_destroy(struct ssam_cplt *cplt)
 	 * Note: destroy_workqueue ensures that all currently queued work will
 	 * be fully completed and the workqueue drained. This means that this
 	 * call will inherently also free any queued ssam_event_items, thus we
-	 * don't have to take care of that here explicitly.
+	 * don't have to take care of that here explicitly. It also ensures
+	 * that all pooled items have been returned before the pool is freed.
 	 */
-	destroy_workqueue(cplt->wq);
+	ssam_cplt_wq_destroy(cplt);
+	ssam_event_pool_destroy(&cplt->event.pool);
 	ssam_nf_destroy(&cplt->event.notif);
 }
 
 
-/* -- Main SSAM device structures. ------------------------------------------ */
+/* -- Response cache. ------------------------------------------------------- */
+
+/*
+ * SSAM_RSP_CACHE_MAX_ENTRIES - Maximum number of entries in the response
+ * cache. If exceeded, the least recently used entry is evicted.
+ */
+#define SSAM_RSP_CACHE_MAX_ENTRIES	32
+
+/*
+ * SSAM_RSP_CACHE_MAX_PAYLOAD - Maximum request payload length for which
+ * responses are cached.
+ */
+#define SSAM_RSP_CACHE_MAX_PAYLOAD	32
+
+/*
+ * SSAM_RSP_CACHE_MAX_RESPONSE - Maximum response length stored in the cache.
+ */
+#define SSAM_RSP_CACHE_MAX_RESPONSE	256
 
 /**
- * ssam_controller_device() - Get the &struct device associated with this
- * controller.
- * @c: The controller for which to get the device.
- *
- * Return: Returns the &struct device associated with this controller,
- * providing its lower-level transport.
+ * struct ssam_rsp_cache_entry - Entry of the response cache.
+ * @node:        The node in the list of cache entries.
+ * @expires:     Time (in jiffies) at which this entry expires.
+ * @tc:          Target category of the request.
+ * @tid:         Target ID of the request.
+ * @cid:         Command ID of the request.
+ * @iid:         Instance ID of the request.
+ * @payload_len: Length of the request payload.
+ * @rsp_len:     Length of the cached response.
+ * @data:        Request payload, immediately followed by the response data.
  */
-struct device *ssam_controller_device(struct ssam_controller *c)
+struct ssam_rsp_cache_entry {
+	struct list_head node;
+	unsigned long expires;
+
+	u8 tc;
+	u8 tid;
+	u8 cid;
+	u8 iid;
+	u16 payload_len;
+	u16 rsp_len;
+
+	u8 data[];
+};
+
+static bool ssam_rsp_cache_entry_matches(const struct ssam_rsp_cache_entry *e,
+					 const struct ssam_request *rqst)
 {
-	return ssh_rtl_get_device(&c->rtl);
+	return e->tc == rqst->target_category &&
+	       e->tid == rqst->target_id &&
+	       e->cid == rqst->command_id &&
+	       e->iid == rqst->instance_id &&
+	       e->payload_len == rqst->length &&
+	       !memcmp(e->data, rqst->payload, rqst->length);
 }
-EXPORT_SYMBOL_GPL(ssam_controller_device);
 
-static void __ssam_controller_release(struct kref *kref)
+static bool ssam_rsp_cache_is_cacheable(const struct ssam_request *rqst)
 {
-	struct ssam_controller *ctrl = to_ssam_controller(kref, kref);
+	return (rqst->flags & SSAM_REQUEST_HAS_RESPONSE) &&
+	       rqst->length <= SSAM_RSP_CACHE_MAX_PAYLOAD;
+}
 
-	/*
-	 * The lock-call here is to satisfy lockdep. At this point we really
-	 * expect this to be the last remaining reference to the controller.
-	 * Anything else is a bug.
-	 */
-	ssam_controller_lock(ctrl);
-	ssam_controller_destroy(ctrl);
-	ssam_controller_unlock(ctrl);
+static void ssam_rsp_cache_entry_remove(struct ssam_rsp_cache *cache,
+					struct ssam_rsp_cache_entry *e)
+{
+	lockdep_assert_held(&cache->lock);
 
-	kfree(ctrl);
+	list_del(&e->node);
+	cache->count--;
+	kfree(e);
+}
+
+static struct ssam_rsp_cache_entry *
+ssam_rsp_cache_find(struct ssam_rsp_cache *cache,
+		    const struct ssam_request *rqst)
+{
+	struct ssam_rsp_cache_entry *e;
+
+	lockdep_assert_held(&cache->lock);
+
+	list_for_each_entry(e, &cache->entries, node) {
+		if (ssam_rsp_cache_entry_matches(e, rqst))
+			return e;
+	}
+
+	return NULL;
 }
 
 /**
- * ssam_controller_get() - Increment reference count of controller.
- * @c: The controller.
+ * ssam_rsp_cache_invalidate() - Invalidate all cached responses of a target
+ * category.
+ * @cache: The response cache.
+ * @tc:    The target category.
+ *
+ * Removes all entries with the given target category from the cache and
+ * prevents responses of currently pending requests of this category from
+ * being stored.
+ */
+static void ssam_rsp_cache_invalidate(struct ssam_rsp_cache *cache, u8 tc)
+{
+	struct ssam_rsp_cache_entry *e, *n;
+
+	spin_lock(&cache->lock);
+
+	cache->gen[tc % SSAM_RSP_CACHE_NUM_GEN]++;
+
+	list_for_each_entry_safe(e, n, &cache->entries, node) {
+		if (e->tc == tc)
+			ssam_rsp_cache_entry_remove(cache, e);
+	}
+
+	spin_unlock(&cache->lock);
+}
+
+/**
+ * ssam_rsp_cache_flush() - Invalidate all cached responses.
+ * @cache: The response cache.
  *
- * Return: Returns the controller provided as input.
+ * Removes all entries from the cache and prevents responses of currently
+ * pending requests from being stored.
  */
-struct ssam_controller *ssam_controller_get(struct ssam_controller *c)
+static void ssam_rsp_cache_flush(struct ssam_rsp_cache *cache)
 {
-	if (c)
-		kref_get(&c->kref);
-	return c;
+	struct ssam_rsp_cache_entry *e, *n;
+	unsigned int i;
+
+	spin_lock(&cache->lock);
+
+	for (i = 0; i < SSAM_RSP_CACHE_NUM_GEN; i++)
+		cache->gen[i]++;
+
+	list_for_each_entry_safe(e, n, &cache->entries, node)
+		ssam_rsp_cache_entry_remove(cache, e);
+
+	spin_unlock(&cache->lock);
 }
-EXPORT_SYMBOL_GPL(ssam_controller_get);
 
 /**
- * ssam_controller_put() - Decrement reference count of controller.
- * @c: The controller.
+ * ssam_rsp_cache_init() - Initialize the response cache.
+ * @cache: The response cache to initialize.
  */
-void ssam_controller_put(struct ssam_controller *c)
+static void ssam_rsp_cache_init(struct ssam_rsp_cache *cache)
 {
-	if (c)
-		kref_put(&c->kref, __ssam_controller_release);
+	unsigned int i;
+
+	spin_lock_init(&cache->lock);
+	INIT_LIST_HEAD(&cache->entries);
+	cache->count = 0;
+
+	for (i = 0; i < SSAM_RSP_CACHE_NUM_GEN; i++)
+		cache->gen[i] = 0;
+
+	atomic_long_set(&cache->hits, 0);
+	atomic_long_set(&cache->misses, 0);
 }
-EXPORT_SYMBOL_GPL(ssam_controller_put);
 
 /**
- * ssam_controller_statelock() - Lock the controller against state transitions.
- * @c: The controller to lock.
- *
- * Lock the controller against state transitions. Holding this lock guarantees
- * that the controller will not transition between states, i.e. if the
- * controller is in state "started", when this lock has been acquired, it will
- * remain in this state at least until the lock has been released.
- *
- * Multiple clients may concurrently hold this lock. In other words: The
- * ``statelock`` functions represent the read-lock part of a r/w-semaphore.
- * Actions causing state transitions of the controller must be executed while
- * holding the write-part of this r/w-semaphore (see ssam_controller_lock()
- * and ssam_controller_unlock() for that).
- *
- * See ssam_controller_stateunlock() for the corresponding unlock function.
+ * ssam_rsp_cache_destroy() - Deinitialize the response cache and free all of
+ * its entries.
+ * @cache: The response cache to deinitialize.
  */
-void ssam_controller_statelock(struct ssam_controller *c)
+static void ssam_rsp_cache_destroy(struct ssam_rsp_cache *cache)
 {
-	down_read(&c->lock);
+	struct ssam_rsp_cache_entry *e, *n;
+
+	list_for_each_entry_safe(e, n, &cache->entries, node)
+		kfree(e);
+
+	INIT_LIST_HEAD(&cache->entries);
+	cache->count = 0;
 }
-EXPORT_SYMBOL_GPL(ssam_controller_statelock);
+
+
+/* -- Request pool. --------------------------------------------------------- */
+
+/*
+ * ssam_rqst_pool_classes - Size classes of the synchronous request pool.
+ *
+ * Virtually all requests issued via ssam_request_do_sync() carry either no or
+ * only a few bytes of payload (e.g. a single instance or state argument),
+ * which is covered by the first class. The second class covers larger
+ * writes, e.g. HID output reports and battery/thermal configuration. Requests
+ * exceeding the largest class, as well as requests issued while a class is
+ * exhausted, fall back to the generic allocator. As usage is tracked in a
+ * single bitmap word per class, no class may exceed BITS_PER_LONG objects.
+ */
+static const struct {
+	size_t len;
+	unsigned int count;
+} ssam_rqst_pool_classes[SSAM_RQST_POOL_NUM_CLASSES] = {
+	{ .len = 8,   .count = 16 },
+	{ .len = 128, .count = 8  },
+};
 
 /**
- * ssam_controller_stateunlock() - Unlock controller state transitions.
- * @c: The controller to unlock.
+ * ssam_rqst_pool_init() - Initialize the synchronous request pool.
+ * @pool: The pool to initialize.
  *
- * See ssam_controller_statelock() for the corresponding lock function.
+ * Preallocates the request objects of each size class. Failure to do so is
+ * not fatal, as allocations fall back to the generic allocator if a class
+ * is not available.
  */
-void ssam_controller_stateunlock(struct ssam_controller *c)
+static void ssam_rqst_pool_init(struct ssam_rqst_pool *pool)
 {
-	up_read(&c->lock);
+	struct ssam_rqst_pool_class *cls;
+	int i;
+
+	atomic_long_set(&pool->oversize, 0);
+
+	for (i = 0; i < ARRAY_SIZE(pool->cls); i++) {
+		cls = &pool->cls[i];
+
+		cls->len = ssam_rqst_pool_classes[i].len;
+		cls->stride = sizeof(struct ssam_request_sync) +
+			      SSH_COMMAND_MESSAGE_LENGTH(cls->len);
+		cls->stride = ALIGN(cls->stride, sizeof(long));
+		cls->used = 0;
+		atomic_long_set(&cls->hits, 0);
+		atomic_long_set(&cls->misses, 0);
+
+		cls->base = kcalloc(ssam_rqst_pool_classes[i].count, cls->stride,
+				    GFP_KERNEL);
+		cls->count = cls->base ? ssam_rqst_pool_classes[i].count : 0;
+	}
 }
-EXPORT_SYMBOL_GPL(ssam_controller_stateunlock);
 
 /**
- * ssam_controller_lock() - Acquire the main controller lock.
- * @c: The controller to lock.
+ * ssam_rqst_pool_destroy() - Deinitialize the synchronous request pool.
+ * @pool: The pool to deinitialize.
  *
- * This lock must be held for any state transitions, including transition to
- * suspend/resumed states and during shutdown. See ssam_controller_statelock()
- * for more details on controller locking.
+ * Frees the backing storage of all size classes. All request objects must
+ * have been returned to the pool prior to this call.
+ */
+static void ssam_rqst_pool_destroy(struct ssam_rqst_pool *pool)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(pool->cls); i++) {
+		WARN_ON(pool->cls[i].used);
+
+		kfree(pool->cls[i].base);
+		pool->cls[i].base = NULL;
+		pool->cls[i].count = 0;
+	}
+}
+
+/**
+ * ssam_rqst_pool_class_get() - Claim a free request object of a size class.
+ * @cls: The pool size class.
  *
- * See ssam_controller_unlock() for the corresponding unlock function.
+ * Return: Returns the claimed request object, or %NULL if all request
+ * objects of this class are currently in use.
  */
-void ssam_controller_lock(struct ssam_controller *c)
+static struct ssam_request_sync *
+ssam_rqst_pool_class_get(struct ssam_rqst_pool_class *cls)
 {
-	down_write(&c->lock);
+	unsigned int bit;
+
+	do {
+		bit = find_first_zero_bit(&cls->used, cls->count);
+		if (bit >= cls->count)
+			return NULL;
+	} while (test_and_set_bit_lock(bit, &cls->used));
+
+	return cls->base + bit * cls->stride;
 }
 
-/*
- * ssam_controller_unlock() - Release the main controller lock.
- * @c: The controller to unlock.
+/**
+ * ssam_rqst_pool_get() - Get a synchronous request from the pool.
+ * @pool:        The pool.
+ * @payload_len: The length of the request payload.
+ * @rqst:        Where to store the pointer to the request.
+ * @buffer:      Where to store the buffer descriptor for the message buffer of
+ *               the request.
  *
- * See ssam_controller_lock() for the corresponding lock function.
+ * Claims a request object from the smallest size class that can hold the
+ * given payload. If that class is exhausted or the payload exceeds all
+ * classes, falls back to ssam_request_sync_alloc(). The request must be
+ * returned via ssam_rqst_pool_put() after use.
+ *
+ * Return: Returns zero on success, %-ENOMEM if the request could not be
+ * allocated.
  */
-void ssam_controller_unlock(struct ssam_controller *c)
+static int ssam_rqst_pool_get(struct ssam_rqst_pool *pool, size_t payload_len,
+			      struct ssam_request_sync **rqst,
+			      struct ssam_span *buffer)
 {
-	up_write(&c->lock);
+	struct ssam_rqst_pool_class *cls;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(pool->cls); i++) {
+		cls = &pool->cls[i];
+
+		if (payload_len > cls->len)
+			continue;
+
+		*rqst = ssam_rqst_pool_class_get(cls);
+		if (!*rqst) {
+			atomic_long_inc(&cls->misses);
+			break;
+		}
+
+		atomic_long_inc(&cls->hits);
+
+		memset(*rqst, 0, sizeof(**rqst));
+		buffer->ptr = (u8 *)(*rqst + 1);
+		buffer->len = SSH_COMMAND_MESSAGE_LENGTH(payload_len);
+		return 0;
+	}
+
+	if (i == ARRAY_SIZE(pool->cls))
+		atomic_long_inc(&pool->oversize);
+
+	return ssam_request_sync_alloc(payload_len, GFP_KERNEL, rqst, buffer);
 }
 
-static void ssam_handle_event(struct ssh_rtl *rtl,
-			      const struct ssh_command *cmd,
-			      const struct ssam_span *data)
+/**
+ * ssam_rqst_pool_put() - Return a synchronous request to the pool.
+ * @pool: The pool.
+ * @rqst: The request, obtained via ssam_rqst_pool_get().
+ *
+ * Releases the request object back to its size class or frees it via
+ * ssam_request_sync_free() if it has been allocated via the fallback path.
+ * The same restrictions as for ssam_request_sync_free() apply.
+ */
+static void ssam_rqst_pool_put(struct ssam_rqst_pool *pool,
+			       struct ssam_request_sync *rqst)
 {
-	struct ssam_controller *ctrl = to_ssam_controller(rtl, rtl);
-	struct ssam_event_item *item;
+	struct ssam_rqst_pool_class *cls;
+	void *ptr = rqst;
+	int i;
 
-	item = ssam_event_item_alloc(data->len, GFP_KERNEL);
-	if (!item)
-		return;
+	for (i = 0; i < ARRAY_SIZE(pool->cls); i++) {
+		cls = &pool->cls[i];
 
-	item->rqid = get_unaligned_le16(&cmd->rqid);
-	item->event.target_category = cmd->tc;
-	item->event.target_id = cmd->sid;
-	item->event.command_id = cmd->cid;
-	item->event.instance_id = cmd->iid;
-	memcpy(&item->event.data[0], data->ptr, data->len);
+		if (ptr < cls->base || ptr >= cls->base + cls->count * cls->stride)
+			continue;
 
-	if (WARN_ON(ssam_cplt_submit_event(&ctrl->cplt, item)))
-		ssam_event_item_free(item);
+		clear_bit_unlock((ptr - cls->base) / cls->stride, &cls->used);
+		return;
+	}
+
+	ssam_request_sync_free(rqst);
 }
 
-static const struct ssh_rtl_ops ssam_rtl_ops = {
-	.handle_event = ssam_handle_event,
-};
 
-static bool ssam_notifier_is_empty(struct ssam_controller *ctrl);
-static void ssam_notifier_unregister_all(struct ssam_controller *ctrl);
+/* -- Client data cache. ---------------------------------------------------- */
 
-#define SSAM_SSH_DSM_REVISION	0
+/*
+ * SSAM_CLIENT_CACHE_MAX_SIZE - Maximum total size of all data blobs stored in
+ * the client data cache.
+ */
+#define SSAM_CLIENT_CACHE_MAX_SIZE	SZ_64K
 
-/* d5e383e1-d892-4a76-89fc-f6aaae7ed5b5 */
-static const guid_t SSAM_SSH_DSM_GUID =
-	GUID_INIT(0xd5e383e1, 0xd892, 0x4a76,
-		  0x89, 0xfc, 0xf6, 0xaa, 0xae, 0x7e, 0xd5, 0xb5);
+/**
+ * struct ssam_client_cache_entry - Entry of the client data cache.
+ * @node: The node in the list of cache entries.
+ * @key:  The driver-defined key identifying this entry.
+ * @len:  Length of the cached data.
+ * @data: The cached data.
+ */
+struct ssam_client_cache_entry {
+	struct list_head node;
+	u64 key;
+	size_t len;
 
-enum ssh_dsm_fn {
-	SSH_DSM_FN_SSH_POWER_PROFILE             = 0x05,
-	SSH_DSM_FN_SCREEN_ON_SLEEP_IDLE_TIMEOUT  = 0x06,
-	SSH_DSM_FN_SCREEN_OFF_SLEEP_IDLE_TIMEOUT = 0x07,
-	SSH_DSM_FN_D3_CLOSES_HANDLE              = 0x08,
-	SSH_DSM_FN_SSH_BUFFER_SIZE               = 0x09,
+	u8 data[];
 };
 
-static int ssam_dsm_get_functions(acpi_handle handle, u64 *funcs)
+static struct ssam_client_cache_entry *
+ssam_client_cache_find(struct ssam_client_cache *cache, u64 key)
 {
-	union acpi_object *obj;
-	u64 mask = 0;
-	int i;
+	struct ssam_client_cache_entry *e;
+
+	lockdep_assert_held(&cache->lock);
+
+	list_for_each_entry(e, &cache->entries, node) {
+		if (e->key == key)
+			return e;
+	}
+
+	return NULL;
+}
+
+static void ssam_client_cache_entry_remove(struct ssam_client_cache *cache,
+					   struct ssam_client_cache_entry *e)
+{
+	lockdep_assert_held(&cache->lock);
+
+	list_del(&e->node);
+	cache->count--;
+	cache->size -= e->len;
+	kfree(e);
+}
+
+/**
+ * ssam_client_cache_init() - Initialize the client data cache.
+ * @cache: The client data cache to initialize.
+ */
+static void ssam_client_cache_init(struct ssam_client_cache *cache)
+{
+	mutex_init(&cache->lock);
+	INIT_LIST_HEAD(&cache->entries);
+	cache->count = 0;
+	cache->size = 0;
+
+	atomic_long_set(&cache->hits, 0);
+	atomic_long_set(&cache->misses, 0);
+}
+
+/**
+ * ssam_client_cache_destroy() - Deinitialize the client data cache and free
+ * all of its entries.
+ * @cache: The client data cache to deinitialize.
+ */
+static void ssam_client_cache_destroy(struct ssam_client_cache *cache)
+{
+	struct ssam_client_cache_entry *e, *n;
+
+	list_for_each_entry_safe(e, n, &cache->entries, node)
+		kfree(e);
+
+	INIT_LIST_HEAD(&cache->entries);
+	cache->count = 0;
+	cache->size = 0;
+
+	mutex_destroy(&cache->lock);
+}
+
+
+/* -- PM transition log. ---------------------------------------------------- */
+
+/**
+ * ssam_pm_log_init() - Initialize the PM transition log.
+ * @log: The PM transition log to initialize.
+ */
+static void ssam_pm_log_init(struct ssam_pm_log *log)
+{
+	mutex_init(&log->lock);
+	log->count = 0;
+}
+
+/**
+ * ssam_pm_log_destroy() - Deinitialize the PM transition log.
+ * @log: The PM transition log to deinitialize.
+ */
+static void ssam_pm_log_destroy(struct ssam_pm_log *log)
+{
+	mutex_destroy(&log->lock);
+}
+
+/**
+ * ssam_pm_phase_end() - Record the end of a phase of a PM transition.
+ * @r:     The record of the transition.
+ * @phase: The phase that has just been completed.
+ * @start: The time at which the phase has been started.
+ *
+ * Adds the time elapsed since @start to the given phase of the record. Phases
+ * may be executed multiple times per transition, e.g. on error paths.
+ *
+ * Return: Returns the current time, i.e. the end of the phase, to be used as
+ * start time of the next phase.
+ */
+ktime_t ssam_pm_phase_end(struct ssam_pm_record *r, enum ssam_pm_phase phase,
+			  ktime_t start)
+{
+	ktime_t now = ktime_get_boottime();
+	ktime_t duration = ktime_sub(now, start);
+
+	r->phase[phase] += ktime_to_ns(duration);
+	trace_ssam_pm_phase(r->transition, phase, duration);
+
+	return now;
+}
+
+/**
+ * ssam_pm_record_end() - Complete a PM transition record and store it in the
+ * PM log of the controller.
+ * @ctrl:   The controller.
+ * @r:      The record of the transition, set up via ssam_pm_record_begin().
+ * @status: The status of the transition.
+ *
+ * Stores the record as most recent entry in the log, replacing the oldest
+ * entry if the log is full.
+ */
+void ssam_pm_record_end(struct ssam_controller *ctrl, struct ssam_pm_record *r,
+			int status)
+{
+	struct ssam_pm_log *log = &ctrl->pm_log;
+	struct ssam_pm_log_entry *e;
+
+	r->status = status;
+	r->duration = ktime_to_ns(ktime_sub(ktime_get_boottime(), r->start));
+
+	trace_ssam_pm_transition(r);
+
+	mutex_lock(&log->lock);
+
+	e = &log->entries[log->count % SSAM_PM_LOG_SIZE];
+	e->rec = *r;
+	e->num_clients = 0;
+	log->count++;
+
+	mutex_unlock(&log->lock);
+}
+
+/**
+ * ssam_controller_pm_record_client() - Record resume timing of a client
+ * device.
+ * @ctrl:   The controller the client device is associated with.
+ * @dev:    The client device.
+ * @start:  Boot time at which the client resume has been started, i.e.
+ *          obtained via ktime_get_boottime().
+ * @status: The status of the client resume.
+ *
+ * Client device drivers may use this function to report the time taken to
+ * resume their device, e.g. to re-query the device state from the EC. The
+ * timing is attributed to the most recent PM transition of the controller,
+ * which usually is the controller's own resume transition, and shown in the
+ * PM summary in debugfs. Reports exceeding the capacity of the log entry are
+ * only visible via the respective tracepoint.
+ */
+void ssam_controller_pm_record_client(struct ssam_controller *ctrl,
+				      struct device *dev, ktime_t start,
+				      int status)
+{
+	struct ssam_pm_log *log = &ctrl->pm_log;
+	ktime_t duration = ktime_sub(ktime_get_boottime(), start);
+	struct ssam_pm_client_record *c;
+	struct ssam_pm_log_entry *e;
+
+	trace_ssam_pm_client(dev, duration, status);
+
+	mutex_lock(&log->lock);
+
+	if (!log->count)
+		goto out;
+
+	e = &log->entries[(log->count - 1) % SSAM_PM_LOG_SIZE];
+	if (e->num_clients >= SSAM_PM_LOG_MAX_CLIENTS)
+		goto out;
+
+	c = &e->clients[e->num_clients++];
+	strscpy(c->name, dev_name(dev), ARRAY_SIZE(c->name));
+	c->duration = ktime_to_ns(duration);
+	c->status = status;
+
+out:
+	mutex_unlock(&log->lock);
+}
+EXPORT_SYMBOL_GPL(ssam_controller_pm_record_client);
+
+
+/* -- Main SSAM device structures. ------------------------------------------ */
+
+/**
+ * ssam_controller_device() - Get the &struct device associated with this
+ * controller.
+ * @c: The controller for which to get the device.
+ *
+ * Return: Returns the &struct device associated with this controller,
+ * providing its lower-level transport.
+ */
+struct device *ssam_controller_device(struct ssam_controller *c)
+{
+	return ssh_rtl_get_device(&c->rtl);
+}
+EXPORT_SYMBOL_GPL(ssam_controller_device);
+
+static void __ssam_controller_release(struct kref *kref)
+{
+	struct ssam_controller *ctrl = to_ssam_controller(kref, kref);
+
+	/*
+	 * The lock-call here is to satisfy lockdep. At this point we really
+	 * expect this to be the last remaining reference to the controller.
+	 * Anything else is a bug.
+	 */
+	ssam_controller_lock(ctrl);
+	ssam_controller_destroy(ctrl);
+	ssam_controller_unlock(ctrl);
+
+	kfree(ctrl);
+}
+
+/**
+ * ssam_controller_get() - Increment reference count of controller.
+ * @c: The controller.
+ *
+ * Return: Returns the controller provided as input.
+ */
+struct ssam_controller *ssam_controller_get(struct ssam_controller *c)
+{
+	if (c)
+		kref_get(&c->kref);
+	return c;
+}
+EXPORT_SYMBOL_GPL(ssam_controller_get);
+
+/**
+ * ssam_controller_put() - Decrement reference count of controller.
+ * @c: The controller.
+ */
+void ssam_controller_put(struct ssam_controller *c)
+{
+	if (c)
+		kref_put(&c->kref, __ssam_controller_release);
+}
+EXPORT_SYMBOL_GPL(ssam_controller_put);
+
+/**
+ * ssam_controller_statelock() - Lock the controller against state transitions.
+ * @c: The controller to lock.
+ *
+ * Lock the controller against state transitions. Holding this lock guarantees
+ * that the controller will not transition between states, i.e. if the
+ * controller is in state "started", when this lock has been acquired, it will
+ * remain in this state at least until the lock has been released.
+ *
+ * Multiple clients may concurrently hold this lock. In other words: The
+ * ``statelock`` functions represent the read-lock part of a r/w-semaphore.
+ * Actions causing state transitions of the controller must be executed while
+ * holding the write-part of this r/w-semaphore (see ssam_controller_lock()
+ * and ssam_controller_unlock() for that).
+ *
+ * See ssam_controller_stateunlock() for the corresponding unlock function.
+ */
+void ssam_controller_statelock(struct ssam_controller *c)
+{
+	down_read(&c->lock);
+}
+EXPORT_SYMBOL_GPL(ssam_controller_statelock);
+
+/**
+ * ssam_controller_stateunlock() - Unlock controller state transitions.
+ * @c: The controller to unlock.
+ *
+ * See ssam_controller_statelock() for the corresponding lock function.
+ */
+void ssam_controller_stateunlock(struct ssam_controller *c)
+{
+	up_read(&c->lock);
+}
+EXPORT_SYMBOL_GPL(ssam_controller_stateunlock);
+
+/**
+ * ssam_controller_lock() - Acquire the main controller lock.
+ * @c: The controller to lock.
+ *
+ * This lock must be held for any state transitions, including transition to
+ * suspend/resumed states and during shutdown. See ssam_controller_statelock()
+ * for more details on controller locking.
+ *
+ * See ssam_controller_unlock() for the corresponding unlock function.
+ */
+void ssam_controller_lock(struct ssam_controller *c)
+{
+	down_write(&c->lock);
+}
+
+/*
+ * ssam_controller_unlock() - Release the main controller lock.
+ * @c: The controller to unlock.
+ *
+ * See ssam_controller_lock() for the corresponding lock function.
+ */
+void ssam_controller_unlock(struct ssam_controller *c)
+{
+	up_write(&c->lock);
+}
+
+static void ssam_handle_event(struct ssh_rtl *rtl,
+			      const struct ssh_command *cmd,
+			      const struct ssam_span *data)
+{
+	struct ssam_controller *ctrl = to_ssam_controller(rtl, rtl);
+	struct ssam_event_item *item;
+
+	/*
+	 * Events indicate state changes of their target category. Invalidate
+	 * any cached responses before notifiers can re-query the EC.
+	 */
+	ssam_rsp_cache_invalidate(&ctrl->rsp_cache, cmd->tc);
+
+	item = ssam_event_item_alloc(&ctrl->cplt.event.pool, data->len,
+				     GFP_KERNEL);
+	if (!item)
+		return;
+
+	item->rqid = get_unaligned_le16(&cmd->rqid);
+	item->event.target_category = cmd->tc;
+	item->event.target_id = cmd->sid;
+	item->event.command_id = cmd->cid;
+	item->event.instance_id = cmd->iid;
+	memcpy(&item->event.data[0], data->ptr, data->len);
+
+	if (WARN_ON(ssam_cplt_submit_event(&ctrl->cplt, item)))
+		ssam_event_item_free(item);
+}
+
+static const struct ssh_rtl_ops ssam_rtl_ops = {
+	.handle_event = ssam_handle_event,
+};
+
+static bool ssam_notifier_is_empty(struct ssam_controller *ctrl);
+static void ssam_notifier_unregister_all(struct ssam_controller *ctrl);
+
+#define SSAM_SSH_DSM_REVISION	0
+
+/* d5e383e1-d892-4a76-89fc-f6aaae7ed5b5 */
+static const guid_t SSAM_SSH_DSM_GUID =
+	GUID_INIT(0xd5e383e1, 0xd892, 0x4a76,
+		  0x89, 0xfc, 0xf6, 0xaa, 0xae, 0x7e, 0xd5, 0xb5);
+
+enum ssh_dsm_fn {
+	SSH_DSM_FN_SSH_POWER_PROFILE             = 0x05,
+	SSH_DSM_FN_SCREEN_ON_SLEEP_IDLE_TIMEOUT  = 0x06,
+	SSH_DSM_FN_SCREEN_OFF_SLEEP_IDLE_TIMEOUT = 0x07,
+	SSH_DSM_FN_D3_CLOSES_HANDLE              = 0x08,
+	SSH_DSM_FN_SSH_BUFFER_SIZE               = 0x09,
+};
+
+static int ssam_dsm_get_functions(acpi_handle handle, u64 *funcs)
+{
+	union acpi_object *obj;
+	u64 mask = 0;
+	int i;
 
 	*funcs = 0;
 
@@ -1190,6 +2452,13 @@ int ssam_controller_init(struct ssam_controller *ctrl,
 
 	ssh_seq_reset(&ctrl->counter.seq);
 	ssh_rqid_reset(&ctrl->counter.rqid);
+	ssam_rsp_cache_init(&ctrl->rsp_cache);
+	ssam_rqst_pool_init(&ctrl->rqst_pool);
+	ssam_client_cache_init(&ctrl->client_cache);
+	ssam_pm_log_init(&ctrl->pm_log);
+
+	spin_lock_init(&ctrl->dedup.lock);
+	INIT_LIST_HEAD(&ctrl->dedup.pending);
 
 	/* Initialize event/request completion system. */
 	status = ssam_cplt_init(&ctrl->cplt, &serdev->dev);
@@ -1367,6 +2636,10 @@ void ssam_controller_destroy(struct ssam_controller *ctrl)
 	/* Actually free resources. */
 	ssam_cplt_destroy(&ctrl->cplt);
 	ssh_rtl_destroy(&ctrl->rtl);
+	ssam_rsp_cache_destroy(&ctrl->rsp_cache);
+	ssam_rqst_pool_destroy(&ctrl->rqst_pool);
+	ssam_client_cache_destroy(&ctrl->client_cache);
+	ssam_pm_log_destroy(&ctrl->pm_log);
 
 	/*
 	 * Set state via write_once even though we expect to be locked/in an
@@ -1377,125 +2650,885 @@ void ssam_controller_destroy(struct ssam_controller *ctrl)
 }
 
 /**
- * ssam_controller_suspend() - Suspend the controller.
- * @ctrl: The controller to suspend.
- *
- * Marks the controller as suspended. Note that display-off and D0-exit
- * notifications have to be sent manually before transitioning the controller
- * into the suspended state via this function.
- *
- * See ssam_controller_resume() for the corresponding resume function.
- *
- * Return: Returns %-EINVAL if the controller is currently not in the
- * "started" state.
+ * ssam_controller_suspend() - Suspend the controller.
+ * @ctrl: The controller to suspend.
+ *
+ * Marks the controller as suspended. Note that display-off and D0-exit
+ * notifications have to be sent manually before transitioning the controller
+ * into the suspended state via this function.
+ *
+ * See ssam_controller_resume() for the corresponding resume function.
+ *
+ * Return: Returns %-EINVAL if the controller is currently not in the
+ * "started" state.
+ */
+int ssam_controller_suspend(struct ssam_controller *ctrl)
+{
+	ssam_controller_lock(ctrl);
+
+	if (ctrl->state != SSAM_CONTROLLER_STARTED) {
+		ssam_controller_unlock(ctrl);
+		return -EINVAL;
+	}
+
+	ssam_dbg(ctrl, "pm: suspending controller\n");
+
+	/*
+	 * Set state via write_once even though we're locked, due to
+	 * smoke-testing in ssam_request_sync_submit().
+	 */
+	WRITE_ONCE(ctrl->state, SSAM_CONTROLLER_SUSPENDED);
+
+	ssam_controller_unlock(ctrl);
+	return 0;
+}
+
+/**
+ * ssam_controller_resume() - Resume the controller from suspend.
+ * @ctrl: The controller to resume.
+ *
+ * Resume the controller from the suspended state it was put into via
+ * ssam_controller_suspend(). This function does not issue display-on and
+ * D0-entry notifications. If required, those have to be sent manually after
+ * this call.
+ *
+ * All cached responses are dropped, as the EC state may have changed while
+ * the system was suspended without us receiving any event for it. This has
+ * to be done before any client device is resumed, as clients commonly
+ * re-query their state on resume.
+ *
+ * Return: Returns %-EINVAL if the controller is currently not suspended.
+ */
+int ssam_controller_resume(struct ssam_controller *ctrl)
+{
+	ssam_controller_lock(ctrl);
+
+	if (ctrl->state != SSAM_CONTROLLER_SUSPENDED) {
+		ssam_controller_unlock(ctrl);
+		return -EINVAL;
+	}
+
+	ssam_dbg(ctrl, "pm: resuming controller\n");
+
+	/*
+	 * Response lifetimes are based on jiffies, which do not advance while
+	 * suspended. Cached responses would thus still be considered valid.
+	 */
+	ssam_rsp_cache_flush(&ctrl->rsp_cache);
+
+	/*
+	 * Set state via write_once even though we're locked, due to
+	 * smoke-testing in ssam_request_sync_submit().
+	 */
+	WRITE_ONCE(ctrl->state, SSAM_CONTROLLER_STARTED);
+
+	ssam_controller_unlock(ctrl);
+	return 0;
+}
+
+
+/* -- Top-level request interface ------------------------------------------- */
+
+/**
+ * ssam_request_write_data() - Construct and write SAM request message to
+ * buffer.
+ * @buf:  The buffer to write the data to.
+ * @ctrl: The controller via which the request will be sent.
+ * @spec: The request data and specification.
+ *
+ * Constructs a SAM/SSH request message and writes it to the provided buffer.
+ * The request and transport counters, specifically RQID and SEQ, will be set
+ * in this call. These counters are obtained from the controller. It is thus
+ * only valid to send the resulting message via the controller specified here.
+ *
+ * For calculation of the required buffer size, refer to the
+ * SSH_COMMAND_MESSAGE_LENGTH() macro.
+ *
+ * Return: Returns the number of bytes used in the buffer on success. Returns
+ * %-EINVAL if the payload length provided in the request specification is too
+ * large (larger than %SSH_COMMAND_MAX_PAYLOAD_SIZE) or if the provided buffer
+ * is too small.
+ */
+ssize_t ssam_request_write_data(struct ssam_span *buf,
+				struct ssam_controller *ctrl,
+				const struct ssam_request *spec)
+{
+	struct msgbuf msgb;
+	u16 rqid;
+	u8 seq;
+
+	if (spec->length > SSH_COMMAND_MAX_PAYLOAD_SIZE)
+		return -EINVAL;
+
+	if (SSH_COMMAND_MESSAGE_LENGTH(spec->length) > buf->len)
+		return -EINVAL;
+
+	msgb_init(&msgb, buf->ptr, buf->len);
+	seq = ssh_seq_next(&ctrl->counter.seq);
+	rqid = ssh_rqid_next(&ctrl->counter.rqid);
+	msgb_push_cmd(&msgb, seq, rqid, spec);
+
+	return msgb_bytes_used(&msgb);
+}
+EXPORT_SYMBOL_GPL(ssam_request_write_data);
+
+/**
+ * ssam_request_store_response() - Copy response data to the response buffer.
+ * @rtl:  The request transport layer, used for logging.
+ * @resp: The response buffer. May be %NULL.
+ * @data: The response data. May be %NULL for requests without a response.
+ *
+ * Return: Returns zero on success or %-ENOSPC if the response buffer is too
+ * small to hold the response data.
+ */
+static int ssam_request_store_response(struct ssh_rtl *rtl,
+				       struct ssam_response *resp,
+				       const struct ssam_span *data)
+{
+	if (!data)	/* Handle requests without a response. */
+		return 0;
+
+	if (!resp || !resp->pointer) {
+		if (data->len)
+			rtl_warn(rtl, "rsp: no response buffer provided, dropping data\n");
+		return 0;
+	}
+
+	if (data->len > resp->capacity) {
+		rtl_err(rtl,
+			"rsp: response buffer too small, capacity: %zu bytes, got: %zu bytes\n",
+			resp->capacity, data->len);
+		return -ENOSPC;
+	}
+
+	resp->length = data->len;
+	memcpy(resp->pointer, data->ptr, data->len);
+	return 0;
+}
+
+static void ssam_request_sync_complete(struct ssh_request *rqst,
+				       const struct ssh_command *cmd,
+				       const struct ssam_span *data, int status)
+{
+	struct ssh_rtl *rtl = ssh_request_rtl(rqst);
+	struct ssam_request_sync *r;
+
+	r = container_of(rqst, struct ssam_request_sync, base);
+	r->status = status;
+
+	if (r->resp)
+		r->resp->length = 0;
+
+	if (status) {
+		rtl_dbg_cond(rtl, "rsp: request failed: %d\n", status);
+		return;
+	}
+
+	r->status = ssam_request_store_response(rtl, r->resp, data);
+}
+
+static void ssam_request_sync_release(struct ssh_request *rqst)
+{
+	complete_all(&container_of(rqst, struct ssam_request_sync, base)->comp);
+}
+
+static const struct ssh_request_ops ssam_request_sync_ops = {
+	.release = ssam_request_sync_release,
+	.complete = ssam_request_sync_complete,
+};
+
+/**
+ * ssam_request_sync_alloc() - Allocate a synchronous request.
+ * @payload_len: The length of the request payload.
+ * @flags:       Flags used for allocation.
+ * @rqst:        Where to store the pointer to the allocated request.
+ * @buffer:      Where to store the buffer descriptor for the message buffer of
+ *               the request.
+ *
+ * Allocates a synchronous request with corresponding message buffer. The
+ * request still needs to be initialized ssam_request_sync_init() before
+ * it can be submitted, and the message buffer data must still be set to the
+ * returned buffer via ssam_request_sync_set_data() after it has been filled,
+ * if need be with adjusted message length.
+ *
+ * After use, the request and its corresponding message buffer should be freed
+ * via ssam_request_sync_free(). The buffer must not be freed separately.
+ *
+ * Return: Returns zero on success, %-ENOMEM if the request could not be
+ * allocated.
+ */
+int ssam_request_sync_alloc(size_t payload_len, gfp_t flags,
+			    struct ssam_request_sync **rqst,
+			    struct ssam_span *buffer)
+{
+	size_t msglen = SSH_COMMAND_MESSAGE_LENGTH(payload_len);
+
+	*rqst = kzalloc(sizeof(**rqst) + msglen, flags);
+	if (!*rqst)
+		return -ENOMEM;
+
+	buffer->ptr = (u8 *)(*rqst + 1);
+	buffer->len = msglen;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(ssam_request_sync_alloc);
+
+/**
+ * ssam_request_sync_free() - Free a synchronous request.
+ * @rqst: The request to be freed.
+ *
+ * Free a synchronous request and its corresponding buffer allocated with
+ * ssam_request_sync_alloc(). Do not use for requests allocated on the stack
+ * or via any other function.
+ *
+ * Warning: The caller must ensure that the request is not in use any more.
+ * I.e. the caller must ensure that it has the only reference to the request
+ * and the request is not currently pending. This means that the caller has
+ * either never submitted the request, request submission has failed, or the
+ * caller has waited until the submitted request has been completed via
+ * ssam_request_sync_wait().
+ */
+void ssam_request_sync_free(struct ssam_request_sync *rqst)
+{
+	kfree(rqst);
+}
+EXPORT_SYMBOL_GPL(ssam_request_sync_free);
+
+/**
+ * ssam_request_sync_init() - Initialize a synchronous request struct.
+ * @rqst:  The request to initialize.
+ * @flags: The request flags.
+ *
+ * Initializes the given request struct. Does not initialize the request
+ * message data. This has to be done explicitly after this call via
+ * ssam_request_sync_set_data() and the actual message data has to be written
+ * via ssam_request_write_data().
+ *
+ * Return: Returns zero on success or %-EINVAL if the given flags are invalid.
+ */
+int ssam_request_sync_init(struct ssam_request_sync *rqst,
+			   enum ssam_request_flags flags)
+{
+	int status;
+
+	status = ssh_request_init(&rqst->base, flags, &ssam_request_sync_ops);
+	if (status)
+		return status;
+
+	init_completion(&rqst->comp);
+	rqst->resp = NULL;
+	rqst->status = 0;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(ssam_request_sync_init);
+
+/**
+ * ssam_request_sync_submit() - Submit a synchronous request.
+ * @ctrl: The controller with which to submit the request.
+ * @rqst: The request to submit.
+ *
+ * Submit a synchronous request. The request has to be initialized and
+ * properly set up, including response buffer (may be %NULL if no response is
+ * expected) and command message data. This function does not wait for the
+ * request to be completed.
+ *
+ * If this function succeeds, ssam_request_sync_wait() must be used to ensure
+ * that the request has been completed before the response data can be
+ * accessed and/or the request can be freed. On failure, the request may
+ * immediately be freed.
+ *
+ * This function may only be used if the controller is active, i.e. has been
+ * initialized and not suspended.
+ */
+int ssam_request_sync_submit(struct ssam_controller *ctrl,
+			     struct ssam_request_sync *rqst)
+{
+	int status;
+
+	/*
+	 * This is only a superficial check. In general, the caller needs to
+	 * ensure that the controller is initialized and is not (and does not
+	 * get) suspended during use, i.e. until the request has been completed
+	 * (if _absolutely_ necessary, by use of ssam_controller_statelock/
+	 * ssam_controller_stateunlock, but something like ssam_client_link
+	 * should be preferred as this needs to last until the request has been
+	 * completed).
+	 *
+	 * Note that it is actually safe to use this function while the
+	 * controller is in the process of being shut down (as ssh_rtl_submit
+	 * is safe with regards to this), but it is generally discouraged to do
+	 * so.
+	 */
+	if (WARN_ON(READ_ONCE(ctrl->state) != SSAM_CONTROLLER_STARTED)) {
+		ssh_request_put(&rqst->base);
+		return -ENODEV;
+	}
+
+	status = ssh_rtl_submit(&ctrl->rtl, &rqst->base);
+	ssh_request_put(&rqst->base);
+
+	return status;
+}
+EXPORT_SYMBOL_GPL(ssam_request_sync_submit);
+
+/**
+ * struct ssam_request_dedup - In-flight synchronous request that identical
+ * concurrent requests may attach to.
+ * @node:    The node in the list of pending de-duplicated requests.
+ * @spec:    The request specification and payload.
+ * @waiters: List of &struct ssam_request_dedup_waiter attached to this
+ *           request.
+ */
+struct ssam_request_dedup {
+	struct list_head node;
+	const struct ssam_request *spec;
+	struct list_head waiters;
+};
+
+/**
+ * struct ssam_request_dedup_waiter - Request attached to an identical
+ * in-flight request.
+ * @node:   The node in the list of waiters of the in-flight request.
+ * @rsp:    The response buffer of the attached request.
+ * @comp:   Completion signaled once the response has been provided.
+ * @status: Status of the attached request.
+ */
+struct ssam_request_dedup_waiter {
+	struct list_head node;
+	struct ssam_response *rsp;
+	struct completion comp;
+	int status;
+};
+
+static bool ssam_request_dedup_is_eligible(const struct ssam_request *spec,
+					   const struct ssam_response *rsp)
+{
+	if (!(spec->flags & SSAM_REQUEST_HAS_RESPONSE))
+		return false;
+
+	if (!rsp || !rsp->pointer)
+		return false;
+
+	return spec->flags & SSAM_REQUEST_IDEMPOTENT;
+}
+
+static bool ssam_request_dedup_matches(const struct ssam_request *a,
+				       const struct ssam_request *b)
+{
+	return a->target_category == b->target_category &&
+	       a->target_id == b->target_id &&
+	       a->command_id == b->command_id &&
+	       a->instance_id == b->instance_id &&
+	       a->flags == b->flags &&
+	       a->length == b->length &&
+	       !memcmp(a->payload, b->payload, a->length);
+}
+
+/**
+ * ssam_request_dedup_begin() - Attach to an identical in-flight request or
+ * register a new in-flight request.
+ * @ctrl:   The controller.
+ * @spec:   The request specification and payload.
+ * @rsp:    The response buffer.
+ * @dedup:  Storage for the in-flight request entry.
+ * @status: Output for the status of the request if it has been handled by
+ *          attaching to an identical in-flight request.
+ *
+ * If an identical request eligible for de-duplication is currently in
+ * flight, attach to it and wait for its completion, copying its response to
+ * @rsp. Otherwise, if the request is eligible, register it via @dedup so
+ * that subsequent identical requests may attach to it. In this case, the
+ * caller must execute the request and then call ssam_request_dedup_end().
+ *
+ * Return: Returns %true if the request has been handled by attaching to an
+ * in-flight request, with its status stored in @status. Returns %false if
+ * the request needs to be executed by the caller.
+ */
+static bool ssam_request_dedup_begin(struct ssam_controller *ctrl,
+				     const struct ssam_request *spec,
+				     struct ssam_response *rsp,
+				     struct ssam_request_dedup *dedup,
+				     int *status)
+{
+	struct ssam_request_dedup_waiter waiter;
+	struct ssam_request_dedup *p;
+
+	INIT_LIST_HEAD(&dedup->node);
+	INIT_LIST_HEAD(&dedup->waiters);
+	dedup->spec = spec;
+
+	if (!ssam_request_dedup_is_eligible(spec, rsp))
+		return false;
+
+	spin_lock(&ctrl->dedup.lock);
+
+	list_for_each_entry(p, &ctrl->dedup.pending, node) {
+		if (!ssam_request_dedup_matches(p->spec, spec))
+			continue;
+
+		waiter.rsp = rsp;
+		waiter.status = 0;
+		init_completion(&waiter.comp);
+		list_add_tail(&waiter.node, &p->waiters);
+
+		spin_unlock(&ctrl->dedup.lock);
+
+		wait_for_completion(&waiter.comp);
+		*status = waiter.status;
+		return true;
+	}
+
+	list_add_tail(&dedup->node, &ctrl->dedup.pending);
+	spin_unlock(&ctrl->dedup.lock);
+
+	return false;
+}
+
+/**
+ * ssam_request_dedup_end() - Complete all requests attached to an in-flight
+ * request.
+ * @ctrl:   The controller.
+ * @dedup:  The in-flight request entry, set up via
+ *          ssam_request_dedup_begin().
+ * @rsp:    The response of the in-flight request.
+ * @status: The status of the in-flight request.
+ *
+ * Unregisters the in-flight request and provides its status and response to
+ * all requests attached to it.
+ */
+static void ssam_request_dedup_end(struct ssam_controller *ctrl,
+				   struct ssam_request_dedup *dedup,
+				   const struct ssam_response *rsp, int status)
+{
+	struct ssam_request_dedup_waiter *w, *n;
+
+	if (list_empty(&dedup->node))
+		return;
+
+	/* After removal, no new waiters can attach to this request. */
+	spin_lock(&ctrl->dedup.lock);
+	list_del(&dedup->node);
+	spin_unlock(&ctrl->dedup.lock);
+
+	list_for_each_entry_safe(w, n, &dedup->waiters, node) {
+		/*
+		 * A response that does not fit into the buffer of this waiter
+		 * only fails this waiter. The status of the in-flight request
+		 * is passed on unchanged to all others.
+		 */
+		if (!status && rsp->length > w->rsp->capacity) {
+			w->status = -ENOSPC;
+		} else {
+			w->status = status;
+
+			if (!status) {
+				memcpy(w->rsp->pointer, rsp->pointer, rsp->length);
+				w->rsp->length = rsp->length;
+			}
+		}
+
+		/* The waiter may go out of scope after this. */
+		complete(&w->comp);
+	}
+}
+
+/**
+ * ssam_request_do_sync() - Execute a synchronous request.
+ * @ctrl: The controller via which the request will be submitted.
+ * @spec: The request specification and payload.
+ * @rsp:  The response buffer.
+ *
+ * Takes a synchronous request with its message data buffer from the
+ * preallocated request pool of the controller, falling back to
+ * ssam_request_sync_alloc() if the pool is exhausted, fully initializes it via
+ * the provided request specification, submits it, and finally waits for its
+ * completion before releasing it and returning its status.
+ *
+ * Requests with response marked via %SSAM_REQUEST_IDEMPOTENT are
+ * de-duplicated: If an identical request is already in flight, no new request
+ * is submitted. Instead, the response of that request is copied to @rsp once
+ * it has been completed. All other requests are always submitted to the EC.
+ *
+ * Return: Returns the status of the request or any failure during setup.
+ */
+int ssam_request_do_sync(struct ssam_controller *ctrl,
+			 const struct ssam_request *spec,
+			 struct ssam_response *rsp)
+{
+	struct ssam_request_dedup dedup;
+	struct ssam_request_sync *rqst;
+	struct ssam_span buf;
+	ssize_t len;
+	int status;
+
+	if (ssam_request_dedup_begin(ctrl, spec, rsp, &dedup, &status))
+		return status;
+
+	status = ssam_rqst_pool_get(&ctrl->rqst_pool, spec->length, &rqst, &buf);
+	if (status)
+		goto out;
+
+	status = ssam_request_sync_init(rqst, spec->flags);
+	if (status)
+		goto out_free;
+
+	ssam_request_sync_set_resp(rqst, rsp);
+
+	len = ssam_request_write_data(&buf, ctrl, spec);
+	if (len < 0) {
+		status = len;
+		goto out_free;
+	}
+
+	ssam_request_sync_set_data(rqst, buf.ptr, len);
+
+	status = ssam_request_sync_submit(ctrl, rqst);
+	if (!status)
+		status = ssam_request_sync_wait(rqst);
+
+out_free:
+	ssam_rqst_pool_put(&ctrl->rqst_pool, rqst);
+out:
+	ssam_request_dedup_end(ctrl, &dedup, rsp, status);
+	return status;
+}
+EXPORT_SYMBOL_GPL(ssam_request_do_sync);
+
+/**
+ * ssam_request_do_sync_with_buffer() - Execute a synchronous request with the
+ * provided buffer as back-end for the message buffer.
+ * @ctrl: The controller via which the request will be submitted.
+ * @spec: The request specification and payload.
+ * @rsp:  The response buffer.
+ * @buf:  The buffer for the request message data.
+ *
+ * Allocates a synchronous request struct on the stack, fully initializes it
+ * using the provided buffer as message data buffer, submits it, and then
+ * waits for its completion before returning its status. The
+ * SSH_COMMAND_MESSAGE_LENGTH() macro can be used to compute the required
+ * message buffer size.
+ *
+ * This function does essentially the same as ssam_request_do_sync(), but
+ * instead of dynamically allocating the request and message data buffer, it
+ * uses the provided message data buffer and stores the (small) request struct
+ * on the heap. Requests are de-duplicated in the same way.
+ *
+ * Return: Returns the status of the request or any failure during setup.
+ */
+int ssam_request_do_sync_with_buffer(struct ssam_controller *ctrl,
+				     const struct ssam_request *spec,
+				     struct ssam_response *rsp,
+				     struct ssam_span *buf)
+{
+	struct ssam_request_dedup dedup;
+	struct ssam_request_sync rqst;
+	ssize_t len;
+	int status;
+
+	if (ssam_request_dedup_begin(ctrl, spec, rsp, &dedup, &status))
+		return status;
+
+	status = ssam_request_sync_init(&rqst, spec->flags);
+	if (status)
+		goto out;
+
+	ssam_request_sync_set_resp(&rqst, rsp);
+
+	len = ssam_request_write_data(buf, ctrl, spec);
+	if (len < 0) {
+		status = len;
+		goto out;
+	}
+
+	ssam_request_sync_set_data(&rqst, buf->ptr, len);
+
+	status = ssam_request_sync_submit(ctrl, &rqst);
+	if (!status)
+		status = ssam_request_sync_wait(&rqst);
+
+out:
+	ssam_request_dedup_end(ctrl, &dedup, rsp, status);
+	return status;
+}
+EXPORT_SYMBOL_GPL(ssam_request_do_sync_with_buffer);
+
+/**
+ * ssam_request_cache_lookup() - Look up the response of a request in the
+ * controller's response cache.
+ * @ctrl: The controller.
+ * @spec: The request specification and payload.
+ * @rsp:  The response buffer.
+ * @gen:  Output for the current invalidation generation of the request's
+ *        target category. Must be passed to ssam_request_cache_store() when
+ *        storing the response of the forwarded request.
+ *
+ * Looks up an unexpired response for a request matching @spec in target
+ * category, target ID, command ID, instance ID, and payload. If found, the
+ * response is copied to @rsp.
+ *
+ * Return: Returns zero if the request has been answered from the cache,
+ * %-ENOENT if no valid entry exists or the cached response does not fit into
+ * @rsp, and %-EINVAL if the request cannot be cached.
+ */
+int ssam_request_cache_lookup(struct ssam_controller *ctrl,
+			      const struct ssam_request *spec,
+			      struct ssam_response *rsp, u32 *gen)
+{
+	struct ssam_rsp_cache *cache = &ctrl->rsp_cache;
+	struct ssam_rsp_cache_entry *e;
+	int status = -ENOENT;
+
+	if (!ssam_rsp_cache_is_cacheable(spec))
+		return -EINVAL;
+
+	spin_lock(&cache->lock);
+
+	*gen = cache->gen[spec->target_category % SSAM_RSP_CACHE_NUM_GEN];
+
+	e = ssam_rsp_cache_find(cache, spec);
+	if (e && time_after_eq(jiffies, e->expires)) {
+		ssam_rsp_cache_entry_remove(cache, e);
+		e = NULL;
+	}
+
+	if (e && e->rsp_len <= rsp->capacity) {
+		memcpy(rsp->pointer, e->data + e->payload_len, e->rsp_len);
+		rsp->length = e->rsp_len;
+		list_move(&e->node, &cache->entries);
+		status = 0;
+	}
+
+	spin_unlock(&cache->lock);
+
+	if (status)
+		atomic_long_inc(&cache->misses);
+	else
+		atomic_long_inc(&cache->hits);
+
+	return status;
+}
+EXPORT_SYMBOL_GPL(ssam_request_cache_lookup);
+
+/**
+ * ssam_request_cache_store() - Store the response of a request in the
+ * controller's response cache.
+ * @ctrl:   The controller.
+ * @spec:   The request specification and payload.
+ * @rsp:    The response of the request.
+ * @ttl_ms: Time-to-live of the entry, in milliseconds.
+ * @gen:    The invalidation generation obtained via
+ *          ssam_request_cache_lookup() before the request has been submitted.
+ *
+ * Stores the given response, replacing any previous entry for the same
+ * request. The response is discarded if the target category of the request
+ * has been invalidated since @gen has been obtained, as it may be stale. If
+ * the cache is full, the least recently used entry is evicted. Failure to
+ * store the response is not reported, as the cache is purely an optimization.
+ */
+void ssam_request_cache_store(struct ssam_controller *ctrl,
+			      const struct ssam_request *spec,
+			      const struct ssam_response *rsp,
+			      unsigned int ttl_ms, u32 gen)
+{
+	struct ssam_rsp_cache *cache = &ctrl->rsp_cache;
+	struct ssam_rsp_cache_entry *e, *old;
+
+	if (!ssam_rsp_cache_is_cacheable(spec) || !ttl_ms)
+		return;
+
+	if (rsp->length > SSAM_RSP_CACHE_MAX_RESPONSE)
+		return;
+
+	e = kmalloc(struct_size(e, data, spec->length + rsp->length), GFP_KERNEL);
+	if (!e)
+		return;
+
+	e->expires = jiffies + msecs_to_jiffies(ttl_ms);
+	e->tc = spec->target_category;
+	e->tid = spec->target_id;
+	e->cid = spec->command_id;
+	e->iid = spec->instance_id;
+	e->payload_len = spec->length;
+	e->rsp_len = rsp->length;
+	memcpy(e->data, spec->payload, spec->length);
+	memcpy(e->data + spec->length, rsp->pointer, rsp->length);
+
+	spin_lock(&cache->lock);
+
+	if (cache->gen[e->tc % SSAM_RSP_CACHE_NUM_GEN] != gen) {
+		spin_unlock(&cache->lock);
+		kfree(e);
+		return;
+	}
+
+	old = ssam_rsp_cache_find(cache, spec);
+	if (old)
+		ssam_rsp_cache_entry_remove(cache, old);
+
+	list_add(&e->node, &cache->entries);
+	cache->count++;
+
+	if (cache->count > SSAM_RSP_CACHE_MAX_ENTRIES) {
+		old = list_last_entry(&cache->entries, struct ssam_rsp_cache_entry,
+				      node);
+		ssam_rsp_cache_entry_remove(cache, old);
+	}
+
+	spin_unlock(&cache->lock);
+}
+EXPORT_SYMBOL_GPL(ssam_request_cache_store);
+
+/**
+ * ssam_request_cache_invalidate() - Invalidate cached responses of a target
+ * category.
+ * @ctrl: The controller.
+ * @tc:   The target category to invalidate.
+ *
+ * Drops all cached responses of requests with the given target category.
+ * Cached responses are automatically invalidated on reception of an event of
+ * the same target category. This function may be used by drivers to
+ * invalidate responses after state changes not signaled by events, e.g.
+ * after changing the device state via a request.
+ */
+void ssam_request_cache_invalidate(struct ssam_controller *ctrl, u8 tc)
+{
+	ssam_rsp_cache_invalidate(&ctrl->rsp_cache, tc);
+}
+EXPORT_SYMBOL_GPL(ssam_request_cache_invalidate);
+
+/**
+ * ssam_client_cache_store() - Store static client device data in the
+ * controller's client data cache.
+ * @ctrl: The controller.
+ * @key:  The key identifying the data.
+ * @data: The data to store.
+ * @len:  The length of the data.
+ *
+ * Stores a copy of the given data, replacing any previous entry with the same
+ * key. The key is defined by the client driver and must encode everything
+ * identifying the data, usually the device UID and type of data. If the cache
+ * exceeds its size limit, the least recently used entries are evicted.
+ *
+ * Return: Returns zero on success, %-E2BIG if the data exceeds the size limit
+ * of the cache, or %-ENOMEM if the entry could not be allocated. Callers
+ * should generally ignore failures, as the cache is purely an optimization.
  */
-int ssam_controller_suspend(struct ssam_controller *ctrl)
+int ssam_client_cache_store(struct ssam_controller *ctrl, u64 key,
+			    const void *data, size_t len)
 {
-	ssam_controller_lock(ctrl);
+	struct ssam_client_cache *cache = &ctrl->client_cache;
+	struct ssam_client_cache_entry *e, *old;
 
-	if (ctrl->state != SSAM_CONTROLLER_STARTED) {
-		ssam_controller_unlock(ctrl);
-		return -EINVAL;
-	}
+	if (len > SSAM_CLIENT_CACHE_MAX_SIZE)
+		return -E2BIG;
 
-	ssam_dbg(ctrl, "pm: suspending controller\n");
+	e = kmalloc(struct_size(e, data, len), GFP_KERNEL);
+	if (!e)
+		return -ENOMEM;
 
-	/*
-	 * Set state via write_once even though we're locked, due to
-	 * smoke-testing in ssam_request_sync_submit().
-	 */
-	WRITE_ONCE(ctrl->state, SSAM_CONTROLLER_SUSPENDED);
+	e->key = key;
+	e->len = len;
+	memcpy(e->data, data, len);
 
-	ssam_controller_unlock(ctrl);
+	mutex_lock(&cache->lock);
+
+	old = ssam_client_cache_find(cache, key);
+	if (old)
+		ssam_client_cache_entry_remove(cache, old);
+
+	list_add(&e->node, &cache->entries);
+	cache->count++;
+	cache->size += len;
+
+	while (cache->size > SSAM_CLIENT_CACHE_MAX_SIZE) {
+		old = list_last_entry(&cache->entries,
+				      struct ssam_client_cache_entry, node);
+		ssam_client_cache_entry_remove(cache, old);
+	}
+
+	mutex_unlock(&cache->lock);
 	return 0;
 }
+EXPORT_SYMBOL_GPL(ssam_client_cache_store);
 
 /**
- * ssam_controller_resume() - Resume the controller from suspend.
- * @ctrl: The controller to resume.
- *
- * Resume the controller from the suspended state it was put into via
- * ssam_controller_suspend(). This function does not issue display-on and
- * D0-entry notifications. If required, those have to be sent manually after
- * this call.
+ * ssam_client_cache_load() - Load static client device data from the
+ * controller's client data cache.
+ * @ctrl: The controller.
+ * @key:  The key identifying the data.
+ * @buf:  The buffer to copy the data to.
+ * @len:  The capacity of the buffer.
  *
- * Return: Returns %-EINVAL if the controller is currently not suspended.
+ * Return: Returns the length of the cached data copied to @buf on success,
+ * %-ENOENT if no entry for @key exists, or %-ENOSPC if the cached data does
+ * not fit into @buf.
  */
-int ssam_controller_resume(struct ssam_controller *ctrl)
+ssize_t ssam_client_cache_load(struct ssam_controller *ctrl, u64 key,
+			       void *buf, size_t len)
 {
-	ssam_controller_lock(ctrl);
+	struct ssam_client_cache *cache = &ctrl->client_cache;
+	struct ssam_client_cache_entry *e;
+	ssize_t status;
 
-	if (ctrl->state != SSAM_CONTROLLER_SUSPENDED) {
-		ssam_controller_unlock(ctrl);
-		return -EINVAL;
+	mutex_lock(&cache->lock);
+
+	e = ssam_client_cache_find(cache, key);
+	if (!e) {
+		status = -ENOENT;
+	} else if (e->len > len) {
+		status = -ENOSPC;
+	} else {
+		memcpy(buf, e->data, e->len);
+		list_move(&e->node, &cache->entries);
+		status = e->len;
 	}
 
-	ssam_dbg(ctrl, "pm: resuming controller\n");
+	mutex_unlock(&cache->lock);
 
-	/*
-	 * Set state via write_once even though we're locked, due to
-	 * smoke-testing in ssam_request_sync_submit().
-	 */
-	WRITE_ONCE(ctrl->state, SSAM_CONTROLLER_STARTED);
+	if (status < 0)
+		atomic_long_inc(&cache->misses);
+	else
+		atomic_long_inc(&cache->hits);
 
-	ssam_controller_unlock(ctrl);
-	return 0;
+	return status;
 }
-
-
-/* -- Top-level request interface ------------------------------------------- */
+EXPORT_SYMBOL_GPL(ssam_client_cache_load);
 
 /**
- * ssam_request_write_data() - Construct and write SAM request message to
- * buffer.
- * @buf:  The buffer to write the data to.
- * @ctrl: The controller via which the request will be sent.
- * @spec: The request data and specification.
- *
- * Constructs a SAM/SSH request message and writes it to the provided buffer.
- * The request and transport counters, specifically RQID and SEQ, will be set
- * in this call. These counters are obtained from the controller. It is thus
- * only valid to send the resulting message via the controller specified here.
- *
- * For calculation of the required buffer size, refer to the
- * SSH_COMMAND_MESSAGE_LENGTH() macro.
+ * ssam_client_cache_drop() - Drop static client device data from the
+ * controller's client data cache.
+ * @ctrl: The controller.
+ * @key:  The key identifying the data.
  *
- * Return: Returns the number of bytes used in the buffer on success. Returns
- * %-EINVAL if the payload length provided in the request specification is too
- * large (larger than %SSH_COMMAND_MAX_PAYLOAD_SIZE) or if the provided buffer
- * is too small.
+ * Removes the entry for the given key, if any. Should be used by client
+ * drivers when the cached data has been found to be invalid.
  */
-ssize_t ssam_request_write_data(struct ssam_span *buf,
-				struct ssam_controller *ctrl,
-				const struct ssam_request *spec)
+void ssam_client_cache_drop(struct ssam_controller *ctrl, u64 key)
 {
-	struct msgbuf msgb;
-	u16 rqid;
-	u8 seq;
+	struct ssam_client_cache *cache = &ctrl->client_cache;
+	struct ssam_client_cache_entry *e;
 
-	if (spec->length > SSH_COMMAND_MAX_PAYLOAD_SIZE)
-		return -EINVAL;
-
-	if (SSH_COMMAND_MESSAGE_LENGTH(spec->length) > buf->len)
-		return -EINVAL;
+	mutex_lock(&cache->lock);
 
-	msgb_init(&msgb, buf->ptr, buf->len);
-	seq = ssh_seq_next(&ctrl->counter.seq);
-	rqid = ssh_rqid_next(&ctrl->counter.rqid);
-	msgb_push_cmd(&msgb, seq, rqid, spec);
+	e = ssam_client_cache_find(cache, key);
+	if (e)
+		ssam_client_cache_entry_remove(cache, e);
 
-	return msgb_bytes_used(&msgb);
+	mutex_unlock(&cache->lock);
 }
-EXPORT_SYMBOL_GPL(ssam_request_write_data);
+EXPORT_SYMBOL_GPL(ssam_client_cache_drop);
 
-static void ssam_request_sync_complete(struct ssh_request *rqst,
-				       const struct ssh_command *cmd,
-				       const struct ssam_span *data, int status)
+
+static void ssam_request_async_complete(struct ssh_request *rqst,
+					const struct ssh_command *cmd,
+					const struct ssam_span *data, int status)
 {
 	struct ssh_rtl *rtl = ssh_request_rtl(rqst);
-	struct ssam_request_sync *r;
+	struct ssam_request_async *r;
 
-	r = container_of(rqst, struct ssam_request_sync, base);
+	r = container_of(rqst, struct ssam_request_async, base);
 	r->status = status;
 
 	if (r->resp)
@@ -1506,60 +3539,68 @@ static void ssam_request_sync_complete(struct ssh_request *rqst,
 		return;
 	}
 
-	if (!data)	/* Handle requests without a response. */
-		return;
+	r->status = ssam_request_store_response(rtl, r->resp, data);
+}
 
-	if (!r->resp || !r->resp->pointer) {
-		if (data->len)
-			rtl_warn(rtl, "rsp: no response buffer provided, dropping data\n");
-		return;
-	}
+static void ssam_request_async_release(struct ssh_request *rqst)
+{
+	struct ssam_request_async *r;
 
-	if (data->len > r->resp->capacity) {
-		rtl_err(rtl,
-			"rsp: response buffer too small, capacity: %zu bytes, got: %zu bytes\n",
-			r->resp->capacity, data->len);
-		r->status = -ENOSPC;
+	r = container_of(rqst, struct ssam_request_async, base);
+
+	/*
+	 * The controller reference is cleared in ssam_request_async_submit()
+	 * if submission fails. In that case, the request has never entered
+	 * the transport system and the caller is notified via the return value
+	 * of the submit call instead of the callback.
+	 */
+	if (!r->ctrl)
 		return;
-	}
 
-	r->resp->length = data->len;
-	memcpy(r->resp->pointer, data->ptr, data->len);
+	/*
+	 * Defer the callback to the completion workqueue. Release may be
+	 * called from the receiver thread or the timeout reaper, so we don't
+	 * want to block those with client code.
+	 */
+	ssam_cplt_submit(&r->ctrl->cplt.wq[SSAM_CPLT_WQ_DEFAULT], &r->work);
 }
 
-static void ssam_request_sync_release(struct ssh_request *rqst)
+static const struct ssh_request_ops ssam_request_async_ops = {
+	.release = ssam_request_async_release,
+	.complete = ssam_request_async_complete,
+};
+
+static void ssam_request_async_work_fn(struct work_struct *work)
 {
-	complete_all(&container_of(rqst, struct ssam_request_sync, base)->comp);
-}
+	struct ssam_request_async *r;
 
-static const struct ssh_request_ops ssam_request_sync_ops = {
-	.release = ssam_request_sync_release,
-	.complete = ssam_request_sync_complete,
-};
+	r = container_of(work, struct ssam_request_async, work);
+	r->fn(r, r->status);
+}
 
 /**
- * ssam_request_sync_alloc() - Allocate a synchronous request.
+ * ssam_request_async_alloc() - Allocate an asynchronous request.
  * @payload_len: The length of the request payload.
  * @flags:       Flags used for allocation.
  * @rqst:        Where to store the pointer to the allocated request.
  * @buffer:      Where to store the buffer descriptor for the message buffer of
  *               the request.
  *
- * Allocates a synchronous request with corresponding message buffer. The
- * request still needs to be initialized ssam_request_sync_init() before
+ * Allocates an asynchronous request with corresponding message buffer. The
+ * request still needs to be initialized via ssam_request_async_init() before
  * it can be submitted, and the message buffer data must still be set to the
- * returned buffer via ssam_request_sync_set_data() after it has been filled,
+ * returned buffer via ssam_request_async_set_data() after it has been filled,
  * if need be with adjusted message length.
  *
  * After use, the request and its corresponding message buffer should be freed
- * via ssam_request_sync_free(). The buffer must not be freed separately.
+ * via ssam_request_async_free(). The buffer must not be freed separately.
  *
  * Return: Returns zero on success, %-ENOMEM if the request could not be
  * allocated.
  */
-int ssam_request_sync_alloc(size_t payload_len, gfp_t flags,
-			    struct ssam_request_sync **rqst,
-			    struct ssam_span *buffer)
+int ssam_request_async_alloc(size_t payload_len, gfp_t flags,
+			     struct ssam_request_async **rqst,
+			     struct ssam_span *buffer)
 {
 	size_t msglen = SSH_COMMAND_MESSAGE_LENGTH(payload_len);
 
@@ -1572,208 +3613,134 @@ int ssam_request_sync_alloc(size_t payload_len, gfp_t flags,
 
 	return 0;
 }
-EXPORT_SYMBOL_GPL(ssam_request_sync_alloc);
+EXPORT_SYMBOL_GPL(ssam_request_async_alloc);
 
 /**
- * ssam_request_sync_free() - Free a synchronous request.
+ * ssam_request_async_free() - Free an asynchronous request.
  * @rqst: The request to be freed.
  *
- * Free a synchronous request and its corresponding buffer allocated with
- * ssam_request_sync_alloc(). Do not use for requests allocated on the stack
- * or via any other function.
+ * Free an asynchronous request and its corresponding buffer allocated with
+ * ssam_request_async_alloc(). Do not use for requests allocated via any other
+ * function.
  *
  * Warning: The caller must ensure that the request is not in use any more.
- * I.e. the caller must ensure that it has the only reference to the request
- * and the request is not currently pending. This means that the caller has
- * either never submitted the request, request submission has failed, or the
- * caller has waited until the submitted request has been completed via
- * ssam_request_sync_wait().
+ * I.e. the caller must ensure that either the request has never been
+ * submitted, request submission has failed, or the completion callback of
+ * the request has been executed. It is valid to call this function from
+ * inside the completion callback.
  */
-void ssam_request_sync_free(struct ssam_request_sync *rqst)
+void ssam_request_async_free(struct ssam_request_async *rqst)
 {
 	kfree(rqst);
 }
-EXPORT_SYMBOL_GPL(ssam_request_sync_free);
+EXPORT_SYMBOL_GPL(ssam_request_async_free);
 
 /**
- * ssam_request_sync_init() - Initialize a synchronous request struct.
+ * ssam_request_async_init() - Initialize an asynchronous request struct.
  * @rqst:  The request to initialize.
  * @flags: The request flags.
+ * @fn:    The completion callback of the request.
  *
  * Initializes the given request struct. Does not initialize the request
  * message data. This has to be done explicitly after this call via
- * ssam_request_sync_set_data() and the actual message data has to be written
+ * ssam_request_async_set_data() and the actual message data has to be written
  * via ssam_request_write_data().
  *
  * Return: Returns zero on success or %-EINVAL if the given flags are invalid.
  */
-int ssam_request_sync_init(struct ssam_request_sync *rqst,
-			   enum ssam_request_flags flags)
+int ssam_request_async_init(struct ssam_request_async *rqst,
+			    enum ssam_request_flags flags,
+			    ssam_request_async_fn fn)
 {
 	int status;
 
-	status = ssh_request_init(&rqst->base, flags, &ssam_request_sync_ops);
+	status = ssh_request_init(&rqst->base, flags, &ssam_request_async_ops);
 	if (status)
 		return status;
 
-	init_completion(&rqst->comp);
+	INIT_WORK(&rqst->work, ssam_request_async_work_fn);
+	rqst->ctrl = NULL;
 	rqst->resp = NULL;
 	rqst->status = 0;
+	rqst->fn = fn;
 
 	return 0;
 }
-EXPORT_SYMBOL_GPL(ssam_request_sync_init);
+EXPORT_SYMBOL_GPL(ssam_request_async_init);
 
 /**
- * ssam_request_sync_submit() - Submit a synchronous request.
+ * ssam_request_async_submit() - Submit an asynchronous request.
  * @ctrl: The controller with which to submit the request.
  * @rqst: The request to submit.
  *
- * Submit a synchronous request. The request has to be initialized and
+ * Submit an asynchronous request. The request has to be initialized and
  * properly set up, including response buffer (may be %NULL if no response is
  * expected) and command message data. This function does not wait for the
  * request to be completed.
  *
- * If this function succeeds, ssam_request_sync_wait() must be used to ensure
- * that the request has been completed before the response data can be
- * accessed and/or the request can be freed. On failure, the request may
- * immediately be freed.
- *
- * This function may only be used if the controller is active, i.e. has been
- * initialized and not suspended.
- */
-int ssam_request_sync_submit(struct ssam_controller *ctrl,
-			     struct ssam_request_sync *rqst)
-{
-	int status;
-
-	/*
-	 * This is only a superficial check. In general, the caller needs to
-	 * ensure that the controller is initialized and is not (and does not
-	 * get) suspended during use, i.e. until the request has been completed
-	 * (if _absolutely_ necessary, by use of ssam_controller_statelock/
-	 * ssam_controller_stateunlock, but something like ssam_client_link
-	 * should be preferred as this needs to last until the request has been
-	 * completed).
-	 *
-	 * Note that it is actually safe to use this function while the
-	 * controller is in the process of being shut down (as ssh_rtl_submit
-	 * is safe with regards to this), but it is generally discouraged to do
-	 * so.
-	 */
-	if (WARN_ON(READ_ONCE(ctrl->state) != SSAM_CONTROLLER_STARTED)) {
-		ssh_request_put(&rqst->base);
-		return -ENODEV;
-	}
-
-	status = ssh_rtl_submit(&ctrl->rtl, &rqst->base);
-	ssh_request_put(&rqst->base);
-
-	return status;
-}
-EXPORT_SYMBOL_GPL(ssam_request_sync_submit);
-
-/**
- * ssam_request_do_sync() - Execute a synchronous request.
- * @ctrl: The controller via which the request will be submitted.
- * @spec: The request specification and payload.
- * @rsp:  The response buffer.
- *
- * Allocates a synchronous request with its message data buffer on the heap
- * via ssam_request_sync_alloc(), fully initializes it via the provided
- * request specification, submits it, and finally waits for its completion
- * before freeing it and returning its status.
- *
- * Return: Returns the status of the request or any failure during setup.
- */
-int ssam_request_do_sync(struct ssam_controller *ctrl,
-			 const struct ssam_request *spec,
-			 struct ssam_response *rsp)
-{
-	struct ssam_request_sync *rqst;
-	struct ssam_span buf;
-	ssize_t len;
-	int status;
-
-	status = ssam_request_sync_alloc(spec->length, GFP_KERNEL, &rqst, &buf);
-	if (status)
-		return status;
-
-	status = ssam_request_sync_init(rqst, spec->flags);
-	if (status) {
-		ssam_request_sync_free(rqst);
-		return status;
-	}
-
-	ssam_request_sync_set_resp(rqst, rsp);
-
-	len = ssam_request_write_data(&buf, ctrl, spec);
-	if (len < 0) {
-		ssam_request_sync_free(rqst);
-		return len;
-	}
-
-	ssam_request_sync_set_data(rqst, buf.ptr, len);
-
-	status = ssam_request_sync_submit(ctrl, rqst);
-	if (!status)
-		status = ssam_request_sync_wait(rqst);
-
-	ssam_request_sync_free(rqst);
-	return status;
-}
-EXPORT_SYMBOL_GPL(ssam_request_do_sync);
-
-/**
- * ssam_request_do_sync_with_buffer() - Execute a synchronous request with the
- * provided buffer as back-end for the message buffer.
- * @ctrl: The controller via which the request will be submitted.
- * @spec: The request specification and payload.
- * @rsp:  The response buffer.
- * @buf:  The buffer for the request message data.
- *
- * Allocates a synchronous request struct on the stack, fully initializes it
- * using the provided buffer as message data buffer, submits it, and then
- * waits for its completion before returning its status. The
- * SSH_COMMAND_MESSAGE_LENGTH() macro can be used to compute the required
- * message buffer size.
- *
- * This function does essentially the same as ssam_request_do_sync(), but
- * instead of dynamically allocating the request and message data buffer, it
- * uses the provided message data buffer and stores the (small) request struct
- * on the heap.
+ * If this function succeeds, the completion callback of the request will be
+ * executed exactly once on the completion workqueue of the controller after
+ * the request has been completed (successfully or not). Only then may the
+ * response data be accessed and/or the request be freed. On failure, the
+ * callback will not be executed and the request may immediately be freed.
  *
- * Return: Returns the status of the request or any failure during setup.
+ * This function may only be used if the controller is active, i.e. has been
+ * initialized and not suspended. Callers must further ensure that all
+ * submitted requests have been completed before the controller is
+ * destroyed, i.e. before the client driver unbinds.
+ *
+ * Return: Returns zero on success, %-ENODEV if the controller is not active,
+ * or any error returned by the request transport layer on submission.
  */
-int ssam_request_do_sync_with_buffer(struct ssam_controller *ctrl,
-				     const struct ssam_request *spec,
-				     struct ssam_response *rsp,
-				     struct ssam_span *buf)
+int ssam_request_async_submit(struct ssam_controller *ctrl,
+			      struct ssam_request_async *rqst)
 {
-	struct ssam_request_sync rqst;
-	ssize_t len;
 	int status;
 
-	status = ssam_request_sync_init(&rqst, spec->flags);
-	if (status)
-		return status;
-
-	ssam_request_sync_set_resp(&rqst, rsp);
+	/*
+	 * This is only a superficial check. See ssam_request_sync_submit() for
+	 * details.
+	 */
+	if (WARN_ON(READ_ONCE(ctrl->state) != SSAM_CONTROLLER_STARTED)) {
+		ssh_request_put(&rqst->base);
+		return -ENODEV;
+	}
 
-	len = ssam_request_write_data(buf, ctrl, spec);
-	if (len < 0)
-		return len;
+	rqst->ctrl = ctrl;
 
-	ssam_request_sync_set_data(&rqst, buf->ptr, len);
+	status = ssh_rtl_submit(&ctrl->rtl, &rqst->base);
 
-	status = ssam_request_sync_submit(ctrl, &rqst);
-	if (!status)
-		status = ssam_request_sync_wait(&rqst);
+	/*
+	 * If submission failed, the transport system does not hold any
+	 * reference to the request, so we can safely clear the controller
+	 * reference to suppress the callback when dropping ours below.
+	 */
+	if (status)
+		rqst->ctrl = NULL;
 
+	ssh_request_put(&rqst->base);
 	return status;
 }
-EXPORT_SYMBOL_GPL(ssam_request_do_sync_with_buffer);
+EXPORT_SYMBOL_GPL(ssam_request_async_submit);
 
+/**
+ * ssam_request_async_cancel() - Cancel an asynchronous request.
+ * @rqst: The request to cancel.
+ *
+ * Cancels the given, previously submitted request, regardless of whether it
+ * has already been transmitted or not. If the request has not been completed
+ * yet, it will be completed with status %-ECANCELED. In either case, its
+ * completion callback will be executed as usual, although possibly only some
+ * time after this call returns.
+ *
+ * Return: Returns %true if the given request has been canceled or completed,
+ * either by this function or prior to calling this function.
+ */
+bool ssam_request_async_cancel(struct ssam_request_async *rqst)
+{
+	return ssh_rtl_cancel(&rqst->base, true);
+}
+EXPORT_SYMBOL_GPL(ssam_request_async_cancel);
 
 /* -- Internal SAM requests. ------------------------------------------------ */
 
@@ -1798,6 +3765,13 @@ SSAM_DEFINE_SYNC_REQUEST_R(ssam_ssh_notif_display_on, u8, {
 	.instance_id     = 0x00,
 });
 
+SSAM_DEFINE_SYNC_REQUEST_R(ssam_ssh_gpio_callback, u8, {
+	.target_category = SSAM_SSH_TC_SAM,
+	.target_id       = SSAM_SSH_TID_SAM,
+	.command_id      = 0x17,
+	.instance_id     = 0x00,
+});
+
 SSAM_DEFINE_SYNC_REQUEST_R(ssam_ssh_notif_d0_exit, u8, {
 	.target_category = SSAM_SSH_TC_SAM,
 	.target_id       = SSAM_SSH_TID_SAM,
@@ -1831,6 +3805,33 @@ struct ssh_notification_params {
 
 static_assert(sizeof(struct ssh_notification_params) == 5);
 
+static int ssam_ssh_event_request_setup(struct ssam_event_registry reg, u8 cid,
+					struct ssam_event_id id, u8 flags,
+					struct ssh_notification_params *params,
+					struct ssam_request *rqst)
+{
+	u16 rqid = ssh_tc_to_rqid(id.target_category);
+
+	/* Only allow RQIDs that lie within the event spectrum. */
+	if (!ssh_rqid_is_event(rqid))
+		return -EINVAL;
+
+	params->target_category = id.target_category;
+	params->instance_id = id.instance;
+	params->flags = flags;
+	put_unaligned_le16(rqid, &params->request_id);
+
+	rqst->target_category = reg.target_category;
+	rqst->target_id = reg.target_id;
+	rqst->command_id = cid;
+	rqst->instance_id = 0x00;
+	rqst->flags = SSAM_REQUEST_HAS_RESPONSE;
+	rqst->length = sizeof(*params);
+	rqst->payload = (u8 *)params;
+
+	return 0;
+}
+
 static int __ssam_ssh_event_request(struct ssam_controller *ctrl,
 				    struct ssam_event_registry reg, u8 cid,
 				    struct ssam_event_id id, u8 flags)
@@ -1839,26 +3840,11 @@ static int __ssam_ssh_event_request(struct ssam_controller *ctrl,
 	struct ssam_request rqst;
 	struct ssam_response result;
 	int status;
-
-	u16 rqid = ssh_tc_to_rqid(id.target_category);
 	u8 buf = 0;
 
-	/* Only allow RQIDs that lie within the event spectrum. */
-	if (!ssh_rqid_is_event(rqid))
-		return -EINVAL;
-
-	params.target_category = id.target_category;
-	params.instance_id = id.instance;
-	params.flags = flags;
-	put_unaligned_le16(rqid, &params.request_id);
-
-	rqst.target_category = reg.target_category;
-	rqst.target_id = reg.target_id;
-	rqst.command_id = cid;
-	rqst.instance_id = 0x00;
-	rqst.flags = SSAM_REQUEST_HAS_RESPONSE;
-	rqst.length = sizeof(params);
-	rqst.payload = (u8 *)&params;
+	status = ssam_ssh_event_request_setup(reg, cid, id, flags, &params, &rqst);
+	if (status)
+		return status;
 
 	result.capacity = sizeof(buf);
 	result.length = 0;
@@ -1870,6 +3856,33 @@ static int __ssam_ssh_event_request(struct ssam_controller *ctrl,
 	return status < 0 ? status : buf;
 }
 
+/*
+ * Convert the result of a SSH event (de-)activation request to a status code,
+ * logging any failures.
+ */
+static int ssam_ssh_event_check_result(struct ssam_controller *ctrl,
+				       struct ssam_event_registry reg,
+				       struct ssam_event_id id, bool enable,
+				       int status)
+{
+	if (status < 0 && status != -EINVAL) {
+		ssam_err(ctrl,
+			 "failed to %s event source (tc: %#04x, iid: %#04x, reg: %#04x)\n",
+			 enable ? "enable" : "disable", id.target_category,
+			 id.instance, reg.target_category);
+	}
+
+	if (status > 0) {
+		ssam_err(ctrl,
+			 "unexpected result while %s event source: %#04x (tc: %#04x, iid: %#04x, reg: %#04x)\n",
+			 enable ? "enabling" : "disabling", status,
+			 id.target_category, id.instance, reg.target_category);
+		return -EPROTO;
+	}
+
+	return status;
+}
+
 /**
  * ssam_ssh_event_enable() - Enable SSH event.
  * @ctrl:  The controller for which to enable the event.
@@ -1894,21 +3907,7 @@ static int ssam_ssh_event_enable(struct ssam_controller *ctrl,
 	int status;
 
 	status = __ssam_ssh_event_request(ctrl, reg, reg.cid_enable, id, flags);
-
-	if (status < 0 && status != -EINVAL) {
-		ssam_err(ctrl,
-			 "failed to enable event source (tc: %#04x, iid: %#04x, reg: %#04x)\n",
-			 id.target_category, id.instance, reg.target_category);
-	}
-
-	if (status > 0) {
-		ssam_err(ctrl,
-			 "unexpected result while enabling event source: %#04x (tc: %#04x, iid: %#04x, reg: %#04x)\n",
-			 status, id.target_category, id.instance, reg.target_category);
-		return -EPROTO;
-	}
-
-	return status;
+	return ssam_ssh_event_check_result(ctrl, reg, id, true, status);
 }
 
 /**
@@ -1935,21 +3934,162 @@ static int ssam_ssh_event_disable(struct ssam_controller *ctrl,
 	int status;
 
 	status = __ssam_ssh_event_request(ctrl, reg, reg.cid_disable, id, flags);
+	return ssam_ssh_event_check_result(ctrl, reg, id, false, status);
+}
 
-	if (status < 0 && status != -EINVAL) {
-		ssam_err(ctrl,
-			 "failed to disable event source (tc: %#04x, iid: %#04x, reg: %#04x)\n",
-			 id.target_category, id.instance, reg.target_category);
-	}
+/**
+ * struct ssam_ssh_event_batch - Batch of pipelined SSH event (de-)activation
+ * requests.
+ * @pending: Number of requests not yet completed, biased by one until all
+ *           requests have been submitted.
+ * @comp:    Completion signaled once all requests have been completed.
+ */
+struct ssam_ssh_event_batch {
+	atomic_t pending;
+	struct completion comp;
+};
 
-	if (status > 0) {
-		ssam_err(ctrl,
-			 "unexpected result while disabling event source: %#04x (tc: %#04x, iid: %#04x, reg: %#04x)\n",
-			 status, id.target_category, id.instance, reg.target_category);
-		return -EPROTO;
+/**
+ * struct ssam_ssh_event_batch_entry - Entry of a batch of pipelined SSH event
+ * (de-)activation requests.
+ * @rqst:   The asynchronous request.
+ * @batch:  The batch this entry belongs to.
+ * @ref:    The event reference count entry describing the event to enable or
+ *          disable.
+ * @params: The request payload.
+ * @rsp:    The response descriptor.
+ * @rspbuf: The response buffer.
+ * @msgbuf: The request message buffer.
+ * @status: The status of the request. Set to the final result after
+ *          ssam_ssh_event_batch_execute() returns.
+ */
+struct ssam_ssh_event_batch_entry {
+	struct ssam_request_async rqst;
+	struct ssam_ssh_event_batch *batch;
+	struct ssam_nf_refcount_entry *ref;
+
+	struct ssh_notification_params params;
+	struct ssam_response rsp;
+	u8 rspbuf;
+	u8 msgbuf[SSH_COMMAND_MESSAGE_LENGTH(sizeof(struct ssh_notification_params))];
+
+	int status;
+};
+
+static void ssam_ssh_event_batch_complete(struct ssam_request_async *rqst,
+					  int status)
+{
+	struct ssam_ssh_event_batch_entry *e;
+
+	e = container_of(rqst, struct ssam_ssh_event_batch_entry, rqst);
+	e->status = status;
+
+	if (atomic_dec_and_test(&e->batch->pending))
+		complete(&e->batch->comp);
+}
+
+static int ssam_ssh_event_batch_setup(struct ssam_controller *ctrl,
+				      struct ssam_ssh_event_batch_entry *e,
+				      bool enable)
+{
+	struct ssam_event_registry reg = e->ref->key.reg;
+	u8 cid = enable ? reg.cid_enable : reg.cid_disable;
+	struct ssam_span buf = { e->msgbuf, sizeof(e->msgbuf) };
+	struct ssam_request rqst;
+	ssize_t len;
+	int status;
+
+	status = ssam_ssh_event_request_setup(reg, cid, e->ref->key.id,
+					      e->ref->flags, &e->params, &rqst);
+	if (status)
+		return status;
+
+	status = ssam_request_async_init(&e->rqst, rqst.flags,
+					 ssam_ssh_event_batch_complete);
+	if (status)
+		return status;
+
+	len = ssam_request_write_data(&buf, ctrl, &rqst);
+	if (len < 0)
+		return len;
+
+	e->rspbuf = 0;
+	e->rsp.capacity = sizeof(e->rspbuf);
+	e->rsp.length = 0;
+	e->rsp.pointer = &e->rspbuf;
+
+	ssam_request_async_set_data(&e->rqst, buf.ptr, len);
+	ssam_request_async_set_resp(&e->rqst, &e->rsp);
+	return 0;
+}
+
+/**
+ * ssam_ssh_event_batch_execute() - Enable or disable multiple SSH events in
+ * a pipelined fashion.
+ * @ctrl:    The controller.
+ * @entries: The batch entries, with the event to enable or disable set via
+ *           their @ref member.
+ * @count:   The number of entries.
+ * @enable:  Whether to enable (%true) or disable (%false) the events.
+ *
+ * Submits all requests before waiting for any of them, so that multiple
+ * requests are in flight at once. Requests failing due to a timeout or I/O
+ * error are retried synchronously via ssam_ssh_event_enable() or
+ * ssam_ssh_event_disable(). The result of each request is stored in the
+ * @status member of its entry, with errors being logged per entry.
+ */
+static void ssam_ssh_event_batch_execute(struct ssam_controller *ctrl,
+					 struct ssam_ssh_event_batch_entry *entries,
+					 unsigned int count, bool enable)
+{
+	struct ssam_ssh_event_batch batch;
+	struct ssam_ssh_event_batch_entry *e;
+	unsigned int i;
+	int status;
+
+	atomic_set(&batch.pending, 1);
+	init_completion(&batch.comp);
+
+	for (i = 0; i < count; i++) {
+		e = &entries[i];
+		e->batch = &batch;
+
+		e->status = ssam_ssh_event_batch_setup(ctrl, e, enable);
+		if (e->status)
+			continue;
+
+		atomic_inc(&batch.pending);
+
+		e->status = ssam_request_async_submit(ctrl, &e->rqst);
+		if (e->status)
+			atomic_dec(&batch.pending);
 	}
 
-	return status;
+	/* Drop submission bias and wait for all requests to complete. */
+	if (!atomic_dec_and_test(&batch.pending))
+		wait_for_completion(&batch.comp);
+
+	for (i = 0; i < count; i++) {
+		struct ssam_nf_refcount_entry *ref = entries[i].ref;
+
+		e = &entries[i];
+		status = e->status ? e->status : e->rspbuf;
+
+		if (status == -ETIMEDOUT || status == -EREMOTEIO) {
+			if (enable)
+				status = ssam_ssh_event_enable(ctrl, ref->key.reg,
+							       ref->key.id, ref->flags);
+			else
+				status = ssam_ssh_event_disable(ctrl, ref->key.reg,
+								ref->key.id, ref->flags);
+		} else {
+			status = ssam_ssh_event_check_result(ctrl, ref->key.reg,
+							     ref->key.id, enable,
+							     status);
+		}
+
+		e->status = status;
+	}
 }
 
 
@@ -2278,10 +4418,15 @@ static int ssam_nf_refcount_disable_free(struct ssam_controller *ctrl,
  * event, i.e. as long as no event matching is performed, only the event target
  * category needs to be set.
  *
- * Return: Returns zero on success, %-ENOSPC if there have already been
- * %INT_MAX notifiers for the event ID/type associated with the notifier block
- * registered, %-ENOMEM if the corresponding event entry could not be
- * allocated. If this is the first time that a notifier block is registered
+ * If the notifier specifies a coalescing window (``coalesce.window_ms``),
+ * consecutive matching events within that window are collapsed before being
+ * delivered to it. See &struct ssam_event_notifier for details.
+ *
+ * Return: Returns zero on success, %-EEXIST if the notifier has already been
+ * registered, %-ENOSPC if there have already been %INT_MAX notifiers for the
+ * event ID/type associated with the notifier block registered, %-ENOMEM if
+ * the corresponding event entry or coalescing state could not be allocated.
+ * If this is the first time that a notifier block is registered
  * for the specific associated event, returns the status of the event-enable
  * EC-command.
  */
@@ -2290,6 +4435,7 @@ int ssam_notifier_register(struct ssam_controller *ctrl, struct ssam_event_notif
 	u16 rqid = ssh_tc_to_rqid(n->event.id.target_category);
 	struct ssam_nf_refcount_entry *entry = NULL;
 	struct ssam_nf_head *nf_head;
+	struct ssam_cplt_wq *wq;
 	struct ssam_nf *nf;
 	int status;
 
@@ -2298,22 +4444,36 @@ int ssam_notifier_register(struct ssam_controller *ctrl, struct ssam_event_notif
 
 	nf = &ctrl->cplt.event.notif;
 	nf_head = &nf->head[ssh_rqid_to_event(rqid)];
+	wq = &ctrl->cplt.wq[ssam_cplt_tc_to_wq(n->event.id.target_category)];
 
 	mutex_lock(&nf->lock);
 
+	if (ssam_nfblk_find(nf_head, n)) {
+		mutex_unlock(&nf->lock);
+		return -EEXIST;
+	}
+
+	status = ssam_event_coalesce_alloc(n, nf_head, ssam_controller_device(ctrl), wq);
+	if (status) {
+		mutex_unlock(&nf->lock);
+		return status;
+	}
+
 	if (!(n->flags & SSAM_EVENT_NOTIFIER_OBSERVER)) {
 		entry = ssam_nf_refcount_inc(nf, n->event.reg, n->event.id);
 		if (IS_ERR(entry)) {
+			ssam_event_coalesce_free(n);
 			mutex_unlock(&nf->lock);
 			return PTR_ERR(entry);
 		}
 	}
 
-	status = ssam_nfblk_insert(nf_head, &n->base);
+	status = ssam_nfblk_insert(nf_head, n);
 	if (status) {
 		if (entry)
 			ssam_nf_refcount_dec_free(nf, n->event.reg, n->event.id);
 
+		ssam_event_coalesce_free(n);
 		mutex_unlock(&nf->lock);
 		return status;
 	}
@@ -2321,10 +4481,11 @@ int ssam_notifier_register(struct ssam_controller *ctrl, struct ssam_event_notif
 	if (entry) {
 		status = ssam_nf_refcount_enable(ctrl, entry, n->event.flags);
 		if (status) {
-			ssam_nfblk_remove(&n->base);
+			ssam_nfblk_remove(n);
 			ssam_nf_refcount_dec_free(nf, n->event.reg, n->event.id);
 			mutex_unlock(&nf->lock);
 			synchronize_srcu(&nf_head->srcu);
+			ssam_event_coalesce_free(n);
 			return status;
 		}
 	}
@@ -2370,7 +4531,7 @@ int __ssam_notifier_unregister(struct ssam_controller *ctrl, struct ssam_event_n
 
 	mutex_lock(&nf->lock);
 
-	if (!ssam_nfblk_find(nf_head, &n->base)) {
+	if (!ssam_nfblk_find(nf_head, n)) {
 		mutex_unlock(&nf->lock);
 		return -ENOENT;
 	}
@@ -2396,10 +4557,11 @@ int __ssam_notifier_unregister(struct ssam_controller *ctrl, struct ssam_event_n
 	}
 
 remove:
-	ssam_nfblk_remove(&n->base);
+	ssam_nfblk_remove(n);
 	mutex_unlock(&nf->lock);
 	synchronize_srcu(&nf_head->srcu);
 
+	ssam_event_coalesce_free(n);
 	return status;
 }
 EXPORT_SYMBOL_GPL(__ssam_notifier_unregister);
@@ -2503,6 +4665,44 @@ int ssam_controller_event_disable(struct ssam_controller *ctrl,
 }
 EXPORT_SYMBOL_GPL(ssam_controller_event_disable);
 
+/**
+ * ssam_nf_batch_alloc() - Allocate batch entries for all enabled events.
+ * @nf:    The notifier system.
+ * @count: Output for the number of entries.
+ *
+ * Allocates one &struct ssam_ssh_event_batch_entry for each event reference
+ * count entry, in order of the reference count tree. Must be called with
+ * ``nf->lock`` held.
+ *
+ * Return: Returns the allocated entries, %NULL if there are no enabled
+ * events, or %ERR_PTR(-ENOMEM) if the allocation failed.
+ */
+static struct ssam_ssh_event_batch_entry *ssam_nf_batch_alloc(struct ssam_nf *nf,
+							       unsigned int *count)
+{
+	struct ssam_ssh_event_batch_entry *entries;
+	unsigned int n = 0, i = 0;
+	struct rb_node *node;
+
+	lockdep_assert_held(&nf->lock);
+
+	for (node = rb_first(&nf->refcount); node; node = rb_next(node))
+		n++;
+
+	*count = n;
+	if (!n)
+		return NULL;
+
+	entries = kcalloc(n, sizeof(*entries), GFP_KERNEL);
+	if (!entries)
+		return ERR_PTR(-ENOMEM);
+
+	for (node = rb_first(&nf->refcount); node; node = rb_next(node))
+		entries[i++].ref = rb_entry(node, struct ssam_nf_refcount_entry, node);
+
+	return entries;
+}
+
 /**
  * ssam_notifier_disable_registered() - Disable events for all registered
  * notifiers.
@@ -2512,6 +4712,9 @@ EXPORT_SYMBOL_GPL(ssam_controller_event_disable);
  * (EC command failing), all previously disabled events will be restored and
  * the error code returned.
  *
+ * All requests are submitted as one pipelined batch before waiting for any of
+ * them to complete.
+ *
  * This function is intended to disable all events prior to hibernation entry.
  * See ssam_notifier_restore_registered() to restore/re-enable all events
  * disabled with this function.
@@ -2522,36 +4725,43 @@ EXPORT_SYMBOL_GPL(ssam_controller_event_disable);
  * call to ssam_notifier_restore_registered().
  *
  * Return: Returns zero on success. In case of failure returns the error code
- * returned by the failed EC command to disable an event.
+ * returned by the first failed EC command to disable an event.
  */
 int ssam_notifier_disable_registered(struct ssam_controller *ctrl)
 {
 	struct ssam_nf *nf = &ctrl->cplt.event.notif;
-	struct rb_node *n;
-	int status;
+	struct ssam_ssh_event_batch_entry *entries;
+	unsigned int count, i, n = 0;
+	ktime_t start = ktime_get();
+	int status = 0;
 
 	mutex_lock(&nf->lock);
-	for (n = rb_first(&nf->refcount); n; n = rb_next(n)) {
-		struct ssam_nf_refcount_entry *e;
 
-		e = rb_entry(n, struct ssam_nf_refcount_entry, node);
-		status = ssam_ssh_event_disable(ctrl, e->key.reg,
-						e->key.id, e->flags);
-		if (status)
-			goto err;
+	entries = ssam_nf_batch_alloc(nf, &count);
+	if (IS_ERR_OR_NULL(entries)) {
+		mutex_unlock(&nf->lock);
+		return PTR_ERR_OR_ZERO(entries);
 	}
-	mutex_unlock(&nf->lock);
-
-	return 0;
 
-err:
-	for (n = rb_prev(n); n; n = rb_prev(n)) {
-		struct ssam_nf_refcount_entry *e;
+	ssam_ssh_event_batch_execute(ctrl, entries, count, false);
 
-		e = rb_entry(n, struct ssam_nf_refcount_entry, node);
-		ssam_ssh_event_enable(ctrl, e->key.reg, e->key.id, e->flags);
+	/* Compact successfully disabled entries for potential rollback. */
+	for (i = 0; i < count; i++) {
+		if (entries[i].status && !status)
+			status = entries[i].status;
+		else if (!entries[i].status)
+			entries[n++].ref = entries[i].ref;
 	}
+
+	/* Errors are logged per entry, nothing else we can do here. */
+	if (status && n)
+		ssam_ssh_event_batch_execute(ctrl, entries, n, true);
+
 	mutex_unlock(&nf->lock);
+	kfree(entries);
+
+	ssam_dbg(ctrl, "pm: disabled %u events in %lld us (status: %d)\n",
+		 count, ktime_us_delta(ktime_get(), start), status);
 
 	return status;
 }
@@ -2565,6 +4775,10 @@ err:
  * the given controller. In case of a failure, the error is logged and the
  * function continues to try and enable the remaining events.
  *
+ * All requests are submitted as one pipelined batch before waiting for any of
+ * them to complete. If the batch cannot be allocated, events are re-enabled
+ * one by one instead.
+ *
  * This function is intended to restore/re-enable all registered events after
  * hibernation. See ssam_notifier_disable_registered() for the counter part
  * disabling the events and more details.
@@ -2572,18 +4786,34 @@ err:
 void ssam_notifier_restore_registered(struct ssam_controller *ctrl)
 {
 	struct ssam_nf *nf = &ctrl->cplt.event.notif;
+	struct ssam_ssh_event_batch_entry *entries;
+	ktime_t start = ktime_get();
+	unsigned int count;
 	struct rb_node *n;
 
 	mutex_lock(&nf->lock);
-	for (n = rb_first(&nf->refcount); n; n = rb_next(n)) {
-		struct ssam_nf_refcount_entry *e;
 
-		e = rb_entry(n, struct ssam_nf_refcount_entry, node);
+	entries = ssam_nf_batch_alloc(nf, &count);
+	if (!IS_ERR_OR_NULL(entries)) {
+		/* Ignore errors, will get logged per entry. */
+		ssam_ssh_event_batch_execute(ctrl, entries, count, true);
+		kfree(entries);
 
-		/* Ignore errors, will get logged in call. */
-		ssam_ssh_event_enable(ctrl, e->key.reg, e->key.id, e->flags);
+	} else if (IS_ERR(entries)) {
+		for (n = rb_first(&nf->refcount); n; n = rb_next(n)) {
+			struct ssam_nf_refcount_entry *e;
+
+			e = rb_entry(n, struct ssam_nf_refcount_entry, node);
+
+			/* Ignore errors, will get logged in call. */
+			ssam_ssh_event_enable(ctrl, e->key.reg, e->key.id, e->flags);
+		}
 	}
+
 	mutex_unlock(&nf->lock);
+
+	ssam_dbg(ctrl, "pm: restored %u events in %lld us\n", count,
+		 ktime_us_delta(ktime_get(), start));
 }
 
 /**
@@ -2632,32 +4862,102 @@ static void ssam_notifier_unregister_all(struct ssam_controller *ctrl)
 
 /* -- Wakeup IRQ. ----------------------------------------------------------- */
 
+/*
+ * Events held back by the EC in display-off state are only released and
+ * filtered while the controller is running, i.e. from PM prepare until the
+ * controller is suspended, and from controller resume until PM complete. This
+ * does not cover the time the system actually spends in s2idle: The serial
+ * device is suspended at that point, and releasing events would require
+ * resuming it from the s2idle wake path without resuming the rest of the
+ * system, which is not supported. Thus, while suspended, any event held back
+ * by the EC, regardless of its type, causes a full system resume.
+ */
+
+/*
+ * SSAM_IRQ_RELEASE_MAX - Maximum number of events released per IRQ.
+ *
+ * Bounds the release loop in case the EC keeps reporting pending events.
+ * Events left over are released by the display-on notification.
+ */
+#define SSAM_IRQ_RELEASE_MAX		64
+
+/**
+ * ssam_irq_release() - Release events held back by the EC.
+ * @ctrl: The controller.
+ *
+ * Repeatedly sends the GPIO callback request to the EC. Each request releases
+ * a single held-back event, which is then received and dispatched via the
+ * completion system like any other event. The response of the request
+ * indicates whether there are more events pending. Once all events have been
+ * released, the EC resets the wakeup GPIO.
+ *
+ * Must be called with the controller state lock held.
+ *
+ * Return: Returns the number of released events.
+ */
+static unsigned int ssam_irq_release(struct ssam_controller *ctrl)
+{
+	unsigned int n = 0;
+	u8 more;
+	int status;
+
+	do {
+		status = ssam_retry(ssam_ssh_gpio_callback, ctrl, &more);
+		if (status) {
+			ssam_err(ctrl, "pm: failed to release event: %d\n", status);
+			break;
+		}
+
+		n++;
+	} while (more && n < SSAM_IRQ_RELEASE_MAX);
+
+	if (!status && more)
+		ssam_warn(ctrl, "pm: events left after releasing %u events\n", n);
+
+	return n;
+}
+
 static irqreturn_t ssam_irq_handle(int irq, void *dev_id)
 {
 	struct ssam_controller *ctrl = dev_id;
+	unsigned int n;
 
 	ssam_dbg(ctrl, "pm: wake irq triggered\n");
 
 	/*
-	 * Note: Proper wakeup detection is currently unimplemented.
-	 *       When the EC is in display-off or any other non-D0 state, it
-	 *       does not send events/notifications to the host. Instead it
-	 *       signals that there are events available via the wakeup IRQ.
-	 *       This driver is responsible for calling back to the EC to
-	 *       release these events one-by-one.
+	 * When the EC is in display-off or any other non-D0 state, it does
+	 * not send events/notifications to the host. Instead it signals that
+	 * there are events available via the wakeup IRQ and we are
+	 * responsible for releasing these events one-by-one.
 	 *
-	 *       This IRQ should not cause a full system resume by its own.
-	 *       Instead, events should be handled by their respective subsystem
-	 *       drivers, which in turn should signal whether a full system
-	 *       resume should be performed.
+	 * This IRQ does not cause a system wakeup by itself. The released
+	 * events are handled by their respective notifiers. Notifiers for
+	 * events that warrant a full system wakeup report so via
+	 * %SSAM_NOTIF_WAKEUP, which is then forwarded to the PM core by the
+	 * completion system (see ssam_event_queue_work_fn()).
 	 *
-	 * TODO: Send GPIO callback command repeatedly to EC until callback
-	 *       returns 0x00. Return flag of callback is "has more events".
-	 *       Each time the command is sent, one event is "released". Once
-	 *       all events have been released (return = 0x00), the GPIO is
-	 *       re-armed. Detect wakeup events during this process, go back to
-	 *       sleep if no wakeup event has been received.
+	 * Requests can only be sent while the controller is running. If the
+	 * controller has already been suspended, leave the events pending.
+	 * They will be released via the display-on notification on resume.
+	 * Note that this means that filtering of wakeup events only works
+	 * between PM prepare and suspend: Once suspended, the IRQ is armed
+	 * via enable_irq_wake() and any pending event, regardless of its
+	 * type, causes a full system resume. The serial device is suspended
+	 * at that point, so events cannot be released without resuming.
 	 */
+	ssam_controller_statelock(ctrl);
+
+	if (ctrl->state != SSAM_CONTROLLER_STARTED) {
+		ssam_controller_stateunlock(ctrl);
+		ssam_dbg(ctrl, "pm: controller suspended, deferring event release\n");
+		return IRQ_HANDLED;
+	}
+
+	n = ssam_irq_release(ctrl);
+	ssam_controller_stateunlock(ctrl);
+
+	atomic_long_add(n, &ctrl->irq.released);
+	ssam_dbg(ctrl, "pm: released %u events\n", n);
 
 	return IRQ_HANDLED;
 }
@@ -2677,14 +4977,14 @@ static irqreturn_t ssam_irq_handle(int irq, void *dev_id)
  * reset, or all at once by transitioning the EC out of the display-off state,
  * which will also clear the GPIO.
  *
- * Not all events, however, should trigger a full system wakeup. Instead the
- * driver should, if necessary, inspect and forward each event to the
- * corresponding subsystem, which in turn should decide if the system needs to
- * be woken up. This logic has not been implemented yet, thus wakeup by this
- * IRQ should be disabled by default to avoid spurious wake-ups, caused, for
- * example, by the remaining battery percentage changing. Refer to comments in
- * this function and comments in the corresponding IRQ handler for more
- * details on how this should be implemented.
+ * Not all events, however, should trigger a full system wakeup. Instead, the
+ * IRQ handler releases all pending events and forwards them to the
+ * corresponding notifiers, which in turn decide if the system needs to be
+ * woken up (see %SSAM_NOTIF_WAKEUP). To release events while the system is
+ * still running in display-off state, the IRQ can be enabled via
+ * ssam_irq_arm_for_release(). This is only possible while the controller is
+ * not suspended. Once the IRQ has been armed for wakeup and the controller
+ * has been suspended (e.g. in s2idle), any pending event wakes the system.
  *
  * See also ssam_ctrl_notif_display_off() and ssam_ctrl_notif_display_off()
  * for functions to transition the EC into and out of the display-off state as
@@ -2704,13 +5004,14 @@ int ssam_irq_setup(struct ssam_controller *ctrl)
 	/*
 	 * The actual GPIO interrupt is declared in ACPI as TRIGGER_HIGH.
 	 * However, the GPIO line only gets reset by sending the GPIO callback
-	 * command to SAM (or alternatively the display-on notification). As
-	 * proper handling for this interrupt is not implemented yet, leaving
-	 * the IRQ at TRIGGER_HIGH would cause an IRQ storm (as the callback
-	 * never gets sent and thus the line never gets reset). To avoid this,
-	 * mark the IRQ as TRIGGER_RISING for now, only creating a single
-	 * interrupt, and let the SAM resume callback during the controller
-	 * resume process clear it.
+	 * command to SAM (or alternatively the display-on notification). Event
+	 * release is deferred while the controller is suspended, so leaving
+	 * the IRQ at TRIGGER_HIGH would cause an IRQ storm during that time.
+	 * To avoid this, mark the IRQ as TRIGGER_RISING. The IRQ handler
+	 * releases events until the line is reset, so new events will cause a
+	 * new rising edge. Events left over when the controller is suspended
+	 * are released by the SAM resume callback during the controller
+	 * resume process.
 	 */
 	const int irqf = IRQF_ONESHOT | IRQF_TRIGGER_RISING | IRQF_NO_AUTOEN;
 
@@ -2724,6 +5025,9 @@ int ssam_irq_setup(struct ssam_controller *ctrl)
 	if (irq < 0)
 		return irq;
 
+	ctrl->irq.release_enabled = false;
+	atomic_long_set(&ctrl->irq.released, 0);
+
 	status = request_threaded_irq(irq, NULL, ssam_irq_handle, irqf,
 				      "ssam_wakeup", ctrl);
 	if (status)
@@ -2745,14 +5049,75 @@ void ssam_irq_free(struct ssam_controller *ctrl)
 	ctrl->irq.num = -1;
 }
 
+/**
+ * ssam_irq_arm_for_release() - Enable the EC IRQ for event release.
+ * @ctrl: The controller for which the IRQ should be enabled.
+ *
+ * Enables the IRQ so that events held back by the EC in display-off state
+ * are released and dispatched to their notifiers. See
+ * ssam_irq_disarm_release() for the corresponding function to disable the
+ * IRQ.
+ *
+ * This function is intended to be called after the display-off notification
+ * has been sent.
+ *
+ * Note: calls to ssam_irq_arm_for_release() and ssam_irq_disarm_release()
+ * must be balanced.
+ */
+void ssam_irq_arm_for_release(struct ssam_controller *ctrl)
+{
+	WRITE_ONCE(ctrl->irq.release_enabled, true);
+	enable_irq(ctrl->irq.num);
+}
+
+/**
+ * ssam_irq_disarm_release() - Disable the EC IRQ for event release.
+ * @ctrl: The controller for which the IRQ should be disabled.
+ *
+ * Disables the IRQ previously enabled via ssam_irq_arm_for_release() and
+ * waits for any running release process to finish.
+ *
+ * This function is intended to be called before the display-on notification
+ * is sent.
+ *
+ * Note: calls to ssam_irq_arm_for_release() and ssam_irq_disarm_release()
+ * must be balanced.
+ */
+void ssam_irq_disarm_release(struct ssam_controller *ctrl)
+{
+	disable_irq(ctrl->irq.num);
+	WRITE_ONCE(ctrl->irq.release_enabled, false);
+}
+
+/**
+ * ssam_controller_events_held() - Check whether the EC currently holds back
+ * events.
+ * @ctrl: The controller.
+ *
+ * Checks whether the EC is in display-off state, i.e. holds back events and
+ * the controller releases them one-by-one via the wakeup IRQ. Event
+ * notifiers can use this to decide whether to request a system wakeup via
+ * %SSAM_NOTIF_WAKEUP, as any event received outside of this state is not
+ * relevant for wakeup.
+ *
+ * Return: Returns %true if events are currently held back by the EC and
+ * released via the wakeup IRQ, %false otherwise.
+ */
+bool ssam_controller_events_held(struct ssam_controller *ctrl)
+{
+	return READ_ONCE(ctrl->irq.release_enabled);
+}
+EXPORT_SYMBOL_GPL(ssam_controller_events_held);
+
 /**
  * ssam_irq_arm_for_wakeup() - Arm the EC IRQ for wakeup, if enabled.
  * @ctrl: The controller for which the IRQ should be armed.
  *
  * Sets up the IRQ so that it can be used to wake the device. Specifically,
- * this function enables the irq and then, if the device is allowed to wake up
- * the system, calls enable_irq_wake(). See ssam_irq_disarm_wakeup() for the
- * corresponding function to disable the IRQ.
+ * if the device is allowed to wake up the system, this function calls
+ * enable_irq_wake(). The IRQ itself must have been enabled via
+ * ssam_irq_arm_for_release() before. See ssam_irq_disarm_wakeup() for the
+ * corresponding function to disable IRQ wakeup.
  *
  * This function is intended to arm the IRQ before entering S2idle suspend.
  *
@@ -2764,12 +5129,10 @@ int ssam_irq_arm_for_wakeup(struct ssam_controller *ctrl)
 	struct device *dev = ssam_controller_device(ctrl);
 	int status;
 
-	enable_irq(ctrl->irq.num);
 	if (device_may_wakeup(dev)) {
 		status = enable_irq_wake(ctrl->irq.num);
 		if (status) {
 			ssam_err(ctrl, "failed to enable wake IRQ: %d\n", status);
-			disable_irq(ctrl->irq.num);
 			return status;
 		}
 
@@ -2786,6 +5149,8 @@ int ssam_irq_arm_for_wakeup(struct ssam_controller *ctrl)
  * @ctrl: The controller for which the IRQ should be disarmed.
  *
  * Disarm the IRQ previously set up for wake via ssam_irq_arm_for_wakeup().
+ * The IRQ stays enabled for event release until ssam_irq_disarm_release()
+ * is called.
  *
  * This function is intended to disarm the IRQ after exiting S2idle suspend.
  *
@@ -2803,5 +5168,4 @@ void ssam_irq_disarm_wakeup(struct ssam_controller *ctrl)
 
 		ctrl->irq.wakeup_enabled = false;
 	}
-	disable_irq(ctrl->irq.num);
 }
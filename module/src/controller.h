@@ -8,8 +8,10 @@
 #ifndef _SURFACE_AGGREGATOR_CONTROLLER_H
 #define _SURFACE_AGGREGATOR_CONTROLLER_H
 
+#include <linux/atomic.h>
 #include <linux/kref.h>
 #include <linux/list.h>
+#include <linux/llist.h>
 #include <linux/mutex.h>
 #include <linux/rbtree.h>
 #include <linux/rwsem.h>
@@ -22,6 +24,7 @@
 #include "../include/linux/surface_aggregator/controller.h"
 #include "../include/linux/surface_aggregator/serial_hub.h"
 
+#include "pm_log.h"
 #include "ssh_request_layer.h"
 
 
@@ -46,14 +49,63 @@ struct ssh_rqid_counter {
 
 /* -- Event/notification system. -------------------------------------------- */
 
+/*
+ * SSAM_NF_HEAD_NUM_BUCKETS - Number of notifier buckets per notifier head.
+ * Must be a power of two.
+ */
+#define SSAM_NF_HEAD_NUM_BUCKETS	8
+
 /**
  * struct ssam_nf_head - Notifier head for SSAM events.
- * @srcu: The SRCU struct for synchronization.
- * @head: List-head for notifier blocks registered under this head.
+ * @srcu:   The SRCU struct for synchronization.
+ * @bucket: List-heads for notifier blocks registered under this head, hashed
+ *          by event mask, target ID, and instance ID of the notifier. Each
+ *          list is ordered by notifier priority.
+ * @seq:    Registration sequence counter, used to preserve registration
+ *          order of notifiers with equal priority across buckets.
  */
 struct ssam_nf_head {
 	struct srcu_struct srcu;
-	struct list_head head;
+	struct list_head bucket[SSAM_NF_HEAD_NUM_BUCKETS];
+	u32 seq;
+};
+
+struct ssam_cplt_wq;
+
+/**
+ * struct ssam_event_coalesce - Coalescing state of an event notifier.
+ * @notif:    The event notifier this state belongs to.
+ * @nh:       The notifier head the notifier is registered on.
+ * @dev:      The controller device, used for logging.
+ * @wq:       The completion workqueue on which deferred events are delivered.
+ * @lock:     Lock guarding all other members below. Held while calling the
+ *            notifier callback, serializing all deliveries to the notifier.
+ * @active:   Whether a coalescing window is currently open.
+ * @tc:       Target category of the last delivered event.
+ * @tid:      Target ID of the last delivered event.
+ * @cid:      Command ID of the last delivered event.
+ * @iid:      Instance ID of the last delivered event.
+ * @last_ret: Notifier status value of the last delivered event.
+ * @pending:  The latest collapsed event, to be delivered at the end of the
+ *            current window, or %NULL if there is none. Always matches the
+ *            last delivered event.
+ * @work:     Work item closing the coalescing window.
+ */
+struct ssam_event_coalesce {
+	struct ssam_event_notifier *notif;
+	struct ssam_nf_head *nh;
+	struct device *dev;
+	struct ssam_cplt_wq *wq;
+
+	struct mutex lock;
+	bool active;
+	u8 tc;
+	u8 tid;
+	u8 cid;
+	u8 iid;
+	u32 last_ret;
+	struct ssam_event *pending;
+	struct delayed_work work;
 };
 
 /**
@@ -76,16 +128,61 @@ struct ssam_nf {
 
 struct ssam_cplt;
 
+/*
+ * SSAM_EVENT_POOL_NUM_CLASSES - Number of size classes in the event item
+ * pool.
+ */
+#define SSAM_EVENT_POOL_NUM_CLASSES	4
+
+/**
+ * struct ssam_event_pool_class - Size class of the event item pool.
+ * @free:     Lock-less list of free event items in this class.
+ * @len:      Maximum payload length of event items in this class.
+ * @size:     Number of event items currently owned by this class, including
+ *            items that are in use.
+ * @capacity: Maximum number of event items owned by this class.
+ * @hits:     Number of allocations served from this class.
+ * @misses:   Number of allocations that had to fall back to the generic
+ *            allocator because this class has been exhausted.
+ */
+struct ssam_event_pool_class {
+	struct llist_head free;
+	size_t len;
+	atomic_t size;
+	unsigned int capacity;
+	atomic_long_t hits;
+	atomic_long_t misses;
+};
+
+/**
+ * struct ssam_event_pool - Pool of preallocated event items.
+ * @cls:    Size classes of the pool, ordered by increasing payload length.
+ * @refill: Work item for growing exhausted size classes.
+ *
+ * Event items are allocated only on the receiver thread, which thus is the
+ * only consumer of the free lists and allows lock-less operation. Items may
+ * be returned to the pool from any context.
+ */
+struct ssam_event_pool {
+	struct ssam_event_pool_class cls[SSAM_EVENT_POOL_NUM_CLASSES];
+	struct work_struct refill;
+};
+
 /**
  * struct ssam_event_item - Struct for event queuing and completion.
- * @node:     The node in the queue.
- * @rqid:     The request ID of the event.
- * @ops:      Instance specific functions.
- * @ops.free: Callback for freeing this event item.
- * @event:    Actual event data.
+ * @node:      The node in the queue.
+ * @pool_node: The node in the free list of the pool size class.
+ * @pool:      The pool size class this item belongs to, or %NULL if it has
+ *             not been allocated from the pool.
+ * @rqid:      The request ID of the event.
+ * @ops:       Instance specific functions.
+ * @ops.free:  Callback for freeing this event item.
+ * @event:     Actual event data.
  */
 struct ssam_event_item {
 	struct list_head node;
+	struct llist_node pool_node;
+	struct ssam_event_pool_class *pool;
 	u16 rqid;
 
 	struct {
@@ -95,15 +192,46 @@ struct ssam_event_item {
 	struct ssam_event event;	/* must be last */
 };
 
+/**
+ * enum ssam_cplt_wq_id - Completion workqueue classes.
+ * @SSAM_CPLT_WQ_DEFAULT: Default completion workqueue, used for asynchronous
+ *                        requests and all events not explicitly assigned to
+ *                        a different class.
+ * @SSAM_CPLT_WQ_HIPRI:   High-priority completion workqueue, intended for
+ *                        latency-sensitive events, such as HID input events.
+ * @SSAM_CPLT_NUM_WQ:     Number of completion workqueue classes.
+ */
+enum ssam_cplt_wq_id {
+	SSAM_CPLT_WQ_DEFAULT,
+	SSAM_CPLT_WQ_HIPRI,
+	SSAM_CPLT_NUM_WQ,
+};
+
+/**
+ * struct ssam_cplt_wq - Completion workqueue.
+ * @wq:  The &struct workqueue_struct on which completion work items of this
+ *       class are queued.
+ * @cpu: The CPU on which work items of this class are executed while it is
+ *       online, or %WORK_CPU_UNBOUND if they are not bound to any specific
+ *       CPU.
+ */
+struct ssam_cplt_wq {
+	struct workqueue_struct *wq;
+	int cpu;
+};
+
 /**
  * struct ssam_event_queue - Queue for completing received events.
  * @cplt: Reference to the completion system on which this queue is active.
+ * @wq:   The completion workqueue on which the work item of this queue is
+ *        executed.
  * @lock: The lock for any operation on the queue.
  * @head: The list-head of the queue.
  * @work: The &struct work_struct performing completion work for this queue.
  */
 struct ssam_event_queue {
 	struct ssam_cplt *cplt;
+	struct ssam_cplt_wq *wq;
 
 	spinlock_t lock;
 	struct list_head head;
@@ -120,25 +248,139 @@ struct ssam_event_target {
 
 /**
  * struct ssam_cplt - SSAM event/async request completion system.
- * @dev:          The device with which this system is associated. Only used
- *                for logging.
- * @wq:           The &struct workqueue_struct on which all completion work
- *                items are queued.
+ * @dev:          The device with which this system is associated. Used for
+ *                logging and for reporting wakeup events.
+ * @wq:           Array of completion workqueues, indexed by
+ *                &enum ssam_cplt_wq_id. Each event queue is statically
+ *                assigned to one of them, based on its target category.
  * @event:        Event completion management.
  * @event.target: Array of &struct ssam_event_target, one for each target.
  * @event.notif:  Notifier callbacks and event activation reference counting.
+ * @event.pool:   Pool of preallocated event items.
+ * @event.wakeups: Number of events reported as wakeup event by their
+ *                 notifiers, i.e. with %SSAM_NOTIF_WAKEUP set.
  */
 struct ssam_cplt {
 	struct device *dev;
-	struct workqueue_struct *wq;
+	struct ssam_cplt_wq wq[SSAM_CPLT_NUM_WQ];
 
 	struct {
 		struct ssam_event_target target[SSH_NUM_TARGETS];
 		struct ssam_nf notif;
+		struct ssam_event_pool pool;
+		atomic_long_t wakeups;
 	} event;
 };
 
 
+/* -- Response cache. ------------------------------------------------------- */
+
+/*
+ * SSAM_RSP_CACHE_NUM_GEN - Number of invalidation generation counters.
+ *
+ * Target categories are mapped onto these counters modulo this value.
+ */
+#define SSAM_RSP_CACHE_NUM_GEN		64
+
+/**
+ * struct ssam_rsp_cache - Read-through cache for responses of idempotent
+ * requests.
+ * @lock:    Lock guarding all cache members.
+ * @entries: List of cached responses, most recently used first.
+ * @count:   Number of entries currently in the cache.
+ * @gen:     Invalidation generation counters, indexed by target category.
+ * @hits:    Number of requests answered from the cache.
+ * @misses:  Number of cache lookups that had to be forwarded to the EC.
+ *
+ * Entries are invalidated on expiry of their time-to-live as well as on
+ * reception of any event with the same target category. The generation
+ * counters are incremented on each invalidation and prevent responses of
+ * requests that have been in flight during an invalidation from being stored.
+ */
+struct ssam_rsp_cache {
+	spinlock_t lock;
+	struct list_head entries;
+	unsigned int count;
+	u32 gen[SSAM_RSP_CACHE_NUM_GEN];
+
+	atomic_long_t hits;
+	atomic_long_t misses;
+};
+
+
+/* -- Request pool. --------------------------------------------------------- */
+
+/*
+ * SSAM_RQST_POOL_NUM_CLASSES - Number of size classes in the synchronous
+ * request pool.
+ */
+#define SSAM_RQST_POOL_NUM_CLASSES	2
+
+/**
+ * struct ssam_rqst_pool_class - Size class of the synchronous request pool.
+ * @base:     Backing storage of all request objects in this class.
+ * @stride:   Size of a single request object, including its message buffer.
+ * @len:      Maximum payload length of requests in this class.
+ * @count:    Number of request objects in this class.
+ * @used:     Bitmap of request objects currently in use.
+ * @hits:     Number of allocations served from this class.
+ * @misses:   Number of allocations that had to fall back to the generic
+ *            allocator because this class has been exhausted.
+ */
+struct ssam_rqst_pool_class {
+	void *base;
+	size_t stride;
+	size_t len;
+	unsigned int count;
+	unsigned long used;
+
+	atomic_long_t hits;
+	atomic_long_t misses;
+};
+
+/**
+ * struct ssam_rqst_pool - Pool of preallocated synchronous request objects.
+ * @cls:      Size classes of the pool, ordered by increasing payload length.
+ * @oversize: Number of allocations exceeding the largest size class.
+ *
+ * Request objects are claimed and released by atomically setting and
+ * clearing their bit in the usage bitmap of their size class, which allows
+ * any number of concurrent users without taking a lock.
+ */
+struct ssam_rqst_pool {
+	struct ssam_rqst_pool_class cls[SSAM_RQST_POOL_NUM_CLASSES];
+	atomic_long_t oversize;
+};
+
+
+/* -- Client data cache. ---------------------------------------------------- */
+
+/**
+ * struct ssam_client_cache - Cache for static data of client devices.
+ * @lock:    Lock guarding @entries, @count, and @size.
+ * @entries: List of cached data blobs, most recently used first.
+ * @count:   Number of entries currently in the cache.
+ * @size:    Total size of all cached data blobs, in bytes.
+ * @hits:    Number of successful lookups.
+ * @misses:  Number of lookups without matching entry.
+ *
+ * Stores data that client drivers would otherwise have to re-fetch from the
+ * EC each time the device is (re-)attached, e.g. HID descriptors. Entries are
+ * identified by a driver-defined key and persist for the lifetime of the
+ * controller, i.e. across client device removal, re-binding, and
+ * suspend/resume cycles.
+ */
+struct ssam_client_cache {
+	struct mutex lock;
+	struct list_head entries;
+	unsigned int count;
+	size_t size;
+
+	atomic_long_t hits;
+	atomic_long_t misses;
+};
+
+
 /* -- Main SSAM device structures. ------------------------------------------ */
 
 /**
@@ -187,13 +429,26 @@ struct ssam_controller_caps {
  * @state: Controller state.
  * @rtl:   Request transport layer for SSH I/O.
  * @cplt:  Completion system for SSH/SSAM events and asynchronous requests.
+ * @rsp_cache:    Response cache for idempotent requests.
+ * @rqst_pool:    Pool of preallocated synchronous request objects.
+ * @client_cache: Cache for static data of client devices.
+ * @dedup:         De-duplication of concurrent identical synchronous requests.
+ * @dedup.lock:    Lock guarding @dedup.pending.
+ * @dedup.pending: List of in-flight synchronous requests other requests may
+ *                 attach to.
  * @counter:      Safe SSH message ID counters.
  * @counter.seq:  Sequence ID counter.
  * @counter.rqid: Request ID counter.
  * @irq:          Wakeup IRQ resources.
  * @irq.num:      The wakeup IRQ number.
  * @irq.wakeup_enabled: Whether wakeup by IRQ is enabled during suspend.
+ * @irq.release_enabled: Whether the IRQ is enabled for event release, i.e.
+ *                whether the EC is in display-off state.
+ * @irq.released: Number of events released from the EC via the GPIO callback
+ *                request.
  * @caps: The controller device capabilities.
+ * @pm_log:  Log of the most recent PM transitions and their timing.
+ * @debugfs: The debugfs directory of the controller.
  */
 struct ssam_controller {
 	struct kref kref;
@@ -203,6 +458,14 @@ struct ssam_controller {
 
 	struct ssh_rtl rtl;
 	struct ssam_cplt cplt;
+	struct ssam_rsp_cache rsp_cache;
+	struct ssam_rqst_pool rqst_pool;
+	struct ssam_client_cache client_cache;
+
+	struct {
+		spinlock_t lock;
+		struct list_head pending;
+	} dedup;
 
 	struct {
 		struct ssh_seq_counter seq;
@@ -212,9 +475,13 @@ struct ssam_controller {
 	struct {
 		int num;
 		bool wakeup_enabled;
+		bool release_enabled;
+		atomic_long_t released;
 	} irq;
 
 	struct ssam_controller_caps caps;
+	struct ssam_pm_log pm_log;
+	struct dentry *debugfs;
 };
 
 #define to_ssam_controller(ptr, member) \
@@ -262,8 +529,15 @@ void ssam_controller_destroy(struct ssam_controller *ctrl);
 int ssam_notifier_disable_registered(struct ssam_controller *ctrl);
 void ssam_notifier_restore_registered(struct ssam_controller *ctrl);
 
+ktime_t ssam_pm_phase_end(struct ssam_pm_record *r, enum ssam_pm_phase phase,
+			  ktime_t start);
+void ssam_pm_record_end(struct ssam_controller *ctrl, struct ssam_pm_record *r,
+			int status);
+
 int ssam_irq_setup(struct ssam_controller *ctrl);
 void ssam_irq_free(struct ssam_controller *ctrl);
+void ssam_irq_arm_for_release(struct ssam_controller *ctrl);
+void ssam_irq_disarm_release(struct ssam_controller *ctrl);
 int ssam_irq_arm_for_wakeup(struct ssam_controller *ctrl);
 void ssam_irq_disarm_wakeup(struct ssam_controller *ctrl);
 
@@ -26,6 +26,7 @@
 
 #include "bus.h"
 #include "controller.h"
+#include "debugfs.h"
 
 #define CREATE_TRACE_POINTS
 #include "trace.h"
@@ -392,10 +393,16 @@ static void ssam_serial_hub_shutdown(struct device *dev)
 static int ssam_serial_hub_pm_prepare(struct device *dev)
 {
 	struct ssam_controller *c = dev_get_drvdata(dev);
+	struct ssam_pm_record r;
+	ktime_t t;
 	int status;
 
+	t = ssam_pm_record_begin(&r, SSAM_PM_PREPARE);
+
 	/*
-	 * Try to signal display-off, This will quiesce events.
+	 * Try to signal display-off, This will quiesce events. Events are
+	 * held back by the EC from here on and released via the wakeup IRQ,
+	 * so enable it.
 	 *
 	 * Note: Signaling display-off/display-on should normally be done from
 	 * some sort of display state notifier. As that is not available,
@@ -403,66 +410,104 @@ static int ssam_serial_hub_pm_prepare(struct device *dev)
 	 */
 
 	status = ssam_ctrl_notif_display_off(c);
-	if (status)
+	t = ssam_pm_phase_end(&r, SSAM_PM_PHASE_DISPLAY_OFF, t);
+	if (status) {
 		ssam_err(c, "pm: display-off notification failed: %d\n", status);
+		goto out;
+	}
 
+	ssam_irq_arm_for_release(c);
+	ssam_pm_phase_end(&r, SSAM_PM_PHASE_IRQ, t);
+
+out:
+	ssam_pm_record_end(c, &r, status);
 	return status;
 }
 
 static void ssam_serial_hub_pm_complete(struct device *dev)
 {
 	struct ssam_controller *c = dev_get_drvdata(dev);
+	struct ssam_pm_record r;
+	ktime_t t;
 	int status;
 
+	t = ssam_pm_record_begin(&r, SSAM_PM_COMPLETE);
+
 	/*
-	 * Try to signal display-on. This will restore events.
+	 * Try to signal display-on. This will restore events and release any
+	 * events still held back by the EC, so the wakeup IRQ is no longer
+	 * needed.
 	 *
 	 * Note: Signaling display-off/display-on should normally be done from
 	 * some sort of display state notifier. As that is not available,
 	 * signal it here.
 	 */
 
+	ssam_irq_disarm_release(c);
+	t = ssam_pm_phase_end(&r, SSAM_PM_PHASE_IRQ, t);
+
 	status = ssam_ctrl_notif_display_on(c);
+	ssam_pm_phase_end(&r, SSAM_PM_PHASE_DISPLAY_ON, t);
 	if (status)
 		ssam_err(c, "pm: display-on notification failed: %d\n", status);
+
+	ssam_pm_record_end(c, &r, status);
 }
 
 static int ssam_serial_hub_pm_suspend(struct device *dev)
 {
 	struct ssam_controller *c = dev_get_drvdata(dev);
+	struct ssam_pm_record r;
+	ktime_t t;
 	int status;
 
+	t = ssam_pm_record_begin(&r, SSAM_PM_SUSPEND);
+
 	/*
 	 * Try to signal D0-exit, enable IRQ wakeup if specified. Abort on
 	 * error.
 	 */
 
 	status = ssam_ctrl_notif_d0_exit(c);
+	t = ssam_pm_phase_end(&r, SSAM_PM_PHASE_D0_EXIT, t);
 	if (status) {
 		ssam_err(c, "pm: D0-exit notification failed: %d\n", status);
 		goto err_notif;
 	}
 
 	status = ssam_irq_arm_for_wakeup(c);
+	t = ssam_pm_phase_end(&r, SSAM_PM_PHASE_IRQ, t);
 	if (status)
 		goto err_irq;
 
 	WARN_ON(ssam_controller_suspend(c));
+	ssam_pm_phase_end(&r, SSAM_PM_PHASE_CONTROLLER, t);
+
+	ssam_pm_record_end(c, &r, 0);
 	return 0;
 
 err_irq:
 	ssam_ctrl_notif_d0_entry(c);
+	t = ssam_pm_phase_end(&r, SSAM_PM_PHASE_D0_ENTRY, t);
 err_notif:
 	ssam_ctrl_notif_display_on(c);
+	ssam_pm_phase_end(&r, SSAM_PM_PHASE_DISPLAY_ON, t);
+
+	ssam_pm_record_end(c, &r, status);
 	return status;
 }
 
 static int ssam_serial_hub_pm_resume(struct device *dev)
 {
 	struct ssam_controller *c = dev_get_drvdata(dev);
+	struct ssam_pm_record r;
+	ktime_t t;
 	int status;
 
+	t = ssam_pm_record_begin(&r, SSAM_PM_RESUME);
+
 	WARN_ON(ssam_controller_resume(c));
+	t = ssam_pm_phase_end(&r, SSAM_PM_PHASE_CONTROLLER, t);
 
 	/*
 	 * Try to disable IRQ wakeup (if specified) and signal D0-entry. In
@@ -475,60 +520,85 @@ static int ssam_serial_hub_pm_resume(struct device *dev)
 	 */
 
 	ssam_irq_disarm_wakeup(c);
+	t = ssam_pm_phase_end(&r, SSAM_PM_PHASE_IRQ, t);
 
 	status = ssam_ctrl_notif_d0_entry(c);
+	ssam_pm_phase_end(&r, SSAM_PM_PHASE_D0_ENTRY, t);
 	if (status)
 		ssam_err(c, "pm: D0-entry notification failed: %d\n", status);
 
+	ssam_pm_record_end(c, &r, status);
 	return 0;
 }
 
 static int ssam_serial_hub_pm_freeze(struct device *dev)
 {
 	struct ssam_controller *c = dev_get_drvdata(dev);
+	struct ssam_pm_record r;
+	ktime_t t;
 	int status;
 
+	t = ssam_pm_record_begin(&r, SSAM_PM_FREEZE);
+
 	/*
 	 * During hibernation image creation, we only have to ensure that the
 	 * EC doesn't send us any events. This is done via the display-off
 	 * and D0-exit notifications. Note that this sets up the wakeup IRQ
-	 * on the EC side, however, we have disabled it by default on our side
-	 * and won't enable it here.
+	 * on the EC side. On our side, it is only used for releasing events
+	 * until the controller is suspended and won't be armed for wakeup
+	 * here.
 	 *
 	 * See ssam_serial_hub_poweroff() for more details on the hibernation
 	 * process.
 	 */
 
 	status = ssam_ctrl_notif_d0_exit(c);
+	t = ssam_pm_phase_end(&r, SSAM_PM_PHASE_D0_EXIT, t);
 	if (status) {
 		ssam_err(c, "pm: D0-exit notification failed: %d\n", status);
 		ssam_ctrl_notif_display_on(c);
-		return status;
+		ssam_pm_phase_end(&r, SSAM_PM_PHASE_DISPLAY_ON, t);
+		goto out;
 	}
 
 	WARN_ON(ssam_controller_suspend(c));
-	return 0;
+	ssam_pm_phase_end(&r, SSAM_PM_PHASE_CONTROLLER, t);
+
+out:
+	ssam_pm_record_end(c, &r, status);
+	return status;
 }
 
 static int ssam_serial_hub_pm_thaw(struct device *dev)
 {
 	struct ssam_controller *c = dev_get_drvdata(dev);
+	struct ssam_pm_record r;
+	ktime_t t;
 	int status;
 
+	t = ssam_pm_record_begin(&r, SSAM_PM_THAW);
+
 	WARN_ON(ssam_controller_resume(c));
+	t = ssam_pm_phase_end(&r, SSAM_PM_PHASE_CONTROLLER, t);
 
 	status = ssam_ctrl_notif_d0_entry(c);
+	ssam_pm_phase_end(&r, SSAM_PM_PHASE_D0_ENTRY, t);
 	if (status)
 		ssam_err(c, "pm: D0-exit notification failed: %d\n", status);
 
+	ssam_pm_record_end(c, &r, status);
 	return status;
 }
 
 static int ssam_serial_hub_pm_poweroff(struct device *dev)
 {
 	struct ssam_controller *c = dev_get_drvdata(dev);
+	struct ssam_pm_record r;
+	ktime_t t;
 	int status;
 
+	t = ssam_pm_record_begin(&r, SSAM_PM_POWEROFF);
+
 	/*
 	 * When entering hibernation and powering off the system, the EC, at
 	 * least on some models, may disable events. Without us taking care of
@@ -546,28 +616,39 @@ static int ssam_serial_hub_pm_poweroff(struct device *dev)
 	 */
 
 	status = ssam_notifier_disable_registered(c);
+	t = ssam_pm_phase_end(&r, SSAM_PM_PHASE_EVENTS_DISABLE, t);
 	if (status) {
 		ssam_err(c, "pm: failed to disable notifiers for hibernation: %d\n",
 			 status);
-		return status;
+		goto out;
 	}
 
 	status = ssam_ctrl_notif_d0_exit(c);
+	t = ssam_pm_phase_end(&r, SSAM_PM_PHASE_D0_EXIT, t);
 	if (status) {
 		ssam_err(c, "pm: D0-exit notification failed: %d\n", status);
 		ssam_notifier_restore_registered(c);
-		return status;
+		ssam_pm_phase_end(&r, SSAM_PM_PHASE_EVENTS_RESTORE, t);
+		goto out;
 	}
 
 	WARN_ON(ssam_controller_suspend(c));
-	return 0;
+	ssam_pm_phase_end(&r, SSAM_PM_PHASE_CONTROLLER, t);
+
+out:
+	ssam_pm_record_end(c, &r, status);
+	return status;
 }
 
 static int ssam_serial_hub_pm_restore(struct device *dev)
 {
 	struct ssam_controller *c = dev_get_drvdata(dev);
+	struct ssam_pm_record r;
+	ktime_t t;
 	int status;
 
+	t = ssam_pm_record_begin(&r, SSAM_PM_RESTORE);
+
 	/*
 	 * Ignore but log errors, try to restore state as much as possible in
 	 * case of failures. See ssam_serial_hub_poweroff() for more details on
@@ -575,12 +656,17 @@ static int ssam_serial_hub_pm_restore(struct device *dev)
 	 */
 
 	WARN_ON(ssam_controller_resume(c));
+	t = ssam_pm_phase_end(&r, SSAM_PM_PHASE_CONTROLLER, t);
 
 	status = ssam_ctrl_notif_d0_entry(c);
+	t = ssam_pm_phase_end(&r, SSAM_PM_PHASE_D0_ENTRY, t);
 	if (status)
 		ssam_err(c, "pm: D0-entry notification failed: %d\n", status);
 
 	ssam_notifier_restore_registered(c);
+	ssam_pm_phase_end(&r, SSAM_PM_PHASE_EVENTS_RESTORE, t);
+
+	ssam_pm_record_end(c, &r, status);
 	return 0;
 }
 
@@ -659,6 +745,8 @@ static int ssam_serial_hub_probe(struct serdev_device *serdev)
 
 	ssam_controller_unlock(ctrl);
 
+	ssam_controller_debugfs_init(ctrl);
+
 	/*
 	 * Initial SAM requests: Log version and notify default/init power
 	 * states.
@@ -709,6 +797,7 @@ err_mainref:
 err_irq:
 	sysfs_remove_group(&serdev->dev.kobj, &ssam_sam_group);
 err_initrq:
+	ssam_controller_debugfs_remove(ctrl);
 	ssam_controller_lock(ctrl);
 	ssam_controller_shutdown(ctrl);
 err_devinit:
@@ -733,6 +822,7 @@ static void ssam_serial_hub_remove(struct serdev_device *serdev)
 	ssam_irq_free(ctrl);
 
 	sysfs_remove_group(&serdev->dev.kobj, &ssam_sam_group);
+	ssam_controller_debugfs_remove(ctrl);
 	ssam_controller_lock(ctrl);
 
 	/* Remove all client devices. */
@@ -802,6 +892,8 @@ static int __init ssam_core_init(void)
 	if (status)
 		goto err_evitem;
 
+	ssam_debugfs_init();
+
 	status = serdev_device_driver_register(&ssam_serial_hub);
 	if (status)
 		goto err_register;
@@ -809,6 +901,7 @@ static int __init ssam_core_init(void)
 	return 0;
 
 err_register:
+	ssam_debugfs_exit();
 	ssam_event_item_cache_destroy();
 err_evitem:
 	ssh_ctrl_packet_cache_destroy();
@@ -822,6 +915,7 @@ subsys_initcall(ssam_core_init);
 static void __exit ssam_core_exit(void)
 {
 	serdev_device_driver_unregister(&ssam_serial_hub);
+	ssam_debugfs_exit();
 	ssam_event_item_cache_destroy();
 	ssh_ctrl_packet_cache_destroy();
 	ssam_bus_unregister();
@@ -0,0 +1,567 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Surface System Aggregator Module debugfs interface.
+ *
+ * Provides transport statistics and other diagnostic information of the
+ * SSAM controller via debugfs, in a directory named after the controller
+ * device under the ``surface_aggregator`` root directory.
+ *
+ * Copyright (C) 2019-2022 Maximilian Luz <luzmaximilian@gmail.com>
+ */
+
+#include <linux/atomic.h>
+#include <linux/bitops.h>
+#include <linux/debugfs.h>
+#include <linux/device.h>
+#include <linux/fs.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/types.h>
+
+#include "../include/linux/surface_aggregator/device.h"
+
+#include "controller.h"
+#include "debugfs.h"
+#include "pm_log.h"
+#include "ssh_fault.h"
+#include "ssh_rtt.h"
+#include "ssh_stats.h"
+
+static struct dentry *ssam_debugfs_root;
+
+
+/* -- Transport statistics. ------------------------------------------------- */
+
+static const char * const ssam_debugfs_counter_names[] = {
+	[SSH_STATS_RETRANSMIT]      = "retransmits",
+	[SSH_STATS_NAK_RX]          = "naks_received",
+	[SSH_STATS_NAK_TX]          = "naks_sent",
+	[SSH_STATS_PACKET_TIMEOUT]  = "packet_timeouts",
+	[SSH_STATS_REQUEST_TIMEOUT] = "request_timeouts",
+	[SSH_STATS_CRC_ERROR]       = "crc_errors",
+};
+
+static const char * const ssam_debugfs_hist_names[] = {
+	[SSH_STATS_HIST_ACK]   = "ack",
+	[SSH_STATS_HIST_RSP]   = "rsp",
+	[SSH_STATS_HIST_TOTAL] = "total",
+};
+
+static_assert(ARRAY_SIZE(ssam_debugfs_counter_names) == SSH_STATS_NUM_COUNTERS);
+static_assert(ARRAY_SIZE(ssam_debugfs_hist_names) == SSH_STATS_NUM_HIST);
+
+static void ssam_debugfs_stats_show_hist(struct seq_file *s,
+					 struct ssh_stats *stats,
+					 enum ssh_stats_hist h)
+{
+	unsigned int counts[SSH_STATS_HIST_BUCKETS];
+	unsigned int tc, b;
+	bool empty;
+
+	for (tc = 0; tc < SSH_STATS_NUM_TC; tc++) {
+		empty = true;
+
+		for (b = 0; b < SSH_STATS_HIST_BUCKETS; b++) {
+			counts[b] = atomic_read(&stats->hist[h][tc][b]);
+			empty &= !counts[b];
+		}
+
+		if (empty)
+			continue;
+
+		seq_printf(s, "%-6s %#04x", ssam_debugfs_hist_names[h], tc);
+		for (b = 0; b < SSH_STATS_HIST_BUCKETS; b++)
+			seq_printf(s, " %u", counts[b]);
+		seq_putc(s, '\n');
+	}
+}
+
+static void ssam_debugfs_stats_show_rtt(struct seq_file *s, const char *name,
+					struct ssh_rtt *rtt)
+{
+	unsigned long samples;
+	ktime_t srtt, rttvar;
+
+	ssh_rtt_get(rtt, &srtt, &rttvar, &samples);
+
+	seq_printf(s, "%-6s %12lu %12lld %12lld %12lld\n", name, samples,
+		   ktime_to_us(srtt), ktime_to_us(rttvar),
+		   ktime_to_us(ssh_rtt_timeout(rtt)));
+}
+
+static int ssam_debugfs_stats_show(struct seq_file *s, void *data)
+{
+	struct ssam_controller *ctrl = s->private;
+	struct ssh_stats *stats = &ctrl->rtl.ptl.stats;
+	unsigned int i;
+
+	for (i = 0; i < SSH_STATS_NUM_COUNTERS; i++) {
+		seq_printf(s, "%-18s %lu\n", ssam_debugfs_counter_names[i],
+			   (unsigned long)atomic_long_read(&stats->counter[i]));
+	}
+
+	/*
+	 * Histogram rows: name, target category, and the sample count per
+	 * bucket. The header lists the (exclusive) upper bound of each bucket
+	 * in microseconds.
+	 */
+	seq_puts(s, "\nhist   tc  ");
+	for (i = 0; i < SSH_STATS_HIST_BUCKETS - 1; i++)
+		seq_printf(s, " <%u", 1u << i);
+	seq_puts(s, " inf\n");
+
+	for (i = 0; i < SSH_STATS_NUM_HIST; i++)
+		ssam_debugfs_stats_show_hist(s, stats, i);
+
+	/*
+	 * Round-trip time estimates of the packet (ACK) and request (response)
+	 * layer and the timeouts derived from them, in microseconds.
+	 */
+	seq_printf(s, "\n%-6s %12s %12s %12s %12s\n", "rtt", "samples",
+		   "srtt", "rttvar", "timeout");
+	ssam_debugfs_stats_show_rtt(s, "ack", &ctrl->rtl.ptl.rtx_timeout.rtt);
+	ssam_debugfs_stats_show_rtt(s, "rsp", &ctrl->rtl.rtx_timeout.rtt);
+
+	return 0;
+}
+
+static int ssam_debugfs_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ssam_debugfs_stats_show, inode->i_private);
+}
+
+static ssize_t ssam_debugfs_stats_write(struct file *file,
+					const char __user *buf, size_t count,
+					loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct ssam_controller *ctrl = s->private;
+
+	/* Any write resets all statistics. */
+	ssh_stats_reset(&ctrl->rtl.ptl.stats);
+	return count;
+}
+
+static const struct file_operations ssam_debugfs_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = ssam_debugfs_stats_open,
+	.read = seq_read,
+	.write = ssam_debugfs_stats_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+
+/* -- Event item pool. ----------------------------------------------------- */
+
+static int ssam_debugfs_event_pool_show(struct seq_file *s, void *data)
+{
+	struct ssam_controller *ctrl = s->private;
+	struct ssam_event_pool *pool = &ctrl->cplt.event.pool;
+	struct ssam_event_pool_class *cls;
+	unsigned int i;
+
+	seq_printf(s, "%8s %8s %8s %12s %12s\n", "len", "items", "capacity",
+		   "hits", "misses");
+
+	for (i = 0; i < ARRAY_SIZE(pool->cls); i++) {
+		cls = &pool->cls[i];
+
+		seq_printf(s, "%8zu %8d %8u %12ld %12ld\n", cls->len,
+			   atomic_read(&cls->size), cls->capacity,
+			   atomic_long_read(&cls->hits),
+			   atomic_long_read(&cls->misses));
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ssam_debugfs_event_pool);
+
+
+/* -- Response cache. ------------------------------------------------------- */
+
+static int ssam_debugfs_rsp_cache_show(struct seq_file *s, void *data)
+{
+	struct ssam_controller *ctrl = s->private;
+	struct ssam_rsp_cache *cache = &ctrl->rsp_cache;
+
+	seq_printf(s, "entries: %u\n", READ_ONCE(cache->count));
+	seq_printf(s, "hits:    %ld\n", atomic_long_read(&cache->hits));
+	seq_printf(s, "misses:  %ld\n", atomic_long_read(&cache->misses));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ssam_debugfs_rsp_cache);
+
+
+/* -- Request pool. --------------------------------------------------------- */
+
+static int ssam_debugfs_rqst_pool_show(struct seq_file *s, void *data)
+{
+	struct ssam_controller *ctrl = s->private;
+	struct ssam_rqst_pool *pool = &ctrl->rqst_pool;
+	struct ssam_rqst_pool_class *cls;
+	unsigned int i;
+
+	seq_printf(s, "%8s %8s %8s %12s %12s\n", "len", "used", "count",
+		   "hits", "misses");
+
+	for (i = 0; i < ARRAY_SIZE(pool->cls); i++) {
+		cls = &pool->cls[i];
+
+		seq_printf(s, "%8zu %8lu %8u %12ld %12ld\n", cls->len,
+			   hweight_long(READ_ONCE(cls->used)), cls->count,
+			   atomic_long_read(&cls->hits),
+			   atomic_long_read(&cls->misses));
+	}
+
+	seq_printf(s, "oversize: %ld\n", atomic_long_read(&pool->oversize));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ssam_debugfs_rqst_pool);
+
+
+/* -- Client data cache. ---------------------------------------------------- */
+
+static int ssam_debugfs_client_cache_show(struct seq_file *s, void *data)
+{
+	struct ssam_controller *ctrl = s->private;
+	struct ssam_client_cache *cache = &ctrl->client_cache;
+
+	seq_printf(s, "entries: %u\n", READ_ONCE(cache->count));
+	seq_printf(s, "size:    %zu\n", READ_ONCE(cache->size));
+	seq_printf(s, "hits:    %ld\n", atomic_long_read(&cache->hits));
+	seq_printf(s, "misses:  %ld\n", atomic_long_read(&cache->misses));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ssam_debugfs_client_cache);
+
+
+/* -- Wakeup IRQ. ----------------------------------------------------------- */
+
+static int ssam_debugfs_wakeup_show(struct seq_file *s, void *data)
+{
+	struct ssam_controller *ctrl = s->private;
+
+	seq_printf(s, "released: %ld\n", atomic_long_read(&ctrl->irq.released));
+	seq_printf(s, "wakeups:  %ld\n",
+		   atomic_long_read(&ctrl->cplt.event.wakeups));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ssam_debugfs_wakeup);
+
+
+/* -- Client device probing. ------------------------------------------------ */
+
+static int ssam_debugfs_probe_show_dev(struct device *dev, void *data)
+{
+	struct seq_file *s = data;
+	struct ssam_controller *ctrl = s->private;
+	struct ssam_device *sdev;
+
+	if (!is_ssam_device(dev))
+		return 0;
+
+	sdev = to_ssam_device(dev);
+	if (sdev->ctrl != ctrl)
+		return 0;
+
+	if (!READ_ONCE(dev->driver)) {
+		seq_printf(s, "%-24s %12s %8s\n", dev_name(dev), "-", "-");
+		return 0;
+	}
+
+	seq_printf(s, "%-24s %12lld %8d\n", dev_name(dev),
+		   ktime_to_us(READ_ONCE(sdev->probe.duration)),
+		   READ_ONCE(sdev->probe.status));
+
+	return 0;
+}
+
+static int ssam_debugfs_probe_show(struct seq_file *s, void *data)
+{
+	seq_printf(s, "%-24s %12s %8s\n", "device", "duration_us", "status");
+	return bus_for_each_dev(&ssam_bus_type, NULL, s, ssam_debugfs_probe_show_dev);
+}
+DEFINE_SHOW_ATTRIBUTE(ssam_debugfs_probe);
+
+
+/* -- PM transitions. ------------------------------------------------------- */
+
+static const char * const ssam_debugfs_pm_transition_names[] = {
+	[SSAM_PM_PREPARE]  = "prepare",
+	[SSAM_PM_COMPLETE] = "complete",
+	[SSAM_PM_SUSPEND]  = "suspend",
+	[SSAM_PM_RESUME]   = "resume",
+	[SSAM_PM_FREEZE]   = "freeze",
+	[SSAM_PM_THAW]     = "thaw",
+	[SSAM_PM_POWEROFF] = "poweroff",
+	[SSAM_PM_RESTORE]  = "restore",
+};
+
+static const char * const ssam_debugfs_pm_phase_names[] = {
+	[SSAM_PM_PHASE_DISPLAY_OFF]    = "display_off",
+	[SSAM_PM_PHASE_DISPLAY_ON]     = "display_on",
+	[SSAM_PM_PHASE_D0_EXIT]        = "d0_exit",
+	[SSAM_PM_PHASE_D0_ENTRY]       = "d0_entry",
+	[SSAM_PM_PHASE_IRQ]            = "irq",
+	[SSAM_PM_PHASE_CONTROLLER]     = "controller",
+	[SSAM_PM_PHASE_EVENTS_DISABLE] = "events_disable",
+	[SSAM_PM_PHASE_EVENTS_RESTORE] = "events_restore",
+};
+
+static_assert(ARRAY_SIZE(ssam_debugfs_pm_transition_names) == SSAM_PM_NUM_TRANSITIONS);
+static_assert(ARRAY_SIZE(ssam_debugfs_pm_phase_names) == SSAM_PM_NUM_PHASES);
+
+static void ssam_debugfs_pm_show_entry(struct seq_file *s,
+				       const struct ssam_pm_log_entry *e)
+{
+	const struct ssam_pm_record *r = &e->rec;
+	unsigned int i;
+	s64 start_s;
+	s32 start_us;
+
+	start_s = div_s64_rem(ktime_to_us(r->start), USEC_PER_SEC, &start_us);
+
+	seq_printf(s, "%-10s %6lld.%06d %6d %10lld",
+		   ssam_debugfs_pm_transition_names[r->transition],
+		   start_s, start_us, r->status,
+		   div_s64(r->duration, NSEC_PER_USEC));
+
+	for (i = 0; i < SSAM_PM_NUM_PHASES; i++)
+		seq_printf(s, " %*lld", (int)strlen(ssam_debugfs_pm_phase_names[i]),
+			   div_s64(r->phase[i], NSEC_PER_USEC));
+
+	seq_puts(s, "\n");
+
+	for (i = 0; i < e->num_clients; i++) {
+		seq_printf(s, "  client %-24s %10lld %6d\n", e->clients[i].name,
+			   div_s64(e->clients[i].duration, NSEC_PER_USEC),
+			   e->clients[i].status);
+	}
+}
+
+/*
+ * Show the most recent PM transitions, oldest first, with the time spent in
+ * each phase and the resume time of client devices in microseconds.
+ */
+static int ssam_debugfs_pm_show(struct seq_file *s, void *data)
+{
+	struct ssam_controller *ctrl = s->private;
+	struct ssam_pm_log *log = &ctrl->pm_log;
+	unsigned long n;
+	unsigned int i;
+
+	seq_printf(s, "%-10s %13s %6s %10s", "transition", "start_s", "status",
+		   "total_us");
+
+	for (i = 0; i < SSAM_PM_NUM_PHASES; i++)
+		seq_printf(s, " %s", ssam_debugfs_pm_phase_names[i]);
+
+	seq_puts(s, "\n");
+
+	mutex_lock(&log->lock);
+
+	n = log->count > SSAM_PM_LOG_SIZE ? log->count - SSAM_PM_LOG_SIZE : 0;
+	for (; n < log->count; n++)
+		ssam_debugfs_pm_show_entry(s, &log->entries[n % SSAM_PM_LOG_SIZE]);
+
+	mutex_unlock(&log->lock);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ssam_debugfs_pm);
+
+
+/* -- Fault injection. ------------------------------------------------------ */
+
+#ifdef CONFIG_SURFACE_AGGREGATOR_ERROR_INJECTION
+
+static const char * const ssam_debugfs_fault_names[] = {
+	[SSH_FAULT_DROP_ACK]        = "drop_ack",
+	[SSH_FAULT_DROP_NAK]        = "drop_nak",
+	[SSH_FAULT_DROP_DSQ]        = "drop_dsq",
+	[SSH_FAULT_FAIL_WRITE]      = "fail_write",
+	[SSH_FAULT_CORRUPT_TX_DATA] = "corrupt_tx_data",
+	[SSH_FAULT_CORRUPT_RX_SYN]  = "corrupt_rx_syn",
+	[SSH_FAULT_CORRUPT_RX_DATA] = "corrupt_rx_data",
+	[SSH_FAULT_DROP_RESPONSE]   = "drop_response",
+};
+
+static const char * const ssam_debugfs_recovery_names[] = {
+	[SSH_FAULT_RECOVERY_RETRANSMIT] = "retransmit",
+	[SSH_FAULT_RECOVERY_RESYNC]     = "resync",
+	[SSH_FAULT_RECOVERY_DUPLICATE]  = "duplicate",
+	[SSH_FAULT_RECOVERY_TIMEOUT]    = "timeout",
+};
+
+static_assert(ARRAY_SIZE(ssam_debugfs_fault_names) == SSH_FAULT_NUM_HOOKS);
+static_assert(ARRAY_SIZE(ssam_debugfs_recovery_names) == SSH_FAULT_NUM_RECOVERY);
+
+static int ssam_debugfs_faults_show(struct seq_file *s, void *data)
+{
+	struct ssam_controller *ctrl = s->private;
+	struct ssh_faults *f = &ctrl->rtl.ptl.faults;
+	unsigned int i, b;
+	long count;
+	s64 mean;
+
+	/* Injection rates (in parts per million) and injected faults. */
+	seq_printf(s, "%-16s %8s %12s\n", "hook", "rate", "injected");
+	for (i = 0; i < SSH_FAULT_NUM_HOOKS; i++) {
+		seq_printf(s, "%-16s %8u %12ld\n", ssam_debugfs_fault_names[i],
+			   READ_ONCE(f->rate[i]), atomic_long_read(&f->injected[i]));
+	}
+
+	/* Recovery statistics, times in microseconds. */
+	seq_printf(s, "\n%-16s %8s %12s %12s %8s\n", "recovery", "count",
+		   "mean_us", "max_us", "pending");
+	for (i = 0; i < SSH_FAULT_NUM_RECOVERY; i++) {
+		count = atomic_long_read(&f->recovered[i]);
+		mean = count ? div_s64(atomic64_read(&f->time[i]), count) : 0;
+
+		seq_printf(s, "%-16s %8ld %12lld %12lld %8d\n",
+			   ssam_debugfs_recovery_names[i], count,
+			   div_s64(mean, NSEC_PER_USEC),
+			   div_s64(atomic64_read(&f->max[i]), NSEC_PER_USEC),
+			   atomic64_read(&f->pending[i]) != 0);
+	}
+
+	/* Recovery time histograms, same bucket layout as for the stats. */
+	seq_printf(s, "\n%-16s", "hist");
+	for (b = 0; b < SSH_STATS_HIST_BUCKETS - 1; b++)
+		seq_printf(s, " <%u", 1u << b);
+	seq_puts(s, " inf\n");
+
+	for (i = 0; i < SSH_FAULT_NUM_RECOVERY; i++) {
+		seq_printf(s, "%-16s", ssam_debugfs_recovery_names[i]);
+		for (b = 0; b < SSH_STATS_HIST_BUCKETS; b++)
+			seq_printf(s, " %d", atomic_read(&f->hist[i][b]));
+		seq_putc(s, '\n');
+	}
+
+	return 0;
+}
+
+static int ssam_debugfs_faults_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ssam_debugfs_faults_show, inode->i_private);
+}
+
+static ssize_t ssam_debugfs_faults_write(struct file *file,
+					 const char __user *buf, size_t count,
+					 loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct ssam_controller *ctrl = s->private;
+
+	/* Any write resets all fault and recovery statistics. */
+	ssh_fault_reset(&ctrl->rtl.ptl.faults);
+	return count;
+}
+
+static const struct file_operations ssam_debugfs_faults_fops = {
+	.owner = THIS_MODULE,
+	.open = ssam_debugfs_faults_open,
+	.read = seq_read,
+	.write = ssam_debugfs_faults_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/*
+ * Creates the "faults" directory, containing one file per hook to set its
+ * injection rate in parts per million, and the "stats" file showing the
+ * injected faults and the time it took to recover from them.
+ */
+static void ssam_debugfs_faults_init(struct ssam_controller *ctrl)
+{
+	struct ssh_faults *f = &ctrl->rtl.ptl.faults;
+	struct dentry *dir;
+	unsigned int i;
+
+	dir = debugfs_create_dir("faults", ctrl->debugfs);
+
+	for (i = 0; i < SSH_FAULT_NUM_HOOKS; i++)
+		debugfs_create_u32(ssam_debugfs_fault_names[i], 0600, dir, &f->rate[i]);
+
+	debugfs_create_file("stats", 0600, dir, ctrl, &ssam_debugfs_faults_fops);
+}
+
+#else /* CONFIG_SURFACE_AGGREGATOR_ERROR_INJECTION */
+
+static void ssam_debugfs_faults_init(struct ssam_controller *ctrl)
+{
+}
+
+#endif /* CONFIG_SURFACE_AGGREGATOR_ERROR_INJECTION */
+
+
+/* -- Controller debugfs directory. ----------------------------------------- */
+
+/**
+ * ssam_controller_debugfs_init() - Create the debugfs directory for the
+ * given controller.
+ * @ctrl: The controller.
+ *
+ * Creates the debugfs directory of the controller and all entries therein.
+ * Failure to do so is not fatal and thus not reported, in accordance to the
+ * general debugfs API.
+ */
+void ssam_controller_debugfs_init(struct ssam_controller *ctrl)
+{
+	struct device *dev = ssam_controller_device(ctrl);
+
+	ctrl->debugfs = debugfs_create_dir(dev_name(dev), ssam_debugfs_root);
+
+	debugfs_create_file("stats", 0600, ctrl->debugfs, ctrl,
+			    &ssam_debugfs_stats_fops);
+	debugfs_create_file("event_pool", 0400, ctrl->debugfs, ctrl,
+			    &ssam_debugfs_event_pool_fops);
+	debugfs_create_file("rsp_cache", 0400, ctrl->debugfs, ctrl,
+			    &ssam_debugfs_rsp_cache_fops);
+	debugfs_create_file("rqst_pool", 0400, ctrl->debugfs, ctrl,
+			    &ssam_debugfs_rqst_pool_fops);
+	debugfs_create_file("client_cache", 0400, ctrl->debugfs, ctrl,
+			    &ssam_debugfs_client_cache_fops);
+	debugfs_create_file("wakeup", 0400, ctrl->debugfs, ctrl,
+			    &ssam_debugfs_wakeup_fops);
+	debugfs_create_file("probe", 0400, ctrl->debugfs, ctrl,
+			    &ssam_debugfs_probe_fops);
+	debugfs_create_file("pm", 0400, ctrl->debugfs, ctrl,
+			    &ssam_debugfs_pm_fops);
+
+	ssam_debugfs_faults_init(ctrl);
+}
+
+/**
+ * ssam_controller_debugfs_remove() - Remove the debugfs directory of the
+ * given controller.
+ * @ctrl: The controller.
+ */
+void ssam_controller_debugfs_remove(struct ssam_controller *ctrl)
+{
+	debugfs_remove_recursive(ctrl->debugfs);
+	ctrl->debugfs = NULL;
+}
+
+/**
+ * ssam_debugfs_init() - Create the debugfs root directory.
+ */
+void ssam_debugfs_init(void)
+{
+	ssam_debugfs_root = debugfs_create_dir("surface_aggregator", NULL);
+}
+
+/**
+ * ssam_debugfs_exit() - Remove the debugfs root directory.
+ */
+void ssam_debugfs_exit(void)
+{
+	debugfs_remove_recursive(ssam_debugfs_root);
+	ssam_debugfs_root = NULL;
+}
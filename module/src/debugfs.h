@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Surface System Aggregator Module debugfs interface.
+ *
+ * Copyright (C) 2019-2022 Maximilian Luz <luzmaximilian@gmail.com>
+ */
+
+#ifndef _SURFACE_AGGREGATOR_DEBUGFS_H
+#define _SURFACE_AGGREGATOR_DEBUGFS_H
+
+#include "controller.h"
+
+void ssam_debugfs_init(void);
+void ssam_debugfs_exit(void);
+
+void ssam_controller_debugfs_init(struct ssam_controller *ctrl);
+void ssam_controller_debugfs_remove(struct ssam_controller *ctrl);
+
+#endif /* _SURFACE_AGGREGATOR_DEBUGFS_H */
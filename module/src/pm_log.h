@@ -0,0 +1,161 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Surface System Aggregator Module power management transition log.
+ *
+ * Copyright (C) 2019-2022 Maximilian Luz <luzmaximilian@gmail.com>
+ */
+
+#ifndef _SURFACE_AGGREGATOR_PM_LOG_H
+#define _SURFACE_AGGREGATOR_PM_LOG_H
+
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/string.h>
+#include <linux/timekeeping.h>
+#include <linux/types.h>
+
+/*
+ * SSAM_PM_LOG_SIZE - Number of transitions kept in the PM log.
+ */
+#define SSAM_PM_LOG_SIZE		16
+
+/*
+ * SSAM_PM_LOG_MAX_CLIENTS - Maximum number of client resume records per
+ * transition.
+ */
+#define SSAM_PM_LOG_MAX_CLIENTS		8
+
+/*
+ * SSAM_PM_LOG_CLIENT_NAME_LEN - Maximum length of client device names stored
+ * in the PM log, including the terminating null byte.
+ */
+#define SSAM_PM_LOG_CLIENT_NAME_LEN	24
+
+/**
+ * enum ssam_pm_transition - PM transitions of the controller device.
+ * @SSAM_PM_PREPARE:         Preparation for system sleep.
+ * @SSAM_PM_COMPLETE:        Completion of system resume.
+ * @SSAM_PM_SUSPEND:         Suspend to RAM/idle.
+ * @SSAM_PM_RESUME:          Resume from RAM/idle.
+ * @SSAM_PM_FREEZE:          Freeze for hibernation image creation.
+ * @SSAM_PM_THAW:            Thaw after hibernation image creation.
+ * @SSAM_PM_POWEROFF:        Power-off for hibernation.
+ * @SSAM_PM_RESTORE:         Restore from hibernation.
+ * @SSAM_PM_NUM_TRANSITIONS: Number of transitions.
+ */
+enum ssam_pm_transition {
+	SSAM_PM_PREPARE,
+	SSAM_PM_COMPLETE,
+	SSAM_PM_SUSPEND,
+	SSAM_PM_RESUME,
+	SSAM_PM_FREEZE,
+	SSAM_PM_THAW,
+	SSAM_PM_POWEROFF,
+	SSAM_PM_RESTORE,
+	SSAM_PM_NUM_TRANSITIONS,
+};
+
+/**
+ * enum ssam_pm_phase - Phases of controller PM transitions.
+ * @SSAM_PM_PHASE_DISPLAY_OFF:    Display-off notification request.
+ * @SSAM_PM_PHASE_DISPLAY_ON:     Display-on notification request.
+ * @SSAM_PM_PHASE_D0_EXIT:        D0-exit notification request.
+ * @SSAM_PM_PHASE_D0_ENTRY:       D0-entry notification request.
+ * @SSAM_PM_PHASE_IRQ:            Arming or disarming the wakeup IRQ.
+ * @SSAM_PM_PHASE_CONTROLLER:     Suspending or resuming the controller.
+ * @SSAM_PM_PHASE_EVENTS_DISABLE: Disabling all registered events.
+ * @SSAM_PM_PHASE_EVENTS_RESTORE: Re-enabling all registered events.
+ * @SSAM_PM_NUM_PHASES:           Number of phases.
+ */
+enum ssam_pm_phase {
+	SSAM_PM_PHASE_DISPLAY_OFF,
+	SSAM_PM_PHASE_DISPLAY_ON,
+	SSAM_PM_PHASE_D0_EXIT,
+	SSAM_PM_PHASE_D0_ENTRY,
+	SSAM_PM_PHASE_IRQ,
+	SSAM_PM_PHASE_CONTROLLER,
+	SSAM_PM_PHASE_EVENTS_DISABLE,
+	SSAM_PM_PHASE_EVENTS_RESTORE,
+	SSAM_PM_NUM_PHASES,
+};
+
+/**
+ * struct ssam_pm_record - Timing of a single controller PM transition.
+ * @transition: The transition, see &enum ssam_pm_transition.
+ * @status:     The status returned by the PM callback.
+ * @start:      Boot time at which the transition started.
+ * @duration:   Total duration of the transition, in nanoseconds.
+ * @phase:      Time spent in each phase, in nanoseconds. See
+ *              &enum ssam_pm_phase.
+ */
+struct ssam_pm_record {
+	enum ssam_pm_transition transition;
+	int status;
+	ktime_t start;
+	s64 duration;
+	s64 phase[SSAM_PM_NUM_PHASES];
+};
+
+/**
+ * struct ssam_pm_client_record - Resume timing of a single client device.
+ * @name:     Name of the client device.
+ * @duration: Time taken by the client to resume, in nanoseconds.
+ * @status:   Status of the client resume.
+ */
+struct ssam_pm_client_record {
+	char name[SSAM_PM_LOG_CLIENT_NAME_LEN];
+	s64 duration;
+	int status;
+};
+
+/**
+ * struct ssam_pm_log_entry - Entry of the controller PM log.
+ * @rec:         Timing of the controller transition.
+ * @num_clients: Number of valid entries in @clients.
+ * @clients:     Resume timing of client devices, recorded after the
+ *               controller transition.
+ */
+struct ssam_pm_log_entry {
+	struct ssam_pm_record rec;
+	unsigned int num_clients;
+	struct ssam_pm_client_record clients[SSAM_PM_LOG_MAX_CLIENTS];
+};
+
+/**
+ * struct ssam_pm_log - Log of the most recent controller PM transitions.
+ * @lock:    Lock guarding @count and @entries.
+ * @count:   Total number of transitions recorded.
+ * @entries: Ring buffer of the last %SSAM_PM_LOG_SIZE transitions. The
+ *           entry of the n-th transition is stored at index
+ *           n % %SSAM_PM_LOG_SIZE.
+ */
+struct ssam_pm_log {
+	struct mutex lock;
+	unsigned long count;
+	struct ssam_pm_log_entry entries[SSAM_PM_LOG_SIZE];
+};
+
+/**
+ * ssam_pm_record_begin() - Start recording a PM transition.
+ * @r:          The record to initialize.
+ * @transition: The transition that is about to be executed.
+ *
+ * All times of the PM log are based on the boot time clock, which, in
+ * contrast to monotonic time, keeps running while the system is suspended.
+ * This allows correlating transitions across a suspend/resume cycle.
+ *
+ * Return: Returns the start time of the transition, to be passed as start
+ * time of the first phase to ssam_pm_phase_end().
+ */
+static inline ktime_t ssam_pm_record_begin(struct ssam_pm_record *r,
+					   enum ssam_pm_transition transition)
+{
+	memset(r, 0, sizeof(*r));
+
+	r->transition = transition;
+	r->start = ktime_get_boottime();
+
+	return r->start;
+}
+
+#endif /* _SURFACE_AGGREGATOR_PM_LOG_H */
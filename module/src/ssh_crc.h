@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * CRC computation for SSH messages.
+ *
+ * Copyright (C) 2019-2022 Maximilian Luz <luzmaximilian@gmail.com>
+ */
+
+#ifndef _SURFACE_AGGREGATOR_SSH_CRC_H
+#define _SURFACE_AGGREGATOR_SSH_CRC_H
+
+#include <linux/types.h>
+
+u16 ssh_crc_update(u16 crc, const u8 *buf, size_t len);
+
+/**
+ * ssh_crc_fast() - Compute CRC for SSH messages.
+ * @buf: The pointer pointing to the data for which the CRC should be computed.
+ * @len: The length of the data for which the CRC should be computed.
+ *
+ * Equivalent to ssh_crc(), but uses a slice-by-4 lookup implementation
+ * instead of the byte-wise crc_ccitt_false(). Intended for the RX and TX hot
+ * paths of the transport layer.
+ *
+ * Return: Returns the CRC computed on the provided data, as used for SSH
+ * messages.
+ */
+static inline u16 ssh_crc_fast(const u8 *buf, size_t len)
+{
+	return ssh_crc_update(0xffff, buf, len);
+}
+
+#endif /* _SURFACE_AGGREGATOR_SSH_CRC_H */
@@ -0,0 +1,246 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * SSH fault injection rates and recovery tracking.
+ *
+ * Copyright (C) 2019-2022 Maximilian Luz <luzmaximilian@gmail.com>
+ */
+
+#ifndef _SURFACE_AGGREGATOR_SSH_FAULT_H
+#define _SURFACE_AGGREGATOR_SSH_FAULT_H
+
+#include <linux/atomic.h>
+#include <linux/bitops.h>
+#include <linux/compiler.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/minmax.h>
+#include <linux/random.h>
+#include <linux/string.h>
+#include <linux/types.h>
+
+#include "ssh_stats.h"
+
+/*
+ * SSH_FAULT_RATE_SCALE - Scale of fault injection rates.
+ *
+ * Rates are specified in parts per million, i.e. a rate of
+ * %SSH_FAULT_RATE_SCALE injects a fault on every invocation of the respective
+ * hook.
+ */
+#define SSH_FAULT_RATE_SCALE		1000000
+
+/**
+ * enum ssh_fault_hook - Fault injection hooks of the SSH transport layers.
+ * @SSH_FAULT_DROP_ACK:        Drop outgoing ACK packets.
+ * @SSH_FAULT_DROP_NAK:        Drop outgoing NAK packets.
+ * @SSH_FAULT_DROP_DSQ:        Drop outgoing sequenced data packets.
+ * @SSH_FAULT_FAIL_WRITE:      Fail writing packets to the serial device.
+ * @SSH_FAULT_CORRUPT_TX_DATA: Corrupt outgoing sequenced data packets.
+ * @SSH_FAULT_CORRUPT_RX_SYN:  Corrupt the SYN bytes of incoming messages.
+ * @SSH_FAULT_CORRUPT_RX_DATA: Corrupt the checksum of incoming messages.
+ * @SSH_FAULT_DROP_RESPONSE:   Drop incoming request responses.
+ * @SSH_FAULT_NUM_HOOKS:       Number of hooks.
+ */
+enum ssh_fault_hook {
+	SSH_FAULT_DROP_ACK,
+	SSH_FAULT_DROP_NAK,
+	SSH_FAULT_DROP_DSQ,
+	SSH_FAULT_FAIL_WRITE,
+	SSH_FAULT_CORRUPT_TX_DATA,
+	SSH_FAULT_CORRUPT_RX_SYN,
+	SSH_FAULT_CORRUPT_RX_DATA,
+	SSH_FAULT_DROP_RESPONSE,
+	SSH_FAULT_NUM_HOOKS,
+};
+
+/**
+ * enum ssh_fault_recovery - Recovery classes of injected faults.
+ * @SSH_FAULT_RECOVERY_RETRANSMIT: Time from a lost or corrupted outgoing
+ *                                 data packet to its re-transmission.
+ * @SSH_FAULT_RECOVERY_RESYNC:     Time from corrupted incoming data to the
+ *                                 next valid frame.
+ * @SSH_FAULT_RECOVERY_DUPLICATE:  Time from a dropped ACK to the reception
+ *                                 of the re-transmitted data frame.
+ * @SSH_FAULT_RECOVERY_TIMEOUT:    Time from a dropped response to the
+ *                                 request timing out, i.e. being lost.
+ * @SSH_FAULT_NUM_RECOVERY:        Number of recovery classes.
+ */
+enum ssh_fault_recovery {
+	SSH_FAULT_RECOVERY_RETRANSMIT,
+	SSH_FAULT_RECOVERY_RESYNC,
+	SSH_FAULT_RECOVERY_DUPLICATE,
+	SSH_FAULT_RECOVERY_TIMEOUT,
+	SSH_FAULT_NUM_RECOVERY,
+};
+
+#ifdef CONFIG_SURFACE_AGGREGATOR_ERROR_INJECTION
+
+/**
+ * struct ssh_faults - Fault injection rates and recovery statistics.
+ * @rate:      Injection rate per hook, in parts per million. See
+ *             %SSH_FAULT_RATE_SCALE.
+ * @injected:  Number of faults injected per hook.
+ * @pending:   Per recovery class, time in nanoseconds at which the oldest
+ *             not yet recovered fault has been injected, or zero if there is
+ *             none.
+ * @recovered: Number of recoveries per recovery class.
+ * @time:      Accumulated recovery time per recovery class, in nanoseconds.
+ * @max:       Maximum recovery time per recovery class, in nanoseconds.
+ * @hist:      Log2 recovery time histograms per recovery class, with the same
+ *             bucket layout as the ones of &struct ssh_stats.
+ *
+ * Only the oldest pending fault of each recovery class is tracked. Faults
+ * injected while another one of the same class is pending are counted, but
+ * will be considered recovered together with the pending one.
+ */
+struct ssh_faults {
+	u32 rate[SSH_FAULT_NUM_HOOKS];
+	atomic_long_t injected[SSH_FAULT_NUM_HOOKS];
+
+	atomic64_t pending[SSH_FAULT_NUM_RECOVERY];
+	atomic_long_t recovered[SSH_FAULT_NUM_RECOVERY];
+	atomic64_t time[SSH_FAULT_NUM_RECOVERY];
+	atomic64_t max[SSH_FAULT_NUM_RECOVERY];
+	atomic_t hist[SSH_FAULT_NUM_RECOVERY][SSH_STATS_HIST_BUCKETS];
+};
+
+/**
+ * ssh_fault_check() - Check if a fault should be injected.
+ * @f:      The fault injection state.
+ * @h:      The hook to check.
+ * @forced: Whether the fault has been requested externally, i.e. via the
+ *          error injection framework.
+ *
+ * Return: Returns %true if the fault should be injected, either because it
+ * has been requested externally or because of the configured injection rate
+ * of the hook, %false otherwise.
+ */
+static inline bool ssh_fault_check(struct ssh_faults *f, enum ssh_fault_hook h,
+				   bool forced)
+{
+	u32 rate = READ_ONCE(f->rate[h]);
+
+	if (likely(!forced)) {
+		if (likely(!rate))
+			return false;
+
+		if (get_random_u32() % SSH_FAULT_RATE_SCALE >= rate)
+			return false;
+	}
+
+	atomic_long_inc(&f->injected[h]);
+	return true;
+}
+
+/**
+ * ssh_fault_injected() - Start tracking recovery of an injected fault.
+ * @f: The fault injection state.
+ * @r: The recovery class of the fault.
+ */
+static inline void ssh_fault_injected(struct ssh_faults *f,
+				      enum ssh_fault_recovery r)
+{
+	atomic64_cmpxchg(&f->pending[r], 0, ktime_get_ns());
+}
+
+/**
+ * ssh_fault_recovered() - Record recovery from injected faults.
+ * @f: The fault injection state.
+ * @r: The recovery class.
+ *
+ * Records the time since the oldest pending fault of the given class has
+ * been injected. Does nothing if no fault of this class is pending.
+ */
+static inline void ssh_fault_recovered(struct ssh_faults *f,
+				       enum ssh_fault_recovery r)
+{
+	unsigned int bucket = 0;
+	s64 start, delta, us;
+
+	/* Fast path: Nothing pending. */
+	if (likely(!atomic64_read(&f->pending[r])))
+		return;
+
+	start = atomic64_xchg(&f->pending[r], 0);
+	if (!start)
+		return;
+
+	delta = max_t(s64, ktime_get_ns() - start, 0);
+	us = div_s64(delta, NSEC_PER_USEC);
+
+	if (us > 0)
+		bucket = min_t(unsigned int, fls64(us), SSH_STATS_HIST_BUCKETS - 1);
+
+	atomic_long_inc(&f->recovered[r]);
+	atomic64_add(delta, &f->time[r]);
+	atomic_inc(&f->hist[r][bucket]);
+
+	/* Racing updates may lose a maximum, which is fine for statistics. */
+	if (delta > atomic64_read(&f->max[r]))
+		atomic64_set(&f->max[r], delta);
+}
+
+/**
+ * ssh_fault_reset() - Reset all fault and recovery statistics.
+ * @f: The fault injection state.
+ *
+ * Does not change the configured injection rates.
+ */
+static inline void ssh_fault_reset(struct ssh_faults *f)
+{
+	unsigned int h, r, b;
+
+	for (h = 0; h < SSH_FAULT_NUM_HOOKS; h++)
+		atomic_long_set(&f->injected[h], 0);
+
+	for (r = 0; r < SSH_FAULT_NUM_RECOVERY; r++) {
+		atomic64_set(&f->pending[r], 0);
+		atomic_long_set(&f->recovered[r], 0);
+		atomic64_set(&f->time[r], 0);
+		atomic64_set(&f->max[r], 0);
+
+		for (b = 0; b < SSH_STATS_HIST_BUCKETS; b++)
+			atomic_set(&f->hist[r][b], 0);
+	}
+}
+
+/**
+ * ssh_fault_init() - Initialize fault injection state.
+ * @f: The fault injection state.
+ *
+ * Disables all fault injection hooks and resets all statistics.
+ */
+static inline void ssh_fault_init(struct ssh_faults *f)
+{
+	memset(f->rate, 0, sizeof(f->rate));
+	ssh_fault_reset(f);
+}
+
+#else /* CONFIG_SURFACE_AGGREGATOR_ERROR_INJECTION */
+
+/* Fault injection is disabled, this does not take up any space. */
+struct ssh_faults {};
+
+static inline void ssh_fault_init(struct ssh_faults *f)
+{
+}
+
+static inline bool ssh_fault_check(struct ssh_faults *f, enum ssh_fault_hook h,
+				   bool forced)
+{
+	return false;
+}
+
+static inline void ssh_fault_injected(struct ssh_faults *f,
+				      enum ssh_fault_recovery r)
+{
+}
+
+static inline void ssh_fault_recovered(struct ssh_faults *f,
+				       enum ssh_fault_recovery r)
+{
+}
+
+#endif /* CONFIG_SURFACE_AGGREGATOR_ERROR_INJECTION */
+
+#endif /* _SURFACE_AGGREGATOR_SSH_FAULT_H */
@@ -14,6 +14,8 @@
 #include "../include/linux/surface_aggregator/controller.h"
 #include "../include/linux/surface_aggregator/serial_hub.h"
 
+#include "ssh_crc.h"
+
 /**
  * struct msgbuf - Buffer struct to construct SSH messages.
  * @begin: Pointer to the beginning of the allocated buffer space.
@@ -105,7 +107,7 @@ static inline void msgb_push_buf(struct msgbuf *msgb, const u8 *buf, size_t len)
  */
 static inline void msgb_push_crc(struct msgbuf *msgb, const u8 *buf, size_t len)
 {
-	msgb_push_u16(msgb, ssh_crc(buf, len));
+	msgb_push_u16(msgb, ssh_crc_fast(buf, len));
 }
 
 /**
@@ -9,16 +9,19 @@
 #include <linux/atomic.h>
 #include <linux/error-injection.h>
 #include <linux/jiffies.h>
-#include <linux/kfifo.h>
 #include <linux/kref.h>
 #include <linux/kthread.h>
 #include <linux/ktime.h>
 #include <linux/limits.h>
 #include <linux/list.h>
 #include <linux/lockdep.h>
+#include <linux/minmax.h>
+#include <linux/moduleparam.h>
+#include <linux/sched.h>
 #include <linux/serdev.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
+#include <linux/string.h>
 #include <linux/workqueue.h>
 
 #include "../include/linux/surface_aggregator/serial_hub.h"
@@ -26,6 +29,7 @@
 #include "ssh_msgb.h"
 #include "ssh_packet_layer.h"
 #include "ssh_parser.h"
+#include "ssh_receiver.h"
 
 #include "trace.h"
 
@@ -82,6 +86,12 @@
  * On receival of a NAK, the receiver thread re-submits all currently pending
  * packets.
  *
+ * The number of sequenced packets that may concurrently be pending, i.e.
+ * awaiting an ACK, is limited by the transmission window size. ACKs are
+ * matched to pending packets by their sequence ID, so packets in the window
+ * may be ACKed in any order. A NAK replays the full window, i.e. all pending
+ * packets are re-queued in their original order.
+ *
  * Packet timeouts are detected by the timeout reaper. This is a task,
  * scheduled depending on the earliest packet timeout expiration date,
  * checking all currently pending packets if their timeout has expired. If the
@@ -197,9 +207,21 @@
  *
  * Timeout as ktime_t delta for ACKs. If we have not received an ACK in this
  * time-frame after starting transmission, the packet will be re-submitted.
+ * The actual timeout is derived from the measured ACK round-trip time. This
+ * value serves as upper bound and as initial timeout before the first
+ * measurement.
  */
 #define SSH_PTL_PACKET_TIMEOUT			ms_to_ktime(1000)
 
+/*
+ * SSH_PTL_PACKET_TIMEOUT_MIN - Minimum packet response timeout.
+ *
+ * Lower bound for the timeout derived from the measured ACK round-trip time.
+ * Should be well above the timeout resolution and leave headroom for
+ * scheduling delays of the receiver thread.
+ */
+#define SSH_PTL_PACKET_TIMEOUT_MIN		ms_to_ktime(100)
+
 /*
  * SSH_PTL_PACKET_TIMEOUT_RESOLUTION - Packet timeout granularity.
  *
@@ -209,23 +231,58 @@
 #define SSH_PTL_PACKET_TIMEOUT_RESOLUTION	ms_to_ktime(max(2000 / HZ, 50))
 
 /*
- * SSH_PTL_MAX_PENDING - Maximum number of pending packets.
+ * SSH_PTL_MAX_PENDING - Default maximum number of pending packets.
  *
- * Maximum number of sequenced packets concurrently waiting for an ACK.
- * Packets marked as blocking will not be transmitted while this limit is
- * reached.
+ * Default maximum number of sequenced packets concurrently waiting for an
+ * ACK, i.e. the default size of the transmission window. Packets marked as
+ * blocking will not be transmitted while this limit is reached. The window
+ * size can be changed via the ptl_window module parameter.
  */
 #define SSH_PTL_MAX_PENDING			1
 
 /*
- * SSH_PTL_RX_BUF_LEN - Evaluation-buffer size in bytes.
+ * SSH_PTL_MAX_WINDOW - Upper limit for the transmission window size.
+ *
+ * Upper limit for the number of sequenced packets concurrently waiting for
+ * an ACK. Sequence IDs must be unique among all pending packets, so this must
+ * be (much) smaller than 256. There is no point in going over the number of
+ * concurrently pending requests allowed by the request layer, so this is
+ * more of a sanity limit.
  */
-#define SSH_PTL_RX_BUF_LEN			4096
+#define SSH_PTL_MAX_WINDOW			8
 
 /*
- * SSH_PTL_RX_FIFO_LEN - Fifo input-buffer size in bytes.
+ * SSH_PTL_TX_BUF_LEN - Transmitter gather buffer size in bytes.
+ *
+ * Packets ready for transmission are gathered into this buffer and written to
+ * the serial device in one go, e.g. to combine ACKs with outgoing requests.
+ * Packets larger than this buffer are written directly, on their own.
  */
-#define SSH_PTL_RX_FIFO_LEN			4096
+#define SSH_PTL_TX_BUF_LEN			512
+
+/*
+ * SSH_PTL_TX_BATCH - Maximum number of packets gathered per write.
+ */
+#define SSH_PTL_TX_BATCH			8
+
+/*
+ * SSH_PTL_RX_POLL_MAX_US - Upper limit for the receiver busy-poll window.
+ *
+ * Upper limit in microseconds for the time the receiver thread busy-polls
+ * for new data before going to sleep. Bounds the CPU time that can be burned
+ * per received chunk of data.
+ */
+#define SSH_PTL_RX_POLL_MAX_US			1000
+
+static unsigned int ptl_window = SSH_PTL_MAX_PENDING;
+module_param(ptl_window, uint, 0444);
+MODULE_PARM_DESC(ptl_window,
+		 "Maximum number of sequenced packets awaiting an ACK (default: 1, max: 8)");
+
+static unsigned int ptl_rx_poll_us;
+module_param(ptl_rx_poll_us, uint, 0644);
+MODULE_PARM_DESC(ptl_rx_poll_us,
+		 "Time in microseconds the receiver busy-polls for new data after activity (default: 0 = disabled, max: 1000)");
 
 #ifdef CONFIG_SURFACE_AGGREGATOR_ERROR_INJECTION
 
@@ -328,9 +385,15 @@ ALLOW_ERROR_INJECTION(ssh_ptl_should_corrupt_rx_data, TRUE);
 
 static bool __ssh_ptl_should_drop_ack_packet(struct ssh_packet *packet)
 {
-	if (likely(!ssh_ptl_should_drop_ack_packet()))
+	struct ssh_faults *f = &packet->ptl->faults;
+
+	if (likely(!ssh_fault_check(f, SSH_FAULT_DROP_ACK,
+				    ssh_ptl_should_drop_ack_packet())))
 		return false;
 
+	/* The EC should re-transmit the data frame we did not ACK. */
+	ssh_fault_injected(f, SSH_FAULT_RECOVERY_DUPLICATE);
+
 	trace_ssam_ei_tx_drop_ack_packet(packet);
 	ptl_info(packet->ptl, "packet error injection: dropping ACK packet %p\n",
 		 packet);
@@ -340,7 +403,8 @@ static bool __ssh_ptl_should_drop_ack_packet(struct ssh_packet *packet)
 
 static bool __ssh_ptl_should_drop_nak_packet(struct ssh_packet *packet)
 {
-	if (likely(!ssh_ptl_should_drop_nak_packet()))
+	if (likely(!ssh_fault_check(&packet->ptl->faults, SSH_FAULT_DROP_NAK,
+				    ssh_ptl_should_drop_nak_packet())))
 		return false;
 
 	trace_ssam_ei_tx_drop_nak_packet(packet);
@@ -352,9 +416,15 @@ static bool __ssh_ptl_should_drop_nak_packet(struct ssh_packet *packet)
 
 static bool __ssh_ptl_should_drop_dsq_packet(struct ssh_packet *packet)
 {
-	if (likely(!ssh_ptl_should_drop_dsq_packet()))
+	struct ssh_faults *f = &packet->ptl->faults;
+
+	if (likely(!ssh_fault_check(f, SSH_FAULT_DROP_DSQ,
+				    ssh_ptl_should_drop_dsq_packet())))
 		return false;
 
+	/* The packet should be re-transmitted after its ACK timed out. */
+	ssh_fault_injected(f, SSH_FAULT_RECOVERY_RETRANSMIT);
+
 	trace_ssam_ei_tx_drop_dsq_packet(packet);
 	ptl_info(packet->ptl,
 		 "packet error injection: dropping sequenced data packet %p\n",
@@ -390,7 +460,10 @@ static int ssh_ptl_write_buf(struct ssh_ptl *ptl, struct ssh_packet *packet,
 	int status;
 
 	status = ssh_ptl_should_fail_write();
-	if (unlikely(status)) {
+	if (unlikely(ssh_fault_check(&ptl->faults, SSH_FAULT_FAIL_WRITE, status))) {
+		if (!status)
+			status = -EIO;
+
 		trace_ssam_ei_tx_fail_write(packet, status);
 		ptl_info(packet->ptl,
 			 "packet error injection: simulating transmit error %d, packet %p\n",
@@ -412,9 +485,13 @@ static void ssh_ptl_tx_inject_invalid_data(struct ssh_packet *packet)
 	if (packet->data.ptr[SSH_MSGOFFSET_FRAME(type)] != SSH_FRAME_TYPE_DATA_SEQ)
 		return;
 
-	if (likely(!ssh_ptl_should_corrupt_tx_data()))
+	if (likely(!ssh_fault_check(&packet->ptl->faults, SSH_FAULT_CORRUPT_TX_DATA,
+				    ssh_ptl_should_corrupt_tx_data())))
 		return;
 
+	/* The EC should NAK the packet, causing it to be re-transmitted. */
+	ssh_fault_injected(&packet->ptl->faults, SSH_FAULT_RECOVERY_RETRANSMIT);
+
 	trace_ssam_ei_tx_corrupt_data(packet);
 	ptl_info(packet->ptl,
 		 "packet error injection: simulating invalid transmit data on packet %p\n",
@@ -428,26 +505,31 @@ static void ssh_ptl_tx_inject_invalid_data(struct ssh_packet *packet)
 	memset(packet->data.ptr, 0xb3, packet->data.len);
 }
 
-static void ssh_ptl_rx_inject_invalid_syn(struct ssh_ptl *ptl,
+static void ssh_ptl_rx_inject_invalid_syn(struct ssh_rx *rx,
 					  struct ssam_span *data)
 {
+	struct ssh_ptl *ptl = container_of(rx, struct ssh_ptl, rx.eval);
 	struct ssam_span frame;
 
 	/* Check if there actually is something to corrupt. */
 	if (!sshp_find_syn(data, &frame))
 		return;
 
-	if (likely(!ssh_ptl_should_corrupt_rx_syn()))
+	if (likely(!ssh_fault_check(&ptl->faults, SSH_FAULT_CORRUPT_RX_SYN,
+				    ssh_ptl_should_corrupt_rx_syn())))
 		return;
 
+	ssh_fault_injected(&ptl->faults, SSH_FAULT_RECOVERY_RESYNC);
+
 	trace_ssam_ei_rx_corrupt_syn(data->len);
 
 	data->ptr[1] = 0xb3;	/* Set second byte of SYN to "random" value. */
 }
 
-static void ssh_ptl_rx_inject_invalid_data(struct ssh_ptl *ptl,
+static void ssh_ptl_rx_inject_invalid_data(struct ssh_rx *rx,
 					   struct ssam_span *frame)
 {
+	struct ssh_ptl *ptl = container_of(rx, struct ssh_ptl, rx.eval);
 	size_t payload_len, message_len;
 	struct ssh_frame *sshf;
 
@@ -461,9 +543,12 @@ static void ssh_ptl_rx_inject_invalid_data(struct ssh_ptl *ptl,
 	if (frame->len < message_len)
 		return;
 
-	if (likely(!ssh_ptl_should_corrupt_rx_data()))
+	if (likely(!ssh_fault_check(&ptl->faults, SSH_FAULT_CORRUPT_RX_DATA,
+				    ssh_ptl_should_corrupt_rx_data())))
 		return;
 
+	ssh_fault_injected(&ptl->faults, SSH_FAULT_RECOVERY_RESYNC);
+
 	sshf = (struct ssh_frame *)&frame->ptr[SSH_MSGOFFSET_FRAME(type)];
 	trace_ssam_ei_rx_corrupt_data(sshf);
 
@@ -495,16 +580,6 @@ static inline void ssh_ptl_tx_inject_invalid_data(struct ssh_packet *packet)
 {
 }
 
-static inline void ssh_ptl_rx_inject_invalid_syn(struct ssh_ptl *ptl,
-						 struct ssam_span *data)
-{
-}
-
-static inline void ssh_ptl_rx_inject_invalid_data(struct ssh_ptl *ptl,
-						  struct ssam_span *frame)
-{
-}
-
 #endif /* CONFIG_SURFACE_AGGREGATOR_ERROR_INJECTION */
 
 static void __ssh_ptl_packet_release(struct kref *kref)
@@ -577,6 +652,7 @@ void ssh_packet_init(struct ssh_packet *packet, unsigned long type,
 	packet->ptl = NULL;
 	INIT_LIST_HEAD(&packet->queue_node);
 	INIT_LIST_HEAD(&packet->pending_node);
+	INIT_LIST_HEAD(&packet->timeout_node);
 
 	packet->state = type & SSH_PACKET_FLAGS_TY_MASK;
 	packet->priority = priority;
@@ -666,11 +742,24 @@ static void ssh_ptl_timeout_reaper_mod(struct ssh_ptl *ptl, ktime_t now,
 	unsigned long delta = msecs_to_jiffies(ktime_ms_delta(expires, now));
 	ktime_t aexp = ktime_add(expires, SSH_PTL_PACKET_TIMEOUT_RESOLUTION);
 
+	/*
+	 * Fast path: The reaper is usually already scheduled to run before
+	 * the new expiration date, so we can avoid taking the lock. The caller
+	 * has added the timeout to the list under the pending lock, and the
+	 * reaper resets the expiration date before scanning that list under
+	 * the same lock. So if we observe an outdated expiration date here,
+	 * the reaper is guaranteed to see the new timeout and re-arm itself
+	 * accordingly. This requires the expiration date to be read atomically.
+	 */
+	if (IS_ENABLED(CONFIG_64BIT) &&
+	    !ktime_before(aexp, READ_ONCE(ptl->rtx_timeout.expires)))
+		return;
+
 	spin_lock(&ptl->rtx_timeout.lock);
 
 	/* Re-adjust / schedule reaper only if it is above resolution delta. */
 	if (ktime_before(aexp, ptl->rtx_timeout.expires)) {
-		ptl->rtx_timeout.expires = expires;
+		WRITE_ONCE(ptl->rtx_timeout.expires, expires);
 		mod_delayed_work(system_wq, &ptl->rtx_timeout.reaper, delta);
 	}
 
@@ -788,11 +877,43 @@ static void ssh_ptl_queue_remove(struct ssh_packet *packet)
 	ssh_packet_put(packet);
 }
 
+/*
+ * Insert the packet into the deadline-ordered timeout list. Timestamps are
+ * set only by the transmitter thread and thus increase monotonically, so
+ * the insertion point is usually found at the tail of the list. Must be
+ * called with pending lock held.
+ */
+static void ssh_ptl_timeout_add(struct ssh_packet *p)
+{
+	struct ssh_ptl *ptl = p->ptl;
+	struct ssh_packet *q;
+
+	lockdep_assert_held(&ptl->pending.lock);
+
+	list_del_init(&p->timeout_node);
+
+	list_for_each_entry_reverse(q, &ptl->rtx_timeout.head, timeout_node) {
+		if (!ktime_after(q->timestamp, p->timestamp)) {
+			list_add(&p->timeout_node, &q->timeout_node);
+			return;
+		}
+	}
+
+	list_add(&p->timeout_node, &ptl->rtx_timeout.head);
+}
+
+/* Must be called with pending lock held. */
+static void ssh_ptl_timeout_del(struct ssh_packet *p)
+{
+	lockdep_assert_held(&p->ptl->pending.lock);
+	list_del_init(&p->timeout_node);
+}
+
 static void ssh_ptl_pending_push(struct ssh_packet *p)
 {
 	struct ssh_ptl *ptl = p->ptl;
 	const ktime_t timestamp = ktime_get_coarse_boottime();
-	const ktime_t timeout = ptl->rtx_timeout.timeout;
+	const ktime_t timeout = ssh_rtt_timeout(&ptl->rtx_timeout.rtt);
 
 	/*
 	 * Note: We can get the time for the timestamp before acquiring the
@@ -822,6 +943,8 @@ static void ssh_ptl_pending_push(struct ssh_packet *p)
 		list_add_tail(&ssh_packet_get(p)->pending_node, &ptl->pending.head);
 	}
 
+	ssh_ptl_timeout_add(p);
+
 	spin_unlock(&ptl->pending.lock);
 
 	/* Arm/update timeout reaper. */
@@ -840,6 +963,7 @@ static void ssh_ptl_pending_remove(struct ssh_packet *packet)
 	}
 
 	list_del(&packet->pending_node);
+	ssh_ptl_timeout_del(packet);
 	atomic_dec(&ptl->pending.count);
 
 	spin_unlock(&ptl->pending.lock);
@@ -880,6 +1004,19 @@ static void ssh_ptl_remove_and_complete(struct ssh_packet *p, int status)
 	__ssh_ptl_complete(p, status);
 }
 
+/**
+ * ssh_ptl_tx_window_open() - Check if the transmission window has space left.
+ * @ptl: The packet transport layer.
+ *
+ * Return: Returns %true if fewer sequenced packets than allowed by the
+ * current window size are awaiting an ACK, i.e. if a new blocking packet may
+ * be transmitted.
+ */
+static bool ssh_ptl_tx_window_open(struct ssh_ptl *ptl)
+{
+	return atomic_read(&ptl->pending.count) < ptl->pending.window;
+}
+
 static bool ssh_ptl_tx_can_process(struct ssh_packet *packet)
 {
 	struct ssh_ptl *ptl = packet->ptl;
@@ -896,10 +1033,10 @@ static bool ssh_ptl_tx_can_process(struct ssh_packet *packet)
 		return true;
 
 	/* Otherwise: Check if we have the capacity to send. */
-	return atomic_read(&ptl->pending.count) < SSH_PTL_MAX_PENDING;
+	return ssh_ptl_tx_window_open(ptl);
 }
 
-static struct ssh_packet *ssh_ptl_tx_pop(struct ssh_ptl *ptl)
+static struct ssh_packet *ssh_ptl_tx_pop(struct ssh_ptl *ptl, size_t space)
 {
 	struct ssh_packet *packet = ERR_PTR(-ENOENT);
 	struct ssh_packet *p, *n;
@@ -923,6 +1060,15 @@ static struct ssh_packet *ssh_ptl_tx_pop(struct ssh_ptl *ptl)
 			break;
 		}
 
+		/*
+		 * Don't re-order packets when gathering: If this one does not
+		 * fit, leave it and all following packets for the next write.
+		 */
+		if (p->data.len > space) {
+			packet = ERR_PTR(-ENOSPC);
+			break;
+		}
+
 		/*
 		 * We are allowed to change the state now. Remove it from the
 		 * queue and mark it as being transmitted.
@@ -952,11 +1098,11 @@ static struct ssh_packet *ssh_ptl_tx_pop(struct ssh_ptl *ptl)
 	return packet;
 }
 
-static struct ssh_packet *ssh_ptl_tx_next(struct ssh_ptl *ptl)
+static struct ssh_packet *ssh_ptl_tx_next(struct ssh_ptl *ptl, size_t space)
 {
 	struct ssh_packet *p;
 
-	p = ssh_ptl_tx_pop(ptl);
+	p = ssh_ptl_tx_pop(ptl, space);
 	if (IS_ERR(p))
 		return p;
 
@@ -1048,18 +1194,15 @@ static long ssh_ptl_tx_wait_transfer(struct ssh_ptl *ptl, long timeout)
 	return status;
 }
 
-static int ssh_ptl_tx_packet(struct ssh_ptl *ptl, struct ssh_packet *packet)
+static bool ssh_ptl_tx_prepare(struct ssh_ptl *ptl, struct ssh_packet *packet)
 {
-	long timeout = SSH_PTL_TX_TIMEOUT;
-	size_t offset = 0;
-
 	/* Note: Flush-packets don't have any data. */
 	if (unlikely(!packet->data.ptr))
-		return 0;
+		return false;
 
 	/* Error injection: drop packet to simulate transmission problem. */
 	if (ssh_ptl_should_drop_packet(packet))
-		return 0;
+		return false;
 
 	/* Error injection: simulate invalid packet data. */
 	ssh_ptl_tx_inject_invalid_data(packet);
@@ -1068,12 +1211,21 @@ static int ssh_ptl_tx_packet(struct ssh_ptl *ptl, struct ssh_packet *packet)
 	print_hex_dump_debug("tx: ", DUMP_PREFIX_OFFSET, 16, 1,
 			     packet->data.ptr, packet->data.len, false);
 
+	return true;
+}
+
+static int ssh_ptl_tx_write(struct ssh_ptl *ptl, struct ssh_packet *packet,
+			    const u8 *data, size_t count)
+{
+	long timeout = SSH_PTL_TX_TIMEOUT;
+	size_t offset = 0;
+
 	do {
 		ssize_t status, len;
-		u8 *buf;
+		const u8 *buf;
 
-		buf = packet->data.ptr + offset;
-		len = packet->data.len - offset;
+		buf = data + offset;
+		len = count - offset;
 
 		status = ssh_ptl_write_buf(ptl, packet, buf, len);
 		if (status < 0)
@@ -1096,31 +1248,100 @@ static int ssh_ptl_tx_packet(struct ssh_ptl *ptl, struct ssh_packet *packet)
 	} while (true);
 }
 
+/**
+ * ssh_ptl_tx_gather() - Get and transmit the next batch of packets.
+ * @ptl:    The packet transport layer.
+ * @batch:  Array of at least %SSH_PTL_TX_BATCH elements to store the
+ *          transmitted packets in.
+ * @status: Where to store the transmission status.
+ *
+ * Gathers the data of all packets that are ready for transmission, up to
+ * %SSH_PTL_TX_BATCH packets and %SSH_PTL_TX_BUF_LEN bytes, into the transmit
+ * buffer of the packet layer and writes it to the serial device at once. This
+ * reduces the number of write calls and thread wakeups under bidirectional
+ * load, e.g. by combining ACKs for received events with outgoing requests.
+ * Packets exceeding the buffer size are written directly and on their own.
+ *
+ * The transmission status applies to all packets in the batch. The caller
+ * is responsible for completing the packets and dropping the references
+ * returned via @batch.
+ *
+ * Return: Returns the number of packets stored in @batch, zero if no packet
+ * is ready for transmission.
+ */
+static unsigned int ssh_ptl_tx_gather(struct ssh_ptl *ptl,
+				      struct ssh_packet **batch, int *status)
+{
+	struct ssh_packet *p;
+	unsigned int n = 0;
+	size_t len = 0;
+
+	p = ssh_ptl_tx_next(ptl, SIZE_MAX);
+	if (IS_ERR(p))
+		return 0;
+
+	batch[n++] = p;
+
+	/* Write packets that don't fit into the buffer directly. */
+	if (p->data.len > SSH_PTL_TX_BUF_LEN) {
+		*status = 0;
+
+		if (ssh_ptl_tx_prepare(ptl, p))
+			*status = ssh_ptl_tx_write(ptl, p, p->data.ptr, p->data.len);
+
+		return n;
+	}
+
+	do {
+		if (ssh_ptl_tx_prepare(ptl, p)) {
+			memcpy(ptl->tx.buf + len, p->data.ptr, p->data.len);
+			len += p->data.len;
+		}
+
+		if (n == SSH_PTL_TX_BATCH)
+			break;
+
+		p = ssh_ptl_tx_next(ptl, SSH_PTL_TX_BUF_LEN - len);
+		if (IS_ERR(p))
+			break;
+
+		batch[n++] = p;
+	} while (true);
+
+	if (n > 1)
+		ptl_dbg(ptl, "tx: gathered %u packets (length: %zu)\n", n, len);
+
+	*status = len ? ssh_ptl_tx_write(ptl, batch[0], ptl->tx.buf, len) : 0;
+	return n;
+}
+
 static int ssh_ptl_tx_threadfn(void *data)
 {
 	struct ssh_ptl *ptl = data;
 
 	while (!kthread_should_stop() && atomic_read(&ptl->tx.running)) {
-		struct ssh_packet *packet;
+		struct ssh_packet *batch[SSH_PTL_TX_BATCH];
+		unsigned int i, n;
 		int status;
 
-		/* Try to get the next packet. */
-		packet = ssh_ptl_tx_next(ptl);
+		/* Try to get and transfer the next batch of packets. */
+		n = ssh_ptl_tx_gather(ptl, batch, &status);
 
 		/* If no packet can be processed, we are done. */
-		if (IS_ERR(packet)) {
+		if (!n) {
 			ssh_ptl_tx_wait_packet(ptl);
 			continue;
 		}
 
-		/* Transfer and complete packet. */
-		status = ssh_ptl_tx_packet(ptl, packet);
-		if (status)
-			ssh_ptl_tx_compl_error(packet, status);
-		else
-			ssh_ptl_tx_compl_success(packet);
+		/* Complete packets. */
+		for (i = 0; i < n; i++) {
+			if (status)
+				ssh_ptl_tx_compl_error(batch[i], status);
+			else
+				ssh_ptl_tx_compl_success(batch[i]);
 
-		ssh_packet_put(packet);
+			ssh_packet_put(batch[i]);
+		}
 	}
 
 	return 0;
@@ -1193,6 +1414,7 @@ int ssh_ptl_tx_stop(struct ssh_ptl *ptl)
 static struct ssh_packet *ssh_ptl_ack_pop(struct ssh_ptl *ptl, u8 seq_id)
 {
 	struct ssh_packet *packet = ERR_PTR(-ENOENT);
+	ktime_t sent = KTIME_MAX;
 	struct ssh_packet *p, *n;
 
 	spin_lock(&ptl->pending.lock);
@@ -1225,12 +1447,25 @@ static struct ssh_packet *ssh_ptl_ack_pop(struct ssh_ptl *ptl, u8 seq_id)
 
 		atomic_dec(&ptl->pending.count);
 		list_del(&p->pending_node);
+		ssh_ptl_timeout_del(p);
 		packet = p;
 
+		/*
+		 * Only sample the round-trip time of packets that have not
+		 * been re-transmitted, as we cannot tell which transmission
+		 * this ACK belongs to otherwise.
+		 */
+		if (ssh_packet_priority_get_try(READ_ONCE(p->priority)) == 1)
+			sent = p->timestamp;
+
 		break;
 	}
 	spin_unlock(&ptl->pending.lock);
 
+	if (sent != KTIME_MAX)
+		ssh_rtt_sample(&ptl->rtx_timeout.rtt,
+			       ktime_sub(ktime_get_coarse_boottime(), sent));
+
 	return packet;
 }
 
@@ -1292,7 +1527,7 @@ static void ssh_ptl_acknowledge(struct ssh_ptl *ptl, u8 seq)
 	ssh_ptl_remove_and_complete(p, 0);
 	ssh_packet_put(p);
 
-	if (atomic_read(&ptl->pending.count) < SSH_PTL_MAX_PENDING)
+	if (ssh_ptl_tx_window_open(ptl))
 		ssh_ptl_tx_wakeup_packet(ptl);
 }
 
@@ -1342,7 +1577,7 @@ int ssh_ptl_submit(struct ssh_ptl *ptl, struct ssh_packet *p)
 		return status;
 
 	if (!test_bit(SSH_PACKET_TY_BLOCKING_BIT, &p->state) ||
-	    (atomic_read(&ptl->pending.count) < SSH_PTL_MAX_PENDING))
+	    ssh_ptl_tx_window_open(ptl))
 		ssh_ptl_tx_wakeup_packet(ptl);
 
 	return 0;
@@ -1390,8 +1625,12 @@ static int __ssh_ptl_resubmit(struct ssh_packet *packet)
 	}
 
 	packet->timestamp = KTIME_MAX;
+	ssh_ptl_timeout_del(packet);
 
 	spin_unlock(&packet->ptl->queue.lock);
+
+	ssh_stats_inc(&packet->ptl->stats, SSH_STATS_RETRANSMIT);
+	ssh_fault_recovered(&packet->ptl->faults, SSH_FAULT_RECOVERY_RETRANSMIT);
 	return 0;
 }
 
@@ -1478,7 +1717,7 @@ void ssh_ptl_cancel(struct ssh_packet *p)
 	if (READ_ONCE(p->ptl)) {
 		ssh_ptl_remove_and_complete(p, -ECANCELED);
 
-		if (atomic_read(&p->ptl->pending.count) < SSH_PTL_MAX_PENDING)
+		if (ssh_ptl_tx_window_open(p->ptl))
 			ssh_ptl_tx_wakeup_packet(p->ptl);
 
 	} else if (!test_and_set_bit(SSH_PACKET_SF_COMPLETED_BIT, &p->state)) {
@@ -1502,10 +1741,13 @@ static void ssh_ptl_timeout_reap(struct work_struct *work)
 	struct ssh_ptl *ptl = to_ssh_ptl(work, rtx_timeout.reaper.work);
 	struct ssh_packet *p, *n;
 	LIST_HEAD(claimed);
+	ktime_t start = ktime_get();
 	ktime_t now = ktime_get_coarse_boottime();
-	ktime_t timeout = ptl->rtx_timeout.timeout;
+	ktime_t timeout = ssh_rtt_timeout(&ptl->rtx_timeout.rtt);
 	ktime_t next = KTIME_MAX;
+	unsigned int expired = 0;
 	bool resub = false;
+	ktime_t scheduled, delay;
 	int status;
 
 	trace_ssam_ptl_timeout_reap(atomic_read(&ptl->pending.count));
@@ -1515,24 +1757,31 @@ static void ssh_ptl_timeout_reap(struct work_struct *work)
 	 * packets to avoid lost-update type problems.
 	 */
 	spin_lock(&ptl->rtx_timeout.lock);
-	ptl->rtx_timeout.expires = KTIME_MAX;
+	scheduled = ptl->rtx_timeout.expires;
+	WRITE_ONCE(ptl->rtx_timeout.expires, KTIME_MAX);
 	spin_unlock(&ptl->rtx_timeout.lock);
 
 	spin_lock(&ptl->pending.lock);
 
-	list_for_each_entry_safe(p, n, &ptl->pending.head, pending_node) {
+	/*
+	 * Packets with running timeout are ordered by their expiration date,
+	 * so we can stop at the first one that has not expired yet.
+	 */
+	list_for_each_entry_safe(p, n, &ptl->rtx_timeout.head, timeout_node) {
 		ktime_t expires = ssh_packet_get_expiration(p, timeout);
 
 		/*
-		 * Check if the timeout hasn't expired yet. Find out next
+		 * Check if the timeout hasn't expired yet. This is the next
 		 * expiration date to be handled after this run.
 		 */
 		if (ktime_after(expires, now)) {
-			next = ktime_before(expires, next) ? expires : next;
-			continue;
+			next = expires;
+			break;
 		}
 
 		trace_ssam_packet_timeout(p);
+		ssh_stats_inc(&ptl->stats, SSH_STATS_PACKET_TIMEOUT);
+		expired++;
 
 		status = __ssh_ptl_resubmit(p);
 
@@ -1567,11 +1816,16 @@ static void ssh_ptl_timeout_reap(struct work_struct *work)
 		clear_bit(SSH_PACKET_SF_PENDING_BIT, &p->state);
 
 		atomic_dec(&ptl->pending.count);
+		ssh_ptl_timeout_del(p);
 		list_move_tail(&p->pending_node, &claimed);
 	}
 
 	spin_unlock(&ptl->pending.lock);
 
+	/* Back off before re-transmitted packets are armed again. */
+	if (expired)
+		ssh_rtt_backoff(&ptl->rtx_timeout.rtt);
+
 	/* Cancel and complete the packet. */
 	list_for_each_entry_safe(p, n, &claimed, pending_node) {
 		if (!test_and_set_bit(SSH_PACKET_SF_COMPLETED_BIT, &p->state)) {
@@ -1594,56 +1848,42 @@ static void ssh_ptl_timeout_reap(struct work_struct *work)
 
 	if (resub)
 		ssh_ptl_tx_wakeup_packet(ptl);
+
+	/* Report how late this run has been and how long it took. */
+	delay = scheduled != KTIME_MAX ? ktime_sub(now, scheduled) : 0;
+	trace_ssam_ptl_timeout_reap_done(delay, ktime_sub(ktime_get(), start), expired);
 }
 
-static bool ssh_ptl_rx_retransmit_check(struct ssh_ptl *ptl, const struct ssh_frame *frame)
+/**
+ * ssh_ptl_ack_queued() - Check if an ACK for the given sequence ID is queued.
+ * @ptl: The packet transport layer.
+ * @seq: The sequence ID to check for.
+ *
+ * Return: Returns %true if an ACK for the given sequence ID is queued and has
+ * not been picked up for transmission yet, %false otherwise.
+ */
+static bool ssh_ptl_ack_queued(struct ssh_ptl *ptl, u8 seq)
 {
-	int i;
+	struct ssh_packet *p;
+	bool found = false;
 
-	/*
-	 * Ignore unsequenced packets. On some devices (notably Surface Pro 9),
-	 * unsequenced events will always be sent with SEQ=0x00. Attempting to
-	 * detect retransmission would thus just block all events.
-	 *
-	 * While sequence numbers would also allow detection of retransmitted
-	 * packets in unsequenced communication, they have only ever been used
-	 * to cover edge-cases in sequenced transmission. In particular, the
-	 * only instance of packets being retransmitted (that we are aware of)
-	 * is due to an ACK timeout. As this does not happen in unsequenced
-	 * communication, skip the retransmission check for those packets
-	 * entirely.
-	 */
-	if (frame->type == SSH_FRAME_TYPE_DATA_NSQ)
-		return false;
+	spin_lock(&ptl->queue.lock);
+	list_for_each_entry(p, &ptl->queue.head, queue_node) {
+		/* ACKs have the highest priority and are queued first. */
+		if (ssh_packet_priority_get_base(p->priority) != SSH_PACKET_PRIORITY_ACK)
+			break;
 
-	/*
-	 * Check if SEQ has been seen recently (i.e. packet was
-	 * re-transmitted and we should ignore it).
-	 */
-	for (i = 0; i < ARRAY_SIZE(ptl->rx.blocked.seqs); i++) {
-		if (likely(ptl->rx.blocked.seqs[i] != frame->seq))
+		if (test_bit(SSH_PACKET_SF_LOCKED_BIT, &p->state))
 			continue;
 
-		ptl_dbg(ptl, "ptl: ignoring repeated data packet\n");
-		return true;
+		if (ssh_packet_get_seq(p) == seq) {
+			found = true;
+			break;
+		}
 	}
+	spin_unlock(&ptl->queue.lock);
 
-	/* Update list of blocked sequence IDs. */
-	ptl->rx.blocked.seqs[ptl->rx.blocked.offset] = frame->seq;
-	ptl->rx.blocked.offset = (ptl->rx.blocked.offset + 1)
-				  % ARRAY_SIZE(ptl->rx.blocked.seqs);
-
-	return false;
-}
-
-static void ssh_ptl_rx_dataframe(struct ssh_ptl *ptl,
-				 const struct ssh_frame *frame,
-				 const struct ssam_span *payload)
-{
-	if (ssh_ptl_rx_retransmit_check(ptl, frame))
-		return;
-
-	ptl->ops.data_received(ptl, payload);
+	return found;
 }
 
 static void ssh_ptl_send_ack(struct ssh_ptl *ptl, u8 seq)
@@ -1653,6 +1893,21 @@ static void ssh_ptl_send_ack(struct ssh_ptl *ptl, u8 seq)
 	struct msgbuf msgb;
 	int status;
 
+	/*
+	 * Coalesce ACKs: If the EC re-transmits a frame before our ACK for
+	 * its first transmission went out, a single ACK covers both.
+	 *
+	 * Note: ACKs only cover the exact sequence ID they carry, so ACKs for
+	 * different sequence IDs must not be merged. As this function is only
+	 * called from the receiver thread, the ACK found cannot be replaced
+	 * by another one concurrently. It can only be transmitted, which is
+	 * fine.
+	 */
+	if (ssh_ptl_ack_queued(ptl, seq)) {
+		ptl_dbg(ptl, "ptl: ACK for SEQ %#04x already queued\n", seq);
+		return;
+	}
+
 	status = ssh_ctrl_packet_alloc(&packet, &buf, GFP_KERNEL);
 	if (status) {
 		ptl_err(ptl, "ptl: failed to allocate ACK packet\n");
@@ -1691,141 +1946,181 @@ static void ssh_ptl_send_nak(struct ssh_ptl *ptl)
 	ssh_packet_set_data(packet, msgb.begin, msgb_bytes_used(&msgb));
 
 	ssh_ptl_submit(ptl, packet);
+	ssh_stats_inc(&ptl->stats, SSH_STATS_NAK_TX);
 	ssh_packet_put(packet);
 }
 
-static size_t ssh_ptl_rx_eval(struct ssh_ptl *ptl, struct ssam_span *source)
+static struct ssh_ptl *ssh_ptl_from_rx(struct ssh_rx *rx)
 {
-	struct ssh_frame *frame;
-	struct ssam_span payload;
-	struct ssam_span aligned;
-	bool syn_found;
-	int status;
+	return container_of(rx, struct ssh_ptl, rx.eval);
+}
 
-	/* Error injection: Modify data to simulate corrupt SYN bytes. */
-	ssh_ptl_rx_inject_invalid_syn(ptl, source);
+static void ssh_ptl_rx_resync(struct ssh_rx *rx, const struct ssam_span *data, size_t skip)
+{
+	ssh_ptl_send_nak(ssh_ptl_from_rx(rx));
+}
 
-	/* Find SYN. */
-	syn_found = sshp_find_syn(source, &aligned);
+static void ssh_ptl_rx_frame_invalid(struct ssh_rx *rx, int status)
+{
+	if (status == -EBADMSG)
+		ssh_stats_inc(&ssh_ptl_from_rx(rx)->stats, SSH_STATS_CRC_ERROR);
+}
 
-	if (unlikely(aligned.ptr != source->ptr)) {
-		/*
-		 * We expect aligned.ptr == source->ptr. If this is not the
-		 * case, then aligned.ptr > source->ptr and we've encountered
-		 * some unexpected data where we'd expect the start of a new
-		 * message (i.e. the SYN sequence).
-		 *
-		 * This can happen when a CRC check for the previous message
-		 * failed and we start actively searching for the next one
-		 * (via the call to sshp_find_syn() above), or the first bytes
-		 * of a message got dropped or corrupted.
-		 *
-		 * In any case, we issue a warning, send a NAK to the EC to
-		 * request re-transmission of any data we haven't acknowledged
-		 * yet, and finally, skip everything up to the next SYN
-		 * sequence.
-		 */
+static void ssh_ptl_rx_frame_received(struct ssh_rx *rx, const struct ssh_frame *frame,
+				      const struct ssam_span *payload)
+{
+	struct ssh_ptl *ptl = ssh_ptl_from_rx(rx);
 
-		ptl_warn(ptl, "rx: parser: invalid start of frame, skipping\n");
+	ssh_fault_recovered(&ptl->faults, SSH_FAULT_RECOVERY_RESYNC);
+	trace_ssam_rx_frame_received(frame);
 
-		/*
-		 * Notes:
-		 * - This might send multiple NAKs in case the communication
-		 *   starts with an invalid SYN and is broken down into multiple
-		 *   pieces. This should generally be handled fine, we just
-		 *   might receive duplicate data in this case, which is
-		 *   detected when handling data frames.
-		 * - This path will also be executed on invalid CRCs: When an
-		 *   invalid CRC is encountered, the code below will skip data
-		 *   until directly after the SYN. This causes the search for
-		 *   the next SYN, which is generally not placed directly after
-		 *   the last one.
-		 *
-		 *   Open question: Should we send this in case of invalid
-		 *   payload CRCs if the frame-type is non-sequential (current
-		 *   implementation) or should we drop that frame without
-		 *   telling the EC?
-		 */
-		ssh_ptl_send_nak(ptl);
+	if (trace_ssam_rx_frame_dispatch_enabled()) {
+		ktime_t received = ns_to_ktime(atomic64_read(&ptl->rx.received));
+
+		trace_ssam_rx_frame_dispatch(frame, ktime_sub(ktime_get(), received));
 	}
+}
 
-	if (unlikely(!syn_found))
-		return aligned.ptr - source->ptr;
+static void ssh_ptl_rx_ack_received(struct ssh_rx *rx, u8 seq)
+{
+	ssh_ptl_acknowledge(ssh_ptl_from_rx(rx), seq);
+}
 
-	/* Error injection: Modify data to simulate corruption. */
-	ssh_ptl_rx_inject_invalid_data(ptl, &aligned);
+static void ssh_ptl_rx_nak_received(struct ssh_rx *rx)
+{
+	struct ssh_ptl *ptl = ssh_ptl_from_rx(rx);
 
-	/* Parse and validate frame. */
-	status = sshp_parse_frame(&ptl->serdev->dev, &aligned, &frame, &payload,
-				  SSH_PTL_RX_BUF_LEN);
-	if (status)	/* Invalid frame: skip to next SYN. */
-		return aligned.ptr - source->ptr + sizeof(u16);
-	if (!frame)	/* Not enough data. */
-		return aligned.ptr - source->ptr;
+	ssh_stats_inc(&ptl->stats, SSH_STATS_NAK_RX);
+	ssh_ptl_resubmit_pending(ptl);
+}
 
-	trace_ssam_rx_frame_received(frame);
+static void ssh_ptl_rx_send_ack(struct ssh_rx *rx, u8 seq)
+{
+	ssh_ptl_send_ack(ssh_ptl_from_rx(rx), seq);
+}
 
-	switch (frame->type) {
-	case SSH_FRAME_TYPE_ACK:
-		ssh_ptl_acknowledge(ptl, frame->seq);
-		break;
+static void ssh_ptl_rx_data_repeated(struct ssh_rx *rx, const struct ssh_frame *frame)
+{
+	ssh_fault_recovered(&ssh_ptl_from_rx(rx)->faults, SSH_FAULT_RECOVERY_DUPLICATE);
+}
 
-	case SSH_FRAME_TYPE_NAK:
-		ssh_ptl_resubmit_pending(ptl);
-		break;
+static void ssh_ptl_rx_data_received(struct ssh_rx *rx, const struct ssam_span *payload)
+{
+	struct ssh_ptl *ptl = ssh_ptl_from_rx(rx);
 
-	case SSH_FRAME_TYPE_DATA_SEQ:
-		ssh_ptl_send_ack(ptl, frame->seq);
-		fallthrough;
+	ptl->ops.data_received(ptl, payload);
+}
 
-	case SSH_FRAME_TYPE_DATA_NSQ:
-		ssh_ptl_rx_dataframe(ptl, frame, &payload);
-		break;
+static const struct ssh_rx_ops ssh_ptl_rx_ops = {
+#ifdef CONFIG_SURFACE_AGGREGATOR_ERROR_INJECTION
+	.inject_syn = ssh_ptl_rx_inject_invalid_syn,
+	.inject_frame = ssh_ptl_rx_inject_invalid_data,
+#endif
+	.resync = ssh_ptl_rx_resync,
+	.frame_invalid = ssh_ptl_rx_frame_invalid,
+	.frame_received = ssh_ptl_rx_frame_received,
+	.ack_received = ssh_ptl_rx_ack_received,
+	.nak_received = ssh_ptl_rx_nak_received,
+	.send_ack = ssh_ptl_rx_send_ack,
+	.data_repeated = ssh_ptl_rx_data_repeated,
+	.data_received = ssh_ptl_rx_data_received,
+};
 
-	default:
-		ptl_warn(ptl, "ptl: received frame with unknown type %#04x\n",
-			 frame->type);
-		break;
-	}
+/**
+ * ssh_ptl_rx_poll() - Busy-poll for new data.
+ * @ptl:  The packet transport layer.
+ * @seen: The write counter of the receiver ring buffer up to which data has
+ *        already been seen by the receiver thread.
+ *
+ * Busy-polls the receiver ring buffer for new data for the time specified via
+ * the ptl_rx_poll_us module parameter. This avoids a scheduler round-trip per
+ * received chunk of data for bursty, latency sensitive traffic, e.g. pen or
+ * touch input reports. Polling is aborted early if the thread should stop or
+ * reschedule. While polling, wakeups of the receiver thread are skipped.
+ *
+ * Return: Returns %true if new data has arrived while polling, %false if
+ * polling is disabled or no new data has arrived within the poll window.
+ */
+static bool ssh_ptl_rx_poll(struct ssh_ptl *ptl, size_t seen)
+{
+	unsigned int window = READ_ONCE(ptl_rx_poll_us);
+	ktime_t start, deadline;
+	bool found = false;
+
+	if (!window)
+		return false;
+
+	window = min_t(unsigned int, window, SSH_PTL_RX_POLL_MAX_US);
+
+	WRITE_ONCE(ptl->rx.polling, true);
+
+	start = ktime_get();
+	deadline = ktime_add_us(start, window);
+
+	do {
+		if (sshp_ring_tail(&ptl->rx.ring) != seen) {
+			found = true;
+			break;
+		}
+
+		if (kthread_should_stop() || need_resched())
+			break;
+
+		cpu_relax();
+	} while (ktime_before(ktime_get(), deadline));
 
-	return aligned.ptr - source->ptr + SSH_MESSAGE_LENGTH(payload.len);
+	WRITE_ONCE(ptl->rx.polling, false);
+
+	/*
+	 * Pairs with barrier in ssh_ptl_rx_wakeup(): Either we see data that
+	 * has been written while we were polling once we check for it before
+	 * going to sleep, or the writer sees that we are no longer polling and
+	 * wakes us up.
+	 */
+	smp_mb();
+
+	trace_ssam_rx_poll(ktime_sub(ktime_get(), start), found);
+	return found;
 }
 
 static int ssh_ptl_rx_threadfn(void *data)
 {
 	struct ssh_ptl *ptl = data;
+	bool active = false;
+	size_t seen = 0;
 
 	while (true) {
-		struct ssam_span span;
-		size_t offs = 0;
+		struct ssam_span data;
+		size_t tail;
 		size_t n;
 
-		wait_event_interruptible(ptl->rx.wq,
-					 !kfifo_is_empty(&ptl->rx.fifo) ||
-					 kthread_should_stop());
+		/* After activity, poll before going to sleep. */
+		if (!active || !ssh_ptl_rx_poll(ptl, seen)) {
+			wait_event_interruptible(ptl->rx.wq,
+						 sshp_ring_tail(&ptl->rx.ring) != seen ||
+						 kthread_should_stop());
+		}
+
 		if (kthread_should_stop())
 			break;
 
-		/* Copy from fifo to evaluation buffer. */
-		n = sshp_buf_read_from_fifo(&ptl->rx.buf, &ptl->rx.fifo);
+		active = true;
+
+		/*
+		 * Get a linear view of all buffered data. No copy is required
+		 * here as the ring buffer is mapped twice contiguously.
+		 */
+		tail = sshp_ring_span(&ptl->rx.ring, &data);
+		n = tail - seen;
+		seen = tail;
 
 		ptl_dbg(ptl, "rx: received data (size: %zu)\n", n);
 		print_hex_dump_debug("rx: ", DUMP_PREFIX_OFFSET, 16, 1,
-				     ptl->rx.buf.ptr + ptl->rx.buf.len - n,
-				     n, false);
+				     data.ptr + data.len - n, n, false);
 
-		/* Parse until we need more bytes or buffer is empty. */
-		while (offs < ptl->rx.buf.len) {
-			sshp_buf_span_from(&ptl->rx.buf, offs, &span);
-			n = ssh_ptl_rx_eval(ptl, &span);
-			if (n == 0)
-				break;	/* Need more bytes. */
-
-			offs += n;
-		}
-
-		/* Throw away the evaluated parts. */
-		sshp_buf_drop(&ptl->rx.buf, offs);
+		/* Parse and throw away the evaluated parts. */
+		n = ssh_rx_process(&ptl->rx.eval, &data);
+		sshp_ring_drop(&ptl->rx.ring, n);
 	}
 
 	return 0;
@@ -1833,6 +2128,16 @@ static int ssh_ptl_rx_threadfn(void *data)
 
 static void ssh_ptl_rx_wakeup(struct ssh_ptl *ptl)
 {
+	/*
+	 * Pairs with barrier in ssh_ptl_rx_poll(). Ensures that the receiver
+	 * either sees the new data or we see that it stopped polling.
+	 */
+	smp_mb();
+
+	/* The receiver thread will pick up new data by itself when polling. */
+	if (READ_ONCE(ptl->rx.polling))
+		return;
+
 	wake_up(&ptl->rx.wq);
 }
 
@@ -1880,7 +2185,7 @@ int ssh_ptl_rx_stop(struct ssh_ptl *ptl)
  * @buf: Pointer to the data to push to the layer.
  * @n:   Size of the data to push to the layer, in bytes.
  *
- * Pushes data from a lower-layer transport to the receiver fifo buffer of the
+ * Pushes data from a lower-layer transport to the receiver ring buffer of the
  * packet layer and notifies the receiver thread. Calls to this function are
  * ignored once the packet layer has been shut down.
  *
@@ -1894,7 +2199,10 @@ int ssh_ptl_rx_rcvbuf(struct ssh_ptl *ptl, const u8 *buf, size_t n)
 	if (test_bit(SSH_PTL_SF_SHUTDOWN_BIT, &ptl->state))
 		return -ESHUTDOWN;
 
-	used = kfifo_in(&ptl->rx.fifo, buf, n);
+	if (trace_ssam_rx_frame_dispatch_enabled())
+		atomic64_set(&ptl->rx.received, ktime_to_ns(ktime_get()));
+
+	used = sshp_ring_write(&ptl->rx.ring, buf, n);
 	if (used)
 		ssh_ptl_rx_wakeup(ptl);
 
@@ -1983,6 +2291,7 @@ void ssh_ptl_shutdown(struct ssh_ptl *ptl)
 		smp_mb__before_atomic();
 		clear_bit(SSH_PACKET_SF_PENDING_BIT, &p->state);
 
+		ssh_ptl_timeout_del(p);
 		list_move_tail(&p->pending_node, &complete_q);
 	}
 	atomic_set(&ptl->pending.count, 0);
@@ -2026,7 +2335,7 @@ void ssh_ptl_shutdown(struct ssh_ptl *ptl)
 int ssh_ptl_init(struct ssh_ptl *ptl, struct serdev_device *serdev,
 		 struct ssh_ptl_ops *ops)
 {
-	int i, status;
+	int status;
 
 	ptl->serdev = serdev;
 	ptl->state = 0;
@@ -2037,6 +2346,7 @@ int ssh_ptl_init(struct ssh_ptl *ptl, struct serdev_device *serdev,
 	spin_lock_init(&ptl->pending.lock);
 	INIT_LIST_HEAD(&ptl->pending.head);
 	atomic_set_release(&ptl->pending.count, 0);
+	ptl->pending.window = clamp_t(unsigned int, ptl_window, 1, SSH_PTL_MAX_WINDOW);
 
 	ptl->tx.thread = NULL;
 	atomic_set(&ptl->tx.running, 0);
@@ -2046,28 +2356,33 @@ int ssh_ptl_init(struct ssh_ptl *ptl, struct serdev_device *serdev,
 
 	ptl->rx.thread = NULL;
 	init_waitqueue_head(&ptl->rx.wq);
+	ptl->rx.polling = false;
+	atomic64_set(&ptl->rx.received, 0);
 
 	spin_lock_init(&ptl->rtx_timeout.lock);
-	ptl->rtx_timeout.timeout = SSH_PTL_PACKET_TIMEOUT;
+	INIT_LIST_HEAD(&ptl->rtx_timeout.head);
+	ssh_rtt_init(&ptl->rtx_timeout.rtt, SSH_PTL_PACKET_TIMEOUT_MIN,
+		     SSH_PTL_PACKET_TIMEOUT);
 	ptl->rtx_timeout.expires = KTIME_MAX;
 	INIT_DELAYED_WORK(&ptl->rtx_timeout.reaper, ssh_ptl_timeout_reap);
 
 	ptl->ops = *ops;
+	ssh_stats_reset(&ptl->stats);
+	ssh_fault_init(&ptl->faults);
 
-	/* Initialize list of recent/blocked SEQs with invalid sequence IDs. */
-	for (i = 0; i < ARRAY_SIZE(ptl->rx.blocked.seqs); i++)
-		ptl->rx.blocked.seqs[i] = U16_MAX;
-	ptl->rx.blocked.offset = 0;
+	ssh_rx_init(&ptl->rx.eval, &serdev->dev, &ssh_ptl_rx_ops);
 
-	status = kfifo_alloc(&ptl->rx.fifo, SSH_PTL_RX_FIFO_LEN, GFP_KERNEL);
-	if (status)
-		return status;
+	ptl->tx.buf = kmalloc(SSH_PTL_TX_BUF_LEN, GFP_KERNEL);
+	if (!ptl->tx.buf)
+		return -ENOMEM;
 
-	status = sshp_buf_alloc(&ptl->rx.buf, SSH_PTL_RX_BUF_LEN, GFP_KERNEL);
-	if (status)
-		kfifo_free(&ptl->rx.fifo);
+	status = sshp_ring_alloc(&ptl->rx.ring, SSH_RX_RING_LEN);
+	if (status) {
+		kfree(ptl->tx.buf);
+		return status;
+	}
 
-	return status;
+	return 0;
 }
 
 /**
@@ -2081,6 +2396,6 @@ int ssh_ptl_init(struct ssh_ptl *ptl, struct serdev_device *serdev,
  */
 void ssh_ptl_destroy(struct ssh_ptl *ptl)
 {
-	kfifo_free(&ptl->rx.fifo);
-	sshp_buf_free(&ptl->rx.buf);
+	sshp_ring_free(&ptl->rx.ring);
+	kfree(ptl->tx.buf);
 }
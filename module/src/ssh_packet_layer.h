@@ -9,7 +9,6 @@
 #define _SURFACE_AGGREGATOR_SSH_PACKET_LAYER_H
 
 #include <linux/atomic.h>
-#include <linux/kfifo.h>
 #include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/serdev.h>
@@ -19,7 +18,11 @@
 #include <linux/workqueue.h>
 
 #include "../include/linux/surface_aggregator/serial_hub.h"
+#include "ssh_fault.h"
 #include "ssh_parser.h"
+#include "ssh_receiver.h"
+#include "ssh_rtt.h"
+#include "ssh_stats.h"
 
 /**
  * enum ssh_ptl_state_flags - State-flags for &struct ssh_ptl.
@@ -53,26 +56,42 @@ struct ssh_ptl_ops {
  * @pending.lock:  Lock for modifying the pending set.
  * @pending.head:  List-head of the pending set/list.
  * @pending.count: Number of currently pending packets.
+ * @pending.window: Maximum number of concurrently pending packets, i.e. the
+ *                 transmission window size.
  * @tx:            Transmitter subsystem.
  * @tx.running:    Flag indicating (desired) transmitter thread state.
  * @tx.thread:     Transmitter thread.
  * @tx.thread_cplt_tx:  Completion for transmitter thread waiting on transfer.
  * @tx.thread_cplt_pkt: Completion for transmitter thread waiting on packets.
  * @tx.packet_wq:  Waitqueue-head for packet transmit completion.
+ * @tx.buf:        Buffer for gathering packet data into a single write. Only
+ *                 accessed by the transmitter thread.
  * @rx:            Receiver subsystem.
  * @rx.thread:     Receiver thread.
  * @rx.wq:         Waitqueue-head for receiver thread.
- * @rx.fifo:       Buffer for receiving data/pushing data to receiver thread.
- * @rx.buf:        Buffer for evaluating data on receiver thread.
- * @rx.blocked:    List of recent/blocked sequence IDs to detect retransmission.
- * @rx.blocked.seqs:   Array of blocked sequence IDs.
- * @rx.blocked.offset: Offset indicating where a new ID should be inserted.
+ * @rx.ring:       Ring buffer for receiving data/pushing data to and
+ *                 evaluating data on receiver thread.
+ * @rx.eval:       Receiver state machine, evaluating data on the receiver
+ *                 thread.
+ * @rx.polling:    Flag indicating that the receiver thread is busy-polling for
+ *                 new data and does not need to be woken up.
+ * @rx.received:   Time of the most recent data reception, in nanoseconds. Only
+ *                 updated while the frame dispatch tracepoint is enabled.
  * @rtx_timeout:   Retransmission timeout subsystem.
  * @rtx_timeout.lock:    Lock for modifying the retransmission timeout reaper.
- * @rtx_timeout.timeout: Timeout interval for retransmission.
+ * @rtx_timeout.rtt:     Round-trip time estimator, providing the timeout
+ *                       interval for retransmission.
+ * @rtx_timeout.head:    List of pending packets with running timeout, ordered
+ *                       by their transmission timestamp and thus expiration
+ *                       date. Guarded by the pending lock.
  * @rtx_timeout.expires: Time specifying when the reaper work is next scheduled.
+ *                       Written under the timeout lock, may be read without
+ *                       it to check whether the reaper needs re-arming.
  * @rtx_timeout.reaper:  Work performing timeout checks and subsequent actions.
  * @ops:           Packet layer operations.
+ * @stats:         Transport statistics, shared with the request layer.
+ * @faults:        Fault injection rates and recovery statistics, shared with
+ *                 the request layer. Empty unless error injection is enabled.
  */
 struct ssh_ptl {
 	struct serdev_device *serdev;
@@ -87,6 +106,7 @@ struct ssh_ptl {
 		spinlock_t lock;
 		struct list_head head;
 		atomic_t count;
+		unsigned int window;
 	} pending;
 
 	struct {
@@ -95,28 +115,30 @@ struct ssh_ptl {
 		struct completion thread_cplt_tx;
 		struct completion thread_cplt_pkt;
 		struct wait_queue_head packet_wq;
+		u8 *buf;
 	} tx;
 
 	struct {
 		struct task_struct *thread;
 		struct wait_queue_head wq;
-		struct kfifo fifo;
-		struct sshp_buf buf;
+		struct sshp_ring ring;
+		struct ssh_rx eval;
 
-		struct {
-			u16 seqs[8];
-			u16 offset;
-		} blocked;
+		bool polling;
+		atomic64_t received;
 	} rx;
 
 	struct {
 		spinlock_t lock;
-		ktime_t timeout;
+		struct ssh_rtt rtt;
+		struct list_head head;
 		ktime_t expires;
 		struct delayed_work reaper;
 	} rtx_timeout;
 
 	struct ssh_ptl_ops ops;
+	struct ssh_stats stats;
+	struct ssh_faults faults;
 };
 
 #define __ssam_prcond(func, p, fmt, ...)		\
@@ -11,6 +11,7 @@
 #include <linux/types.h>
 
 #include "../include/linux/surface_aggregator/serial_hub.h"
+#include "ssh_crc.h"
 #include "ssh_parser.h"
 
 /**
@@ -28,7 +29,7 @@
  */
 static bool sshp_validate_crc(const struct ssam_span *src, const u8 *crc)
 {
-	u16 actual = ssh_crc(src->ptr, src->len);
+	u16 actual = ssh_crc_fast(src->ptr, src->len);
 	u16 expected = get_unaligned_le16(crc);
 
 	return actual == expected;
@@ -68,18 +69,51 @@ static bool sshp_starts_with_syn(const struct ssam_span *src)
  */
 bool sshp_find_syn(const struct ssam_span *src, struct ssam_span *rem)
 {
+	const unsigned long ones = ~0ul / 0xff;
+	const unsigned long pattern = ones * (SSH_MSG_SYN & 0xff);
+	const u8 lo = SSH_MSG_SYN & 0xff;
+	const u8 hi = SSH_MSG_SYN >> 8;
+	const u8 *end = src->ptr + src->len;
+	const u8 *p = src->ptr;
+	unsigned long x;
 	size_t i;
 
-	for (i = 0; i < src->len - 1; i++) {
-		if (likely(get_unaligned_le16(src->ptr + i) == SSH_MSG_SYN)) {
-			rem->ptr = src->ptr + i;
-			rem->len = src->len - i;
-			return true;
+	if (unlikely(!src->len)) {
+		rem->ptr = src->ptr;
+		rem->len = 0;
+		return false;
+	}
+
+	/*
+	 * Scan word-at-a-time for the first SYN byte: XOR-ing with the pattern
+	 * turns matching bytes into zero bytes, which we can detect for the
+	 * whole word at once. The zero-byte test may report false positives
+	 * (never false negatives), so check candidate words byte-wise. Stop
+	 * one word before the end so that the second SYN byte can always be
+	 * accessed inside the word loop.
+	 */
+	while (p + sizeof(unsigned long) < end) {
+		x = get_unaligned((const unsigned long *)p) ^ pattern;
+
+		if (likely(!((x - ones) & ~x & (ones << 7)))) {
+			p += sizeof(unsigned long);
+			continue;
 		}
+
+		for (i = 0; i < sizeof(unsigned long); i++, p++) {
+			if (p[0] == lo && p[1] == hi)
+				goto found;
+		}
+	}
+
+	/* Handle the remaining tail byte-wise. */
+	for (; p + 1 < end; p++) {
+		if (p[0] == lo && p[1] == hi)
+			goto found;
 	}
 
-	if (unlikely(src->ptr[src->len - 1] == (SSH_MSG_SYN & 0xff))) {
-		rem->ptr = src->ptr + src->len - 1;
+	if (unlikely(*p == lo)) {
+		rem->ptr = (u8 *)p;
 		rem->len = 1;
 		return false;
 	}
@@ -87,6 +121,11 @@ bool sshp_find_syn(const struct ssam_span *src, struct ssam_span *rem)
 	rem->ptr = src->ptr + src->len;
 	rem->len = 0;
 	return false;
+
+found:
+	rem->ptr = (u8 *)p;
+	rem->len = end - p;
+	return true;
 }
 
 /**
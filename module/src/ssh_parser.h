@@ -8,137 +8,116 @@
 #ifndef _SURFACE_AGGREGATOR_SSH_PARSER_H
 #define _SURFACE_AGGREGATOR_SSH_PARSER_H
 
+#include <asm/barrier.h>
 #include <linux/device.h>
-#include <linux/kfifo.h>
-#include <linux/slab.h>
+#include <linux/minmax.h>
+#include <linux/mm_types.h>
+#include <linux/string.h>
 #include <linux/types.h>
 
 #include "../include/linux/surface_aggregator/serial_hub.h"
 
 /**
- * struct sshp_buf - Parser buffer for SSH messages.
- * @ptr: Pointer to the beginning of the buffer.
- * @len: Number of bytes used in the buffer.
- * @cap: Maximum capacity of the buffer.
+ * struct sshp_ring - Mirrored ring buffer for SSH message parsing.
+ * @ptr:   Pointer to the beginning of the mirrored mapping. The mapping covers
+ *         twice the capacity, with the second half mapping the same pages as
+ *         the first one.
+ * @pages: Pages backing the buffer.
+ * @cap:   Capacity of the buffer in bytes. Always a power of two and a
+ *         multiple of %PAGE_SIZE.
+ * @head:  Free-running read counter. Only modified by the consumer.
+ * @tail:  Free-running write counter. Only modified by the producer.
+ *
+ * Single-producer, single-consumer ring buffer. As the backing pages are
+ * mapped twice in a row, any valid region of the buffer can be accessed as
+ * one contiguous memory span, regardless of where it wraps around. This
+ * allows the parser to operate directly on the ring buffer data, without
+ * having to copy it to a separate linear evaluation buffer first.
  */
-struct sshp_buf {
-	u8    *ptr;
-	size_t len;
+struct sshp_ring {
+	u8 *ptr;
+	struct page **pages;
 	size_t cap;
+	size_t head;
+	size_t tail;
 };
 
-/**
- * sshp_buf_init() - Initialize a SSH parser buffer.
- * @buf: The buffer to initialize.
- * @ptr: The memory backing the buffer.
- * @cap: The length of the memory backing the buffer, i.e. its capacity.
- *
- * Initializes the buffer with the given memory as backing and set its used
- * length to zero.
- */
-static inline void sshp_buf_init(struct sshp_buf *buf, u8 *ptr, size_t cap)
-{
-	buf->ptr = ptr;
-	buf->len = 0;
-	buf->cap = cap;
-}
+int sshp_ring_alloc(struct sshp_ring *ring, size_t cap);
+void sshp_ring_free(struct sshp_ring *ring);
 
 /**
- * sshp_buf_alloc() - Allocate and initialize a SSH parser buffer.
- * @buf:   The buffer to initialize/allocate to.
- * @cap:   The desired capacity of the buffer.
- * @flags: The flags used for allocating the memory.
+ * sshp_ring_write() - Write data to the ring buffer.
+ * @ring: The ring buffer to write to.
+ * @buf:  The data to write.
+ * @n:    The number of bytes to write.
  *
- * Allocates @cap bytes and initializes the provided buffer struct with the
- * allocated memory.
+ * Writes as much of the given data as fits into the ring buffer. Must only be
+ * called by the (single) producer.
  *
- * Return: Returns zero on success and %-ENOMEM if allocation failed.
+ * Return: Returns the number of bytes written.
  */
-static inline int sshp_buf_alloc(struct sshp_buf *buf, size_t cap, gfp_t flags)
+static inline size_t sshp_ring_write(struct sshp_ring *ring, const u8 *buf,
+				     size_t n)
 {
-	u8 *ptr;
+	/* Pairs with release in sshp_ring_drop(). */
+	size_t head = smp_load_acquire(&ring->head);
+	size_t tail = ring->tail;
 
-	ptr = kzalloc(cap, flags);
-	if (!ptr)
-		return -ENOMEM;
+	n = min(n, ring->cap - (tail - head));
+	memcpy(ring->ptr + (tail & (ring->cap - 1)), buf, n);
 
-	sshp_buf_init(buf, ptr, cap);
-	return 0;
-}
-
-/**
- * sshp_buf_free() - Free a SSH parser buffer.
- * @buf: The buffer to free.
- *
- * Frees a SSH parser buffer by freeing the memory backing it and then
- * resetting its pointer to %NULL and length and capacity to zero. Intended to
- * free a buffer previously allocated with sshp_buf_alloc().
- */
-static inline void sshp_buf_free(struct sshp_buf *buf)
-{
-	kfree(buf->ptr);
-	buf->ptr = NULL;
-	buf->len = 0;
-	buf->cap = 0;
+	/* Pairs with acquire in sshp_ring_span() and sshp_ring_tail(). */
+	smp_store_release(&ring->tail, tail + n);
+	return n;
 }
 
 /**
- * sshp_buf_drop() - Drop data from the beginning of the buffer.
- * @buf: The buffer to drop data from.
- * @n:   The number of bytes to drop.
+ * sshp_ring_tail() - Get the current write counter of the ring buffer.
+ * @ring: The ring buffer.
  *
- * Drops the first @n bytes from the buffer. Re-aligns any remaining data to
- * the beginning of the buffer.
+ * Return: Returns the free-running write counter, i.e. the total number of
+ * bytes written to the ring buffer so far (modulo overflow).
  */
-static inline void sshp_buf_drop(struct sshp_buf *buf, size_t n)
+static inline size_t sshp_ring_tail(struct sshp_ring *ring)
 {
-	memmove(buf->ptr, buf->ptr + n, buf->len - n);
-	buf->len -= n;
+	return smp_load_acquire(&ring->tail);
 }
 
 /**
- * sshp_buf_read_from_fifo() - Transfer data from a fifo to the buffer.
- * @buf:  The buffer to write the data into.
- * @fifo: The fifo to read the data from.
+ * sshp_ring_span() - Get a span covering all readable data.
+ * @ring: The ring buffer.
+ * @span: The span to initialize (output).
  *
- * Transfers the data contained in the fifo to the buffer, removing it from
- * the fifo. This function will try to transfer as much data as possible,
- * limited either by the remaining space in the buffer or by the number of
- * bytes available in the fifo.
+ * Initializes the provided span to cover all data currently available for
+ * reading in the ring buffer as one contiguous region. The span stays valid
+ * until the data is dropped via sshp_ring_drop(). Must only be called by the
+ * (single) consumer.
  *
- * Return: Returns the number of bytes transferred.
+ * Return: Returns the write counter corresponding to the end of the span.
  */
-static inline size_t sshp_buf_read_from_fifo(struct sshp_buf *buf,
-					     struct kfifo *fifo)
+static inline size_t sshp_ring_span(struct sshp_ring *ring,
+				    struct ssam_span *span)
 {
-	size_t n;
+	size_t tail = sshp_ring_tail(ring);
 
-	n =  kfifo_out(fifo, buf->ptr + buf->len, buf->cap - buf->len);
-	buf->len += n;
+	span->ptr = ring->ptr + (ring->head & (ring->cap - 1));
+	span->len = tail - ring->head;
 
-	return n;
+	return tail;
 }
 
 /**
- * sshp_buf_span_from() - Initialize a span from the given buffer and offset.
- * @buf:    The buffer to create the span from.
- * @offset: The offset in the buffer at which the span should start.
- * @span:   The span to initialize (output).
- *
- * Initializes the provided span to point to the memory at the given offset in
- * the buffer, with the length of the span being capped by the number of bytes
- * used in the buffer after the offset (i.e. bytes remaining after the
- * offset).
+ * sshp_ring_drop() - Drop data from the beginning of the ring buffer.
+ * @ring: The ring buffer.
+ * @n:    The number of bytes to drop.
  *
- * Warning: This function does not validate that @offset is less than or equal
- * to the number of bytes used in the buffer or the buffer capacity. This must
- * be guaranteed by the caller.
+ * Drops the first @n bytes of readable data, freeing up the space for the
+ * producer. Must only be called by the (single) consumer.
  */
-static inline void sshp_buf_span_from(struct sshp_buf *buf, size_t offset,
-				      struct ssam_span *span)
+static inline void sshp_ring_drop(struct sshp_ring *ring, size_t n)
 {
-	span->ptr = buf->ptr + offset;
-	span->len = buf->len - offset;
+	/* Pairs with acquire in sshp_ring_write(). */
+	smp_store_release(&ring->head, ring->head + n);
 }
 
 bool sshp_find_syn(const struct ssam_span *src, struct ssam_span *rem);
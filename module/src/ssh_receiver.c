@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * SSH receiver state machine.
+ *
+ * Copyright (C) 2019-2022 Maximilian Luz <luzmaximilian@gmail.com>
+ */
+
+#include <linux/compiler.h>
+#include <linux/device.h>
+#include <linux/limits.h>
+#include <linux/types.h>
+
+#include "../include/linux/surface_aggregator/serial_hub.h"
+#include "ssh_parser.h"
+#include "ssh_receiver.h"
+
+/**
+ * ssh_rx_init() - Initialize the SSH receiver state machine.
+ * @rx:  The receiver to initialize.
+ * @dev: The device used for logging.
+ * @ops: The receiver callback operations.
+ */
+void ssh_rx_init(struct ssh_rx *rx, const struct device *dev,
+		 const struct ssh_rx_ops *ops)
+{
+	unsigned int i;
+
+	rx->dev = dev;
+	rx->ops = ops;
+
+	for (i = 0; i < ARRAY_SIZE(rx->blocked.seqs); i++)
+		rx->blocked.seqs[i] = U16_MAX;
+	rx->blocked.offset = 0;
+}
+
+static bool ssh_rx_retransmit_check(struct ssh_rx *rx, const struct ssh_frame *frame)
+{
+	unsigned int i;
+
+	/*
+	 * Ignore unsequenced packets. On some devices (notably Surface Pro 9),
+	 * unsequenced events will always be sent with SEQ=0x00. Attempting to
+	 * detect retransmission would thus just block all events.
+	 *
+	 * While sequence numbers would also allow detection of retransmitted
+	 * packets in unsequenced communication, they have only ever been used
+	 * to cover edge-cases in sequenced transmission. In particular, the
+	 * only instance of packets being retransmitted (that we are aware of)
+	 * is due to an ACK timeout. As this does not happen in unsequenced
+	 * communication, skip the retransmission check for those packets
+	 * entirely.
+	 */
+	if (frame->type == SSH_FRAME_TYPE_DATA_NSQ)
+		return false;
+
+	/*
+	 * Check if SEQ has been seen recently (i.e. packet was
+	 * re-transmitted and we should ignore it).
+	 */
+	for (i = 0; i < ARRAY_SIZE(rx->blocked.seqs); i++) {
+		if (likely(rx->blocked.seqs[i] != frame->seq))
+			continue;
+
+		dev_dbg(rx->dev, "ptl: ignoring repeated data packet\n");
+		return true;
+	}
+
+	/* Update list of blocked sequence IDs. */
+	rx->blocked.seqs[rx->blocked.offset] = frame->seq;
+	rx->blocked.offset = (rx->blocked.offset + 1)
+			     % ARRAY_SIZE(rx->blocked.seqs);
+
+	return false;
+}
+
+static void ssh_rx_dataframe(struct ssh_rx *rx, const struct ssh_frame *frame,
+			     const struct ssam_span *payload)
+{
+	if (ssh_rx_retransmit_check(rx, frame)) {
+		rx->ops->data_repeated(rx, frame);
+		return;
+	}
+
+	rx->ops->data_received(rx, payload);
+}
+
+/**
+ * ssh_rx_eval() - Evaluate the next message in the received data.
+ * @rx:     The receiver.
+ * @source: The received data, starting at the expected begin of a message.
+ *
+ * Searches the provided data for the next message, parses and validates its
+ * frame, and dispatches it via the receiver callbacks. Unexpected data in
+ * front of the message and invalid frames are skipped.
+ *
+ * Return: Returns the number of bytes that have been evaluated and can be
+ * dropped, or zero if more data is required to evaluate the next message.
+ */
+size_t ssh_rx_eval(struct ssh_rx *rx, struct ssam_span *source)
+{
+	struct ssh_frame *frame;
+	struct ssam_span payload;
+	struct ssam_span aligned;
+	bool syn_found;
+	int status;
+
+	/* Error injection: Modify data to simulate corrupt SYN bytes. */
+	if (rx->ops->inject_syn)
+		rx->ops->inject_syn(rx, source);
+
+	/* Find SYN. */
+	syn_found = sshp_find_syn(source, &aligned);
+
+	if (unlikely(aligned.ptr != source->ptr)) {
+		/*
+		 * We expect aligned.ptr == source->ptr. If this is not the
+		 * case, then aligned.ptr > source->ptr and we've encountered
+		 * some unexpected data where we'd expect the start of a new
+		 * message (i.e. the SYN sequence).
+		 *
+		 * This can happen when a CRC check for the previous message
+		 * failed and we start actively searching for the next one
+		 * (via the call to sshp_find_syn() above), or the first bytes
+		 * of a message got dropped or corrupted.
+		 *
+		 * In any case, we issue a warning, send a NAK to the EC to
+		 * request re-transmission of any data we haven't acknowledged
+		 * yet, and finally, skip everything up to the next SYN
+		 * sequence.
+		 */
+
+		dev_warn(rx->dev, "rx: parser: invalid start of frame, skipping\n");
+
+		/*
+		 * Notes:
+		 * - This might send multiple NAKs in case the communication
+		 *   starts with an invalid SYN and is broken down into multiple
+		 *   pieces. This should generally be handled fine, we just
+		 *   might receive duplicate data in this case, which is
+		 *   detected when handling data frames.
+		 * - This path will also be executed on invalid CRCs: When an
+		 *   invalid CRC is encountered, the code below will skip data
+		 *   until directly after the SYN. This causes the search for
+		 *   the next SYN, which is generally not placed directly after
+		 *   the last one.
+		 *
+		 *   Open question: Should we send this in case of invalid
+		 *   payload CRCs if the frame-type is non-sequential (current
+		 *   implementation) or should we drop that frame without
+		 *   telling the EC?
+		 */
+		rx->ops->resync(rx, source, aligned.ptr - source->ptr);
+	}
+
+	if (unlikely(!syn_found))
+		return aligned.ptr - source->ptr;
+
+	/* Error injection: Modify data to simulate corruption. */
+	if (rx->ops->inject_frame)
+		rx->ops->inject_frame(rx, &aligned);
+
+	/* Parse and validate frame. */
+	status = sshp_parse_frame(rx->dev, &aligned, &frame, &payload,
+				  SSH_RX_BUF_LEN);
+	if (status) {	/* Invalid frame: skip to next SYN. */
+		rx->ops->frame_invalid(rx, status);
+		return aligned.ptr - source->ptr + sizeof(u16);
+	}
+	if (!frame)	/* Not enough data. */
+		return aligned.ptr - source->ptr;
+
+	rx->ops->frame_received(rx, frame, &payload);
+
+	switch (frame->type) {
+	case SSH_FRAME_TYPE_ACK:
+		rx->ops->ack_received(rx, frame->seq);
+		break;
+
+	case SSH_FRAME_TYPE_NAK:
+		rx->ops->nak_received(rx);
+		break;
+
+	case SSH_FRAME_TYPE_DATA_SEQ:
+		rx->ops->send_ack(rx, frame->seq);
+		fallthrough;
+
+	case SSH_FRAME_TYPE_DATA_NSQ:
+		ssh_rx_dataframe(rx, frame, &payload);
+		break;
+
+	default:
+		dev_warn(rx->dev, "ptl: received frame with unknown type %#04x\n",
+			 frame->type);
+		break;
+	}
+
+	return aligned.ptr - source->ptr + SSH_MESSAGE_LENGTH(payload.len);
+}
+
+/**
+ * ssh_rx_process() - Evaluate all complete messages in the received data.
+ * @rx:   The receiver.
+ * @data: All currently buffered received data.
+ *
+ * Evaluates messages via ssh_rx_eval() until either more data is required or
+ * all data has been evaluated.
+ *
+ * Return: Returns the number of bytes that have been evaluated and can be
+ * dropped from the receive buffer.
+ */
+size_t ssh_rx_process(struct ssh_rx *rx, const struct ssam_span *data)
+{
+	struct ssam_span span;
+	size_t offs = 0;
+	size_t n;
+
+	/* Parse until we need more bytes or buffer is empty. */
+	while (offs < data->len) {
+		span.ptr = data->ptr + offs;
+		span.len = data->len - offs;
+
+		n = ssh_rx_eval(rx, &span);
+		if (n == 0)
+			break;	/* Need more bytes. */
+
+		offs += n;
+	}
+
+	return offs;
+}
@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * SSH receiver state machine.
+ *
+ * Copyright (C) 2019-2022 Maximilian Luz <luzmaximilian@gmail.com>
+ */
+
+#ifndef _SURFACE_AGGREGATOR_SSH_RECEIVER_H
+#define _SURFACE_AGGREGATOR_SSH_RECEIVER_H
+
+#include <linux/device.h>
+#include <linux/types.h>
+
+#include "../include/linux/surface_aggregator/serial_hub.h"
+
+/*
+ * SSH_RX_BUF_LEN - Maximum length of a single received message in bytes.
+ */
+#define SSH_RX_BUF_LEN			4096
+
+/*
+ * SSH_RX_RING_LEN - Receiver ring-buffer size in bytes.
+ *
+ * Must be larger than SSH_RX_BUF_LEN, so that the receiver can always buffer
+ * a complete message of maximum length in addition to (part of) the next one.
+ */
+#define SSH_RX_RING_LEN			8192
+
+struct ssh_rx;
+
+/**
+ * struct ssh_rx_ops - Callback operations for the SSH receiver.
+ * @inject_syn:     Optional. Error injection: Called with the remaining data
+ *                  before searching it for the next SYN sequence. May modify
+ *                  the data.
+ * @inject_frame:   Optional. Error injection: Called with the SYN-aligned
+ *                  remaining data before parsing a frame from it. May modify
+ *                  the data.
+ * @resync:         Called when unexpected data has been found in place of a
+ *                  SYN sequence, with the data searched for the SYN sequence
+ *                  and the number of bytes to be skipped. Should request
+ *                  re-transmission of any unacknowledged data via NAK.
+ * @frame_invalid:  Called when a frame has failed validation, with the error
+ *                  code returned by sshp_parse_frame(). The receiver skips to
+ *                  the next SYN sequence afterwards.
+ * @frame_received: Called for each valid frame and its payload, before it is
+ *                  dispatched.
+ * @ack_received:   Called for each ACK frame, with its sequence ID.
+ * @nak_received:   Called for each NAK frame.
+ * @send_ack:       Called for each sequenced data frame, with the sequence ID
+ *                  to acknowledge. Called before retransmission detection, so
+ *                  that re-transmitted frames are acknowledged again.
+ * @data_repeated:  Called for each data frame ignored as re-transmission of a
+ *                  recently received frame.
+ * @data_received:  Called for each new data frame, with its payload.
+ */
+struct ssh_rx_ops {
+	void (*inject_syn)(struct ssh_rx *rx, struct ssam_span *data);
+	void (*inject_frame)(struct ssh_rx *rx, struct ssam_span *data);
+	void (*resync)(struct ssh_rx *rx, const struct ssam_span *data, size_t skip);
+	void (*frame_invalid)(struct ssh_rx *rx, int status);
+	void (*frame_received)(struct ssh_rx *rx, const struct ssh_frame *frame,
+			       const struct ssam_span *payload);
+	void (*ack_received)(struct ssh_rx *rx, u8 seq);
+	void (*nak_received)(struct ssh_rx *rx);
+	void (*send_ack)(struct ssh_rx *rx, u8 seq);
+	void (*data_repeated)(struct ssh_rx *rx, const struct ssh_frame *frame);
+	void (*data_received)(struct ssh_rx *rx, const struct ssam_span *payload);
+};
+
+/**
+ * struct ssh_rx - SSH receiver state machine.
+ * @dev:            Device used for logging.
+ * @ops:            Receiver callback operations.
+ * @blocked:        List of recent/blocked sequence IDs to detect retransmission.
+ * @blocked.seqs:   Array of blocked sequence IDs.
+ * @blocked.offset: Offset indicating where a new ID should be inserted.
+ *
+ * Evaluates received raw data, i.e. searches for, parses, and validates
+ * frames, and dispatches them via the provided callbacks. Does not perform
+ * any buffering, locking, or transmission by itself, so that it can be run
+ * independently of the packet transport layer, e.g. to replay captured data.
+ */
+struct ssh_rx {
+	const struct device *dev;
+	const struct ssh_rx_ops *ops;
+
+	struct {
+		u16 seqs[8];
+		u16 offset;
+	} blocked;
+};
+
+void ssh_rx_init(struct ssh_rx *rx, const struct device *dev,
+		 const struct ssh_rx_ops *ops);
+
+size_t ssh_rx_eval(struct ssh_rx *rx, struct ssam_span *source);
+size_t ssh_rx_process(struct ssh_rx *rx, const struct ssam_span *data);
+
+#endif /* _SURFACE_AGGREGATOR_SSH_RECEIVER_H */
@@ -12,6 +12,7 @@
 #include <linux/ktime.h>
 #include <linux/limits.h>
 #include <linux/list.h>
+#include <linux/lockdep.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/types.h>
@@ -35,6 +36,17 @@
  */
 #define SSH_RTL_REQUEST_TIMEOUT			ms_to_ktime(3000)
 
+/*
+ * SSH_RTL_REQUEST_TIMEOUT_MIN - Minimum request timeout.
+ *
+ * Lower bound for the timeout derived from the measured response times. The
+ * actual timeout adapts to these measurements, with SSH_RTL_REQUEST_TIMEOUT
+ * as upper bound and initial value. As requests are not re-transmitted on
+ * timeout but fail, and some commands take considerably longer to be
+ * processed by the EC than others, this bound is chosen conservatively.
+ */
+#define SSH_RTL_REQUEST_TIMEOUT_MIN		ms_to_ktime(1000)
+
 /*
  * SSH_RTL_REQUEST_TIMEOUT_RESOLUTION - Request timeout granularity.
  *
@@ -59,6 +71,15 @@
  */
 #define SSH_RTL_TX_BATCH		10
 
+/*
+ * SSH_RTL_PRIO_MAX_SKIP - Maximum number of times requests of a priority
+ * class may be passed over in favor of other classes.
+ *
+ * Once exceeded, the next request of that class is transmitted regardless of
+ * requests of higher priority, ensuring that lower classes are not starved.
+ */
+#define SSH_RTL_PRIO_MAX_SKIP		8
+
 #ifdef CONFIG_SURFACE_AGGREGATOR_ERROR_INJECTION
 
 /**
@@ -97,6 +118,33 @@ static u32 ssh_request_get_rqid_safe(struct ssh_request *rqst)
 	return ssh_request_get_rqid(rqst);
 }
 
+static u8 ssh_request_get_tc(struct ssh_request *rqst)
+{
+	return rqst->packet.data.ptr[SSH_MSGOFFSET_COMMAND(tc)];
+}
+
+static void ssh_rtl_stats_record(struct ssh_rtl *rtl, struct ssh_request *rqst,
+				 enum ssh_stats_hist hist, ktime_t start,
+				 ktime_t end)
+{
+	/* Flush requests do not carry any message data. */
+	if (test_bit(SSH_REQUEST_TY_FLUSH_BIT, &rqst->state))
+		return;
+
+	ssh_stats_record(&rtl->ptl.stats, hist, ssh_request_get_tc(rqst),
+			 start, end);
+}
+
+static void __ssh_rtl_queue_del(struct ssh_rtl *rtl, struct ssh_request *rqst)
+{
+	lockdep_assert_held(&rtl->queue.lock);
+
+	if (test_bit(SSH_REQUEST_TY_FLUSH_BIT, &rqst->state))
+		rtl->queue.flushes--;
+
+	list_del(&rqst->node);
+}
+
 static void ssh_rtl_queue_remove(struct ssh_request *rqst)
 {
 	struct ssh_rtl *rtl = ssh_request_rtl(rqst);
@@ -108,7 +156,7 @@ static void ssh_rtl_queue_remove(struct ssh_request *rqst)
 		return;
 	}
 
-	list_del(&rqst->node);
+	__ssh_rtl_queue_del(rtl, rqst);
 
 	spin_unlock(&rtl->queue.lock);
 	ssh_request_put(rqst);
@@ -116,15 +164,24 @@ static void ssh_rtl_queue_remove(struct ssh_request *rqst)
 
 static bool ssh_rtl_queue_empty(struct ssh_rtl *rtl)
 {
-	bool empty;
+	bool empty = true;
+	int prio;
 
 	spin_lock(&rtl->queue.lock);
-	empty = list_empty(&rtl->queue.head);
+	for (prio = 0; prio < SSH_REQUEST_NUM_PRIO; prio++)
+		empty = empty && list_empty(&rtl->queue.head[prio]);
 	spin_unlock(&rtl->queue.lock);
 
 	return empty;
 }
 
+/* Must be called with pending lock held. */
+static void ssh_rtl_timeout_del(struct ssh_request *rqst)
+{
+	lockdep_assert_held(&ssh_request_rtl(rqst)->pending.lock);
+	list_del_init(&rqst->timeout_node);
+}
+
 static void ssh_rtl_pending_remove(struct ssh_request *rqst)
 {
 	struct ssh_rtl *rtl = ssh_request_rtl(rqst);
@@ -138,6 +195,7 @@ static void ssh_rtl_pending_remove(struct ssh_request *rqst)
 
 	atomic_dec(&rtl->pending.count);
 	list_del(&rqst->node);
+	ssh_rtl_timeout_del(rqst);
 
 	spin_unlock(&rtl->pending.lock);
 
@@ -185,12 +243,23 @@ static void ssh_rtl_complete_with_rsp(struct ssh_request *rqst,
 				      const struct ssam_span *data)
 {
 	struct ssh_rtl *rtl = ssh_request_rtl(rqst);
+	ktime_t now = ktime_get();
 
 	trace_ssam_request_complete(rqst, 0);
 
 	rtl_dbg(rtl, "rtl: completing request with response (rqid: %#06x)\n",
 		ssh_request_get_rqid(rqst));
 
+	ssh_rtl_stats_record(rtl, rqst, SSH_STATS_HIST_RSP, rqst->stats.acked,
+			     now);
+	ssh_rtl_stats_record(rtl, rqst, SSH_STATS_HIST_TOTAL,
+			     rqst->stats.submitted, now);
+
+	/* The request timeout is armed on ACK, so sample from there. */
+	if (rqst->stats.acked != KTIME_MAX)
+		ssh_rtt_sample(&rtl->rtx_timeout.rtt,
+			       ktime_sub(now, rqst->stats.acked));
+
 	rqst->ops->complete(rqst, cmd, data, 0);
 }
 
@@ -204,35 +273,140 @@ static bool ssh_rtl_tx_can_process(struct ssh_request *rqst)
 	return atomic_read(&rtl->pending.count) < SSH_RTL_MAX_PENDING;
 }
 
-static struct ssh_request *ssh_rtl_tx_next(struct ssh_rtl *rtl)
+static struct ssh_request *ssh_rtl_queue_peek(struct ssh_rtl *rtl, int prio)
 {
-	struct ssh_request *rqst = ERR_PTR(-ENOENT);
-	struct ssh_request *p, *n;
+	struct ssh_request *p;
 
-	spin_lock(&rtl->queue.lock);
+	lockdep_assert_held(&rtl->queue.lock);
 
-	/* Find first non-locked request and remove it. */
-	list_for_each_entry_safe(p, n, &rtl->queue.head, node) {
-		if (unlikely(test_bit(SSH_REQUEST_SF_LOCKED_BIT, &p->state)))
-			continue;
+	/* Find first non-locked request. */
+	list_for_each_entry(p, &rtl->queue.head[prio], node) {
+		if (likely(!test_bit(SSH_REQUEST_SF_LOCKED_BIT, &p->state)))
+			return p;
+	}
+
+	return NULL;
+}
+
+/* Test if request a has been submitted before request b. */
+static bool ssh_rtl_queue_before(const struct ssh_request *a,
+				 const struct ssh_request *b)
+{
+	return (s32)(a->seq - b->seq) < 0;
+}
+
+/* Find the oldest queued flush request, if any. */
+static struct ssh_request *ssh_rtl_queue_peek_flush(struct ssh_rtl *rtl)
+{
+	struct ssh_request *flush = NULL;
+	struct ssh_request *p;
+	int prio;
+
+	lockdep_assert_held(&rtl->queue.lock);
+
+	if (likely(!rtl->queue.flushes))
+		return NULL;
+
+	for (prio = 0; prio < SSH_REQUEST_NUM_PRIO; prio++) {
+		/* Queues are ordered by submission, so the first one is oldest. */
+		list_for_each_entry(p, &rtl->queue.head[prio], node) {
+			if (!test_bit(SSH_REQUEST_TY_FLUSH_BIT, &p->state))
+				continue;
+
+			if (test_bit(SSH_REQUEST_SF_LOCKED_BIT, &p->state))
+				continue;
+
+			if (!flush || ssh_rtl_queue_before(p, flush))
+				flush = p;
 
-		if (!ssh_rtl_tx_can_process(p)) {
-			rqst = ERR_PTR(-EBUSY);
 			break;
 		}
+	}
 
-		/* Remove from queue and mark as transmitting. */
-		set_bit(SSH_REQUEST_SF_TRANSMITTING_BIT, &p->state);
-		/* Ensure state never gets zero. */
-		smp_mb__before_atomic();
-		clear_bit(SSH_REQUEST_SF_QUEUED_BIT, &p->state);
+	return flush;
+}
 
-		list_del(&p->node);
+/*
+ * Select the priority class from which the next request is transmitted.
+ *
+ * Prefers higher classes, unless a lower class has been passed over too
+ * often. Flush requests act as barrier: While a flush request is queued,
+ * regardless of its position in its queue, only requests submitted before
+ * it are eligible, subject to the same rules. The flush request itself is
+ * selected once no such request is left, at which point it is at the head
+ * of its queue. As only a limited number of requests can have been
+ * submitted before the flush, it cannot be starved.
+ */
+static int ssh_rtl_queue_select(struct ssh_rtl *rtl,
+				struct ssh_request *const head[])
+{
+	struct ssh_request *flush = ssh_rtl_queue_peek_flush(rtl);
+	bool eligible[SSH_REQUEST_NUM_PRIO];
+	int prio, sel = -1;
 
-		rqst = p;
-		break;
+	lockdep_assert_held(&rtl->queue.lock);
+
+	for (prio = 0; prio < SSH_REQUEST_NUM_PRIO; prio++)
+		eligible[prio] = head[prio] && (!flush || ssh_rtl_queue_before(head[prio], flush));
+
+	for (prio = 0; prio < SSH_REQUEST_NUM_PRIO; prio++) {
+		if (eligible[prio] && rtl->queue.skipped[prio] >= SSH_RTL_PRIO_MAX_SKIP) {
+			sel = prio;
+			break;
+		}
 	}
 
+	for (prio = 0; prio < SSH_REQUEST_NUM_PRIO && sel < 0; prio++) {
+		if (eligible[prio])
+			sel = prio;
+	}
+
+	if (sel < 0 && flush)
+		sel = flush->prio;
+
+	return sel;
+}
+
+static struct ssh_request *ssh_rtl_tx_next(struct ssh_rtl *rtl)
+{
+	struct ssh_request *head[SSH_REQUEST_NUM_PRIO];
+	struct ssh_request *rqst;
+	int prio, sel;
+
+	spin_lock(&rtl->queue.lock);
+
+	for (prio = 0; prio < SSH_REQUEST_NUM_PRIO; prio++)
+		head[prio] = ssh_rtl_queue_peek(rtl, prio);
+
+	sel = ssh_rtl_queue_select(rtl, head);
+	if (sel < 0) {
+		rqst = ERR_PTR(-ENOENT);
+		goto out;
+	}
+
+	rqst = head[sel];
+	if (!ssh_rtl_tx_can_process(rqst)) {
+		rqst = ERR_PTR(-EBUSY);
+		goto out;
+	}
+
+	/* Remove from queue and mark as transmitting. */
+	set_bit(SSH_REQUEST_SF_TRANSMITTING_BIT, &rqst->state);
+	/* Ensure state never gets zero. */
+	smp_mb__before_atomic();
+	clear_bit(SSH_REQUEST_SF_QUEUED_BIT, &rqst->state);
+
+	__ssh_rtl_queue_del(rtl, rqst);
+
+	/* Update starvation counters. */
+	for (prio = 0; prio < SSH_REQUEST_NUM_PRIO; prio++) {
+		if (prio == sel)
+			rtl->queue.skipped[prio] = 0;
+		else if (head[prio])
+			rtl->queue.skipped[prio]++;
+	}
+
+out:
 	spin_unlock(&rtl->queue.lock);
 	return rqst;
 }
@@ -302,17 +476,40 @@ static int ssh_rtl_tx_try_process_one(struct ssh_rtl *rtl)
 	return 0;
 }
 
-static bool ssh_rtl_tx_schedule(struct ssh_rtl *rtl)
+static bool __ssh_rtl_tx_schedule(struct ssh_rtl *rtl, bool queued)
 {
+	/*
+	 * Fast path for submission: If the work item is already pending, i.e.
+	 * has been queued but has not started executing yet, it will pick up
+	 * all requests queued before this call. The pending bit is cleared
+	 * before the work function runs, which then acquires the queue lock.
+	 * Thus, if we still observe it as set after having queued a request
+	 * under that lock, the work function is guaranteed to see the request.
+	 *
+	 * This does not hold for callers freeing up a pending slot: Nothing
+	 * orders the decrement of the pending count before the load of the
+	 * pending bit, so the work function may still see the old count and
+	 * bail out while we see the bit set. Those callers rely on the fully
+	 * ordered test-and-set in schedule_work() instead.
+	 */
+	if (queued && work_pending(&rtl->tx.work))
+		return false;
+
 	if (atomic_read(&rtl->pending.count) >= SSH_RTL_MAX_PENDING)
 		return false;
 
-	if (ssh_rtl_queue_empty(rtl))
+	/* Avoid taking the queue lock if the caller has just added to it. */
+	if (!queued && ssh_rtl_queue_empty(rtl))
 		return false;
 
 	return schedule_work(&rtl->tx.work);
 }
 
+static bool ssh_rtl_tx_schedule(struct ssh_rtl *rtl)
+{
+	return __ssh_rtl_tx_schedule(rtl, false);
+}
+
 static void ssh_rtl_tx_work_fn(struct work_struct *work)
 {
 	struct ssh_rtl *rtl = to_ssh_rtl(work, tx.work);
@@ -414,12 +611,18 @@ int ssh_rtl_submit(struct ssh_rtl *rtl, struct ssh_request *rqst)
 		return -EINVAL;
 	}
 
+	rqst->stats.submitted = ktime_get();
+	rqst->seq = rtl->queue.seq++;
+
+	if (test_bit(SSH_REQUEST_TY_FLUSH_BIT, &rqst->state))
+		rtl->queue.flushes++;
+
 	set_bit(SSH_REQUEST_SF_QUEUED_BIT, &rqst->state);
-	list_add_tail(&ssh_request_get(rqst)->node, &rtl->queue.head);
+	list_add_tail(&ssh_request_get(rqst)->node, &rtl->queue.head[rqst->prio]);
 
 	spin_unlock(&rtl->queue.lock);
 
-	ssh_rtl_tx_schedule(rtl);
+	__ssh_rtl_tx_schedule(rtl, true);
 	return 0;
 }
 
@@ -429,11 +632,24 @@ static void ssh_rtl_timeout_reaper_mod(struct ssh_rtl *rtl, ktime_t now,
 	unsigned long delta = msecs_to_jiffies(ktime_ms_delta(expires, now));
 	ktime_t aexp = ktime_add(expires, SSH_RTL_REQUEST_TIMEOUT_RESOLUTION);
 
+	/*
+	 * Fast path: The reaper is usually already scheduled to run before
+	 * the new expiration date, so we can avoid taking the lock. The caller
+	 * has added the timeout to the list under the pending lock, and the
+	 * reaper resets the expiration date before scanning that list under
+	 * the same lock. So if we observe an outdated expiration date here,
+	 * the reaper is guaranteed to see the new timeout and re-arm itself
+	 * accordingly. This requires the expiration date to be read atomically.
+	 */
+	if (IS_ENABLED(CONFIG_64BIT) &&
+	    !ktime_before(aexp, READ_ONCE(rtl->rtx_timeout.expires)))
+		return;
+
 	spin_lock(&rtl->rtx_timeout.lock);
 
 	/* Re-adjust / schedule reaper only if it is above resolution delta. */
 	if (ktime_before(aexp, rtl->rtx_timeout.expires)) {
-		rtl->rtx_timeout.expires = expires;
+		WRITE_ONCE(rtl->rtx_timeout.expires, expires);
 		mod_delayed_work(system_wq, &rtl->rtx_timeout.reaper, delta);
 	}
 
@@ -444,22 +660,42 @@ static void ssh_rtl_timeout_start(struct ssh_request *rqst)
 {
 	struct ssh_rtl *rtl = ssh_request_rtl(rqst);
 	ktime_t timestamp = ktime_get_coarse_boottime();
-	ktime_t timeout = rtl->rtx_timeout.timeout;
+	ktime_t timeout = ssh_rtt_timeout(&rtl->rtx_timeout.rtt);
+	struct ssh_request *r;
 
 	if (test_bit(SSH_REQUEST_SF_LOCKED_BIT, &rqst->state))
 		return;
 
+	spin_lock(&rtl->pending.lock);
+
+	/*
+	 * Only track requests that are still pending. Requests that have
+	 * already been removed from the pending set are being completed or
+	 * canceled and do not need a timeout any more.
+	 */
+	if (!test_bit(SSH_REQUEST_SF_PENDING_BIT, &rqst->state)) {
+		spin_unlock(&rtl->pending.lock);
+		return;
+	}
+
 	/*
 	 * Note: The timestamp gets set only once. This happens on the packet
 	 * callback. All other access to it is read-only.
 	 */
 	WRITE_ONCE(rqst->timestamp, timestamp);
+
 	/*
-	 * Ensure timestamp is set before starting the reaper. Paired with
-	 * implicit barrier following check on ssh_request_get_expiration() in
-	 * ssh_rtl_timeout_reap.
+	 * Insert into the deadline-ordered timeout list. Packet callbacks are
+	 * usually executed in order, so the insertion point is usually found
+	 * at the tail.
 	 */
-	smp_mb__after_atomic();
+	list_for_each_entry_reverse(r, &rtl->rtx_timeout.head, timeout_node) {
+		if (!ktime_after(READ_ONCE(r->timestamp), timestamp))
+			break;
+	}
+	list_add(&rqst->timeout_node, &r->timeout_node);
+
+	spin_unlock(&rtl->pending.lock);
 
 	ssh_rtl_timeout_reaper_mod(rtl, timestamp, timestamp + timeout);
 }
@@ -485,9 +721,12 @@ static void ssh_rtl_complete(struct ssh_rtl *rtl,
 			continue;
 
 		/* Simulate response timeout. */
-		if (ssh_rtl_should_drop_response()) {
+		if (ssh_fault_check(&rtl->ptl.faults, SSH_FAULT_DROP_RESPONSE,
+				    ssh_rtl_should_drop_response())) {
 			spin_unlock(&rtl->pending.lock);
 
+			ssh_fault_injected(&rtl->ptl.faults, SSH_FAULT_RECOVERY_TIMEOUT);
+
 			trace_ssam_ei_rx_drop_response(p);
 			rtl_info(rtl, "request error injection: dropping response for request %p\n",
 				 &p->packet);
@@ -506,6 +745,7 @@ static void ssh_rtl_complete(struct ssh_rtl *rtl,
 
 		atomic_dec(&rtl->pending.count);
 		list_del(&p->node);
+		ssh_rtl_timeout_del(p);
 
 		r = p;
 		break;
@@ -641,7 +881,7 @@ static bool ssh_rtl_cancel_nonpending(struct ssh_request *r)
 	}
 
 	set_bit(SSH_REQUEST_SF_LOCKED_BIT, &r->state);
-	list_del(&r->node);
+	__ssh_rtl_queue_del(rtl, r);
 
 	spin_unlock(&rtl->queue.lock);
 
@@ -751,6 +991,7 @@ bool ssh_rtl_cancel(struct ssh_request *rqst, bool pending)
 static void ssh_rtl_packet_callback(struct ssh_packet *p, int status)
 {
 	struct ssh_request *r = to_ssh_request(p);
+	struct ssh_rtl *rtl;
 
 	if (unlikely(status)) {
 		set_bit(SSH_REQUEST_SF_LOCKED_BIT, &r->state);
@@ -773,6 +1014,19 @@ static void ssh_rtl_packet_callback(struct ssh_packet *p, int status)
 		return;
 	}
 
+	/*
+	 * Record time of ACK (or transmission, for unsequenced requests). Note
+	 * that the response of a sequenced request is guaranteed to be handled
+	 * on the receiver thread after this callback, so this is visible there
+	 * without further synchronization.
+	 */
+	rtl = ssh_request_rtl(r);
+	r->stats.acked = ktime_get();
+
+	if (test_bit(SSH_PACKET_TY_SEQUENCED_BIT, &p->state))
+		ssh_rtl_stats_record(rtl, r, SSH_STATS_HIST_ACK,
+				     r->stats.submitted, r->stats.acked);
+
 	/* Update state: Mark as transmitted and clear transmitting. */
 	set_bit(SSH_REQUEST_SF_TRANSMITTED_BIT, &r->state);
 	/* Ensure state never gets zero. */
@@ -802,9 +1056,12 @@ static void ssh_rtl_packet_callback(struct ssh_packet *p, int status)
 		return;
 
 	ssh_rtl_pending_remove(r);
+
+	ssh_rtl_stats_record(rtl, r, SSH_STATS_HIST_TOTAL, r->stats.submitted,
+			     r->stats.acked);
 	ssh_rtl_complete_with_status(r, 0);
 
-	ssh_rtl_tx_schedule(ssh_request_rtl(r));
+	ssh_rtl_tx_schedule(rtl);
 }
 
 static ktime_t ssh_request_get_expiration(struct ssh_request *r, ktime_t timeout)
@@ -822,9 +1079,12 @@ static void ssh_rtl_timeout_reap(struct work_struct *work)
 	struct ssh_rtl *rtl = to_ssh_rtl(work, rtx_timeout.reaper.work);
 	struct ssh_request *r, *n;
 	LIST_HEAD(claimed);
+	ktime_t start = ktime_get();
 	ktime_t now = ktime_get_coarse_boottime();
-	ktime_t timeout = rtl->rtx_timeout.timeout;
+	ktime_t timeout = ssh_rtt_timeout(&rtl->rtx_timeout.rtt);
 	ktime_t next = KTIME_MAX;
+	unsigned int expired = 0;
+	ktime_t scheduled, delay;
 
 	trace_ssam_rtl_timeout_reap(atomic_read(&rtl->pending.count));
 
@@ -833,20 +1093,26 @@ static void ssh_rtl_timeout_reap(struct work_struct *work)
 	 * requests to avoid lost-update type problems.
 	 */
 	spin_lock(&rtl->rtx_timeout.lock);
-	rtl->rtx_timeout.expires = KTIME_MAX;
+	scheduled = rtl->rtx_timeout.expires;
+	WRITE_ONCE(rtl->rtx_timeout.expires, KTIME_MAX);
 	spin_unlock(&rtl->rtx_timeout.lock);
 
 	spin_lock(&rtl->pending.lock);
-	list_for_each_entry_safe(r, n, &rtl->pending.head, node) {
+
+	/*
+	 * Requests with running timeout are ordered by their expiration date,
+	 * so we can stop at the first one that has not expired yet.
+	 */
+	list_for_each_entry_safe(r, n, &rtl->rtx_timeout.head, timeout_node) {
 		ktime_t expires = ssh_request_get_expiration(r, timeout);
 
 		/*
-		 * Check if the timeout hasn't expired yet. Find out next
+		 * Check if the timeout hasn't expired yet. This is the next
 		 * expiration date to be handled after this run.
 		 */
 		if (ktime_after(expires, now)) {
-			next = ktime_before(expires, next) ? expires : next;
-			continue;
+			next = expires;
+			break;
 		}
 
 		/* Avoid further transitions if locked. */
@@ -863,13 +1129,21 @@ static void ssh_rtl_timeout_reap(struct work_struct *work)
 		clear_bit(SSH_REQUEST_SF_PENDING_BIT, &r->state);
 
 		atomic_dec(&rtl->pending.count);
+		ssh_rtl_timeout_del(r);
 		list_move_tail(&r->node, &claimed);
+		expired++;
 	}
 	spin_unlock(&rtl->pending.lock);
 
+	/* Back off for requests armed after this. */
+	if (expired)
+		ssh_rtt_backoff(&rtl->rtx_timeout.rtt);
+
 	/* Cancel and complete the request. */
 	list_for_each_entry_safe(r, n, &claimed, node) {
 		trace_ssam_request_timeout(r);
+		ssh_stats_inc(&rtl->ptl.stats, SSH_STATS_REQUEST_TIMEOUT);
+		ssh_fault_recovered(&rtl->ptl.faults, SSH_FAULT_RECOVERY_TIMEOUT);
 
 		/*
 		 * At this point we've removed the packet from pending. This
@@ -893,6 +1167,10 @@ static void ssh_rtl_timeout_reap(struct work_struct *work)
 		ssh_rtl_timeout_reaper_mod(rtl, now, next);
 
 	ssh_rtl_tx_schedule(rtl);
+
+	/* Report how late this run has been and how long it took. */
+	delay = scheduled != KTIME_MAX ? ktime_sub(now, scheduled) : 0;
+	trace_ssam_rtl_timeout_reap_done(delay, ktime_sub(ktime_get(), start), expired);
 }
 
 static void ssh_rtl_rx_event(struct ssh_rtl *rtl, const struct ssh_command *cmd,
@@ -991,6 +1269,10 @@ int ssh_request_init(struct ssh_request *rqst, enum ssam_request_flags flags,
 	if (flags & SSAM_REQUEST_UNSEQUENCED && flags & SSAM_REQUEST_HAS_RESPONSE)
 		return -EINVAL;
 
+	/* Requests can only be of a single priority class. */
+	if (flags & SSAM_REQUEST_PRIO_INTERACTIVE && flags & SSAM_REQUEST_PRIO_BULK)
+		return -EINVAL;
+
 	if (!(flags & SSAM_REQUEST_UNSEQUENCED))
 		type |= BIT(SSH_PACKET_TY_SEQUENCED_BIT);
 
@@ -998,14 +1280,24 @@ int ssh_request_init(struct ssh_request *rqst, enum ssam_request_flags flags,
 			&ssh_rtl_packet_ops);
 
 	INIT_LIST_HEAD(&rqst->node);
+	INIT_LIST_HEAD(&rqst->timeout_node);
 
 	rqst->state = 0;
 	if (flags & SSAM_REQUEST_HAS_RESPONSE)
 		rqst->state |= BIT(SSH_REQUEST_TY_HAS_RESPONSE_BIT);
 
 	rqst->timestamp = KTIME_MAX;
+	rqst->stats.submitted = KTIME_MAX;
+	rqst->stats.acked = KTIME_MAX;
 	rqst->ops = ops;
 
+	if (flags & SSAM_REQUEST_PRIO_INTERACTIVE)
+		rqst->prio = SSH_REQUEST_PRIO_INTERACTIVE;
+	else if (flags & SSAM_REQUEST_PRIO_BULK)
+		rqst->prio = SSH_REQUEST_PRIO_BULK;
+	else
+		rqst->prio = SSH_REQUEST_PRIO_NORMAL;
+
 	return 0;
 }
 
@@ -1026,7 +1318,7 @@ int ssh_rtl_init(struct ssh_rtl *rtl, struct serdev_device *serdev,
 		 const struct ssh_rtl_ops *ops)
 {
 	struct ssh_ptl_ops ptl_ops;
-	int status;
+	int status, prio;
 
 	ptl_ops.data_received = ssh_rtl_rx_data;
 
@@ -1035,7 +1327,12 @@ int ssh_rtl_init(struct ssh_rtl *rtl, struct serdev_device *serdev,
 		return status;
 
 	spin_lock_init(&rtl->queue.lock);
-	INIT_LIST_HEAD(&rtl->queue.head);
+	for (prio = 0; prio < SSH_REQUEST_NUM_PRIO; prio++) {
+		INIT_LIST_HEAD(&rtl->queue.head[prio]);
+		rtl->queue.skipped[prio] = 0;
+	}
+	rtl->queue.seq = 0;
+	rtl->queue.flushes = 0;
 
 	spin_lock_init(&rtl->pending.lock);
 	INIT_LIST_HEAD(&rtl->pending.head);
@@ -1044,7 +1341,9 @@ int ssh_rtl_init(struct ssh_rtl *rtl, struct serdev_device *serdev,
 	INIT_WORK(&rtl->tx.work, ssh_rtl_tx_work_fn);
 
 	spin_lock_init(&rtl->rtx_timeout.lock);
-	rtl->rtx_timeout.timeout = SSH_RTL_REQUEST_TIMEOUT;
+	INIT_LIST_HEAD(&rtl->rtx_timeout.head);
+	ssh_rtt_init(&rtl->rtx_timeout.rtt, SSH_RTL_REQUEST_TIMEOUT_MIN,
+		     SSH_RTL_REQUEST_TIMEOUT);
 	rtl->rtx_timeout.expires = KTIME_MAX;
 	INIT_DELAYED_WORK(&rtl->rtx_timeout.reaper, ssh_rtl_timeout_reap);
 
@@ -1153,7 +1452,7 @@ static const struct ssh_request_ops ssh_rtl_flush_request_ops = {
  */
 int ssh_rtl_flush(struct ssh_rtl *rtl, unsigned long timeout)
 {
-	const unsigned int init_flags = SSAM_REQUEST_UNSEQUENCED;
+	const unsigned int init_flags = SSAM_REQUEST_UNSEQUENCED | SSAM_REQUEST_PRIO_BULK;
 	struct ssh_flush_request rqst;
 	int status;
 
@@ -1198,7 +1497,7 @@ void ssh_rtl_shutdown(struct ssh_rtl *rtl)
 {
 	struct ssh_request *r, *n;
 	LIST_HEAD(claimed);
-	int pending;
+	int pending, prio;
 
 	set_bit(SSH_RTL_SF_SHUTDOWN_BIT, &rtl->state);
 	/*
@@ -1211,14 +1510,17 @@ void ssh_rtl_shutdown(struct ssh_rtl *rtl)
 
 	/* Remove requests from queue. */
 	spin_lock(&rtl->queue.lock);
-	list_for_each_entry_safe(r, n, &rtl->queue.head, node) {
-		set_bit(SSH_REQUEST_SF_LOCKED_BIT, &r->state);
-		/* Ensure state never gets zero. */
-		smp_mb__before_atomic();
-		clear_bit(SSH_REQUEST_SF_QUEUED_BIT, &r->state);
+	for (prio = 0; prio < SSH_REQUEST_NUM_PRIO; prio++) {
+		list_for_each_entry_safe(r, n, &rtl->queue.head[prio], node) {
+			set_bit(SSH_REQUEST_SF_LOCKED_BIT, &r->state);
+			/* Ensure state never gets zero. */
+			smp_mb__before_atomic();
+			clear_bit(SSH_REQUEST_SF_QUEUED_BIT, &r->state);
 
-		list_move_tail(&r->node, &claimed);
+			list_move_tail(&r->node, &claimed);
+		}
 	}
+	rtl->queue.flushes = 0;
 	spin_unlock(&rtl->queue.lock);
 
 	/*
@@ -1250,6 +1552,7 @@ void ssh_rtl_shutdown(struct ssh_rtl *rtl)
 			smp_mb__before_atomic();
 			clear_bit(SSH_REQUEST_SF_PENDING_BIT, &r->state);
 
+			ssh_rtl_timeout_del(r);
 			list_move_tail(&r->node, &claimed);
 		}
 		spin_unlock(&rtl->pending.lock);
@@ -18,6 +18,7 @@
 #include "../include/linux/surface_aggregator/controller.h"
 
 #include "ssh_packet_layer.h"
+#include "ssh_rtt.h"
 
 /**
  * enum ssh_rtl_state_flags - State-flags for &struct ssh_rtl.
@@ -46,9 +47,15 @@ struct ssh_rtl_ops {
  * struct ssh_rtl - SSH request transport layer.
  * @ptl:           Underlying packet transport layer.
  * @state:         State(-flags) of the transport layer.
- * @queue:         Request submission queue.
- * @queue.lock:    Lock for modifying the request submission queue.
- * @queue.head:    List-head of the request submission queue.
+ * @queue:         Request submission queues.
+ * @queue.lock:    Lock for modifying the request submission queues.
+ * @queue.head:    List-heads of the request submission queues, one per
+ *                 priority class (see &enum ssh_request_prio).
+ * @queue.skipped: Number of times requests of the respective priority class
+ *                 have been passed over in favor of other classes since a
+ *                 request of that class has last been transmitted.
+ * @queue.seq:     Submission sequence counter, see &struct ssh_request.seq.
+ * @queue.flushes: Number of flush requests currently queued.
  * @pending:       Set/list of pending requests.
  * @pending.lock:  Lock for modifying the request set.
  * @pending.head:  List-head of the pending set/list.
@@ -57,8 +64,14 @@ struct ssh_rtl_ops {
  * @tx.work:       Transmitter work item.
  * @rtx_timeout:   Retransmission timeout subsystem.
  * @rtx_timeout.lock:    Lock for modifying the retransmission timeout reaper.
- * @rtx_timeout.timeout: Timeout interval for retransmission.
+ * @rtx_timeout.rtt:     Response time estimator, providing the timeout
+ *                       interval for requests.
+ * @rtx_timeout.head:    List of pending requests with running timeout, ordered
+ *                       by their timestamp and thus expiration date. Guarded
+ *                       by the pending lock.
  * @rtx_timeout.expires: Time specifying when the reaper work is next scheduled.
+ *                       Written under the timeout lock, may be read without
+ *                       it to check whether the reaper needs re-arming.
  * @rtx_timeout.reaper:  Work performing timeout checks and subsequent actions.
  * @ops:           Request layer operations.
  */
@@ -68,7 +81,10 @@ struct ssh_rtl {
 
 	struct {
 		spinlock_t lock;
-		struct list_head head;
+		struct list_head head[SSH_REQUEST_NUM_PRIO];
+		unsigned int skipped[SSH_REQUEST_NUM_PRIO];
+		u32 seq;
+		unsigned int flushes;
 	} queue;
 
 	struct {
@@ -83,7 +99,8 @@ struct ssh_rtl {
 
 	struct {
 		spinlock_t lock;
-		ktime_t timeout;
+		struct ssh_rtt rtt;
+		struct list_head head;
 		ktime_t expires;
 		struct delayed_work reaper;
 	} rtx_timeout;
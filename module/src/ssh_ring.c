@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Mirrored ring buffer for SSH message parsing.
+ *
+ * Copyright (C) 2019-2022 Maximilian Luz <luzmaximilian@gmail.com>
+ */
+
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/types.h>
+#include <linux/vmalloc.h>
+
+#include "ssh_parser.h"
+
+/**
+ * sshp_ring_alloc() - Allocate a mirrored ring buffer.
+ * @ring: The ring buffer to initialize.
+ * @cap:  The minimum capacity of the buffer in bytes.
+ *
+ * Allocates the pages backing the ring buffer and maps them twice, directly
+ * following each other, into the kernel virtual address space. The capacity
+ * is rounded up to a power-of-two multiple of %PAGE_SIZE.
+ *
+ * Return: Returns zero on success, %-ENOMEM if allocating or mapping the
+ * buffer failed.
+ */
+int sshp_ring_alloc(struct sshp_ring *ring, size_t cap)
+{
+	unsigned int n, i;
+
+	cap = roundup_pow_of_two(PAGE_ALIGN(cap));
+	n = cap >> PAGE_SHIFT;
+
+	ring->pages = kcalloc(2 * n, sizeof(*ring->pages), GFP_KERNEL);
+	if (!ring->pages)
+		return -ENOMEM;
+
+	for (i = 0; i < n; i++) {
+		ring->pages[i] = alloc_page(GFP_KERNEL | __GFP_ZERO);
+		if (!ring->pages[i])
+			goto err;
+
+		ring->pages[n + i] = ring->pages[i];
+	}
+
+	ring->ptr = vmap(ring->pages, 2 * n, VM_MAP, PAGE_KERNEL);
+	if (!ring->ptr)
+		goto err;
+
+	ring->cap = cap;
+	ring->head = 0;
+	ring->tail = 0;
+	return 0;
+
+err:
+	while (i--)
+		__free_page(ring->pages[i]);
+
+	kfree(ring->pages);
+	ring->pages = NULL;
+	return -ENOMEM;
+}
+
+/**
+ * sshp_ring_free() - Free a mirrored ring buffer.
+ * @ring: The ring buffer to free.
+ *
+ * Unmaps and frees the ring buffer previously allocated via
+ * sshp_ring_alloc().
+ */
+void sshp_ring_free(struct sshp_ring *ring)
+{
+	unsigned int i;
+
+	vunmap(ring->ptr);
+
+	for (i = 0; i < ring->cap >> PAGE_SHIFT; i++)
+		__free_page(ring->pages[i]);
+
+	kfree(ring->pages);
+
+	ring->ptr = NULL;
+	ring->pages = NULL;
+	ring->cap = 0;
+}
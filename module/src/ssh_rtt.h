@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * SSH round-trip time estimation.
+ *
+ * Copyright (C) 2019-2022 Maximilian Luz <luzmaximilian@gmail.com>
+ */
+
+#ifndef _SURFACE_AGGREGATOR_SSH_RTT_H
+#define _SURFACE_AGGREGATOR_SSH_RTT_H
+
+#include <linux/atomic.h>
+#include <linux/ktime.h>
+#include <linux/math.h>
+#include <linux/minmax.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+/**
+ * struct ssh_rtt - Round-trip time estimator.
+ * @lock:    Lock guarding @srtt, @rttvar, and @samples.
+ * @srtt:    Smoothed round-trip time, in nanoseconds.
+ * @rttvar:  Round-trip time variation, in nanoseconds.
+ * @samples: Number of samples taken so far.
+ * @rto:     Current timeout derived from the estimate, in nanoseconds.
+ * @min:     Lower bound for @rto.
+ * @max:     Upper bound for @rto. Also used as initial timeout before the
+ *           first sample has been taken.
+ *
+ * Estimates the round-trip time and derives a timeout from it, following the
+ * retransmission timeout computation of TCP (RFC 6298). Samples are expected
+ * to be taken only from exchanges that have not been retried (Karn's
+ * algorithm). The timeout is published atomically and can be read from any
+ * context without taking the lock.
+ */
+struct ssh_rtt {
+	spinlock_t lock;
+	s64 srtt;
+	s64 rttvar;
+	unsigned long samples;
+
+	atomic64_t rto;
+	ktime_t min;
+	ktime_t max;
+};
+
+/**
+ * ssh_rtt_init() - Initialize a round-trip time estimator.
+ * @rtt: The estimator to initialize.
+ * @min: The lower bound for the timeout.
+ * @max: The upper bound and initial value for the timeout.
+ */
+static inline void ssh_rtt_init(struct ssh_rtt *rtt, ktime_t min, ktime_t max)
+{
+	spin_lock_init(&rtt->lock);
+	rtt->srtt = 0;
+	rtt->rttvar = 0;
+	rtt->samples = 0;
+	rtt->min = min;
+	rtt->max = max;
+
+	atomic64_set(&rtt->rto, ktime_to_ns(max));
+}
+
+/**
+ * ssh_rtt_sample() - Update the estimate with a new round-trip time sample.
+ * @rtt:    The estimator.
+ * @sample: The measured round-trip time.
+ */
+static inline void ssh_rtt_sample(struct ssh_rtt *rtt, ktime_t sample)
+{
+	s64 r = max_t(s64, ktime_to_ns(sample), 0);
+	s64 rto;
+
+	spin_lock(&rtt->lock);
+
+	if (!rtt->samples) {
+		rtt->srtt = r;
+		rtt->rttvar = r >> 1;
+	} else {
+		rtt->rttvar = rtt->rttvar - (rtt->rttvar >> 2) + (abs(rtt->srtt - r) >> 2);
+		rtt->srtt = rtt->srtt - (rtt->srtt >> 3) + (r >> 3);
+	}
+
+	rtt->samples++;
+	rto = clamp_t(s64, rtt->srtt + 4 * rtt->rttvar, ktime_to_ns(rtt->min),
+		      ktime_to_ns(rtt->max));
+
+	atomic64_set(&rtt->rto, rto);
+
+	spin_unlock(&rtt->lock);
+}
+
+/**
+ * ssh_rtt_backoff() - Back off the timeout after it has expired.
+ * @rtt: The estimator.
+ *
+ * Doubles the current timeout, bounded by the upper limit. The backed-off
+ * timeout stays in effect until the next sample has been taken.
+ */
+static inline void ssh_rtt_backoff(struct ssh_rtt *rtt)
+{
+	s64 rto = atomic64_read(&rtt->rto);
+
+	atomic64_set(&rtt->rto, min_t(s64, 2 * rto, ktime_to_ns(rtt->max)));
+}
+
+/**
+ * ssh_rtt_timeout() - Get the current timeout.
+ * @rtt: The estimator.
+ *
+ * Return: Returns the timeout derived from the current estimate.
+ */
+static inline ktime_t ssh_rtt_timeout(struct ssh_rtt *rtt)
+{
+	return ns_to_ktime(atomic64_read(&rtt->rto));
+}
+
+/**
+ * ssh_rtt_get() - Get a consistent snapshot of the current estimate.
+ * @rtt:     The estimator.
+ * @srtt:    Where to store the smoothed round-trip time.
+ * @rttvar:  Where to store the round-trip time variation.
+ * @samples: Where to store the number of samples taken so far.
+ */
+static inline void ssh_rtt_get(struct ssh_rtt *rtt, ktime_t *srtt,
+			       ktime_t *rttvar, unsigned long *samples)
+{
+	spin_lock(&rtt->lock);
+	*srtt = ns_to_ktime(rtt->srtt);
+	*rttvar = ns_to_ktime(rtt->rttvar);
+	*samples = rtt->samples;
+	spin_unlock(&rtt->lock);
+}
+
+#endif /* _SURFACE_AGGREGATOR_SSH_RTT_H */
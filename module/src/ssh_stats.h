@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * SSH transport statistics.
+ *
+ * Copyright (C) 2019-2022 Maximilian Luz <luzmaximilian@gmail.com>
+ */
+
+#ifndef _SURFACE_AGGREGATOR_SSH_STATS_H
+#define _SURFACE_AGGREGATOR_SSH_STATS_H
+
+#include <linux/atomic.h>
+#include <linux/bitops.h>
+#include <linux/ktime.h>
+#include <linux/minmax.h>
+#include <linux/types.h>
+
+/*
+ * SSH_STATS_NUM_TC - Number of target categories tracked individually.
+ *
+ * Latencies of requests with a target category at or above this value are
+ * accounted for in the entry of (invalid) target category zero.
+ */
+#define SSH_STATS_NUM_TC		0x40
+
+/*
+ * SSH_STATS_HIST_BUCKETS - Number of buckets per latency histogram.
+ *
+ * Bucket zero contains all samples below 1us, bucket n > 0 all samples in
+ * [2^(n-1), 2^n) us. The last bucket additionally contains all samples that
+ * would exceed the histogram range (i.e. above ~4.2s).
+ */
+#define SSH_STATS_HIST_BUCKETS		24
+
+/**
+ * enum ssh_stats_counter - Event counters of the SSH transport layers.
+ * @SSH_STATS_RETRANSMIT:      Packets re-submitted for transmission, either
+ *                             due to timeout or due to a received NAK.
+ * @SSH_STATS_NAK_RX:          NAK messages received from the EC.
+ * @SSH_STATS_NAK_TX:          NAK messages sent to the EC.
+ * @SSH_STATS_PACKET_TIMEOUT:  Packet ACK timeouts.
+ * @SSH_STATS_REQUEST_TIMEOUT: Request response timeouts.
+ * @SSH_STATS_CRC_ERROR:       Received messages with invalid frame or payload
+ *                             CRC.
+ * @SSH_STATS_NUM_COUNTERS:    Number of counters.
+ */
+enum ssh_stats_counter {
+	SSH_STATS_RETRANSMIT,
+	SSH_STATS_NAK_RX,
+	SSH_STATS_NAK_TX,
+	SSH_STATS_PACKET_TIMEOUT,
+	SSH_STATS_REQUEST_TIMEOUT,
+	SSH_STATS_CRC_ERROR,
+	SSH_STATS_NUM_COUNTERS,
+};
+
+/**
+ * enum ssh_stats_hist - Latency histograms of the SSH transport layers.
+ * @SSH_STATS_HIST_ACK:   Time from request submission to packet ACK.
+ * @SSH_STATS_HIST_RSP:   Time from packet ACK to request response.
+ * @SSH_STATS_HIST_TOTAL: Time from request submission to completion.
+ * @SSH_STATS_NUM_HIST:   Number of histograms.
+ */
+enum ssh_stats_hist {
+	SSH_STATS_HIST_ACK,
+	SSH_STATS_HIST_RSP,
+	SSH_STATS_HIST_TOTAL,
+	SSH_STATS_NUM_HIST,
+};
+
+/**
+ * struct ssh_stats - SSH transport statistics.
+ * @counter: Event counters, indexed by &enum ssh_stats_counter.
+ * @hist:    Log2 latency histograms, indexed by &enum ssh_stats_hist and
+ *           target category.
+ *
+ * All entries are updated atomically but independently of each other, so a
+ * snapshot taken concurrently to updates may be slightly inconsistent.
+ */
+struct ssh_stats {
+	atomic_long_t counter[SSH_STATS_NUM_COUNTERS];
+	atomic_t hist[SSH_STATS_NUM_HIST][SSH_STATS_NUM_TC][SSH_STATS_HIST_BUCKETS];
+};
+
+/**
+ * ssh_stats_inc() - Increment an event counter.
+ * @s: The statistics.
+ * @c: The counter to increment.
+ */
+static inline void ssh_stats_inc(struct ssh_stats *s, enum ssh_stats_counter c)
+{
+	atomic_long_inc(&s->counter[c]);
+}
+
+/**
+ * ssh_stats_record() - Record a latency sample.
+ * @s:     The statistics.
+ * @h:     The histogram to record the sample in.
+ * @tc:    The target category of the request the sample belongs to.
+ * @start: The start time of the measured interval.
+ * @end:   The end time of the measured interval.
+ */
+static inline void ssh_stats_record(struct ssh_stats *s, enum ssh_stats_hist h,
+				    u8 tc, ktime_t start, ktime_t end)
+{
+	s64 us = ktime_us_delta(end, start);
+	unsigned int bucket = 0;
+
+	if (us > 0)
+		bucket = min_t(unsigned int, fls64(us), SSH_STATS_HIST_BUCKETS - 1);
+
+	if (tc >= SSH_STATS_NUM_TC)
+		tc = 0;
+
+	atomic_inc(&s->hist[h][tc][bucket]);
+}
+
+/**
+ * ssh_stats_reset() - Reset all counters and histograms.
+ * @s: The statistics.
+ */
+static inline void ssh_stats_reset(struct ssh_stats *s)
+{
+	unsigned int h, tc, b, c;
+
+	for (c = 0; c < SSH_STATS_NUM_COUNTERS; c++)
+		atomic_long_set(&s->counter[c], 0);
+
+	for (h = 0; h < SSH_STATS_NUM_HIST; h++)
+		for (tc = 0; tc < SSH_STATS_NUM_TC; tc++)
+			for (b = 0; b < SSH_STATS_HIST_BUCKETS; b++)
+				atomic_set(&s->hist[h][tc][b], 0);
+}
+
+#endif /* _SURFACE_AGGREGATOR_SSH_STATS_H */
@@ -11,9 +11,14 @@
 #if !defined(_SURFACE_AGGREGATOR_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
 #define _SURFACE_AGGREGATOR_TRACE_H
 
+#include "../include/linux/surface_aggregator/device.h"
 #include "../include/linux/surface_aggregator/serial_hub.h"
 
+#include "pm_log.h"
+
 #include <asm/unaligned.h>
+#include <linux/math64.h>
+#include <linux/string.h>
 #include <linux/tracepoint.h>
 
 TRACE_DEFINE_ENUM(SSH_FRAME_TYPE_DATA_SEQ);
@@ -91,6 +96,24 @@ TRACE_DEFINE_ENUM(SSAM_SSH_TC_ACC1);
 TRACE_DEFINE_ENUM(SSAM_SSH_TC_SHB);
 TRACE_DEFINE_ENUM(SSAM_SSH_TC_POS);
 
+TRACE_DEFINE_ENUM(SSAM_PM_PREPARE);
+TRACE_DEFINE_ENUM(SSAM_PM_COMPLETE);
+TRACE_DEFINE_ENUM(SSAM_PM_SUSPEND);
+TRACE_DEFINE_ENUM(SSAM_PM_RESUME);
+TRACE_DEFINE_ENUM(SSAM_PM_FREEZE);
+TRACE_DEFINE_ENUM(SSAM_PM_THAW);
+TRACE_DEFINE_ENUM(SSAM_PM_POWEROFF);
+TRACE_DEFINE_ENUM(SSAM_PM_RESTORE);
+
+TRACE_DEFINE_ENUM(SSAM_PM_PHASE_DISPLAY_OFF);
+TRACE_DEFINE_ENUM(SSAM_PM_PHASE_DISPLAY_ON);
+TRACE_DEFINE_ENUM(SSAM_PM_PHASE_D0_EXIT);
+TRACE_DEFINE_ENUM(SSAM_PM_PHASE_D0_ENTRY);
+TRACE_DEFINE_ENUM(SSAM_PM_PHASE_IRQ);
+TRACE_DEFINE_ENUM(SSAM_PM_PHASE_CONTROLLER);
+TRACE_DEFINE_ENUM(SSAM_PM_PHASE_EVENTS_DISABLE);
+TRACE_DEFINE_ENUM(SSAM_PM_PHASE_EVENTS_RESTORE);
+
 #define SSAM_PTR_UID_LEN		9
 #define SSAM_U8_FIELD_NOT_APPLICABLE	((u16)-1)
 #define SSAM_SEQ_NOT_APPLICABLE		((u16)-1)
@@ -318,6 +341,30 @@ static inline u32 ssam_trace_get_request_tc(const struct ssh_packet *p)
 		{ SSAM_SSH_TC_POS,			"POS"  }	\
 	)
 
+#define ssam_show_pm_transition(transition)				\
+	__print_symbolic(transition,					\
+		{ SSAM_PM_PREPARE,			"prepare"  },	\
+		{ SSAM_PM_COMPLETE,			"complete" },	\
+		{ SSAM_PM_SUSPEND,			"suspend"  },	\
+		{ SSAM_PM_RESUME,			"resume"   },	\
+		{ SSAM_PM_FREEZE,			"freeze"   },	\
+		{ SSAM_PM_THAW,				"thaw"     },	\
+		{ SSAM_PM_POWEROFF,			"poweroff" },	\
+		{ SSAM_PM_RESTORE,			"restore"  }	\
+	)
+
+#define ssam_show_pm_phase(phase)					\
+	__print_symbolic(phase,						\
+		{ SSAM_PM_PHASE_DISPLAY_OFF,		"display_off"    }, \
+		{ SSAM_PM_PHASE_DISPLAY_ON,		"display_on"     }, \
+		{ SSAM_PM_PHASE_D0_EXIT,		"d0_exit"        }, \
+		{ SSAM_PM_PHASE_D0_ENTRY,		"d0_entry"       }, \
+		{ SSAM_PM_PHASE_IRQ,			"irq"            }, \
+		{ SSAM_PM_PHASE_CONTROLLER,		"controller"     }, \
+		{ SSAM_PM_PHASE_EVENTS_DISABLE,		"events_disable" }, \
+		{ SSAM_PM_PHASE_EVENTS_RESTORE,		"events_restore" }  \
+	)
+
 DECLARE_EVENT_CLASS(ssam_frame_class,
 	TP_PROTO(const struct ssh_frame *frame),
 
@@ -348,6 +395,39 @@ DECLARE_EVENT_CLASS(ssam_frame_class,
 		TP_ARGS(frame)					\
 	)
 
+DECLARE_EVENT_CLASS(ssam_frame_latency_class,
+	TP_PROTO(const struct ssh_frame *frame, ktime_t latency),
+
+	TP_ARGS(frame, latency),
+
+	TP_STRUCT__entry(
+		__field(s64, latency)
+		__field(u8, type)
+		__field(u8, seq)
+		__field(u16, len)
+	),
+
+	TP_fast_assign(
+		__entry->latency = ktime_to_ns(latency);
+		__entry->type = frame->type;
+		__entry->seq = frame->seq;
+		__entry->len = get_unaligned_le16(&frame->len);
+	),
+
+	TP_printk("ty=%s, seq=%#04x, len=%u, latency=%lldns",
+		ssam_show_frame_type(__entry->type),
+		__entry->seq,
+		__entry->len,
+		__entry->latency
+	)
+);
+
+#define DEFINE_SSAM_FRAME_LATENCY_EVENT(name)				\
+	DEFINE_EVENT(ssam_frame_latency_class, ssam_##name,		\
+		TP_PROTO(const struct ssh_frame *frame, ktime_t latency), \
+		TP_ARGS(frame, latency)					\
+	)
+
 DECLARE_EVENT_CLASS(ssam_command_class,
 	TP_PROTO(const struct ssh_command *cmd, u16 len),
 
@@ -636,6 +716,202 @@ DECLARE_EVENT_CLASS(ssam_pending_class,
 		TP_ARGS(pending)					\
 	)
 
+DECLARE_EVENT_CLASS(ssam_reap_class,
+	TP_PROTO(ktime_t delay, ktime_t duration, unsigned int expired),
+
+	TP_ARGS(delay, duration, expired),
+
+	TP_STRUCT__entry(
+		__field(s64, delay)
+		__field(s64, duration)
+		__field(unsigned int, expired)
+	),
+
+	TP_fast_assign(
+		__entry->delay = ktime_to_us(delay);
+		__entry->duration = ktime_to_ns(duration);
+		__entry->expired = expired;
+	),
+
+	TP_printk("delay=%lldus duration=%lldns expired=%u",
+		__entry->delay, __entry->duration, __entry->expired)
+);
+
+#define DEFINE_SSAM_REAP_EVENT(name)					\
+	DEFINE_EVENT(ssam_reap_class, ssam_##name,			\
+		TP_PROTO(ktime_t delay, ktime_t duration, unsigned int expired), \
+		TP_ARGS(delay, duration, expired)			\
+	)
+
+DECLARE_EVENT_CLASS(ssam_poll_class,
+	TP_PROTO(ktime_t duration, bool found),
+
+	TP_ARGS(duration, found),
+
+	TP_STRUCT__entry(
+		__field(s64, duration)
+		__field(bool, found)
+	),
+
+	TP_fast_assign(
+		__entry->duration = ktime_to_ns(duration);
+		__entry->found = found;
+	),
+
+	TP_printk("duration=%lldns found=%d",
+		__entry->duration, __entry->found)
+);
+
+#define DEFINE_SSAM_POLL_EVENT(name)					\
+	DEFINE_EVENT(ssam_poll_class, ssam_##name,			\
+		TP_PROTO(ktime_t duration, bool found),			\
+		TP_ARGS(duration, found)				\
+	)
+
+DECLARE_EVENT_CLASS(ssam_device_probe_class,
+	TP_PROTO(const struct ssam_device *sdev, ktime_t duration, int status),
+
+	TP_ARGS(sdev, duration, status),
+
+	TP_STRUCT__entry(
+		__field(s64, duration)
+		__field(int, status)
+		__field(u8, domain)
+		__field(u8, category)
+		__field(u8, target)
+		__field(u8, instance)
+		__field(u8, function)
+	),
+
+	TP_fast_assign(
+		__entry->duration = ktime_to_us(duration);
+		__entry->status = status;
+		__entry->domain = sdev->uid.domain;
+		__entry->category = sdev->uid.category;
+		__entry->target = sdev->uid.target;
+		__entry->instance = sdev->uid.instance;
+		__entry->function = sdev->uid.function;
+	),
+
+	TP_printk("uid=%02x:%02x:%02x:%02x:%02x, tc=%s, duration=%lldus, status=%d",
+		__entry->domain, __entry->category, __entry->target,
+		__entry->instance, __entry->function,
+		ssam_show_ssh_tc(__entry->category),
+		__entry->duration, __entry->status
+	)
+);
+
+#define DEFINE_SSAM_DEVICE_PROBE_EVENT(name)				\
+	DEFINE_EVENT(ssam_device_probe_class, ssam_##name,		\
+		TP_PROTO(const struct ssam_device *sdev, ktime_t duration, int status), \
+		TP_ARGS(sdev, duration, status)				\
+	)
+
+DECLARE_EVENT_CLASS(ssam_pm_phase_class,
+	TP_PROTO(enum ssam_pm_transition transition, enum ssam_pm_phase phase,
+		 ktime_t duration),
+
+	TP_ARGS(transition, phase, duration),
+
+	TP_STRUCT__entry(
+		__field(s64, duration)
+		__field(u8, transition)
+		__field(u8, phase)
+	),
+
+	TP_fast_assign(
+		__entry->duration = ktime_to_us(duration);
+		__entry->transition = transition;
+		__entry->phase = phase;
+	),
+
+	TP_printk("transition=%s, phase=%s, duration=%lldus",
+		ssam_show_pm_transition(__entry->transition),
+		ssam_show_pm_phase(__entry->phase),
+		__entry->duration
+	)
+);
+
+#define DEFINE_SSAM_PM_PHASE_EVENT(name)				\
+	DEFINE_EVENT(ssam_pm_phase_class, ssam_##name,			\
+		TP_PROTO(enum ssam_pm_transition transition,		\
+			 enum ssam_pm_phase phase, ktime_t duration),	\
+		TP_ARGS(transition, phase, duration)			\
+	)
+
+DECLARE_EVENT_CLASS(ssam_pm_transition_class,
+	TP_PROTO(const struct ssam_pm_record *r),
+
+	TP_ARGS(r),
+
+	TP_STRUCT__entry(
+		__field(s64, duration)
+		__field(s64, ec)
+		__field(s64, irq)
+		__field(s64, controller)
+		__field(s64, events)
+		__field(int, status)
+		__field(u8, transition)
+	),
+
+	TP_fast_assign(
+		__entry->duration = div_s64(r->duration, NSEC_PER_USEC);
+		__entry->ec = div_s64(r->phase[SSAM_PM_PHASE_DISPLAY_OFF]
+				      + r->phase[SSAM_PM_PHASE_DISPLAY_ON]
+				      + r->phase[SSAM_PM_PHASE_D0_EXIT]
+				      + r->phase[SSAM_PM_PHASE_D0_ENTRY],
+				      NSEC_PER_USEC);
+		__entry->irq = div_s64(r->phase[SSAM_PM_PHASE_IRQ], NSEC_PER_USEC);
+		__entry->controller = div_s64(r->phase[SSAM_PM_PHASE_CONTROLLER],
+					      NSEC_PER_USEC);
+		__entry->events = div_s64(r->phase[SSAM_PM_PHASE_EVENTS_DISABLE]
+					  + r->phase[SSAM_PM_PHASE_EVENTS_RESTORE],
+					  NSEC_PER_USEC);
+		__entry->status = r->status;
+		__entry->transition = r->transition;
+	),
+
+	TP_printk("transition=%s, duration=%lldus, ec=%lldus, irq=%lldus, controller=%lldus, events=%lldus, status=%d",
+		ssam_show_pm_transition(__entry->transition),
+		__entry->duration, __entry->ec, __entry->irq,
+		__entry->controller, __entry->events, __entry->status
+	)
+);
+
+#define DEFINE_SSAM_PM_TRANSITION_EVENT(name)				\
+	DEFINE_EVENT(ssam_pm_transition_class, ssam_##name,		\
+		TP_PROTO(const struct ssam_pm_record *r),		\
+		TP_ARGS(r)						\
+	)
+
+DECLARE_EVENT_CLASS(ssam_pm_client_class,
+	TP_PROTO(const struct device *dev, ktime_t duration, int status),
+
+	TP_ARGS(dev, duration, status),
+
+	TP_STRUCT__entry(
+		__array(char, name, SSAM_PM_LOG_CLIENT_NAME_LEN)
+		__field(s64, duration)
+		__field(int, status)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->name, dev_name(dev), SSAM_PM_LOG_CLIENT_NAME_LEN);
+		__entry->duration = ktime_to_us(duration);
+		__entry->status = status;
+	),
+
+	TP_printk("device=%s, duration=%lldus, status=%d",
+		__entry->name, __entry->duration, __entry->status
+	)
+);
+
+#define DEFINE_SSAM_PM_CLIENT_EVENT(name)				\
+	DEFINE_EVENT(ssam_pm_client_class, ssam_##name,			\
+		TP_PROTO(const struct device *dev, ktime_t duration, int status), \
+		TP_ARGS(dev, duration, status)				\
+	)
+
 DECLARE_EVENT_CLASS(ssam_data_class,
 	TP_PROTO(size_t length),
 
@@ -659,6 +935,8 @@ DECLARE_EVENT_CLASS(ssam_data_class,
 	)
 
 DEFINE_SSAM_FRAME_EVENT(rx_frame_received);
+DEFINE_SSAM_FRAME_LATENCY_EVENT(rx_frame_dispatch);
+DEFINE_SSAM_POLL_EVENT(rx_poll);
 DEFINE_SSAM_COMMAND_EVENT(rx_response_received);
 DEFINE_SSAM_COMMAND_EVENT(rx_event_received);
 
@@ -669,12 +947,14 @@ DEFINE_SSAM_PACKET_EVENT(packet_timeout);
 DEFINE_SSAM_PACKET_EVENT(packet_cancel);
 DEFINE_SSAM_PACKET_STATUS_EVENT(packet_complete);
 DEFINE_SSAM_PENDING_EVENT(ptl_timeout_reap);
+DEFINE_SSAM_REAP_EVENT(ptl_timeout_reap_done);
 
 DEFINE_SSAM_REQUEST_EVENT(request_submit);
 DEFINE_SSAM_REQUEST_EVENT(request_timeout);
 DEFINE_SSAM_REQUEST_EVENT(request_cancel);
 DEFINE_SSAM_REQUEST_STATUS_EVENT(request_complete);
 DEFINE_SSAM_PENDING_EVENT(rtl_timeout_reap);
+DEFINE_SSAM_REAP_EVENT(rtl_timeout_reap_done);
 
 DEFINE_SSAM_PACKET_EVENT(ei_tx_drop_ack_packet);
 DEFINE_SSAM_PACKET_EVENT(ei_tx_drop_nak_packet);
@@ -691,6 +971,12 @@ DEFINE_SSAM_FREE_EVENT(ctrl_packet_free);
 DEFINE_SSAM_ALLOC_EVENT(event_item_alloc);
 DEFINE_SSAM_FREE_EVENT(event_item_free);
 
+DEFINE_SSAM_DEVICE_PROBE_EVENT(device_probe);
+
+DEFINE_SSAM_PM_PHASE_EVENT(pm_phase);
+DEFINE_SSAM_PM_TRANSITION_EVENT(pm_transition);
+DEFINE_SSAM_PM_CLIENT_EVENT(pm_client);
+
 #endif /* _SURFACE_AGGREGATOR_TRACE_H */
 
 /* This part must be outside protection */
@@ -187,6 +187,12 @@ def main():
     file = sys.argv[1]
 
     data, timestamps = index(file)
+
+    # write the raw byte stream, e.g. for examples/replay
+    if '--raw' in sys.argv[2:]:
+        sys.stdout.buffer.write(data)
+        return
+
     print(json.dumps(parse_data(data, timestamps)))
 
 
@@ -192,12 +192,17 @@ def parse_commands(data, timestamps):
     return records
 
 
-def main(in_file):
+def main(in_file, raw=False):
     with codecs.open(in_file, 'r', encoding='utf-8', errors='ignore') as fd:
         data, timestamps = parse_file(fd)
 
+    # write the raw byte stream, e.g. for examples/replay
+    if raw:
+        sys.stdout.buffer.write(data)
+        return
+
     print(json.dumps(parse_commands(data, timestamps)))
 
 
 if __name__ == '__main__':
-    main(sys.argv[1])
+    main(sys.argv[1], '--raw' in sys.argv[2:])
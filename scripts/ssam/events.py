@@ -14,8 +14,10 @@ def print_help_and_exit():
     print(f'  help')
     print(f'    display this help message')
     print(f'')
-    print(f'  listen <xx>[,<xx>][,...]')
-    print(f'    listen to the specified target categories')
+    print(f'  listen <xx>[,<xx>][,...] [tid=<xx>[,...]] [iid=<xx>[,...]] [cid=<xx>[,...]] [rate=<n>]')
+    print(f'    listen to the specified target categories, optionally only to')
+    print(f'    events with the given target, instance, or command IDs and at')
+    print(f'    most <n> events per second per category')
     print(f'')
     print(f'  enable <reg.tc> <reg.tid> <reg.cid_en> <reg.cid_dis> <tid> <iid> <flags>')
     print(f'    enable the specified event')
@@ -26,18 +28,40 @@ def print_help_and_exit():
     sys.exit(0)
 
 
+def parse_filter(args):
+    filt = {}
+
+    for arg in args:
+        key, _, value = arg.partition('=')
+
+        if key in ('tid', 'iid', 'cid'):
+            filt[key + 's'] = [int(x, base=16) for x in value.split(',')]
+        elif key == 'rate':
+            filt['rate_limit'] = int(value)
+        else:
+            print(f"Error: Invalid filter argument '{arg}'")
+            sys.exit(0)
+
+    return filt
+
+
 def cmd_listen(as_json=False):
-    if len(sys.argv) != 3:
+    if len(sys.argv) < 3:
         print("Error: Invalid number of parameters")
         sys.exit(0)
 
     categories = sys.argv[2].split(',')
     categories = [int(x, base=16) for x in categories]
 
+    filt = parse_filter(sys.argv[3:])
+
     with Controller() as ctrl:
         for x in categories:
             ctrl.notifier_register(x)
 
+            if filt:
+                ctrl.notifier_set_filter(x, **filt)
+
         while True:
             if as_json:
                 print(json.dumps(ctrl.read_event().to_dict()))
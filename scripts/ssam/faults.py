@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+import glob
+import os
+import sys
+import time
+
+from libssam import Controller, Request
+
+
+DEBUGFS_GLOB = '/sys/kernel/debug/surface_aggregator/*/faults'
+
+# Recovery class reported for faults injected by the respective hook, if any.
+HOOKS = {
+    'drop_ack':        'duplicate',
+    'drop_nak':        None,
+    'drop_dsq':        'retransmit',
+    'fail_write':      None,
+    'corrupt_tx_data': 'retransmit',
+    'corrupt_rx_syn':  'resync',
+    'corrupt_rx_data': 'resync',
+    'drop_response':   'timeout',
+}
+
+# Default scenarios: hook, rate in parts per million, number of requests.
+SCENARIOS = [
+    ('drop_dsq',        50000, 200),
+    ('corrupt_tx_data', 50000, 200),
+    ('drop_ack',        50000, 200),
+    ('corrupt_rx_syn',  50000, 200),
+    ('corrupt_rx_data', 50000, 200),
+    ('drop_response',   20000, 200),
+]
+
+# Read-only request used as load: get firmware version.
+REQUEST = Request(0x01, 0x01, 0x13, 0x00, 0x01, response_cap=4)
+
+
+def print_help_and_exit():
+    print(f'Usage:')
+    print(f'  {sys.argv[0]} <command> [args...]')
+    print(f'')
+    print(f'Commands:')
+    print(f'  help')
+    print(f'    display this help message')
+    print(f'')
+    print(f'  show')
+    print(f'    show injection rates, injected faults, and recovery statistics')
+    print(f'')
+    print(f'  set <hook> <rate>')
+    print(f'    set the injection rate of the given hook, in parts per million')
+    print(f'')
+    print(f'  reset')
+    print(f'    set all injection rates to zero and reset statistics')
+    print(f'')
+    print(f'  run [scenario-file] [settle=<s>]')
+    print(f'    run the given scenarios (or the default ones) and report the')
+    print(f'    time taken to recover from each fault class and the requests')
+    print(f'    lost; wait <s> seconds after each scenario for faults to be')
+    print(f'    recovered from (default: 2)')
+    print(f'')
+    print(f'Hooks:')
+    print(f'  {", ".join(HOOKS)}')
+    print(f'')
+    print(f'Scenario files contain one scenario per line, consisting of hook,')
+    print(f'rate, and number of requests, separated by whitespace. Lines')
+    print(f'starting with # are ignored.')
+    print(f'')
+    print(f'Requires a module built with CONFIG_SURFACE_AGGREGATOR_ERROR_INJECTION.')
+    sys.exit(0)
+
+
+def faults_dir():
+    dirs = glob.glob(DEBUGFS_GLOB)
+    if not dirs:
+        print(f'Error: No fault injection directory found ({DEBUGFS_GLOB})')
+        sys.exit(1)
+
+    return dirs[0]
+
+
+def rate_set(base, hook, rate):
+    if hook not in HOOKS:
+        print(f"Error: Unknown hook '{hook}'")
+        sys.exit(1)
+
+    with open(os.path.join(base, hook), 'w') as fd:
+        fd.write(f'{rate}\n')
+
+
+def stats_reset(base):
+    with open(os.path.join(base, 'stats'), 'w') as fd:
+        fd.write('0\n')
+
+
+def stats_read(base):
+    with open(os.path.join(base, 'stats')) as fd:
+        lines = fd.read().splitlines()
+
+    hooks, recovery = {}, {}
+    section = None
+
+    for line in lines:
+        fields = line.split()
+
+        if not fields:
+            continue
+        elif fields[0] in ('hook', 'recovery', 'hist'):
+            section = fields[0]
+        elif section == 'hook':
+            hooks[fields[0]] = {'rate': int(fields[1]), 'injected': int(fields[2])}
+        elif section == 'recovery':
+            recovery[fields[0]] = {
+                'count': int(fields[1]),
+                'mean_us': int(fields[2]),
+                'max_us': int(fields[3]),
+                'pending': int(fields[4]),
+            }
+
+    return hooks, recovery
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+
+    return values[min(int(p * len(values)), len(values) - 1)]
+
+
+def run_scenario(base, ctrl, hook, rate, count, settle):
+    latencies = []
+    lost = 0
+
+    for h in HOOKS:
+        rate_set(base, h, 0)
+    stats_reset(base)
+
+    rate_set(base, hook, rate)
+
+    for _ in range(count):
+        start = time.monotonic()
+
+        try:
+            ctrl.request(REQUEST)
+        except OSError:
+            lost += 1
+
+        latencies.append((time.monotonic() - start) * 1e3)
+
+    rate_set(base, hook, 0)
+    time.sleep(settle)
+
+    hooks, recovery = stats_read(base)
+    latencies.sort()
+
+    cls = HOOKS[hook]
+    rec = recovery.get(cls) if cls else None
+
+    print(f'{hook:<16} {rate:>8} {hooks[hook]["injected"]:>8} {lost:>6} '
+          f'{percentile(latencies, 0.5):>8.2f} {percentile(latencies, 0.99):>8.2f} '
+          f'{latencies[-1] if latencies else 0.0:>8.2f}  ', end='')
+
+    if rec:
+        print(f'{cls:<10} {rec["count"]:>6} {rec["mean_us"]:>10} {rec["max_us"]:>10}'
+              f'{" (pending)" if rec["pending"] else ""}')
+    else:
+        print(f'{"-":<10}')
+
+
+def load_scenarios(path):
+    scenarios = []
+
+    with open(path) as fd:
+        for line in fd:
+            line = line.strip()
+            if not line or line.startswith('#'):
+                continue
+
+            hook, rate, count = line.split()
+            scenarios.append((hook, int(rate, 0), int(count, 0)))
+
+    return scenarios
+
+
+def cmd_run(args):
+    scenarios = SCENARIOS
+    settle = 2.0
+
+    for arg in args:
+        if arg.startswith('settle='):
+            settle = float(arg.split('=', 1)[1])
+        else:
+            scenarios = load_scenarios(arg)
+
+    base = faults_dir()
+
+    print(f'{"hook":<16} {"rate":>8} {"injected":>8} {"lost":>6} '
+          f'{"p50_ms":>8} {"p99_ms":>8} {"max_ms":>8}  '
+          f'{"recovery":<10} {"count":>6} {"mean_us":>10} {"max_us":>10}')
+
+    with Controller() as ctrl:
+        try:
+            for hook, rate, count in scenarios:
+                run_scenario(base, ctrl, hook, rate, count, settle)
+        finally:
+            for h in HOOKS:
+                rate_set(base, h, 0)
+
+
+def main():
+    if len(sys.argv) < 2 or sys.argv[1] == 'help':
+        print_help_and_exit()
+
+    cmd_name = sys.argv[1]
+
+    if cmd_name == 'show':
+        with open(os.path.join(faults_dir(), 'stats')) as fd:
+            print(fd.read(), end='')
+
+    elif cmd_name == 'set':
+        rate_set(faults_dir(), sys.argv[2], int(sys.argv[3], 0))
+
+    elif cmd_name == 'reset':
+        base = faults_dir()
+        for h in HOOKS:
+            rate_set(base, h, 0)
+        stats_reset(base)
+
+    elif cmd_name == 'run':
+        cmd_run(sys.argv[2:])
+
+    else:
+        print(f"Error: Unknown command '{cmd_name}'")
+        print(f'')
+        print(f'Usage:')
+        print(f'  {sys.argv[0]} <command> [args...]')
+        print(f'')
+        print(f"Run '{sys.argv[0]} help' for more information")
+
+
+if __name__ == '__main__':
+    main()
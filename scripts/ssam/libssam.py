@@ -4,6 +4,7 @@ from datetime import datetime
 import fcntl
 import ctypes
 import errno
+import mmap
 import os
 
 
@@ -77,6 +78,15 @@ class _RawRequest(ctypes.Structure):
     ]
 
 
+class _RawRequestBatch(ctypes.Structure):
+    _pack_ = 1
+    _fields_ = [
+        ('requests', ctypes.c_uint64),
+        ('count', ctypes.c_uint16),
+        ('__pad', ctypes.c_uint8 * 6),
+    ]
+
+
 class _RawNotifierDesc(ctypes.Structure):
     _pack_ = 1
     _fields_ = [
@@ -85,6 +95,19 @@ class _RawNotifierDesc(ctypes.Structure):
     ]
 
 
+class _RawNotifierFilter(ctypes.Structure):
+    _pack_ = 1
+    _fields_ = [
+        ('target_category', ctypes.c_uint8),
+        ('flags', ctypes.c_uint8),
+        ('__pad', ctypes.c_uint8 * 2),
+        ('rate_limit', ctypes.c_uint32),
+        ('target_id', ctypes.c_uint64 * 4),
+        ('instance_id', ctypes.c_uint64 * 4),
+        ('command_id', ctypes.c_uint64 * 4),
+    ]
+
+
 class _RawEventReg(ctypes.Structure):
     _pack_ = 1
     _fields_ = [
@@ -123,6 +146,25 @@ class _RawEventHeader(ctypes.Structure):
     ]
 
 
+class _RawEventRingDesc(ctypes.Structure):
+    _pack_ = 1
+    _fields_ = [
+        ('size', ctypes.c_uint32),
+        ('threshold', ctypes.c_uint32),
+    ]
+
+
+class _RawEventRing(ctypes.Structure):
+    _fields_ = [
+        ('head', ctypes.c_uint32),
+        ('tail', ctypes.c_uint32),
+        ('size', ctypes.c_uint32),
+        ('threshold', ctypes.c_uint32),
+        ('data_offset', ctypes.c_uint32),
+        ('dropped', ctypes.c_uint32),
+    ]
+
+
 class Request:
     target_category: int
     target_id: int
@@ -203,6 +245,12 @@ class Event:
 
 REQUEST_HAS_RESPONSE = 1
 REQUEST_UNSEQUENCED = 2
+REQUEST_PRIO_INTERACTIVE = 4
+REQUEST_PRIO_BULK = 8
+
+NOTIF_FILTER_TARGET = 1
+NOTIF_FILTER_INSTANCE = 2
+NOTIF_FILTER_COMMAND = 4
 
 
 _PATH_SSAM_DBGDEV = '/dev/surface/aggregator'
@@ -212,11 +260,15 @@ _IOCTL_NOTIF_REGISTER = _IOW(0xA5, 2, ctypes.sizeof(_RawNotifierDesc))
 _IOCTL_NOTIF_UNREGISTER = _IOW(0xA5, 3, ctypes.sizeof(_RawNotifierDesc))
 _IOCTL_EVENTS_ENABLE = _IOW(0xA5, 4, ctypes.sizeof(_RawEventDesc))
 _IOCTL_EVENTS_DISABLE = _IOW(0xA5, 5, ctypes.sizeof(_RawEventDesc))
+_IOCTL_REQUEST_BATCH = _IOW(0xA5, 6, ctypes.sizeof(_RawRequestBatch))
+_IOCTL_EVENT_RING_SETUP = _IOW(0xA5, 7, ctypes.sizeof(_RawEventRingDesc))
+_IOCTL_NOTIF_SET_FILTER = _IOW(0xA5, 8, ctypes.sizeof(_RawNotifierFilter))
 
+REQUEST_BATCH_MAX = 64
 
-def _request(fd, rqst: Request):
+
+def _request_setup(raw, rqst: Request):
     # set up basic request fields
-    raw = _RawRequest()
     raw.target_category = rqst.target_category
     raw.target_id = rqst.target_id
     raw.command_id = rqst.command_id
@@ -234,6 +286,7 @@ def _request(fd, rqst: Request):
         raw.payload.data = pld_ptr.value
         raw.payload.length = len(rqst.payload)
     else:
+        pld_buf = None
         raw.payload.data = 0
         raw.payload.length = 0
 
@@ -251,14 +304,15 @@ def _request(fd, rqst: Request):
         raw.response.data = rsp_ptr.value
         raw.response.length = rsp_cap
     else:
+        rsp_buf = None
         raw.response.data = 0
         raw.response.length = 0
 
-    # perform actual IOCTL
-    buf = bytearray(raw)
-    fcntl.ioctl(fd, _IOCTL_REQUEST, buf, True)
-    raw = _RawRequest.from_buffer(buf)
+    # return buffers to keep them alive until the IOCTL has been executed
+    return pld_buf, rsp_buf
+
 
+def _request_result(raw, rsp_buf):
     if raw.status:
         raise OSError(-raw.status, errno.errorcode.get(-raw.status))
 
@@ -269,6 +323,43 @@ def _request(fd, rqst: Request):
         return None
 
 
+def _request(fd, rqst: Request):
+    raw = _RawRequest()
+    _pld_buf, rsp_buf = _request_setup(raw, rqst)
+
+    # perform actual IOCTL
+    buf = bytearray(raw)
+    fcntl.ioctl(fd, _IOCTL_REQUEST, buf, True)
+    raw = _RawRequest.from_buffer(buf)
+
+    return _request_result(raw, rsp_buf)
+
+
+def _request_batch(fd, rqsts: list[Request]):
+    if len(rqsts) > REQUEST_BATCH_MAX:
+        raise ValueError(f"too many requests in batch (max: {REQUEST_BATCH_MAX})")
+
+    raw = (_RawRequest * len(rqsts))()
+    bufs = [_request_setup(raw[i], r) for i, r in enumerate(rqsts)]
+
+    desc = _RawRequestBatch()
+    desc.requests = ctypes.cast(raw, ctypes.c_void_p).value or 0
+    desc.count = len(rqsts)
+
+    # perform actual IOCTL, this writes status and response to 'raw'
+    fcntl.ioctl(fd, _IOCTL_REQUEST_BATCH, bytes(desc), False)
+
+    # return response or exception for each request
+    results = []
+    for i, (_pld_buf, rsp_buf) in enumerate(bufs):
+        try:
+            results.append(_request_result(raw[i], rsp_buf))
+        except OSError as e:
+            results.append(e)
+
+    return results
+
+
 def _notifier_register(fd, target_category: int, priority: int):
     raw = _RawNotifierDesc()
     raw.priority = priority
@@ -287,6 +378,33 @@ def _notifier_unregister(fd, target_category: int):
     fcntl.ioctl(fd, _IOCTL_NOTIF_UNREGISTER, buf, False)
 
 
+def _notifier_filter_set(bitmap, ids):
+    for x in ids:
+        bitmap[x // 64] |= 1 << (x % 64)
+
+
+def _notifier_set_filter(fd, target_category: int, tids=None, iids=None,
+                         cids=None, rate_limit: int = 0):
+    raw = _RawNotifierFilter()
+    raw.target_category = target_category
+    raw.rate_limit = rate_limit
+
+    if tids is not None:
+        raw.flags |= NOTIF_FILTER_TARGET
+        _notifier_filter_set(raw.target_id, tids)
+
+    if iids is not None:
+        raw.flags |= NOTIF_FILTER_INSTANCE
+        _notifier_filter_set(raw.instance_id, iids)
+
+    if cids is not None:
+        raw.flags |= NOTIF_FILTER_COMMAND
+        _notifier_filter_set(raw.command_id, cids)
+
+    buf = bytes(raw)
+    fcntl.ioctl(fd, _IOCTL_NOTIF_SET_FILTER, buf, False)
+
+
 def _event_enable(fd, desc: EventDescriptor):
     raw = _RawEventDesc()
     raw.reg.target_category = desc.reg.target_category
@@ -330,6 +448,59 @@ def _event_read_blocking(fd):
                  hdr.command_id, hdr.instance_id, data)
 
 
+class EventRing:
+    """Event ring shared with the kernel, set up via Controller.event_ring_setup()."""
+
+    def __init__(self, fd, size: int):
+        self.map = mmap.mmap(fd, mmap.PAGESIZE + size)
+        self.hdr = _RawEventRing.from_buffer(self.map)
+        self.size = self.hdr.size
+        self.offset = self.hdr.data_offset
+
+    def close(self):
+        del self.hdr
+        self.map.close()
+
+    @property
+    def dropped(self):
+        return self.hdr.dropped
+
+    def _copy(self, pos, length):
+        off = pos % self.size
+        n = min(length, self.size - off)
+
+        data = self.map[self.offset + off:self.offset + off + n]
+        return data + self.map[self.offset:self.offset + length - n]
+
+    def read_events(self):
+        """Read all events currently in the ring without blocking."""
+        hlen = ctypes.sizeof(_RawEventHeader)
+        head = self.hdr.head
+        tail = self.hdr.tail
+        events = []
+
+        while tail != head:
+            hdr = _RawEventHeader.from_buffer_copy(self._copy(tail, hlen))
+            data = self._copy(tail + hlen, hdr.length)
+            tail = (tail + hlen + hdr.length) & 0xffffffff
+
+            events.append(Event(datetime.now(), hdr.target_category,
+                                hdr.target_id, hdr.command_id,
+                                hdr.instance_id, data))
+
+        self.hdr.tail = tail
+        return events
+
+
+def _event_ring_setup(fd, size: int, threshold: int):
+    raw = _RawEventRingDesc()
+    raw.size = size
+    raw.threshold = threshold
+
+    fcntl.ioctl(fd, _IOCTL_EVENT_RING_SETUP, bytes(raw), False)
+    return EventRing(fd, size)
+
+
 class Controller:
     def __init__(self):
         self.fd = None
@@ -354,6 +525,12 @@ class Controller:
 
         return _request(self.fd, request)
 
+    def request_batch(self, requests: list[Request]):
+        if self.fd is None:
+            raise RuntimeError("controller is not open")
+
+        return _request_batch(self.fd, requests)
+
     def notifier_register(self, target_category: int, priority: int = 0):
         if self.fd is None:
             raise RuntimeError("controller is not open")
@@ -366,6 +543,14 @@ class Controller:
 
         return _notifier_unregister(self.fd, target_category)
 
+    def notifier_set_filter(self, target_category: int, tids=None, iids=None,
+                            cids=None, rate_limit: int = 0):
+        if self.fd is None:
+            raise RuntimeError("controller is not open")
+
+        return _notifier_set_filter(self.fd, target_category, tids, iids,
+                                    cids, rate_limit)
+
     def event_enable(self, desc: EventDescriptor):
         if self.fd is None:
             raise RuntimeError("controller is not open")
@@ -383,3 +568,9 @@ class Controller:
             raise RuntimeError("controller is not open")
 
         return _event_read_blocking(self.fd)
+
+    def event_ring_setup(self, size: int = 1 << 16, threshold: int = 1):
+        if self.fd is None:
+            raise RuntimeError("controller is not open")
+
+        return _event_ring_setup(self.fd, size, threshold)